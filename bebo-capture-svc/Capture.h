@@ -9,9 +9,16 @@
 #define CAPTURE_H
 
 #include <strsafe.h>
+#include <thread>
 #include "DesktopCapture.h"
 #include "GameCapture.h"
 #include "GDICapture.h"
+#include "ColorConvert.h"
+#include "ConvertPool.h"
+#include "FramePacer.h"
+#include "FrameQueue.h"
+#include "FramePoolAllocator.h"
+#include "RateControl.h"
 #include "CommonTypes.h"
 #include "registry.h"
 
@@ -41,6 +48,24 @@ const float MAX_FPS = 60;
 
 class CPushPinDesktop;
 
+// PacerClock on the filter graph's stream time. Sleeps on a high resolution
+// waitable timer where Windows has one (10 1803 and later), otherwise on a
+// plain one with the system timer resolution raised to 1 ms for as long as
+// the clock lives.
+class StreamClock : public PacerClock {
+public:
+	explicit StreamClock(CBaseFilter* filter);
+	~StreamClock();
+
+	int64_t Now();
+	void SleepFor(int64_t duration);
+
+private:
+	CBaseFilter* filter_;
+	HANDLE timer_;
+	bool raisedResolution_;
+};
+
 // parent
 class CGameCapture : public CSource // public IAMFilterMiscFlags // CSource is CBaseFilter is IBaseFilter is IMediaFilter is IPersist which is IUnknown
 {
@@ -96,7 +121,35 @@ protected:
     //int m_FramesWritten;				// To track where we are
     REFERENCE_TIME m_rtFrameLength; // also used to get the fps
 	// float m_fFps; use the method to get this now
-	REFERENCE_TIME previousFrame;
+	StreamClock m_streamClock;
+	FramePacer m_pacer;
+	FrameSlot WaitForNextFrame();
+	// QualityControl: downstream's quality notices slow the capture down to
+	// m_rtCaptureFrameLength, the hook's frame interval with it
+	bool m_qualityControl;
+	RateControl m_rateControl;
+	REFERENCE_TIME m_rtCaptureFrameLength;
+	void UpdateCaptureRate();
+	// RepeatCheck: a repeat of the last frame gets its output again without
+	// converting it; VariableFrameRate: it is not delivered at all, see
+	// SkipRepeat
+	bool m_repeatCheck;
+	bool m_variableFrameRate;
+	REFERENCE_TIME m_rtKeyframeInterval;
+	REFERENCE_TIME m_rtLastDelivery;
+	uint64_t m_repeatFrames;
+	uint64_t m_repeatsSkipped;
+	// What CaptureFrame measured about the frame it is capturing, and the
+	// frames captured since the last CleanupCapture; only touched by the
+	// thread that captures. capture_time_ns is the QPC ns of the present the
+	// injected frame was captured at, 0 when the hook did not record it; the
+	// sample is stamped with its stream time
+	FrameInfo m_frameInfo;
+	long m_framesCaptured;
+	bool m_captureRestarted;
+	REFERENCE_TIME m_rtLastSampleStart;
+	long double m_latencySumMillis;
+	long m_latencyCount;
 
     int getNegotiatedFinalWidth();
     int getNegotiatedFinalHeight();                   
@@ -119,6 +172,30 @@ protected:
 
 	DesktopCapture* m_pDesktopCapture;
 	GDICapture* m_pGDICapture;
+	ConvertPool* m_pConvertPool;
+	OutputFormat m_outputFormat;
+	ColorSpace m_colorSpace;
+	DWORD m_shmemSlots;
+	DWORD m_hookCopyThreads;
+	bool m_hookConvert;
+	bool m_largePages;
+	// samples downstream can hold while the next one is filled
+	DWORD m_sampleBuffers;
+
+	// CaptureThread: frames are captured on a thread of the pin's own into
+	// m_pFrameQueue and FillBuffer only copies them out, so a slow
+	// downstream filter does not hold up the capture and the other way round
+	bool m_captureThread;
+	DWORD m_frameQueueDepth;
+	FrameDropPolicy m_frameQueueDrop;
+	FrameQueue* m_pFrameQueue;
+	std::thread m_captureWorker;
+	volatile bool m_captureStop;
+	void StartCaptureThread();
+	void StopCaptureThread();
+	void CaptureThreadLoop();
+	HRESULT CaptureFrame(IMediaSample *pSample, FrameInfo *frameInfo);
+	HRESULT DequeueFrame(IMediaSample *pSample, FrameInfo *frameInfo);
 
 	bool m_bFormatAlreadySet;
 	bool once_;
@@ -149,6 +226,7 @@ public:
 	HRESULT OnThreadStartPlay(void);
 	int GetGameFromRegistry(void);
 	void CleanupCapture();
+	void ResetFrameStats();
 	HRESULT Inactive(void);
 	HRESULT Active(void);
 
@@ -174,10 +252,14 @@ public:
 
     // Override the version that offers exactly one media type
     HRESULT DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES *pRequest);
+    // Offers FramePoolAllocator first, then the usual input pin / CMemAllocator
+    HRESULT DecideAllocator(IMemInputPin *pPin, IMemAllocator **ppAlloc);
     HRESULT FillBuffer(IMediaSample *pSample);
     HRESULT FillBuffer_Inject(IMediaSample *pSample);
     HRESULT FillBuffer_Desktop(IMediaSample *pSample);
     HRESULT FillBuffer_GDI(IMediaSample *pSample);
+    bool IsBlackSample(IMediaSample *pSample, FrameContent content);
+    bool SkipRepeat(const FrameCheck& check, REFERENCE_TIME now);
 
     // Set the agreed media type and set up the necessary parameters
     HRESULT SetMediaType(const CMediaType *pMediaType);
@@ -187,13 +269,8 @@ public:
     HRESULT GetMediaType(int iPosition, CMediaType *pmt);
 
     // IQualityControl
-	// Not implemented because we aren't going in real time.
-	// If the file-writing filter slows the graph down, we just do nothing, which means
-	// wait until we're unblocked. No frames are ever dropped.
-    STDMETHODIMP Notify(IBaseFilter *pSelf, Quality q)
-    {
-        return E_FAIL;
-    }
+    // Downstream falling behind lowers the capture rate, see RateControl.
+    STDMETHODIMP Notify(IBaseFilter *pSelf, Quality q);
 
 	
     //////////////////////////////////////////////////////////////////////////
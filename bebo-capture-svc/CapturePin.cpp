@@ -28,7 +28,6 @@ long sumMillisTook = 0;
 wchar_t out[1024];
 // FIXME :  move these
 bool ever_started = false;
-boolean missed = false;
 
 #ifdef _DEBUG 
 int show_performance = 1;
@@ -38,6 +37,54 @@ int show_performance = 0;
 
 volatile bool initialized = false;
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+StreamClock::StreamClock(CBaseFilter* filter) :
+	filter_(filter),
+	timer_(NULL),
+	raisedResolution_(false)
+{
+	timer_ = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!timer_) {
+		// older than Windows 10 1803, 1 ms is the best there is
+		timer_ = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		raisedResolution_ = timeBeginPeriod(1) == TIMERR_NOERROR;
+	}
+}
+
+StreamClock::~StreamClock() {
+	if (timer_) {
+		CloseHandle(timer_);
+	}
+	if (raisedResolution_) {
+		timeEndPeriod(1);
+	}
+}
+
+int64_t StreamClock::Now() {
+	CRefTime now;
+	now = 0;
+	filter_->StreamTime(now);
+	return now.GetUnits();
+}
+
+void StreamClock::SleepFor(int64_t duration) {
+	if (duration <= 0) {
+		return;
+	}
+
+	// negative is relative, in 100 ns units like REFERENCE_TIME
+	LARGE_INTEGER due;
+	due.QuadPart = -duration;
+	if (timer_ && SetWaitableTimer(timer_, &due, 0, NULL, NULL, FALSE)) {
+		WaitForSingleObject(timer_, INFINITE);
+	} else {
+		Sleep((DWORD)max(1, duration / 10000L));
+	}
+}
+
 static DWORD WINAPI init_hooks(LPVOID unused)
 {
 	info("Init hooks: load graphics offsets start");
@@ -62,7 +109,21 @@ CPushPinDesktop::CPushPinDesktop(HRESULT *phr, CGameCapture *pFilter, int captur
 	m_iFrameNumber(0),
 	m_pParent(pFilter),
 	m_bFormatAlreadySet(false),
-	previousFrame(0),
+	m_streamClock(pFilter),
+	m_pacer(&m_streamClock),
+	m_qualityControl(true),
+	m_rtCaptureFrameLength(UNITS / 30),
+	m_repeatCheck(true),
+	m_variableFrameRate(false),
+	m_rtKeyframeInterval(UNITS),
+	m_rtLastDelivery(MINLONGLONG),
+	m_repeatFrames(0),
+	m_repeatsSkipped(0),
+	m_framesCaptured(0),
+	m_captureRestarted(false),
+	m_rtLastSampleStart(MINLONGLONG),
+	m_latencySumMillis(0),
+	m_latencyCount(0),
 	active(false),
 	type_(capture_type),
 	typeName_(GetTypeName(capture_type)),
@@ -74,6 +135,19 @@ CPushPinDesktop::CPushPinDesktop(HRESULT *phr, CGameCapture *pFilter, int captur
 	game_context(NULL),
 	m_pDesktopCapture(new DesktopCapture),
 	m_pGDICapture(new GDICapture),
+	m_pConvertPool(new ConvertPool(ConvertPool::DefaultThreads())),
+	m_outputFormat(OUTPUT_I420),
+	m_colorSpace(COLOR_BT601_LIMITED),
+	m_shmemSlots(3),
+	m_hookCopyThreads(1),
+	m_hookConvert(true),
+	m_largePages(false),
+	m_sampleBuffers(3),
+	m_captureThread(false),
+	m_frameQueueDepth(2),
+	m_frameQueueDrop(DROP_OLDEST),
+	m_pFrameQueue(NULL),
+	m_captureStop(false),
 	m_iDesktopNumber(-1),
 	m_iDesktopAdapterNumber(-1),
 	windowHandle_(-1),
@@ -136,6 +210,12 @@ CPushPinDesktop::CPushPinDesktop(HRESULT *phr, CGameCapture *pFilter, int captur
 		info("Read registry signal event. Handle: %llu", readRegistryEvent);
 	}
 
+	memset(&m_frameInfo, 0, sizeof(m_frameInfo));
+
+	m_pDesktopCapture->SetConvertPool(m_pConvertPool);
+	m_pGDICapture->SetConvertPool(m_pConvertPool);
+	config->convert_pool = m_pConvertPool;
+
 	// now read some custom settings...
 	WarmupCounter();
 
@@ -144,6 +224,8 @@ CPushPinDesktop::CPushPinDesktop(HRESULT *phr, CGameCapture *pFilter, int captur
 
 CPushPinDesktop::~CPushPinDesktop()
 {
+	StopCaptureThread();
+
 	if (game_context) {
 		stop_game_capture(&game_context);
 		game_context = NULL;
@@ -164,8 +246,17 @@ CPushPinDesktop::~CPushPinDesktop()
 	}
 
 	CleanupCapture();
+	ResetFrameStats();
+
+	if (m_pConvertPool) {
+		delete m_pConvertPool;
+		m_pConvertPool = nullptr;
+	}
 }
 
+// Stops capturing, the next frame starts over. Runs on whichever thread
+// captures; FillBuffer's counters are reset by the first frame after it,
+// see ResetFrameStats.
 void CPushPinDesktop::CleanupCapture() {
 	if (game_context) {
 		stop_game_capture(&game_context);
@@ -180,6 +271,16 @@ void CPushPinDesktop::CleanupCapture() {
 		m_pGDICapture->SetCaptureHandle(NULL);
 	}
 
+	m_framesCaptured = 0;
+	m_captureRestarted = true;
+	m_pacer.Reset();
+	isBlackFrame = true;
+	blackFrameCount = 0;
+}
+
+// Logs and resets what FillBuffer counted since the capture started, on
+// the streaming thread or once it is gone.
+void CPushPinDesktop::ResetFrameStats() {
 	if (!threadCreated) {
 		LOG(INFO) << "Total no. Frames written: " << m_iFrameNumber << ", before thread created.";
 	} else {
@@ -187,23 +288,24 @@ void CPushPinDesktop::CleanupCapture() {
 		WideCharToMultiByte(CP_UTF8, 0, out, 1024, out_c, 1024, NULL, NULL);
 		LOG(INFO) << "Total no. Frames written: " << m_iFrameNumber << " " << out_c;
 	}
+	if (m_latencyCount > 0) {
+		info("average capture to deliver latency: %.02Lf ms over %ld frames", m_latencySumMillis / m_latencyCount, m_latencyCount);
+	}
 
 	// reset counter values 
 
 	globalStart = GetTickCount();
-	missed = true;
 	countMissed = 0;
 	sumMillisTook = 0;
 	fastestRoundMillis = LONG_MAX;
 	m_iFrameNumber = 0;
-	previousFrame = 0;
-	isBlackFrame = true;
-	blackFrameCount = 0;
+	m_latencySumMillis = 0;
+	m_latencyCount = 0;
 
-	_swprintf(out, L"done video frame! total frames: %d this one %dx%d -> (%dx%d) took: %.02Lfms, %.02f ave fps (%.02f is the theoretical max fps based on this round, ave. possible fps %.02f, fastest round fps %.02f, negotiated fps %.06f), frame missed: %d, type: %ls, name: %ls, black frame: %d, black frame count: %llu",
+	_swprintf(out, L"done video frame! total frames: %d this one %dx%d -> (%dx%d) took: %.02Lfms, %.02f ave fps (%.02f is the theoretical max fps based on this round, ave. possible fps %.02f, fastest round fps %.02f, negotiated fps %.06f), frame missed: %d, type: %ls, name: %ls, black frame count: %llu",
 		m_iFrameNumber, width_, height_, getNegotiatedFinalWidth(), getNegotiatedFinalHeight(), 
 		0, 0, 0, 0, 0, 0, countMissed, 
-		typeName_.c_str(), label_.c_str(), isBlackFrame, blackFrameCount);
+		typeName_.c_str(), label_.c_str(), 0ULL);
 }
 
 int CPushPinDesktop::GetGameFromRegistry(void) {
@@ -391,6 +493,217 @@ int CPushPinDesktop::GetGameFromRegistry(void) {
 		}
 	}
 
+	// ColorMatrix is 601 or 709, FullRange 0 or 1. The converters are picked
+	// when the capture starts, so a change restarts it.
+	if (registry.HasValue(TEXT("ColorMatrix")) || registry.HasValue(TEXT("FullRange"))) {
+		DWORD matrix = (m_colorSpace == COLOR_BT709_LIMITED || m_colorSpace == COLOR_BT709_FULL) ? 709 : 601;
+		DWORD fullRange = IsFullRange(m_colorSpace) ? 1 : 0;
+
+		if (registry.HasValue(TEXT("ColorMatrix"))) {
+			registry.ReadValueDW(TEXT("ColorMatrix"), &matrix);
+		}
+		if (registry.HasValue(TEXT("FullRange"))) {
+			registry.ReadValueDW(TEXT("FullRange"), &fullRange);
+		}
+
+		ColorSpace colorSpace = GetColorSpace(matrix, fullRange == 1);
+		if (m_colorSpace != colorSpace) {
+			m_colorSpace = colorSpace;
+			message << "color: BT." << (matrix == 709 ? 709 : 601) << (fullRange == 1 ? " full" : " limited") << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// frame slots the hook shares with us, 2 to 8; the hook sets them up
+	// when the capture starts
+	if (registry.HasValue(TEXT("ShmemSlots"))) {
+		DWORD slots = m_shmemSlots;
+
+		registry.ReadValueDW(TEXT("ShmemSlots"), &slots);
+
+		if (slots != m_shmemSlots) {
+			m_shmemSlots = slots;
+			message << "shmem slots: " << slots << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// threads in the game process copying each frame into shared memory,
+	// 1 to 4; picked up when the capture starts
+	if (registry.HasValue(TEXT("HookCopyThreads"))) {
+		DWORD threads = m_hookCopyThreads;
+
+		registry.ReadValueDW(TEXT("HookCopyThreads"), &threads);
+
+		if (threads != m_hookCopyThreads) {
+			m_hookCopyThreads = threads;
+			message << "hook copy threads: " << threads << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// 1 lets the hook convert I420 / NV12 samples on its copy thread, 0
+	// keeps the conversion here; the hook picks it up when the capture
+	// starts
+	if (registry.HasValue(TEXT("HookConvert"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("HookConvert"), &qout);
+
+		if (m_hookConvert != (qout == 1)) {
+			m_hookConvert = (qout == 1);
+			message << "hook convert: " << m_hookConvert << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// 1 puts the shared frame memory, our scale buffers and the frame pool
+	// allocator's samples on large pages; needs "Lock pages in memory" for
+	// the game's account and ours, either side falls back to normal pages
+	// without it. Picked up when the capture starts (the samples when the
+	// pin connects).
+	if (registry.HasValue(TEXT("LargePages"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("LargePages"), &qout);
+
+		if (m_largePages != (qout == 1)) {
+			m_largePages = (qout == 1);
+			message << "large pages: " << m_largePages << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// 0 ignores downstream's quality notices, the capture runs at the
+	// negotiated rate whatever happens to its frames
+	if (registry.HasValue(TEXT("QualityControl"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("QualityControl"), &qout);
+
+		if (m_qualityControl != (qout == 1)) {
+			m_qualityControl = (qout == 1);
+			message << "quality control: " << m_qualityControl << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// samples in flight between us and downstream, 1 to 8; more let the
+	// next frame be captured while the encoder still has the last one.
+	// Picked up when the pin connects.
+	if (registry.HasValue(TEXT("SampleBuffers"))) {
+		DWORD buffers = m_sampleBuffers;
+
+		registry.ReadValueDW(TEXT("SampleBuffers"), &buffers);
+
+		if (buffers < 1) {
+			buffers = 1;
+		} else if (buffers > 8) {
+			buffers = 8;
+		}
+		if (buffers != m_sampleBuffers) {
+			m_sampleBuffers = buffers;
+			message << "sample buffers: " << buffers << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// 1 captures on a thread of the pin's own into a queue of
+	// FrameQueueDepth frames (1 to 8), FillBuffer only copies them out.
+	// FrameQueueDrop picks what goes when the queue is full: 0 the oldest
+	// queued frame, 1 the new one. Picked up when streaming starts.
+	if (registry.HasValue(TEXT("CaptureThread"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("CaptureThread"), &qout);
+
+		if (m_captureThread != (qout == 1)) {
+			m_captureThread = (qout == 1);
+			message << "capture thread: " << m_captureThread << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	if (registry.HasValue(TEXT("FrameQueueDepth"))) {
+		DWORD depth = m_frameQueueDepth;
+
+		registry.ReadValueDW(TEXT("FrameQueueDepth"), &depth);
+
+		if (depth != m_frameQueueDepth) {
+			m_frameQueueDepth = depth;
+			message << "frame queue depth: " << depth << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	if (registry.HasValue(TEXT("FrameQueueDrop"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("FrameQueueDrop"), &qout);
+
+		FrameDropPolicy policy = (qout == 1) ? DROP_NEWEST : DROP_OLDEST;
+		if (m_frameQueueDrop != policy) {
+			m_frameQueueDrop = policy;
+			message << "frame queue drop: " << (policy == DROP_NEWEST ? "newest" : "oldest") << ", ";
+			numberOfChanges++;
+		}
+	}
+
+	// only changes how frames are converted, no need to restart the capture
+	if (registry.HasValue(TEXT("ConvertThreads"))) {
+		DWORD threads = 0;
+
+		registry.ReadValueDW(TEXT("ConvertThreads"), &threads);
+
+		if (threads > 0 && (int) threads != m_pConvertPool->GetThreads()) {
+			m_pConvertPool->SetThreads(threads);
+			info("convert threads: %d", m_pConvertPool->GetThreads());
+		}
+	}
+
+	// 0 converts every frame, 1 hands a repeat of the last frame out again
+	// without converting it; no restart needed either
+	if (registry.HasValue(TEXT("RepeatCheck"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("RepeatCheck"), &qout);
+
+		if (m_repeatCheck != (qout == 1)) {
+			m_repeatCheck = (qout == 1);
+			info("repeat check: %d", m_repeatCheck);
+		}
+	}
+
+	// 1 does not deliver repeats at all until the picture changes or
+	// KeyframeInterval ms (100 to 10000) passed since the last frame that
+	// went out; needs RepeatCheck
+	if (registry.HasValue(TEXT("VariableFrameRate"))) {
+		DWORD qout;
+
+		registry.ReadValueDW(TEXT("VariableFrameRate"), &qout);
+
+		if (m_variableFrameRate != (qout == 1)) {
+			m_variableFrameRate = (qout == 1);
+			info("variable frame rate: %d", m_variableFrameRate);
+		}
+	}
+
+	if (registry.HasValue(TEXT("KeyframeInterval"))) {
+		DWORD millis = (DWORD)(m_rtKeyframeInterval / 10000);
+
+		registry.ReadValueDW(TEXT("KeyframeInterval"), &millis);
+
+		if (millis < 100) {
+			millis = 100;
+		} else if (millis > 10000) {
+			millis = 10000;
+		}
+		if (millis * 10000LL != m_rtKeyframeInterval) {
+			m_rtKeyframeInterval = millis * 10000LL;
+			info("keyframe interval: %lu ms", millis);
+		}
+	}
+
 	if (numberOfChanges > 0) {
 		std::wstring wstr = message.str();
 		wstr.erase(wstr.size() - 2);
@@ -425,19 +738,238 @@ void CPushPinDesktop::ProcessRegistryReadEvent(long timeout) {
 	}
 }
 
+// IMediaSample over a queued frame, so the capture code that fills the
+// pin's samples can fill FrameQueue buffers on the capture thread. That code
+// only asks for the pointer and size, nothing else is supported. It lives on
+// the capture thread's stack, reference counts are not kept.
+class QueuedFrameSample : public IMediaSample {
+public:
+	QueuedFrameSample() : frame_(NULL) {}
+	void Attach(QueuedFrame* frame) { frame_ = frame; }
+
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+		if (riid == IID_IUnknown || riid == IID_IMediaSample) {
+			*ppv = static_cast<IMediaSample*>(this);
+			return S_OK;
+		}
+		*ppv = NULL;
+		return E_NOINTERFACE;
+	}
+	STDMETHODIMP_(ULONG) AddRef() { return 1; }
+	STDMETHODIMP_(ULONG) Release() { return 1; }
+
+	STDMETHODIMP GetPointer(BYTE **ppBuffer) { *ppBuffer = frame_->data; return S_OK; }
+	STDMETHODIMP_(LONG) GetSize() { return (LONG)frame_->size; }
+	STDMETHODIMP_(LONG) GetActualDataLength() { return (LONG)frame_->size; }
+	STDMETHODIMP SetActualDataLength(LONG lActual) { return E_NOTIMPL; }
+	STDMETHODIMP GetTime(REFERENCE_TIME *pTimeStart, REFERENCE_TIME *pTimeEnd) { return VFW_E_SAMPLE_TIME_NOT_SET; }
+	STDMETHODIMP SetTime(REFERENCE_TIME *pTimeStart, REFERENCE_TIME *pTimeEnd) { return E_NOTIMPL; }
+	STDMETHODIMP GetMediaTime(LONGLONG *pTimeStart, LONGLONG *pTimeEnd) { return VFW_E_MEDIA_TIME_NOT_SET; }
+	STDMETHODIMP SetMediaTime(LONGLONG *pTimeStart, LONGLONG *pTimeEnd) { return E_NOTIMPL; }
+	STDMETHODIMP GetMediaType(AM_MEDIA_TYPE **ppMediaType) { *ppMediaType = NULL; return S_FALSE; }
+	STDMETHODIMP SetMediaType(AM_MEDIA_TYPE *pMediaType) { return E_NOTIMPL; }
+	STDMETHODIMP IsSyncPoint() { return S_OK; }
+	STDMETHODIMP SetSyncPoint(BOOL bIsSyncPoint) { return E_NOTIMPL; }
+	STDMETHODIMP IsPreroll() { return S_FALSE; }
+	STDMETHODIMP SetPreroll(BOOL bIsPreroll) { return E_NOTIMPL; }
+	STDMETHODIMP IsDiscontinuity() { return S_FALSE; }
+	STDMETHODIMP SetDiscontinuity(BOOL bDiscontinuity) { return E_NOTIMPL; }
+
+private:
+	QueuedFrame* frame_;
+};
+
+void CPushPinDesktop::StartCaptureThread() {
+	if (!m_captureThread || m_pFrameQueue) {
+		return;
+	}
+
+	m_pFrameQueue = new FrameQueue(m_frameQueueDepth, GetOutputFrameSize(m_outputFormat, width_, height_), m_frameQueueDrop);
+	m_captureStop = false;
+	m_captureWorker = std::thread(&CPushPinDesktop::CaptureThreadLoop, this);
+
+	info("capture thread started, frame queue depth: %d, drop: %s, frame size: %u",
+		m_pFrameQueue->Depth(), m_pFrameQueue->Policy() == DROP_NEWEST ? "newest" : "oldest", (unsigned)m_pFrameQueue->FrameSize());
+}
+
+void CPushPinDesktop::StopCaptureThread() {
+	if (!m_pFrameQueue) {
+		return;
+	}
+
+	m_captureStop = true;
+	m_pFrameQueue->Close();
+	if (m_captureWorker.joinable()) {
+		m_captureWorker.join();
+	}
+
+	FrameQueue::Stats stats = m_pFrameQueue->GetStats();
+	info("frame queue: %llu queued, %llu delivered, %llu dropped, average depth %.02f, max depth %d, %llu waits for %.02f ms",
+		stats.queued, stats.delivered, stats.dropped,
+		stats.delivered ? (double)stats.depth_sum / stats.delivered : 0.0, stats.max_depth,
+		stats.waits, stats.wait_ns / 1000000.0);
+
+	delete m_pFrameQueue;
+	m_pFrameQueue = NULL;
+}
+
+void CPushPinDesktop::CaptureThreadLoop() {
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	QueuedFrameSample sample;
+
+	// the streaming thread stops us once the pin goes inactive
+	while (!m_captureStop && active) {
+		QueuedFrame* frame = m_pFrameQueue->Acquire();
+		if (!frame) {
+			error("frame queue has no free buffer, capture thread stops");
+			break;
+		}
+
+		sample.Attach(frame);
+		if (CaptureFrame(&sample, &frame->info) != S_OK) {
+			m_pFrameQueue->Discard(frame);
+			continue;
+		}
+
+		// desktop and window frames are captured just now
+		if (!frame->info.capture_time_ns) {
+			frame->info.capture_time_ns = GetCounterNanos();
+		}
+		m_pFrameQueue->Commit(frame);
+	}
+
+	// FillBuffer is not to wait for frames that will not come
+	m_pFrameQueue->Close();
+
+	if (SUCCEEDED(hrCom)) {
+		CoUninitialize();
+	}
+}
+
+// FillBuffer with a capture thread: the next queued frame, waiting for the
+// capture thread to queue one; an error once it stopped while the pin is
+// still active.
+HRESULT CPushPinDesktop::DequeueFrame(IMediaSample *pSample, FrameInfo *frameInfo) {
+	BYTE* pData;
+	pSample->GetPointer(&pData);
+
+	while (true) {
+		if (!active) {
+			info("FillBuffer - inactive");
+			return S_FALSE;
+		}
+
+		QueuedFrame* frame = m_pFrameQueue->Pop(100);
+		if (!frame) {
+			if (active && m_pFrameQueue->Closed()) {
+				error("capture thread stopped, no more frames");
+				return E_FAIL;
+			}
+			continue;
+		}
+
+		memcpy(pData, frame->data, MIN(frame->size, (size_t)pSample->GetSize()));
+		*frameInfo = frame->info;
+		m_pFrameQueue->Release(frame);
+		return S_OK;
+	}
+}
+
 HRESULT CPushPinDesktop::FillBuffer(IMediaSample *pSample)
 {
-	__int64 startThisRound = StartCounter();
-
 	CheckPointer(pSample, E_POINTER);
 
-	long double millisThisRoundTook = 0;
+	FrameInfo frameInfo;
 	CRefTime now;
 	now = 0;
 
+	// numbering and stamps stay on this thread, the capture only measures
+	HRESULT hr;
+	if (m_pFrameQueue) {
+		hr = DequeueFrame(pSample, &frameInfo);
+	} else {
+		hr = CaptureFrame(pSample, &frameInfo);
+	}
+	if (hr != S_OK) {
+		return hr;
+	}
+
+	if (frameInfo.restarted) {
+		ResetFrameStats();
+	}
+	if (frameInfo.skipped) {
+		m_iFrameNumber += frameInfo.skipped;
+		debug("missed %d frames can't keep up %d %d %.02f",
+			frameInfo.skipped, m_iFrameNumber, countMissed + frameInfo.skipped, (100.0L*(countMissed + frameInfo.skipped) / m_iFrameNumber));
+	}
+	countMissed += frameInfo.skipped + frameInfo.missed;
+	long double millisThisRoundTook = frameInfo.millis_took;
+	fastestRoundMillis = min(millisThisRoundTook, fastestRoundMillis);
+	sumMillisTook += millisThisRoundTook;
+	uint64_t captureTimeNs = frameInfo.capture_time_ns;
+
+	REFERENCE_TIME startFrame = m_iFrameNumber * m_rtFrameLength;
+	if (SUCCEEDED(CSourceStream::m_pFilter->StreamTime(now))) {
+		// stream time the frame was captured at: injected frames carry the
+		// QPC time of the game's present, which is taken back from now
+		startFrame = now;
+		if (captureTimeNs) {
+			QWORD nowNs = GetCounterNanos();
+			if (nowNs > captureTimeNs) {
+				long double latency = (nowNs - captureTimeNs) / 1000000.0;
+				m_latencySumMillis += latency;
+				m_latencyCount++;
+				debug("capture to deliver latency %.02Lf ms, average %.02Lf ms", latency, m_latencySumMillis / m_latencyCount);
+				startFrame -= (REFERENCE_TIME)((nowNs - captureTimeNs) / 100);
+			}
+		}
+		// a present can be older than the last sample's, stamps must not go back
+		if (startFrame <= m_rtLastSampleStart) {
+			startFrame = m_rtLastSampleStart + 1;
+		}
+		m_rtLastSampleStart = startFrame;
+	}
+	REFERENCE_TIME endFrame = startFrame + frameInfo.frame_length;
+	pSample->SetTime((REFERENCE_TIME *)&startFrame, (REFERENCE_TIME *)&endFrame);
+	debug("timestamping (%11f) video packet %llf -> %llf length:(%11f) drift:(%llf)", 0.0001 * now, 0.0001 * startFrame, 0.0001 * endFrame, 0.0001 * (endFrame - startFrame), 0.0001 * (now - frameInfo.deadline));
+
+	m_iFrameNumber++;
+
+	if ((m_iFrameNumber - countMissed) == 1) {
+		info("Got first frame, type: %ls, name: %ls", typeName_.c_str(), label_.c_str());
+	}
+
+	// Set TRUE on every sample for uncompressed frames http://msdn.microsoft.com/en-us/library/windows/desktop/dd407021%28v=vs.85%29.aspx
+	pSample->SetSyncPoint(TRUE);
+
+	// only set discontinuous for the first...I think...
+	pSample->SetDiscontinuity(m_iFrameNumber <= 1);
+
+	double m_fFpsSinceBeginningOfTime = ((double)m_iFrameNumber) / (GetTickCount() - globalStart) * 1000;
+	_swprintf(out, L"done video frame! total frames: %d this one %dx%d -> (%dx%d) took: %.02Lfms, %.02f ave fps (%.02f is the theoretical max fps based on this round, ave. possible fps %.02f, fastest round fps %.02f, negotiated fps %.06f), frame missed: %d, type: %ls, name: %ls, black frame count: %llu",
+		m_iFrameNumber, width_, height_, getNegotiatedFinalWidth(), getNegotiatedFinalHeight(), millisThisRoundTook, m_fFpsSinceBeginningOfTime, 1.0 * 1000 / millisThisRoundTook,
+		/* average */ 1.0 * 1000 * m_iFrameNumber / sumMillisTook, 1.0 * 1000 / fastestRoundMillis, GetFps(), countMissed, typeName_.c_str(), label_.c_str(), frameInfo.black_frames);
+	debug(out);
+	return S_OK;
+}
+
+// Captures the next frame into pSample, pacing and retrying until there is
+// one, and what was measured along with it into *frameInfo; S_FALSE once the
+// pin goes inactive. Runs on the streaming thread, or on the capture thread
+// with a frame queue, and only touches the capture's own state.
+HRESULT CPushPinDesktop::CaptureFrame(IMediaSample *pSample, FrameInfo *frameInfo)
+{
+	__int64 startThisRound = StartCounter();
+
+	CheckPointer(pSample, E_POINTER);
+
+	UpdateCaptureRate();
+	m_pacer.SetFrameLength(m_rtCaptureFrameLength);
+	memset(&m_frameInfo, 0, sizeof(m_frameInfo));
+
 	boolean gotFrame = false;
 	while (!gotFrame) {
-		if (!active) {
+		if (!active || m_captureStop) {
 			info("FillBuffer - inactive");
 			return S_FALSE;
 		}
@@ -476,56 +1008,25 @@ HRESULT CPushPinDesktop::FillBuffer(IMediaSample *pSample)
 			continue;
 		} else if (code == 3) { // black frame
 			gotFrame = false;
-
-			long double avg_fps = (sumMillisTook == 0) ? 0 : 1.0 * 1000 * m_iFrameNumber / sumMillisTook;
-			long double max = (millisThisRoundTook == 0) ? 0 : 1.0 * 1000 / millisThisRoundTook;
-
-			double m_fFpsSinceBeginningOfTime = ((double)m_iFrameNumber) / (GetTickCount() - globalStart) * 1000;
-
-			_swprintf(out, L"done video frame! total frames: %d this one %dx%d -> (%dx%d) took: %.02Lfms, %.02f ave fps (%.02f is the theoretical max fps based on this round, ave. possible fps %.02f, fastest round fps %.02f, negotiated fps %.06f), frame missed: %d, type: %ls, name: %ls, black frame: %d, black frame count: %llu",
-				m_iFrameNumber, width_, height_, 
-				getNegotiatedFinalWidth(), getNegotiatedFinalHeight(), millisThisRoundTook, m_fFpsSinceBeginningOfTime, 
-				max, sumMillisTook, 
-				1.0 * 1000 / fastestRoundMillis, GetFps(), countMissed, typeName_.c_str(), label_.c_str(), isBlackFrame, blackFrameCount);
 		} else {
 			gotFrame = false;
 			ProcessRegistryReadEvent(5000);
 		}
 	}
 
-	missed = false;
-	millisThisRoundTook = GetCounterSinceStartMillis(startThisRound);
-	fastestRoundMillis = min(millisThisRoundTook, fastestRoundMillis);
-	sumMillisTook += millisThisRoundTook;
-
-	// accomodate for 0 to avoid startup negatives, which would kill our math on the next loop...
-	previousFrame = max(0, previousFrame);
-	// auto-correct drift
-	previousFrame = previousFrame + m_rtFrameLength;
-
-	REFERENCE_TIME startFrame = m_iFrameNumber * m_rtFrameLength;
-	REFERENCE_TIME endFrame = startFrame + m_rtFrameLength;
-	pSample->SetTime((REFERENCE_TIME *)&startFrame, (REFERENCE_TIME *)&endFrame);
-	CSourceStream::m_pFilter->StreamTime(now);
-	debug("timestamping (%11f) video packet %llf -> %llf length:(%11f) drift:(%llf)", 0.0001 * now, 0.0001 * startFrame, 0.0001 * endFrame, 0.0001 * (endFrame - startFrame), 0.0001 * (now - previousFrame));
-
-	m_iFrameNumber++;
-
-	if ((m_iFrameNumber - countMissed) == 1) {
-		info("Got first frame, type: %ls, name: %ls", typeName_.c_str(), label_.c_str());
-	}
-
-	// Set TRUE on every sample for uncompressed frames http://msdn.microsoft.com/en-us/library/windows/desktop/dd407021%28v=vs.85%29.aspx
-	pSample->SetSyncPoint(TRUE);
+	m_frameInfo.frame_length = m_rtCaptureFrameLength;
+	m_frameInfo.deadline = m_pacer.Deadline();
+	m_frameInfo.millis_took = GetCounterSinceStartMillis(startThisRound);
+	m_frameInfo.black_frames = blackFrameCount;
+	m_frameInfo.restarted = m_captureRestarted;
+	m_captureRestarted = false;
+	m_framesCaptured++;
 
-	// only set discontinuous for the first...I think...
-	pSample->SetDiscontinuity(m_iFrameNumber <= 1);
+	// next deadline is a frame after this one's, not after now, so wake up
+	// jitter does not drift
+	m_pacer.FrameDelivered();
 
-	double m_fFpsSinceBeginningOfTime = ((double)m_iFrameNumber) / (GetTickCount() - globalStart) * 1000;
-	_swprintf(out, L"done video frame! total frames: %d this one %dx%d -> (%dx%d) took: %.02Lfms, %.02f ave fps (%.02f is the theoretical max fps based on this round, ave. possible fps %.02f, fastest round fps %.02f, negotiated fps %.06f), frame missed: %d, type: %ls, name: %ls, black frame: %d, black frame count: %llu",
-		m_iFrameNumber, width_, height_, getNegotiatedFinalWidth(), getNegotiatedFinalHeight(), millisThisRoundTook, m_fFpsSinceBeginningOfTime, 1.0 * 1000 / millisThisRoundTook,
-		/* average */ 1.0 * 1000 * m_iFrameNumber / sumMillisTook, 1.0 * 1000 / fastestRoundMillis, GetFps(), countMissed, typeName_.c_str(), label_.c_str(), isBlackFrame, blackFrameCount);
-	debug(out);
+	*frameInfo = m_frameInfo;
 	return S_OK;
 }
 
@@ -534,7 +1035,7 @@ HRESULT CPushPinDesktop::FillBuffer_Inject(IMediaSample *pSample)
 	CheckPointer(pSample, E_POINTER);
 	
 	if (!isReady(&game_context)) {
-		if (m_iFrameNumber > 0) {
+		if (m_framesCaptured > 0) {
 			CleanupCapture();
 		}
 
@@ -542,86 +1043,44 @@ HRESULT CPushPinDesktop::FillBuffer_Inject(IMediaSample *pSample)
 		config->scale_cy = height_;
 		config->force_scaling = 1;
 		config->anticheat_hook = antiCheat_;
+		config->output_format = m_outputFormat;
+		config->color_space = m_colorSpace;
+		config->shmem_slots = m_shmemSlots;
+		config->copy_threads = m_hookCopyThreads;
+		config->hook_convert = m_hookConvert;
+		config->large_pages = m_largePages;
 
-		game_context = hook(&game_context, windowClassName_, windowName_, config, m_rtFrameLength * 100);
+		game_context = hook(&game_context, windowClassName_, windowName_, config, m_rtCaptureFrameLength * 100);
 
 		if (!isReady(&game_context)) {
 			return 2;
 		}
 	}
 
-	CRefTime now;
-	now = 0;
-	CSourceStream::m_pFilter->StreamTime(now);
-
-	if (now <= 0) {
-		DWORD dwMilliseconds = (DWORD)(m_rtFrameLength / 20000L);
-		debug("no reference graph clock - sleeping %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (now < (previousFrame + (m_rtFrameLength / 2))) {
-		DWORD dwMilliseconds = (DWORD)max(1, min(10000 + previousFrame + (m_rtFrameLength / 2) - now, (m_rtFrameLength / 2)) / 10000L);
-		debug("sleeping A - %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (now < (previousFrame + m_rtFrameLength)) {
-		DWORD dwMilliseconds = (DWORD)max(1, min((previousFrame + m_rtFrameLength - now), (m_rtFrameLength / 2)) / 10000L);
-		debug("sleeping B - %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (missed) {
-		DWORD dwMilliseconds = (DWORD)(m_rtFrameLength / 10000L);
-		debug("starting/missed - sleeping %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-		CSourceStream::m_pFilter->StreamTime(now);
-	}
-	else if (missed == false && m_iFrameNumber == 0) {
-		debug("getting second frame");
-		missed = true;
-	}
-	else if (now > (previousFrame + 2 * m_rtFrameLength)) {
-		int missed_nr = (now - m_rtFrameLength - previousFrame) / m_rtFrameLength;
-		m_iFrameNumber += missed_nr;
-		countMissed += missed_nr;
-		debug("missed %d frames can't keep up %d %d %.02f %llf %llf %11f",
-			missed_nr, m_iFrameNumber, countMissed, (100.0L*countMissed / m_iFrameNumber), 0.0001 * now, 0.0001 * previousFrame, 0.0001 * (now - m_rtFrameLength - previousFrame));
-		previousFrame = previousFrame + missed_nr * m_rtFrameLength;
-		missed = true;
-	}
-	else {
-		debug("late need to catch up");
-		missed = true;
-	}
-
-	bool frame = get_game_frame(&game_context, missed, pSample);
+	FrameSlot slot = WaitForNextFrame();
+	REFERENCE_TIME now = slot.now;
+
+	// on time, give the game up to half a frame to deliver a new one
+	FrameCheck check = { isBlackFrame, m_repeatCheck, CONTENT_UNKNOWN, false };
+	bool frame = get_game_frame(&game_context, slot.late, pSample, (DWORD)(m_rtCaptureFrameLength / 20000L), &check);
 	if (!game_context) {
 		frame = false;
 		info("Capture Ended");
 	}
+	m_frameInfo.capture_time_ns = frame ? get_game_frame_time(&game_context) : 0;
 
-	if (frame && previousFrame <= 0) {
+	if (frame && !m_pacer.Started()) {
 		frame = false;
-		previousFrame = now;
-		missed = false;
+		m_pacer.Restart(now);
 		debug("skip first frame");
 	}
 
 	if (frame && isBlackFrame) {
-		long size = pSample->GetSize();
-		long y_size = width_ * height_;
-		BYTE* pData;
-		pSample->GetPointer(&pData);
-		for (int i = 0; i < size; i++) {
-			if ((i < y_size && pData[i] != 0x10) || (i >= y_size && pData[i] != 0x80)) {
-				isBlackFrame = false;
-				break;
-			}
-		}
+		isBlackFrame = IsBlackSample(pSample, check.content);
 
 		if (isBlackFrame) {
 			frame = false;
-			previousFrame = now;
-			missed = false;
+			m_pacer.Restart(now);
 			blackFrameCount++;
 
 			if (blackFrameCount == GetFps() * 10 * 2) { // 10s frames, cause we double sampling, texture A and B so 5*2
@@ -630,6 +1089,10 @@ HRESULT CPushPinDesktop::FillBuffer_Inject(IMediaSample *pSample)
 		}
 	}
 
+	if (frame && SkipRepeat(check, now)) {
+		frame = false;
+	}
+
 	if (!frame) {
 		return 3;
 	}
@@ -637,83 +1100,87 @@ HRESULT CPushPinDesktop::FillBuffer_Inject(IMediaSample *pSample)
 	return S_OK;
 }
 
+// With VariableFrameRate, whether a repeat of the last frame stays home. It
+// goes out anyway once KeyframeInterval passed since the last frame that
+// did, so downstream's picture is refreshed and the encoder gets to put a
+// keyframe on it. Without a running clock there is no telling how long it
+// has been, and repeats go out.
+bool CPushPinDesktop::SkipRepeat(const FrameCheck& check, REFERENCE_TIME now) {
+	if (check.repeated) {
+		m_repeatFrames++;
+
+		if (m_variableFrameRate && now > 0 && m_rtLastDelivery != MINLONGLONG &&
+			now - m_rtLastDelivery < m_rtKeyframeInterval) {
+			m_repeatsSkipped++;
+			// the slot is used up all the same, the next frame is due a
+			// frame after it
+			m_pacer.FrameDelivered();
+			return true;
+		}
+	}
+
+	m_rtLastDelivery = now;
+	return false;
+}
+
+// Until the first picture, whether the frame is black: as the capture found
+// it before converting, or else by looking at the converted sample.
+bool CPushPinDesktop::IsBlackSample(IMediaSample *pSample, FrameContent content) {
+	if (content != CONTENT_UNKNOWN) {
+		return content == CONTENT_BLACK;
+	}
+
+	OutputLayout layout;
+	GetOutputLayout(&layout, m_outputFormat, m_colorSpace, width_, height_);
+	BYTE* pData;
+	pSample->GetPointer(&pData);
+	return IsBlackFrame(&layout, pData, pSample->GetSize());
+}
+
 HRESULT CPushPinDesktop::FillBuffer_Desktop(IMediaSample *pSample) {
 	CheckPointer(pSample, E_POINTER);
 
 	if (!m_pDesktopCapture->IsReady()) {
-		if (m_iFrameNumber > 0) {
+		if (m_framesCaptured > 0) {
 			CleanupCapture();
 		}
 
 		info("Initializing desktop capture - adapter: %d, desktop: %d, size: %dx%d",
 			m_iDesktopAdapterNumber, m_iDesktopNumber, getNegotiatedFinalWidth(), getNegotiatedFinalHeight());
-		m_pDesktopCapture->Init(m_iDesktopAdapterNumber, m_iDesktopNumber, getNegotiatedFinalWidth(), getNegotiatedFinalHeight());
+		m_pDesktopCapture->Init(m_iDesktopAdapterNumber, m_iDesktopNumber, getNegotiatedFinalWidth(), getNegotiatedFinalHeight(),
+			m_outputFormat, m_colorSpace);
 
 		if (!m_pDesktopCapture->IsReady()) {
 			return 2;
 		}
 	}
 
-	CRefTime now;
-	now = 0;
-	CSourceStream::m_pFilter->StreamTime(now);
-	if (now <= 0) {
-		DWORD dwMilliseconds = (DWORD)(m_rtFrameLength / 10000L);
-		debug("no reference graph clock - sleeping %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (now < (previousFrame + m_rtFrameLength)) {
-		DWORD dwMilliseconds = (DWORD)max(1, min((previousFrame + m_rtFrameLength - now), m_rtFrameLength) / 10000L);
-		debug("sleeping - %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (missed) {
-		DWORD dwMilliseconds = (DWORD)(m_rtFrameLength / 20000L);
-		debug("starting/missed - sleeping %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-		CSourceStream::m_pFilter->StreamTime(now);
-	}
-	else if (now > (previousFrame + 2 * m_rtFrameLength)) {
-		int missed_nr = (now - m_rtFrameLength - previousFrame) / m_rtFrameLength;
-		m_iFrameNumber += missed_nr;
-		countMissed += missed_nr;
-		debug("missed %d frames can't keep up %d %d %.02f %llf %llf %11f",
-			missed_nr, m_iFrameNumber, countMissed, (100.0L*countMissed / m_iFrameNumber), 0.0001 * now, 0.0001 * previousFrame, 0.0001 * (now - m_rtFrameLength - previousFrame));
-		previousFrame = previousFrame + missed_nr * m_rtFrameLength;
-		missed = true;
-	}
-
-	bool frame = m_pDesktopCapture->GetFrame(pSample, false, now);
-
-	if (!frame && missed && now > (previousFrame + 10000000L / 5)) {
+	FrameSlot slot = WaitForNextFrame();
+	REFERENCE_TIME now = slot.now;
+
+	FrameCheck check = { isBlackFrame, m_repeatCheck, CONTENT_UNKNOWN, false };
+	bool frame = m_pDesktopCapture->GetFrame(pSample, false, now, &check);
+
+	if (!frame && slot.late && m_pacer.SinceLastFrame(now) > UNITS / 5) {
 		debug("fake frame");
-		countMissed += 1;
+		m_frameInfo.missed++;
+		check.content = CONTENT_UNKNOWN;
+		check.repeated = true;
 		frame = m_pDesktopCapture->GetOldFrame(pSample, false);
 	}
 
-	if (frame && previousFrame <= 0) {
+	if (frame && !m_pacer.Started()) {
 		frame = false;
-		previousFrame = now;
-		missed = false;
+		m_pacer.Restart(now);
 		debug("skip first frame");
 	}
 
 	if (frame && isBlackFrame) {
-		long size = pSample->GetSize();
-		long y_size = width_ * height_;
-		BYTE* pData;
-		pSample->GetPointer(&pData);
-		for (int i = 0; i < size; i++) {
-			if ((i < y_size && pData[i] != 0x10) || (i >= y_size && pData[i] != 0x80)) {
-				isBlackFrame = false;
-				break;
-			}
-		}
+		isBlackFrame = IsBlackSample(pSample, check.content);
 
 		if (isBlackFrame) {
 			frame = false;
-			previousFrame = now;
-			missed = false;
+			m_pacer.Restart(now);
 			blackFrameCount++;
 
 			if (blackFrameCount == GetFps() * 5) { // 5s frames
@@ -722,6 +1189,10 @@ HRESULT CPushPinDesktop::FillBuffer_Desktop(IMediaSample *pSample) {
 		}
 	}
 
+	if (frame && SkipRepeat(check, now)) {
+		frame = false;
+	}
+
 	if (!frame) {
 		return 3;
 	}
@@ -736,7 +1207,7 @@ HRESULT CPushPinDesktop::FillBuffer_GDI(IMediaSample *pSample)
 	CheckPointer(pSample, E_POINTER);
 
 	if (!m_pGDICapture->IsReady()) {
-		if (m_iFrameNumber > 0) {
+		if (m_framesCaptured > 0) {
 			CleanupCapture();
 		}
 
@@ -749,65 +1220,28 @@ HRESULT CPushPinDesktop::FillBuffer_GDI(IMediaSample *pSample)
 		info("GDI - window_handle: 0x%016x (%ld), class_name: %ls, window_name: %ls, exe_name: %ls, capture_once: %d",
 			windowHandle_, windowHandle_, windowClassName_, windowName_, exeFullName_, once_);
 
-		m_pGDICapture->SetSize(getNegotiatedFinalWidth(), getNegotiatedFinalHeight());
+		m_pGDICapture->SetSize(getNegotiatedFinalWidth(), getNegotiatedFinalHeight(), m_outputFormat, m_colorSpace);
 		m_pGDICapture->SetCaptureHandle(hwnd);
 	}
 
-	CRefTime now;
-	now = 0;
+	FrameSlot slot = WaitForNextFrame();
+	REFERENCE_TIME now = slot.now;
 
-	CSourceStream::m_pFilter->StreamTime(now);
-	if (now <= 0) {
-		DWORD dwMilliseconds = (DWORD)(m_rtFrameLength / 10000L);
-		debug("no reference graph clock - sleeping %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (now < (previousFrame + m_rtFrameLength)) {
-		DWORD dwMilliseconds = (DWORD)max(1, min((previousFrame + m_rtFrameLength - now), m_rtFrameLength) / 10000L);
-		debug("sleeping - %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-	}
-	else if (missed) {
-		DWORD dwMilliseconds = (DWORD)(m_rtFrameLength / 20000L);
-		debug("starting/missed - sleeping %d", dwMilliseconds);
-		Sleep(dwMilliseconds);
-		CSourceStream::m_pFilter->StreamTime(now);
-	}
-	else if (now > (previousFrame + 2 * m_rtFrameLength)) {
-		int missed_nr = (now - m_rtFrameLength - previousFrame) / m_rtFrameLength;
-		m_iFrameNumber += missed_nr;
-		countMissed += missed_nr;
-		debug("missed %d frames can't keep up %d %d %.02f %llf %llf %11f",
-			missed_nr, m_iFrameNumber, countMissed, (100.0L*countMissed / m_iFrameNumber), 0.0001 * now, 0.0001 * previousFrame, 0.0001 * (now - m_rtFrameLength - previousFrame));
-		previousFrame = previousFrame + missed_nr * m_rtFrameLength;
-		missed = true;
-	}
-
-	bool frame = m_pGDICapture->GetFrame(pSample);
+	FrameCheck check = { isBlackFrame, m_repeatCheck, CONTENT_UNKNOWN, false };
+	bool frame = m_pGDICapture->GetFrame(pSample, &check);
 
-	if (frame && previousFrame <= 0) {
+	if (frame && !m_pacer.Started()) {
 		frame = false;
-		previousFrame = now;
-		missed = false;
+		m_pacer.Restart(now);
 		debug("skip first frame");
 	}
 
 	if (frame && isBlackFrame) {
-		long size = pSample->GetSize();
-		long y_size = width_ * height_;
-		BYTE* pData;
-		pSample->GetPointer(&pData);
-		for (int i = 0; i < size; i++) {
-			if ((i < y_size && pData[i] != 0x10) || (i >= y_size && pData[i] != 0x80)) {
-				isBlackFrame = false;
-				break;
-			}
-		}
+		isBlackFrame = IsBlackSample(pSample, check.content);
 
 		if (isBlackFrame) {
 			frame = false;
-			missed = false;
-			previousFrame = now;
+			m_pacer.Restart(now);
 			blackFrameCount++;
 
 			if (blackFrameCount == GetFps() * 5) { // 5s frames
@@ -816,6 +1250,10 @@ HRESULT CPushPinDesktop::FillBuffer_GDI(IMediaSample *pSample)
 		}
 	}
 
+	if (frame && SkipRepeat(check, now)) {
+		frame = false;
+	}
+
 	if (!frame) {
 		if (!IsWindow(m_pGDICapture->GetCaptureHandle())) {
 			info("capturing window is no longer alive"); // TODO: instead of dying - maybe retrying
@@ -828,6 +1266,56 @@ HRESULT CPushPinDesktop::FillBuffer_GDI(IMediaSample *pSample)
 	return S_OK;
 }
 
+STDMETHODIMP CPushPinDesktop::Notify(IBaseFilter *pSelf, Quality q)
+{
+	// whoever set a sink on the pin gets to handle it
+	if (m_pQSink) {
+		return m_pQSink->Notify(m_pFilter, q);
+	}
+
+	if (!m_qualityControl) {
+		return E_FAIL;
+	}
+
+	// on QPC, not stream time: downstream may call from inside Receive on
+	// our streaming thread while Stop() holds the filter lock
+	if (m_rateControl.Notify(GetCounterNanos() / 100, q.Proportion, q.Late)) {
+		info("downstream %s, proportion %ld, late %.02f ms: capture rate down to %d%%",
+			q.Type == Flood ? "flooded" : "starved", q.Proportion, q.Late / 10000.0, m_rateControl.Rate() / 10);
+	}
+	return S_OK;
+}
+
+// Picks up rate changes from Notify() and steps back up once downstream
+// keeps up again; the hook is told the new frame interval.
+void CPushPinDesktop::UpdateCaptureRate() {
+	m_rateControl.SetFrameLength(m_rtFrameLength);
+
+	REFERENCE_TIME frameLength = m_qualityControl ? m_rateControl.Update(GetCounterNanos() / 100) : m_rtFrameLength;
+	if (frameLength == m_rtCaptureFrameLength) {
+		return;
+	}
+
+	info("capture rate: %.02f fps of %.02f negotiated", (double)UNITS / frameLength, GetFps());
+	m_rtCaptureFrameLength = frameLength;
+	if (game_context) {
+		set_fps(&game_context, m_rtCaptureFrameLength * 100);
+	}
+}
+
+// Shared by the FillBuffer_* variants: waits for the pacer and counts the
+// frame slots it gave up for FillBuffer to number the frame.
+FrameSlot CPushPinDesktop::WaitForNextFrame() {
+	FrameSlot slot = m_pacer.Wait();
+
+	if (slot.skipped) {
+		m_frameInfo.skipped += slot.skipped;
+		debug("pacer skipped %d frame slots %llf %llf", slot.skipped, 0.0001 * slot.now, 0.0001 * m_pacer.Deadline());
+	}
+
+	return slot;
+}
+
 float CPushPinDesktop::GetFps() {
 	return (float)(UNITS / m_rtFrameLength);
 }
@@ -894,9 +1382,11 @@ HRESULT CPushPinDesktop::DecideBufferSize(IMemAllocator *pAlloc,
 	// NB that we are adding in space for a final "pixel array" (http://en.wikipedia.org/wiki/BMP_file_format#DIB_Header_.28Bitmap_Information_Header.29) even though we typically don't need it, this seems to fix the segfaults
 	// maybe somehow down the line some VLC thing thinks it might be there...weirder than weird.. LODO debug it LOL.
 	int bitmapSize = 14 + header.biSize + (long)(bytesPerLine)*(header.biHeight) + bytesPerLine*header.biHeight;
-	pProperties->cbBuffer = header.biHeight * header.biWidth * 3 / 2; // necessary to prevent an "out of memory" error for FMLE. Yikes. Oh wow yikes.
+	pProperties->cbBuffer = GetOutputFrameSize(m_outputFormat, header.biWidth, header.biHeight); // necessary to prevent an "out of memory" error for FMLE. Yikes. Oh wow yikes.
 
-	pProperties->cBuffers = 1; // 2 here doesn't seem to help the crashes...
+	// the crashes more than one buffer was blamed for were samples smaller
+	// than a frame; sized by GetOutputFrameSize they can pipeline
+	pProperties->cBuffers = m_sampleBuffers;
 
 	// Ask the allocator to reserve us some sample memory. NOTE: the function
 	// can succeed (return NOERROR) but still not have allocated the
@@ -914,24 +1404,82 @@ HRESULT CPushPinDesktop::DecideBufferSize(IMemAllocator *pAlloc,
 		return E_FAIL;
 	}
 
-	previousFrame = 0; // reset
+	// fewer buffers than asked for only costs overlap
+	info("sample buffers: %ld of %ld bytes, align %ld", Actual.cBuffers, Actual.cbBuffer, Actual.cbAlign);
+
+	m_pacer.Reset();
 	m_iFrameNumber = 0;
+	m_rtLastSampleStart = MINLONGLONG;
 
 	return NOERROR;
 } // DecideBufferSize
 
 
+HRESULT CPushPinDesktop::DecideAllocator(IMemInputPin *pPin, IMemAllocator **ppAlloc) {
+	CheckPointer(pPin, E_POINTER);
+	CheckPointer(ppAlloc, E_POINTER);
+
+	ALLOCATOR_PROPERTIES prop;
+	ZeroMemory(&prop, sizeof(prop));
+	pPin->GetAllocatorRequirements(&prop);
+	if (prop.cbAlign == 0) {
+		prop.cbAlign = 1;
+	}
+
+	HRESULT hr = S_OK;
+	FramePoolAllocator* pool = new FramePoolAllocator(&hr, m_largePages);
+	pool->AddRef();
+
+	if (SUCCEEDED(hr)) {
+		hr = DecideBufferSize(pool, &prop);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = pPin->NotifyAllocator(pool, FALSE);
+	}
+	if (SUCCEEDED(hr)) {
+		*ppAlloc = pool;
+		return NOERROR;
+	}
+
+	pool->Release();
+	info("frame pool allocator not taken (0x%08x), falling back to the input pin's", hr);
+
+	// the base class tries the input pin's allocator, then a CMemAllocator
+	return CSourceStream::DecideAllocator(pPin, ppAlloc);
+}
+
 HRESULT CPushPinDesktop::OnThreadCreate() {
 	info("CPushPinDesktop OnThreadCreate");
-	previousFrame = 0; // reset <sigh> dunno if this helps FME which sometimes had inconsistencies, or not
+	m_pacer.Reset(); // reset <sigh> dunno if this helps FME which sometimes had inconsistencies, or not
 	m_iFrameNumber = 0;
+	m_rtLastSampleStart = MINLONGLONG;
+	m_rateControl.Reset();
+	m_rtCaptureFrameLength = m_rtFrameLength;
+	m_rtLastDelivery = MINLONGLONG;
+	m_repeatFrames = 0;
+	m_repeatsSkipped = 0;
+	m_captureRestarted = false;
 	threadCreated = true;
+	StartCaptureThread();
 	return S_OK;
 }
 
 HRESULT CPushPinDesktop::OnThreadDestroy() {
 	info("CPushPinDesktop::OnThreadDestroy");
+	StopCaptureThread();
+
+	RateControl::Stats rate = m_rateControl.GetStats();
+	if (rate.notices > 0) {
+		info("quality notices: %llu, %llu under pressure, capture rate cut %llu times, raised %llu times, lowest %d%%",
+			rate.notices, rate.floods, rate.decreases, rate.increases, rate.min_rate / 10);
+	}
+
+	if (m_repeatFrames > 0) {
+		info("repeated frames: %llu, %llu of them not delivered", m_repeatFrames, m_repeatsSkipped);
+	}
+
 	CleanupCapture();
+	ResetFrameStats();
 	return NOERROR;
 };
 
@@ -20,6 +20,37 @@ const int PIN_HEIGHT[PIN_RESOLUTION_SIZE] = { 480, 480, 480,
 					1080, 1080, 1080 };
 const REFERENCE_TIME PIN_FPS[PIN_FPS_SIZE] = { UNITS / 60 };
 
+// 30313050-0000-0010-8000-00AA00389B71, not in the DirectShow headers
+static const GUID MEDIASUBTYPE_P010_BEBO = { MAKEFOURCC('P', '0', '1', '0'), 0x0000, 0x0010,
+	{ 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 } };
+
+struct PinFormat {
+	const GUID* subtype;
+	DWORD compression;
+	WORD bit_count;
+	OutputFormat output;
+};
+
+// I420 stays first so clients that take the first type still get it
+const int PIN_FORMAT_SIZE = 5;
+const PinFormat PIN_FORMAT[PIN_FORMAT_SIZE] = {
+	{ &WMMEDIASUBTYPE_I420, MAKEFOURCC('I', '4', '2', '0'), 12, OUTPUT_I420 },
+	{ &MEDIASUBTYPE_NV12, MAKEFOURCC('N', 'V', '1', '2'), 12, OUTPUT_NV12 },
+	{ &MEDIASUBTYPE_YUY2, MAKEFOURCC('Y', 'U', 'Y', '2'), 16, OUTPUT_YUY2 },
+	{ &MEDIASUBTYPE_UYVY, MAKEFOURCC('U', 'Y', 'V', 'Y'), 16, OUTPUT_UYVY },
+	{ &MEDIASUBTYPE_P010_BEBO, MAKEFOURCC('P', '0', '1', '0'), 24, OUTPUT_P010 },
+};
+const int PIN_TYPES_PER_FORMAT = PIN_RESOLUTION_SIZE * PIN_FPS_SIZE;
+
+static const PinFormat* FindPinFormat(const GUID& subtype) {
+	for (int i = 0; i < PIN_FORMAT_SIZE; i++) {
+		if (*PIN_FORMAT[i].subtype == subtype) {
+			return &PIN_FORMAT[i];
+		}
+	}
+	return NULL;
+}
+
 // logging stuff
 int DisplayRECT(wchar_t *buffer, size_t count, const RECT& rc)
 {
@@ -201,25 +232,23 @@ HRESULT CPushPinDesktop::CheckMediaType(const CMediaType *pMediaType)
 		&& (SubType2 != MEDIASUBTYPE_RGB32)
 		&& (SubType2 != GUID_NULL)) {
 
-		if (SubType2 == WMMEDIASUBTYPE_I420) { // 30323449-0000-0010-8000-00AA00389B71 MEDIASUBTYPE_I420 == WMMEDIASUBTYPE_I420
-			if (pvi->bmiHeader.biBitCount == 12) { // biCompression 808596553 == 0x30323449
-												   // 12 is correct for i420 -- WFMLE uses this, VLC *can* also use it, too
-			}
-			else {
+		// 30323449-0000-0010-8000-00AA00389B71 MEDIASUBTYPE_I420 == WMMEDIASUBTYPE_I420 -- WFMLE uses this, VLC *can* also use it, too
+		// 3231564E-0000-0010-8000-00AA00389B71 MEDIASUBTYPE_NV12
+		// 32595559-0000-0010-8000-00AA00389B71 MEDIASUBTYPE_YUY2 -- Chrome always asks for YUY2 and UYVY
+		// 59565955-0000-0010-8000-00AA00389B71 MEDIASUBTYPE_UYVY
+		// 30313050-0000-0010-8000-00AA00389B71 P010 -- 10 bit encoders
+		const PinFormat* format = FindPinFormat(SubType2);
+		if (format) {
+			if (pvi->bmiHeader.biBitCount != format->bit_count) {
 				warn("CheckMediaType - E_INVALIDARG invalid bit count: %d", pvi->bmiHeader.biBitCount);
 				return E_INVALIDARG;
 			}
 		}
 		else {
-			if (SubType2 != MEDIASUBTYPE_YUY2 && SubType2 != MEDIASUBTYPE_UYVY) {
-				OLECHAR* bstrGuid;
-				StringFromCLSID(SubType2, &bstrGuid);
-				// note: Chrome always asks for YUV2 and UYVY, we only support I420
-				// 32595559-0000-0010-8000-00AA00389B71  MEDIASUBTYPE_YUY2, which is apparently "identical format" to I420
-				// 59565955-0000-0010-8000-00AA00389B71  MEDIASUBTYPE_UYVY
-				warn("CheckMediaType - E_INVALIDARG - Invalid SubType2: %S", bstrGuid);
-				::CoTaskMemFree(bstrGuid);
-			}
+			OLECHAR* bstrGuid;
+			StringFromCLSID(SubType2, &bstrGuid);
+			warn("CheckMediaType - E_INVALIDARG - Invalid SubType2: %S", bstrGuid);
+			::CoTaskMemFree(bstrGuid);
 			// sometimes FLME asks for YV12 {32315659-0000-0010-8000-00AA00389B71}, or  
 			// 43594448-0000-0010-8000-00AA00389B71  MEDIASUBTYPE_HDYC
 			// 56555949-0000-0010-8000-00AA00389B71  MEDIASUBTYPE_IYUV # dunno if I actually get this one
@@ -314,6 +343,12 @@ HRESULT CPushPinDesktop::SetMediaType(const CMediaType *pMediaType)
 		break;
 	}
 
+	if (hr == S_OK) {
+		// the RGB types never got anything but I420 samples, keep it that way
+		const PinFormat* format = FindPinFormat(*m_mt.Subtype());
+		m_outputFormat = format ? format->output : OUTPUT_I420;
+	}
+
 	// The frame rate at which your filter should produce data is determined by the AvgTimePerFrame field of VIDEOINFOHEADER
 #if 0
 	(if (pvi->AvgTimePerFrame) { // or should Set Format accept this? hmm...
@@ -424,7 +459,7 @@ HRESULT STDMETHODCALLTYPE CPushPinDesktop::GetFormat(AM_MEDIA_TYPE **ppmt)
 
 HRESULT STDMETHODCALLTYPE CPushPinDesktop::GetNumberOfCapabilities(int *piCount, int *piSize)
 {
-	*piCount = PIN_RESOLUTION_SIZE * PIN_FPS_SIZE;
+	*piCount = PIN_FORMAT_SIZE * PIN_TYPES_PER_FORMAT;
 	*piSize = sizeof(VIDEO_STREAM_CONFIG_CAPS); // VIDEO_STREAM_CONFIG_CAPS is an MS struct
 	info("GetNumberOfCapabilities - %d size:%d", *piCount, *piSize);
 	return S_OK;
@@ -458,9 +493,10 @@ HRESULT STDMETHODCALLTYPE CPushPinDesktop::GetStreamCaps(int iIndex, AM_MEDIA_TY
 	most of these are listed as deprecated by msdn... yet some still used, apparently. odd.
 	*/
 
-	int width = PIN_WIDTH[iIndex % PIN_RESOLUTION_SIZE];
-	int height = PIN_HEIGHT[iIndex % PIN_RESOLUTION_SIZE];
-	REFERENCE_TIME fps = PIN_FPS[iIndex / PIN_RESOLUTION_SIZE];
+	int type = iIndex % PIN_TYPES_PER_FORMAT;
+	int width = PIN_WIDTH[type % PIN_RESOLUTION_SIZE];
+	int height = PIN_HEIGHT[type % PIN_RESOLUTION_SIZE];
+	REFERENCE_TIME fps = PIN_FPS[type / PIN_RESOLUTION_SIZE];
 	int fps_n = (int)fps / UNITS;
 
 	pvscc->VideoStandard = AnalogVideo_None;
@@ -679,7 +715,7 @@ HRESULT CPushPinDesktop::GetMediaType(int iPosition, CMediaType *pmt) // AM_MEDI
 	}
 
 	// Have we run out of types?
-	if (iPosition > PIN_RESOLUTION_SIZE * PIN_FPS_SIZE) {
+	if (iPosition >= PIN_FORMAT_SIZE * PIN_TYPES_PER_FORMAT) {
 		warn("GetMediaType - VFW_S_NO_MORE_ITEMS p:%d", iPosition);
 		return VFW_S_NO_MORE_ITEMS;
 	}
@@ -693,18 +729,21 @@ HRESULT CPushPinDesktop::GetMediaType(int iPosition, CMediaType *pmt) // AM_MEDI
 	// Initialize the VideoInfo structure before configuring its members
 	ZeroMemory(pvi, sizeof(VIDEOINFO));
 
-	int width = PIN_WIDTH[iPosition % PIN_RESOLUTION_SIZE];
-	int height = PIN_HEIGHT[iPosition % PIN_RESOLUTION_SIZE];
-	REFERENCE_TIME fps = PIN_FPS[iPosition / PIN_RESOLUTION_SIZE];
+	// every resolution / fps for I420 first, then the same again per format
+	const PinFormat* format = &PIN_FORMAT[iPosition / PIN_TYPES_PER_FORMAT];
+	int type = iPosition % PIN_TYPES_PER_FORMAT;
+	int width = PIN_WIDTH[type % PIN_RESOLUTION_SIZE];
+	int height = PIN_HEIGHT[type % PIN_RESOLUTION_SIZE];
+	REFERENCE_TIME fps = PIN_FPS[type / PIN_RESOLUTION_SIZE];
 	LONGLONG fps_n = fps / UNITS;
 
 	// the i420 freak-o added just for FME's benefit...
 	//pvi->bmiHeader.biCompression = 0x30323449; // => ASCII "I420" is apparently right here...
-	pvi->bmiHeader.biCompression = MAKEFOURCC('I', '4', '2', '0');
-	pvi->bmiHeader.biBitCount = 12;
+	pvi->bmiHeader.biCompression = format->compression;
+	pvi->bmiHeader.biBitCount = format->bit_count;
 	// pvi->bmiHeader.biSizeImage = (getCaptureDesiredFinalWidth()*getCaptureDesiredFinalHeight() * 3) / 2;
-	pvi->bmiHeader.biSizeImage = (width * height * 3) / 2;
-	pmt->SetSubtype(&WMMEDIASUBTYPE_I420);
+	pvi->bmiHeader.biSizeImage = GetOutputFrameSize(format->output, width, height);
+	pmt->SetSubtype(format->subtype);
 
 	// Now adjust some parameters that are the same for all formats
 	pvi->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
@@ -715,7 +754,7 @@ HRESULT CPushPinDesktop::GetMediaType(int iPosition, CMediaType *pmt) // AM_MEDI
 	pvi->bmiHeader.biClrImportant = 0;
 	pmt->SetSampleSize(pvi->bmiHeader.biSizeImage); // use the above size
 
-	pvi->AvgTimePerFrame = PIN_FPS[iPosition / PIN_RESOLUTION_SIZE];
+	pvi->AvgTimePerFrame = fps;
 
 	SetRectEmpty(&(pvi->rcSource)); // we want the whole image area rendered.
 	SetRectEmpty(&(pvi->rcTarget)); // no particular destination rectangle
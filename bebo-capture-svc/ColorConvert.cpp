@@ -0,0 +1,1925 @@
+#include "ColorConvert.h"
+#include <algorithm>
+#include <immintrin.h>
+#include <string.h>
+#include <vector>
+#include "libyuv/convert.h"
+#include "libyuv/convert_from.h"
+#include "libyuv/convert_from_argb.h"
+#include "libyuv/cpu_id.h"
+#include "libyuv/planar_functions.h"
+#include "libyuv/scale.h"
+#include "libyuv/scale_argb.h"
+
+// The AVX2 rows are only picked when the cpu has it, see TestCpuFlag. MSVC
+// takes AVX2 intrinsics anywhere, gcc and clang only in functions built for
+// it.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+ColorSpace GetColorSpace(int matrix, bool full_range) {
+	if (matrix == 709) {
+		return full_range ? COLOR_BT709_FULL : COLOR_BT709_LIMITED;
+	}
+	return full_range ? COLOR_BT601_FULL : COLOR_BT601_LIMITED;
+}
+
+// RGB -> YUV coefficients, 8 bit fixed point. Limited range puts Y in
+// 16..235 and U/V in 16..240 (BT.601 is libyuv's ARGBToI420), full range
+// uses all of 0..255 (BT.601 is libyuv's JPEG ARGBToJ420). Each row of
+// coefficients sums to the Y scale and U/V rows sum to 0, so grey stays
+// exactly grey.
+template <ColorSpace CS> struct YUVCoefs;
+
+template <> struct YUVCoefs<COLOR_BT601_LIMITED> {
+	enum { YR = 66, YG = 129, YB = 25, Y_OFFSET = 16,
+		UR = -38, UG = -74, UB = 112,
+		VR = 112, VG = -94, VB = -18 };
+};
+
+template <> struct YUVCoefs<COLOR_BT709_LIMITED> {
+	enum { YR = 47, YG = 157, YB = 16, Y_OFFSET = 16,
+		UR = -26, UG = -86, UB = 112,
+		VR = 112, VG = -102, VB = -10 };
+};
+
+template <> struct YUVCoefs<COLOR_BT601_FULL> {
+	enum { YR = 77, YG = 150, YB = 29, Y_OFFSET = 0,
+		UR = -43, UG = -84, UB = 127,
+		VR = 127, VG = -107, VB = -20 };
+};
+
+template <> struct YUVCoefs<COLOR_BT709_FULL> {
+	enum { YR = 54, YG = 183, YB = 19, Y_OFFSET = 0,
+		UR = -29, UG = -98, UB = 127,
+		VR = 127, VG = -115, VB = -12 };
+};
+
+// color conversion
+template <ColorSpace CS>
+static __inline int RGBToY(int r, int g, int b) {
+	typedef YUVCoefs<CS> C;
+	return (C::YR * r + C::YG * g + C::YB * b + (C::Y_OFFSET << 8) + 0x80) >> 8;
+}
+
+template <ColorSpace CS>
+static __inline int RGBToU(int r, int g, int b) {
+	typedef YUVCoefs<CS> C;
+	return (C::UR * r + C::UG * g + C::UB * b + 0x8080) >> 8;
+}
+
+template <ColorSpace CS>
+static __inline int RGBToV(int r, int g, int b) {
+	typedef YUVCoefs<CS> C;
+	return (C::VR * r + C::VG * g + C::VB * b + 0x8080) >> 8;
+}
+
+// The SIMD rows keep the C rows' integer math exactly: Y fits unsigned 16
+// bit (max 0xFF80) and U/V are done in wrapping 16 bit arithmetic, which
+// only the final >> 8 looks at.
+template <ColorSpace CS>
+static __inline __m128i RGBToY_SSE2(__m128i r, __m128i g, __m128i b) {
+	typedef YUVCoefs<CS> C;
+	__m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(C::YR)),
+		_mm_mullo_epi16(g, _mm_set1_epi16(C::YG)));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(C::YB)));
+	y = _mm_add_epi16(y, _mm_set1_epi16((C::Y_OFFSET << 8) + 0x80));
+	return _mm_srli_epi16(y, 8);
+}
+
+template <ColorSpace CS>
+static __inline __m128i RGBToU_SSE2(__m128i r, __m128i g, __m128i b) {
+	typedef YUVCoefs<CS> C;
+	__m128i u = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(C::UR)),
+		_mm_mullo_epi16(g, _mm_set1_epi16(C::UG)));
+	u = _mm_add_epi16(u, _mm_mullo_epi16(b, _mm_set1_epi16(C::UB)));
+	u = _mm_add_epi16(u, _mm_set1_epi16((short) 0x8080));
+	return _mm_srli_epi16(u, 8);
+}
+
+template <ColorSpace CS>
+static __inline __m128i RGBToV_SSE2(__m128i r, __m128i g, __m128i b) {
+	typedef YUVCoefs<CS> C;
+	__m128i v = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(C::VR)),
+		_mm_mullo_epi16(g, _mm_set1_epi16(C::VG)));
+	v = _mm_add_epi16(v, _mm_mullo_epi16(b, _mm_set1_epi16(C::VB)));
+	v = _mm_add_epi16(v, _mm_set1_epi16((short) 0x8080));
+	return _mm_srli_epi16(v, 8);
+}
+
+template <ColorSpace CS>
+TARGET_AVX2 static __inline __m256i RGBToY_AVX2(__m256i r, __m256i g, __m256i b) {
+	typedef YUVCoefs<CS> C;
+	__m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(C::YR)),
+		_mm256_mullo_epi16(g, _mm256_set1_epi16(C::YG)));
+	y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(C::YB)));
+	y = _mm256_add_epi16(y, _mm256_set1_epi16((C::Y_OFFSET << 8) + 0x80));
+	return _mm256_srli_epi16(y, 8);
+}
+
+template <ColorSpace CS>
+TARGET_AVX2 static __inline __m256i RGBToU_AVX2(__m256i r, __m256i g, __m256i b) {
+	typedef YUVCoefs<CS> C;
+	__m256i u = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(C::UR)),
+		_mm256_mullo_epi16(g, _mm256_set1_epi16(C::UG)));
+	u = _mm256_add_epi16(u, _mm256_mullo_epi16(b, _mm256_set1_epi16(C::UB)));
+	u = _mm256_add_epi16(u, _mm256_set1_epi16((short) 0x8080));
+	return _mm256_srli_epi16(u, 8);
+}
+
+template <ColorSpace CS>
+TARGET_AVX2 static __inline __m256i RGBToV_AVX2(__m256i r, __m256i g, __m256i b) {
+	typedef YUVCoefs<CS> C;
+	__m256i v = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(C::VR)),
+		_mm256_mullo_epi16(g, _mm256_set1_epi16(C::VG)));
+	v = _mm256_add_epi16(v, _mm256_mullo_epi16(b, _mm256_set1_epi16(C::VB)));
+	v = _mm256_add_epi16(v, _mm256_set1_epi16((short) 0x8080));
+	return _mm256_srli_epi16(v, 8);
+}
+
+// Source pixel formats of the 8 bit converters. Unpack_C gives one pixel's
+// 8 bit r, g, b; Unpack8_SSE2 and Unpack16_AVX2 give 8 and 16 pixels as
+// 16 bit lanes, in pixel order.
+
+// 32 bit pixels, each channel the 8 bits at its shift.
+template <int RShift, int GShift, int BShift>
+struct Packed32Source {
+	enum { kBpp = 4 };
+
+	static __inline void Unpack_C(const uint8_t* src, int* r, int* g, int* b) {
+		uint32_t p = src[0] | src[1] << 8 | src[2] << 16 | (uint32_t) src[3] << 24;
+		*r = (p >> RShift) & 0xFF;
+		*g = (p >> GShift) & 0xFF;
+		*b = (p >> BShift) & 0xFF;
+	}
+
+	static __inline void Unpack8_SSE2(const uint8_t* src, __m128i* r, __m128i* g, __m128i* b) {
+		const __m128i mask = _mm_set1_epi32(0xFF);
+		__m128i p0 = _mm_loadu_si128((const __m128i*) src);
+		__m128i p1 = _mm_loadu_si128((const __m128i*) (src + 16));
+		*r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, RShift), mask),
+			_mm_and_si128(_mm_srli_epi32(p1, RShift), mask));
+		*g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, GShift), mask),
+			_mm_and_si128(_mm_srli_epi32(p1, GShift), mask));
+		*b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, BShift), mask),
+			_mm_and_si128(_mm_srli_epi32(p1, BShift), mask));
+	}
+
+	// Packing works per 128 bit lane, the permute puts the pixels back in
+	// order.
+	TARGET_AVX2 static __inline void Unpack16_AVX2(const uint8_t* src, __m256i* r, __m256i* g, __m256i* b) {
+		const __m256i mask = _mm256_set1_epi32(0xFF);
+		__m256i p0 = _mm256_loadu_si256((const __m256i*) src);
+		__m256i p1 = _mm256_loadu_si256((const __m256i*) (src + 32));
+		*r = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+			_mm256_and_si256(_mm256_srli_epi32(p0, RShift), mask),
+			_mm256_and_si256(_mm256_srli_epi32(p1, RShift), mask)), 0xD8);
+		*g = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+			_mm256_and_si256(_mm256_srli_epi32(p0, GShift), mask),
+			_mm256_and_si256(_mm256_srli_epi32(p1, GShift), mask)), 0xD8);
+		*b = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+			_mm256_and_si256(_mm256_srli_epi32(p0, BShift), mask),
+			_mm256_and_si256(_mm256_srli_epi32(p1, BShift), mask)), 0xD8);
+	}
+};
+
+typedef Packed32Source<16, 8, 0> ARGBSource;      // B, G, R, A in memory
+typedef Packed32Source<0, 8, 16> ABGRSource;      // R, G, B, A in memory
+typedef Packed32Source<2, 12, 22> ABGR10Source;   // top 8 of each 10 bit channel
+
+// 5 and 6 bit channels are widened by repeating their top bits, the same
+// expansion libyuv's RGB565ToARGB / ARGB1555ToARGB use. Alpha is ignored.
+static __inline int Expand5(int c) {
+	return (c << 3) | (c >> 2);
+}
+
+static __inline int Expand6(int c) {
+	return (c << 2) | (c >> 4);
+}
+
+struct B5G6R5Source {
+	enum { kBpp = 2 };
+
+	static __inline void Unpack_C(const uint8_t* src, int* r, int* g, int* b) {
+		int p = src[0] | src[1] << 8;
+		*b = Expand5(p & 0x1F);
+		*g = Expand6((p >> 5) & 0x3F);
+		*r = Expand5(p >> 11);
+	}
+
+	static __inline void Unpack8_SSE2(const uint8_t* src, __m128i* r, __m128i* g, __m128i* b) {
+		__m128i p = _mm_loadu_si128((const __m128i*) src);
+		__m128i b5 = _mm_and_si128(p, _mm_set1_epi16(0x1F));
+		__m128i g6 = _mm_and_si128(_mm_srli_epi16(p, 5), _mm_set1_epi16(0x3F));
+		__m128i r5 = _mm_srli_epi16(p, 11);
+		*b = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
+		*g = _mm_or_si128(_mm_slli_epi16(g6, 2), _mm_srli_epi16(g6, 4));
+		*r = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+	}
+
+	TARGET_AVX2 static __inline void Unpack16_AVX2(const uint8_t* src, __m256i* r, __m256i* g, __m256i* b) {
+		__m256i p = _mm256_loadu_si256((const __m256i*) src);
+		__m256i b5 = _mm256_and_si256(p, _mm256_set1_epi16(0x1F));
+		__m256i g6 = _mm256_and_si256(_mm256_srli_epi16(p, 5), _mm256_set1_epi16(0x3F));
+		__m256i r5 = _mm256_srli_epi16(p, 11);
+		*b = _mm256_or_si256(_mm256_slli_epi16(b5, 3), _mm256_srli_epi16(b5, 2));
+		*g = _mm256_or_si256(_mm256_slli_epi16(g6, 2), _mm256_srli_epi16(g6, 4));
+		*r = _mm256_or_si256(_mm256_slli_epi16(r5, 3), _mm256_srli_epi16(r5, 2));
+	}
+};
+
+struct B5G5R5A1Source {
+	enum { kBpp = 2 };
+
+	static __inline void Unpack_C(const uint8_t* src, int* r, int* g, int* b) {
+		int p = src[0] | src[1] << 8;
+		*b = Expand5(p & 0x1F);
+		*g = Expand5((p >> 5) & 0x1F);
+		*r = Expand5((p >> 10) & 0x1F);
+	}
+
+	static __inline void Unpack8_SSE2(const uint8_t* src, __m128i* r, __m128i* g, __m128i* b) {
+		const __m128i mask = _mm_set1_epi16(0x1F);
+		__m128i p = _mm_loadu_si128((const __m128i*) src);
+		__m128i b5 = _mm_and_si128(p, mask);
+		__m128i g5 = _mm_and_si128(_mm_srli_epi16(p, 5), mask);
+		__m128i r5 = _mm_and_si128(_mm_srli_epi16(p, 10), mask);
+		*b = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
+		*g = _mm_or_si128(_mm_slli_epi16(g5, 3), _mm_srli_epi16(g5, 2));
+		*r = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+	}
+
+	TARGET_AVX2 static __inline void Unpack16_AVX2(const uint8_t* src, __m256i* r, __m256i* g, __m256i* b) {
+		const __m256i mask = _mm256_set1_epi16(0x1F);
+		__m256i p = _mm256_loadu_si256((const __m256i*) src);
+		__m256i b5 = _mm256_and_si256(p, mask);
+		__m256i g5 = _mm256_and_si256(_mm256_srli_epi16(p, 5), mask);
+		__m256i r5 = _mm256_and_si256(_mm256_srli_epi16(p, 10), mask);
+		*b = _mm256_or_si256(_mm256_slli_epi16(b5, 3), _mm256_srli_epi16(b5, 2));
+		*g = _mm256_or_si256(_mm256_slli_epi16(g5, 3), _mm256_srli_epi16(g5, 2));
+		*r = _mm256_or_si256(_mm256_slli_epi16(r5, 3), _mm256_srli_epi16(r5, 2));
+	}
+};
+
+typedef void(*ToYRowFn)(const uint8_t* src, uint8_t* dst_y, int width);
+typedef void(*ToUVRowFn)(const uint8_t* src0, int src_stride,
+	uint8_t* dst_u, uint8_t* dst_v, int width);
+
+template <class Src, ColorSpace CS>
+static void ToYRow_C(const uint8_t* src, uint8_t* dst_y, int width) {
+	int r, g, b;
+	for (int x = 0; x < width; ++x) {
+		Src::Unpack_C(src, &r, &g, &b);
+		dst_y[x] = (uint8_t) RGBToY<CS>(r, g, b);
+		src += Src::kBpp;
+	}
+}
+
+// 2x2 box average per U/V sample, an odd last column averages 2 pixels.
+template <class Src, ColorSpace CS>
+static void ToUVRow_C(const uint8_t* src0, int src_stride,
+	uint8_t* dst_u, uint8_t* dst_v, int width) {
+	const uint8_t* src1 = src0 + src_stride;
+	int r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+	int x;
+	for (x = 0; x < width - 1; x += 2) {
+		Src::Unpack_C(src0, &r0, &g0, &b0);
+		Src::Unpack_C(src0 + Src::kBpp, &r1, &g1, &b1);
+		Src::Unpack_C(src1, &r2, &g2, &b2);
+		Src::Unpack_C(src1 + Src::kBpp, &r3, &g3, &b3);
+		int ab = (b0 + b1 + b2 + b3) >> 2;
+		int ag = (g0 + g1 + g2 + g3) >> 2;
+		int ar = (r0 + r1 + r2 + r3) >> 2;
+		*dst_u++ = (uint8_t) RGBToU<CS>(ar, ag, ab);
+		*dst_v++ = (uint8_t) RGBToV<CS>(ar, ag, ab);
+		src0 += 2 * Src::kBpp;
+		src1 += 2 * Src::kBpp;
+	}
+	if (width & 1) {
+		Src::Unpack_C(src0, &r0, &g0, &b0);
+		Src::Unpack_C(src1, &r2, &g2, &b2);
+		int ab = (b0 + b2) >> 1;
+		int ag = (g0 + g2) >> 1;
+		int ar = (r0 + r2) >> 1;
+		dst_u[0] = (uint8_t) RGBToU<CS>(ar, ag, ab);
+		dst_v[0] = (uint8_t) RGBToV<CS>(ar, ag, ab);
+	}
+}
+
+// Sum of each horizontal pair of two 8 lane column sums, SSE2 has no hadd.
+static __inline __m128i PairSum_SSE2(__m128i lo, __m128i hi) {
+	const __m128i ones = _mm_set1_epi16(1);
+	return _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+}
+
+// Y and UV rows straight from the source pixels, 16 per iteration; the
+// unpacked channels never leave registers.
+template <class Src, ColorSpace CS>
+static void ToYRow_SSE2(const uint8_t* src, uint8_t* dst_y, int width) {
+	__m128i r, g, b;
+	for (int x = 0; x < width; x += 16) {
+		Src::Unpack8_SSE2(src, &r, &g, &b);
+		__m128i y0 = RGBToY_SSE2<CS>(r, g, b);
+		Src::Unpack8_SSE2(src + 8 * Src::kBpp, &r, &g, &b);
+		__m128i y1 = RGBToY_SSE2<CS>(r, g, b);
+		_mm_storeu_si128((__m128i*) dst_y, _mm_packus_epi16(y0, y1));
+		src += 16 * Src::kBpp;
+		dst_y += 16;
+	}
+}
+
+template <class Src, ColorSpace CS>
+static void ToUVRow_SSE2(const uint8_t* src0, int src_stride,
+	uint8_t* dst_u, uint8_t* dst_v, int width) {
+	const uint8_t* src1 = src0 + src_stride;
+	__m128i r0, g0, b0, r1, g1, b1;
+	for (int x = 0; x < width; x += 16) {
+		// column sums of 2 rows, 8 pixels at a time, then horizontal pairs
+		Src::Unpack8_SSE2(src0, &r0, &g0, &b0);
+		Src::Unpack8_SSE2(src1, &r1, &g1, &b1);
+		__m128i rl = _mm_add_epi16(r0, r1);
+		__m128i gl = _mm_add_epi16(g0, g1);
+		__m128i bl = _mm_add_epi16(b0, b1);
+		Src::Unpack8_SSE2(src0 + 8 * Src::kBpp, &r0, &g0, &b0);
+		Src::Unpack8_SSE2(src1 + 8 * Src::kBpp, &r1, &g1, &b1);
+		__m128i ar = _mm_srli_epi16(PairSum_SSE2(rl, _mm_add_epi16(r0, r1)), 2);
+		__m128i ag = _mm_srli_epi16(PairSum_SSE2(gl, _mm_add_epi16(g0, g1)), 2);
+		__m128i ab = _mm_srli_epi16(PairSum_SSE2(bl, _mm_add_epi16(b0, b1)), 2);
+		__m128i u = RGBToU_SSE2<CS>(ar, ag, ab);
+		__m128i v = RGBToV_SSE2<CS>(ar, ag, ab);
+		_mm_storel_epi64((__m128i*) dst_u, _mm_packus_epi16(u, u));
+		_mm_storel_epi64((__m128i*) dst_v, _mm_packus_epi16(v, v));
+		src0 += 16 * Src::kBpp;
+		src1 += 16 * Src::kBpp;
+		dst_u += 8;
+		dst_v += 8;
+	}
+}
+
+template <class Src, ColorSpace CS>
+TARGET_AVX2 static void ToYRow_AVX2(const uint8_t* src, uint8_t* dst_y, int width) {
+	__m256i r, g, b;
+	for (int x = 0; x < width; x += 16) {
+		Src::Unpack16_AVX2(src, &r, &g, &b);
+		__m256i y = RGBToY_AVX2<CS>(r, g, b);
+		_mm_storeu_si128((__m128i*) dst_y, _mm_packus_epi16(
+			_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1)));
+		src += 16 * Src::kBpp;
+		dst_y += 16;
+	}
+	_mm256_zeroupper();
+}
+
+template <class Src, ColorSpace CS>
+TARGET_AVX2 static void ToUVRow_AVX2(const uint8_t* src0, int src_stride,
+	uint8_t* dst_u, uint8_t* dst_v, int width) {
+	const uint8_t* src1 = src0 + src_stride;
+	__m256i r0, g0, b0, r1, g1, b1;
+	for (int x = 0; x < width; x += 16) {
+		Src::Unpack16_AVX2(src0, &r0, &g0, &b0);
+		Src::Unpack16_AVX2(src1, &r1, &g1, &b1);
+		// hadd pairs within each 128 bit lane, so lane 0 holds pixels 0-7
+		// and lane 1 pixels 8-15, each duplicated
+		__m256i rs = _mm256_add_epi16(r0, r1);
+		__m256i gs = _mm256_add_epi16(g0, g1);
+		__m256i bs = _mm256_add_epi16(b0, b1);
+		__m256i ar = _mm256_srli_epi16(_mm256_hadd_epi16(rs, rs), 2);
+		__m256i ag = _mm256_srli_epi16(_mm256_hadd_epi16(gs, gs), 2);
+		__m256i ab = _mm256_srli_epi16(_mm256_hadd_epi16(bs, bs), 2);
+
+		__m256i u = _mm256_permute4x64_epi64(RGBToU_AVX2<CS>(ar, ag, ab), 0x08);
+		__m256i v = _mm256_permute4x64_epi64(RGBToV_AVX2<CS>(ar, ag, ab), 0x08);
+		__m128i u8 = _mm256_castsi256_si128(u);
+		__m128i v8 = _mm256_castsi256_si128(v);
+		_mm_storel_epi64((__m128i*) dst_u, _mm_packus_epi16(u8, u8));
+		_mm_storel_epi64((__m128i*) dst_v, _mm_packus_epi16(v8, v8));
+		src0 += 16 * Src::kBpp;
+		src1 += 16 * Src::kBpp;
+		dst_u += 8;
+		dst_v += 8;
+	}
+	_mm256_zeroupper();
+}
+
+// SIMD rows on the multiple of 16 pixels, the C row on the rest.
+template <class Src, ColorSpace CS, ToYRowFn SimdRow>
+static void ToYRow_Any(const uint8_t* src, uint8_t* dst_y, int width) {
+	int n = width & ~15;
+	if (n > 0) {
+		SimdRow(src, dst_y, n);
+	}
+	ToYRow_C<Src, CS>(src + n * Src::kBpp, dst_y + n, width - n);
+}
+
+template <class Src, ColorSpace CS, ToUVRowFn SimdRow>
+static void ToUVRow_Any(const uint8_t* src0, int src_stride,
+	uint8_t* dst_u, uint8_t* dst_v, int width) {
+	int n = width & ~15;
+	if (n > 0) {
+		SimdRow(src0, src_stride, dst_u, dst_v, n);
+	}
+	ToUVRow_C<Src, CS>(src0 + n * Src::kBpp, src_stride,
+		dst_u + n / 2, dst_v + n / 2, width - n);
+}
+
+struct i420_rows {
+	ToYRowFn  y_row;
+	ToUVRowFn uv_row;
+};
+
+template <class Src, ColorSpace CS>
+static i420_rows select_i420_rows() {
+	i420_rows rows = { ToYRow_C<Src, CS>, ToUVRow_C<Src, CS> };
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasSSE2)) {
+		rows.y_row = ToYRow_Any<Src, CS, ToYRow_SSE2<Src, CS> >;
+		rows.uv_row = ToUVRow_Any<Src, CS, ToUVRow_SSE2<Src, CS> >;
+	}
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasAVX2)) {
+		rows.y_row = ToYRow_Any<Src, CS, ToYRow_AVX2<Src, CS> >;
+		rows.uv_row = ToUVRow_Any<Src, CS, ToUVRow_AVX2<Src, CS> >;
+	}
+	return rows;
+}
+
+// cpuid once per source format and color space, when the dll is loaded
+template <class Src, ColorSpace CS>
+struct I420Rows {
+	static const i420_rows rows;
+};
+
+template <class Src, ColorSpace CS>
+const i420_rows I420Rows<Src, CS>::rows = select_i420_rows<Src, CS>();
+
+static int RowsToI420(const i420_rows* rows,
+	const uint8_t* src_argb,
+	int src_stride_argb,
+	uint8_t* dst_y,
+	int dst_stride_y,
+	uint8_t* dst_u,
+	int dst_stride_u,
+	uint8_t* dst_v,
+	int dst_stride_v,
+	int width,
+	int height) {
+	int y;
+	ToUVRowFn ARGBToUVRow = rows->uv_row;
+	ToYRowFn ARGBToYRow = rows->y_row;
+
+	if (!src_argb || !dst_y || !dst_u || !dst_v || width <= 0 || height == 0) {
+		return -1;
+	}
+
+	// Negative height means invert the image.
+	if (height < 0) {
+		height = -height;
+		src_argb = src_argb + (height - 1) * src_stride_argb;
+		src_stride_argb = -src_stride_argb;
+	}
+
+	for (y = 0; y < height - 1; y += 2) {
+		ARGBToUVRow(src_argb, src_stride_argb, dst_u, dst_v, width);
+		ARGBToYRow(src_argb, dst_y, width);
+		ARGBToYRow(src_argb + src_stride_argb, dst_y + dst_stride_y, width);
+		src_argb += src_stride_argb * 2;
+		dst_y += dst_stride_y * 2;
+		dst_u += dst_stride_u;
+		dst_v += dst_stride_v;
+	}
+
+	if (height & 1) {
+		ARGBToUVRow(src_argb, 0, dst_u, dst_v, width);
+		ARGBToYRow(src_argb, dst_y, width);
+	}
+	return 0;
+}
+
+template <ColorSpace CS>
+int ARGBToI420Matrix(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return RowsToI420(&I420Rows<ARGBSource, CS>::rows, src_argb, src_stride_argb, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+template <ColorSpace CS>
+int ABGRToI420Matrix(const uint8_t* src_abgr, int src_stride_abgr, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return RowsToI420(&I420Rows<ABGRSource, CS>::rows, src_abgr, src_stride_abgr, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+// libyuv's own rows for the default color space.
+template <>
+int ARGBToI420Matrix<COLOR_BT601_LIMITED>(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return libyuv::ARGBToI420(src_argb, src_stride_argb, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+template <>
+int ABGRToI420Matrix<COLOR_BT601_LIMITED>(const uint8_t* src_abgr, int src_stride_abgr, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return libyuv::ABGRToI420(src_abgr, src_stride_abgr, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+template <ColorSpace CS>
+int ABGR10ToI420(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return RowsToI420(&I420Rows<ABGR10Source, CS>::rows, src_argb, src_stride_argb, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+template <ColorSpace CS>
+int B5G6R5ToI420(const uint8_t* src_rgb, int src_stride_rgb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return RowsToI420(&I420Rows<B5G6R5Source, CS>::rows, src_rgb, src_stride_rgb, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+template <ColorSpace CS>
+int B5G5R5A1ToI420(const uint8_t* src_rgb, int src_stride_rgb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	return RowsToI420(&I420Rows<B5G5R5A1Source, CS>::rows, src_rgb, src_stride_rgb, dst_y, dst_stride_y,
+		dst_u, dst_stride_u, dst_v, dst_stride_v, width, height);
+}
+
+// ARGB to I422 (full vertical chroma resolution) for the packed 4:2:2
+// layouts: the UV row with a 0 stride averages each row with itself.
+template <ColorSpace CS>
+static int ARGBToI422Matrix(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height) {
+	const i420_rows* rows = &I420Rows<ARGBSource, CS>::rows;
+	int y;
+
+	for (y = 0; y < height; ++y) {
+		rows->uv_row(src_argb, 0, dst_u, dst_v, width);
+		rows->y_row(src_argb, dst_y, width);
+		src_argb += src_stride_argb;
+		dst_y += dst_stride_y;
+		dst_u += dst_stride_u;
+		dst_v += dst_stride_v;
+	}
+	return 0;
+}
+
+// 10 bit studio / full range, the 8 bit formulas with the offsets scaled:
+// limited range Y 64..940, U/V 512 +- 448. Results go out MSB aligned for
+// P010.
+template <ColorSpace CS>
+static __inline int RGB10ToY(int r, int g, int b) {
+	typedef YUVCoefs<CS> C;
+	return (C::YR * r + C::YG * g + C::YB * b + (C::Y_OFFSET << 10) + 0x80) >> 8;
+}
+
+template <ColorSpace CS>
+static __inline int RGB10ToU(int r, int g, int b) {
+	typedef YUVCoefs<CS> C;
+	return (C::UR * r + C::UG * g + C::UB * b + 0x20080) >> 8;
+}
+
+template <ColorSpace CS>
+static __inline int RGB10ToV(int r, int g, int b) {
+	typedef YUVCoefs<CS> C;
+	return (C::VR * r + C::VG * g + C::VB * b + 0x20080) >> 8;
+}
+
+static __inline void StoreP010(uint8_t* dst, int value) {
+	value <<= 6;
+	dst[0] = (uint8_t) value;
+	dst[1] = (uint8_t) (value >> 8);
+}
+
+// Source pixel formats of the P010 converters: 10 bit r, g, b, the SIMD
+// unpacks one pixel per 32 bit lane.
+struct ABGR10WideSource {
+	static __inline void Unpack_C(const uint8_t* src, int* r, int* g, int* b) {
+		uint32_t p = src[0] | src[1] << 8 | src[2] << 16 | (uint32_t) src[3] << 24;
+		*r = p & 0x3FF;
+		*g = (p >> 10) & 0x3FF;
+		*b = (p >> 20) & 0x3FF;
+	}
+
+	static __inline void Unpack4_SSE2(const uint8_t* src, __m128i* r, __m128i* g, __m128i* b) {
+		const __m128i mask = _mm_set1_epi32(0x3FF);
+		__m128i p = _mm_loadu_si128((const __m128i*) src);
+		*r = _mm_and_si128(p, mask);
+		*g = _mm_and_si128(_mm_srli_epi32(p, 10), mask);
+		*b = _mm_and_si128(_mm_srli_epi32(p, 20), mask);
+	}
+
+	TARGET_AVX2 static __inline void Unpack8_AVX2(const uint8_t* src, __m256i* r, __m256i* g, __m256i* b) {
+		const __m256i mask = _mm256_set1_epi32(0x3FF);
+		__m256i p = _mm256_loadu_si256((const __m256i*) src);
+		*r = _mm256_and_si256(p, mask);
+		*g = _mm256_and_si256(_mm256_srli_epi32(p, 10), mask);
+		*b = _mm256_and_si256(_mm256_srli_epi32(p, 20), mask);
+	}
+};
+
+// 8 bit channels widened to 10 by repeating their top bits
+struct ARGBWideSource {
+	static __inline void Unpack_C(const uint8_t* src, int* r, int* g, int* b) {
+		*b = src[0] << 2 | src[0] >> 6;
+		*g = src[1] << 2 | src[1] >> 6;
+		*r = src[2] << 2 | src[2] >> 6;
+	}
+
+	static __inline void Unpack4_SSE2(const uint8_t* src, __m128i* r, __m128i* g, __m128i* b) {
+		const __m128i mask = _mm_set1_epi32(0xFF);
+		__m128i p = _mm_loadu_si128((const __m128i*) src);
+		__m128i b8 = _mm_and_si128(p, mask);
+		__m128i g8 = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+		__m128i r8 = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+		*b = _mm_or_si128(_mm_slli_epi32(b8, 2), _mm_srli_epi32(b8, 6));
+		*g = _mm_or_si128(_mm_slli_epi32(g8, 2), _mm_srli_epi32(g8, 6));
+		*r = _mm_or_si128(_mm_slli_epi32(r8, 2), _mm_srli_epi32(r8, 6));
+	}
+
+	TARGET_AVX2 static __inline void Unpack8_AVX2(const uint8_t* src, __m256i* r, __m256i* g, __m256i* b) {
+		const __m256i mask = _mm256_set1_epi32(0xFF);
+		__m256i p = _mm256_loadu_si256((const __m256i*) src);
+		__m256i b8 = _mm256_and_si256(p, mask);
+		__m256i g8 = _mm256_and_si256(_mm256_srli_epi32(p, 8), mask);
+		__m256i r8 = _mm256_and_si256(_mm256_srli_epi32(p, 16), mask);
+		*b = _mm256_or_si256(_mm256_slli_epi32(b8, 2), _mm256_srli_epi32(b8, 6));
+		*g = _mm256_or_si256(_mm256_slli_epi32(g8, 2), _mm256_srli_epi32(g8, 6));
+		*r = _mm256_or_si256(_mm256_slli_epi32(r8, 2), _mm256_srli_epi32(r8, 6));
+	}
+};
+
+template <class Src, ColorSpace CS>
+static void ToP010YRow_C(const uint8_t* src, uint8_t* dst_y, int width) {
+	int r, g, b;
+	for (int x = 0; x < width; ++x) {
+		Src::Unpack_C(src, &r, &g, &b);
+		StoreP010(dst_y + 2 * x, RGB10ToY<CS>(r, g, b));
+		src += 4;
+	}
+}
+
+template <class Src, ColorSpace CS>
+static void ToP010UVRow_C(const uint8_t* src0, int src_stride,
+	uint8_t* dst_uv, int width) {
+	const uint8_t* src1 = src0 + src_stride;
+	int r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+	int x;
+	for (x = 0; x < width - 1; x += 2) {
+		Src::Unpack_C(src0, &r0, &g0, &b0);
+		Src::Unpack_C(src0 + 4, &r1, &g1, &b1);
+		Src::Unpack_C(src1, &r2, &g2, &b2);
+		Src::Unpack_C(src1 + 4, &r3, &g3, &b3);
+		int ab = (b0 + b1 + b2 + b3) >> 2;
+		int ag = (g0 + g1 + g2 + g3) >> 2;
+		int ar = (r0 + r1 + r2 + r3) >> 2;
+		StoreP010(dst_uv, RGB10ToU<CS>(ar, ag, ab));
+		StoreP010(dst_uv + 2, RGB10ToV<CS>(ar, ag, ab));
+		src0 += 8;
+		src1 += 8;
+		dst_uv += 4;
+	}
+	if (width & 1) {
+		Src::Unpack_C(src0, &r0, &g0, &b0);
+		Src::Unpack_C(src1, &r2, &g2, &b2);
+		int ab = (b0 + b2) >> 1;
+		int ag = (g0 + g2) >> 1;
+		int ar = (r0 + r2) >> 1;
+		StoreP010(dst_uv, RGB10ToU<CS>(ar, ag, ab));
+		StoreP010(dst_uv + 2, RGB10ToV<CS>(ar, ag, ab));
+	}
+}
+
+// The P010 SIMD rows work on one pixel per 32 bit lane: r | g << 16 feeds
+// pmaddwd for two coefficients at once, so the 10 bit math is exact in 32
+// bits without widening multiplies.
+#define COEF_PAIR(lo, hi) ((int) ((uint32_t) (uint16_t) (lo) | (uint32_t) (uint16_t) (hi) << 16))
+
+template <ColorSpace CS>
+static __inline __m128i RGB10ToY_SSE2(__m128i r, __m128i g, __m128i b) {
+	typedef YUVCoefs<CS> C;
+	__m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+	__m128i y = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set1_epi32(COEF_PAIR(C::YR, C::YG))),
+		_mm_madd_epi16(b, _mm_set1_epi32(COEF_PAIR(C::YB, 0))));
+	return _mm_srai_epi32(_mm_add_epi32(y, _mm_set1_epi32((C::Y_OFFSET << 10) + 0x80)), 8);
+}
+
+// U in the low and V in the high 16 bits of each lane, MSB aligned.
+template <ColorSpace CS>
+static __inline __m128i RGB10ToUV_SSE2(__m128i r, __m128i g, __m128i b) {
+	typedef YUVCoefs<CS> C;
+	const __m128i offset = _mm_set1_epi32(0x20080);
+	__m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+	__m128i u = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set1_epi32(COEF_PAIR(C::UR, C::UG))),
+		_mm_madd_epi16(b, _mm_set1_epi32(COEF_PAIR(C::UB, 0))));
+	__m128i v = _mm_add_epi32(_mm_madd_epi16(rg, _mm_set1_epi32(COEF_PAIR(C::VR, C::VG))),
+		_mm_madd_epi16(b, _mm_set1_epi32(COEF_PAIR(C::VB, 0))));
+	u = _mm_srai_epi32(_mm_add_epi32(u, offset), 8);
+	v = _mm_srai_epi32(_mm_add_epi32(v, offset), 8);
+	return _mm_or_si128(_mm_slli_epi32(u, 6), _mm_slli_epi32(v, 22));
+}
+
+// Sums of horizontal pixel pairs, pixels 0-3 in a and 4-7 in b.
+static __inline __m128i PairSum32_SSE2(__m128i a, __m128i b) {
+	__m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+	return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+template <ColorSpace CS>
+TARGET_AVX2 static __inline __m256i RGB10ToY_AVX2(__m256i r, __m256i g, __m256i b) {
+	typedef YUVCoefs<CS> C;
+	__m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+	__m256i y = _mm256_add_epi32(_mm256_madd_epi16(rg, _mm256_set1_epi32(COEF_PAIR(C::YR, C::YG))),
+		_mm256_madd_epi16(b, _mm256_set1_epi32(COEF_PAIR(C::YB, 0))));
+	return _mm256_srai_epi32(_mm256_add_epi32(y, _mm256_set1_epi32((C::Y_OFFSET << 10) + 0x80)), 8);
+}
+
+template <ColorSpace CS>
+TARGET_AVX2 static __inline __m256i RGB10ToUV_AVX2(__m256i r, __m256i g, __m256i b) {
+	typedef YUVCoefs<CS> C;
+	const __m256i offset = _mm256_set1_epi32(0x20080);
+	__m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+	__m256i u = _mm256_add_epi32(_mm256_madd_epi16(rg, _mm256_set1_epi32(COEF_PAIR(C::UR, C::UG))),
+		_mm256_madd_epi16(b, _mm256_set1_epi32(COEF_PAIR(C::UB, 0))));
+	__m256i v = _mm256_add_epi32(_mm256_madd_epi16(rg, _mm256_set1_epi32(COEF_PAIR(C::VR, C::VG))),
+		_mm256_madd_epi16(b, _mm256_set1_epi32(COEF_PAIR(C::VB, 0))));
+	u = _mm256_srai_epi32(_mm256_add_epi32(u, offset), 8);
+	v = _mm256_srai_epi32(_mm256_add_epi32(v, offset), 8);
+	return _mm256_or_si256(_mm256_slli_epi32(u, 6), _mm256_slli_epi32(v, 22));
+}
+
+#undef COEF_PAIR
+
+// shufps pairs within each 128 bit lane, the permute restores pixel order
+TARGET_AVX2 static __inline __m256i PairSum32_AVX2(__m256i a, __m256i b) {
+	__m256 even = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+	__m256 odd = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+	return _mm256_permute4x64_epi64(_mm256_add_epi32(_mm256_castps_si256(even), _mm256_castps_si256(odd)), 0xD8);
+}
+
+// SSE2 rows do 8 pixels per iteration, AVX2 rows 16.
+template <class Src, ColorSpace CS>
+static void ToP010YRow_SSE2(const uint8_t* src, uint8_t* dst_y, int width) {
+	__m128i r, g, b;
+	for (int x = 0; x < width; x += 8) {
+		Src::Unpack4_SSE2(src, &r, &g, &b);
+		__m128i y0 = RGB10ToY_SSE2<CS>(r, g, b);
+		Src::Unpack4_SSE2(src + 16, &r, &g, &b);
+		__m128i y1 = RGB10ToY_SSE2<CS>(r, g, b);
+		_mm_storeu_si128((__m128i*) dst_y,
+			_mm_slli_epi16(_mm_packs_epi32(y0, y1), 6));
+		src += 4 * 8;
+		dst_y += 2 * 8;
+	}
+}
+
+template <class Src, ColorSpace CS>
+static void ToP010UVRow_SSE2(const uint8_t* src0, int src_stride,
+	uint8_t* dst_uv, int width) {
+	const uint8_t* src1 = src0 + src_stride;
+	__m128i r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+	for (int x = 0; x < width; x += 8) {
+		Src::Unpack4_SSE2(src0, &r0, &g0, &b0);
+		Src::Unpack4_SSE2(src1, &r1, &g1, &b1);
+		Src::Unpack4_SSE2(src0 + 16, &r2, &g2, &b2);
+		Src::Unpack4_SSE2(src1 + 16, &r3, &g3, &b3);
+		__m128i ar = _mm_srli_epi32(PairSum32_SSE2(_mm_add_epi32(r0, r1), _mm_add_epi32(r2, r3)), 2);
+		__m128i ag = _mm_srli_epi32(PairSum32_SSE2(_mm_add_epi32(g0, g1), _mm_add_epi32(g2, g3)), 2);
+		__m128i ab = _mm_srli_epi32(PairSum32_SSE2(_mm_add_epi32(b0, b1), _mm_add_epi32(b2, b3)), 2);
+		_mm_storeu_si128((__m128i*) dst_uv, RGB10ToUV_SSE2<CS>(ar, ag, ab));
+		src0 += 4 * 8;
+		src1 += 4 * 8;
+		dst_uv += 4 * 4;
+	}
+}
+
+template <class Src, ColorSpace CS>
+TARGET_AVX2 static void ToP010YRow_AVX2(const uint8_t* src, uint8_t* dst_y, int width) {
+	__m256i r, g, b;
+	for (int x = 0; x < width; x += 16) {
+		Src::Unpack8_AVX2(src, &r, &g, &b);
+		__m256i y0 = RGB10ToY_AVX2<CS>(r, g, b);
+		Src::Unpack8_AVX2(src + 32, &r, &g, &b);
+		__m256i y1 = RGB10ToY_AVX2<CS>(r, g, b);
+		__m256i y = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), 0xD8);
+		_mm256_storeu_si256((__m256i*) dst_y, _mm256_slli_epi16(y, 6));
+		src += 4 * 16;
+		dst_y += 2 * 16;
+	}
+	_mm256_zeroupper();
+}
+
+template <class Src, ColorSpace CS>
+TARGET_AVX2 static void ToP010UVRow_AVX2(const uint8_t* src0, int src_stride,
+	uint8_t* dst_uv, int width) {
+	const uint8_t* src1 = src0 + src_stride;
+	__m256i r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+	for (int x = 0; x < width; x += 16) {
+		Src::Unpack8_AVX2(src0, &r0, &g0, &b0);
+		Src::Unpack8_AVX2(src1, &r1, &g1, &b1);
+		Src::Unpack8_AVX2(src0 + 32, &r2, &g2, &b2);
+		Src::Unpack8_AVX2(src1 + 32, &r3, &g3, &b3);
+		__m256i ar = _mm256_srli_epi32(PairSum32_AVX2(_mm256_add_epi32(r0, r1), _mm256_add_epi32(r2, r3)), 2);
+		__m256i ag = _mm256_srli_epi32(PairSum32_AVX2(_mm256_add_epi32(g0, g1), _mm256_add_epi32(g2, g3)), 2);
+		__m256i ab = _mm256_srli_epi32(PairSum32_AVX2(_mm256_add_epi32(b0, b1), _mm256_add_epi32(b2, b3)), 2);
+		_mm256_storeu_si256((__m256i*) dst_uv, RGB10ToUV_AVX2<CS>(ar, ag, ab));
+		src0 += 4 * 16;
+		src1 += 4 * 16;
+		dst_uv += 4 * 8;
+	}
+	_mm256_zeroupper();
+}
+
+typedef void(*ToP010YRowFn)(const uint8_t* src, uint8_t* dst_y, int width);
+typedef void(*ToP010UVRowFn)(const uint8_t* src0, int src_stride, uint8_t* dst_uv, int width);
+
+// Mask is the SIMD row's pixels per iteration - 1.
+template <class Src, ColorSpace CS, ToP010YRowFn SimdRow, int Mask>
+static void ToP010YRow_Any(const uint8_t* src, uint8_t* dst_y, int width) {
+	int n = width & ~Mask;
+	if (n > 0) {
+		SimdRow(src, dst_y, n);
+	}
+	ToP010YRow_C<Src, CS>(src + n * 4, dst_y + n * 2, width - n);
+}
+
+template <class Src, ColorSpace CS, ToP010UVRowFn SimdRow, int Mask>
+static void ToP010UVRow_Any(const uint8_t* src0, int src_stride,
+	uint8_t* dst_uv, int width) {
+	int n = width & ~Mask;
+	if (n > 0) {
+		SimdRow(src0, src_stride, dst_uv, n);
+	}
+	ToP010UVRow_C<Src, CS>(src0 + n * 4, src_stride, dst_uv + n * 2, width - n);
+}
+
+struct p010_rows {
+	ToP010YRowFn  y_row;
+	ToP010UVRowFn uv_row;
+};
+
+template <class Src, ColorSpace CS>
+static p010_rows select_p010_rows() {
+	p010_rows rows = { ToP010YRow_C<Src, CS>, ToP010UVRow_C<Src, CS> };
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasSSE2)) {
+		rows.y_row = ToP010YRow_Any<Src, CS, ToP010YRow_SSE2<Src, CS>, 7>;
+		rows.uv_row = ToP010UVRow_Any<Src, CS, ToP010UVRow_SSE2<Src, CS>, 7>;
+	}
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasAVX2)) {
+		rows.y_row = ToP010YRow_Any<Src, CS, ToP010YRow_AVX2<Src, CS>, 15>;
+		rows.uv_row = ToP010UVRow_Any<Src, CS, ToP010UVRow_AVX2<Src, CS>, 15>;
+	}
+	return rows;
+}
+
+template <class Src, ColorSpace CS>
+struct P010Rows {
+	static const p010_rows rows;
+};
+
+template <class Src, ColorSpace CS>
+const p010_rows P010Rows<Src, CS>::rows = select_p010_rows<Src, CS>();
+
+static int RowsToP010(const p010_rows* rows,
+	const uint8_t* src,
+	int src_stride,
+	uint8_t* dst_y,
+	int dst_stride_y,
+	uint8_t* dst_uv,
+	int dst_stride_uv,
+	int width,
+	int height) {
+	int y;
+
+	if (!src || !dst_y || !dst_uv || width <= 0 || height == 0) {
+		return -1;
+	}
+
+	// Negative height means invert the image.
+	if (height < 0) {
+		height = -height;
+		src = src + (height - 1) * src_stride;
+		src_stride = -src_stride;
+	}
+
+	for (y = 0; y < height - 1; y += 2) {
+		rows->uv_row(src, src_stride, dst_uv, width);
+		rows->y_row(src, dst_y, width);
+		rows->y_row(src + src_stride, dst_y + dst_stride_y, width);
+		src += src_stride * 2;
+		dst_y += dst_stride_y * 2;
+		dst_uv += dst_stride_uv;
+	}
+
+	if (height & 1) {
+		rows->uv_row(src, 0, dst_uv, width);
+		rows->y_row(src, dst_y, width);
+	}
+	return 0;
+}
+
+template <ColorSpace CS>
+int ABGR10ToP010(const uint8_t* src_abgr10, int src_stride_abgr10, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_uv, int dst_stride_uv, int width, int height) {
+	return RowsToP010(&P010Rows<ABGR10WideSource, CS>::rows, src_abgr10, src_stride_abgr10, dst_y, dst_stride_y,
+		dst_uv, dst_stride_uv, width, height);
+}
+
+template <ColorSpace CS>
+int ARGBToP010(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_uv, int dst_stride_uv, int width, int height) {
+	return RowsToP010(&P010Rows<ARGBWideSource, CS>::rows, src_argb, src_stride_argb, dst_y, dst_stride_y,
+		dst_uv, dst_stride_uv, width, height);
+}
+
+// Every converter is instantiated for every color space here, callers only
+// see the declarations.
+#define INSTANTIATE_COLOR_SPACE(CS)                                             \
+	template int ABGR10ToI420<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int); \
+	template int B5G6R5ToI420<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int); \
+	template int B5G5R5A1ToI420<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int); \
+	template int ABGR10ToP010<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int); \
+	template int ARGBToP010<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int);
+
+#define INSTANTIATE_MATRIX_I420(CS)                                             \
+	template int ARGBToI420Matrix<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int); \
+	template int ABGRToI420Matrix<CS>(const uint8_t*, int, uint8_t*, int, uint8_t*, int, uint8_t*, int, int, int);
+
+INSTANTIATE_COLOR_SPACE(COLOR_BT601_LIMITED)
+INSTANTIATE_COLOR_SPACE(COLOR_BT709_LIMITED)
+INSTANTIATE_COLOR_SPACE(COLOR_BT601_FULL)
+INSTANTIATE_COLOR_SPACE(COLOR_BT709_FULL)
+INSTANTIATE_MATRIX_I420(COLOR_BT709_LIMITED)
+INSTANTIATE_MATRIX_I420(COLOR_BT601_FULL)
+INSTANTIATE_MATRIX_I420(COLOR_BT709_FULL)
+
+#undef INSTANTIATE_COLOR_SPACE
+#undef INSTANTIATE_MATRIX_I420
+
+void ABGR10ToARGBRow_C(const uint8_t* src_abgr10, uint8_t* dst_argb, int width) {
+	int x;
+	for (x = 0; x < width; ++x) {
+		dst_argb[0] = (src_abgr10[2] & 0xC0) >> 6 | (src_abgr10[3] & 0x3F) << 2;
+		dst_argb[1] = (src_abgr10[1] & 0xF0) >> 4 | (src_abgr10[2] & 0xF) << 4;
+		dst_argb[2] = (src_abgr10[0] & 0xFC) >> 2 | (src_abgr10[1] & 0x3) << 6;
+		dst_argb[3] = 0xFF;
+		src_abgr10 += 4;
+		dst_argb += 4;
+	}
+}
+
+// 4 pixels per iteration, tail done by the C row.
+void ABGR10ToARGBRow_SSE2(const uint8_t* src_abgr10, uint8_t* dst_argb, int width) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	int x;
+	for (x = 0; x + 4 <= width; x += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i*) src_abgr10);
+		__m128i b = _mm_and_si128(_mm_srli_epi32(p, 22), mask);
+		__m128i g = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(p, 12), mask), 8);
+		__m128i r = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(p, 2), mask), 16);
+		__m128i argb = _mm_or_si128(_mm_or_si128(b, g), _mm_or_si128(r, alpha));
+		_mm_storeu_si128((__m128i*) dst_argb, argb);
+		src_abgr10 += 16;
+		dst_argb += 16;
+	}
+	ABGR10ToARGBRow_C(src_abgr10, dst_argb, width - x);
+}
+
+// 8 pixels per iteration, tail done by the C row.
+TARGET_AVX2 void ABGR10ToARGBRow_AVX2(const uint8_t* src_abgr10, uint8_t* dst_argb, int width) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+	int x;
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i p = _mm256_loadu_si256((const __m256i*) src_abgr10);
+		__m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 22), mask);
+		__m256i g = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(p, 12), mask), 8);
+		__m256i r = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(p, 2), mask), 16);
+		__m256i argb = _mm256_or_si256(_mm256_or_si256(b, g), _mm256_or_si256(r, alpha));
+		_mm256_storeu_si256((__m256i*) dst_argb, argb);
+		src_abgr10 += 32;
+		dst_argb += 32;
+	}
+	ABGR10ToARGBRow_C(src_abgr10, dst_argb, width - x);
+}
+
+typedef void(*ABGR10ToARGBRowFn)(const uint8_t* src_abgr10, uint8_t* dst_argb, int width);
+
+static ABGR10ToARGBRowFn select_abgr10_to_argb_row() {
+	ABGR10ToARGBRowFn row = ABGR10ToARGBRow_C;
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasSSE2)) {
+		row = ABGR10ToARGBRow_SSE2;
+	}
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasAVX2)) {
+		row = ABGR10ToARGBRow_AVX2;
+	}
+	return row;
+}
+
+// cpuid once, when the dll is loaded
+static const ABGR10ToARGBRowFn ABGR10ToARGBRow = select_abgr10_to_argb_row();
+
+int ABGR10ToARGB(const uint8_t* src_abgr10,
+	int src_stride_abgr10,
+	uint8_t* dst_argb,
+	int dst_stride_argb,
+	int width,
+	int height) {
+	int y;
+
+	if (!src_abgr10 || !dst_argb || width <= 0 || height == 0) {
+		return -1;
+	}
+
+	// Negative height means invert the image.
+	if (height < 0) {
+		height = -height;
+		src_abgr10 = src_abgr10 + (height - 1) * src_stride_abgr10;
+		src_stride_abgr10 = -src_stride_abgr10;
+	}
+
+	for (y = 0; y < height; ++y) {
+		ABGR10ToARGBRow(src_abgr10, dst_argb, width);
+		src_abgr10 += src_stride_abgr10;
+		dst_argb += dst_stride_argb;
+	}
+	return 0;
+}
+
+void GetOutputLayout(OutputLayout* layout, OutputFormat format, ColorSpace color_space, int width, int height) {
+	int half_width = (width + 1) / 2;
+	int half_height = (height + 1) / 2;
+
+	layout->format = format;
+	layout->color_space = color_space;
+	layout->width = width;
+	layout->height = height;
+
+	switch (format) {
+	case OUTPUT_NV12:
+		layout->stride_y = width;
+		layout->stride_uv = half_width * 2;
+		layout->offset_u = width * height;
+		layout->offset_v = layout->offset_u;
+		break;
+	case OUTPUT_P010:
+		layout->stride_y = width * 2;
+		layout->stride_uv = half_width * 4;
+		layout->offset_u = width * height * 2;
+		layout->offset_v = layout->offset_u;
+		break;
+	case OUTPUT_YUY2:
+	case OUTPUT_UYVY:
+		layout->stride_y = half_width * 4;
+		layout->stride_uv = 0;
+		layout->offset_u = 0;
+		layout->offset_v = 0;
+		break;
+	case OUTPUT_I420:
+	default:
+		layout->stride_y = width;
+		layout->stride_uv = half_width;
+		layout->offset_u = width * height;
+		layout->offset_v = layout->offset_u + half_width * half_height;
+		break;
+	}
+}
+
+int GetOutputFrameSize(OutputFormat format, int width, int height) {
+	int half_width = (width + 1) / 2;
+	int half_height = (height + 1) / 2;
+
+	switch (format) {
+	case OUTPUT_YUY2:
+	case OUTPUT_UYVY:
+		return half_width * 4 * height;
+	case OUTPUT_P010:
+		return width * height * 2 + half_width * half_height * 4;
+	case OUTPUT_NV12:
+	case OUTPUT_I420:
+	default:
+		return width * height + half_width * half_height * 2;
+	}
+}
+
+// Black frame detection. A frame with a picture almost always has it in
+// more than one place, so a sparse probe of BLACK_PROBES blocks spread over
+// the frame turns most of them down after a few cache lines; only frames
+// that pass it get the full scan, which stops at the first 64 bytes that are
+// not black.
+static const int BLACK_PROBES = 64;
+
+// One stretch of a sample that has to repeat a 2 byte pattern, lo at even
+// offsets from the start of the sample.
+struct BlackRegion {
+	const uint8_t* p;
+	size_t size;
+	uint8_t lo;
+	uint8_t hi;
+};
+
+static bool IsPatternProbed(const BlackRegion* region) {
+	if (region->size < (size_t) BLACK_PROBES * 64) {
+		// the full scan is about as cheap
+		return true;
+	}
+
+	const __m128i pattern = _mm_set1_epi16((short) (region->lo | (region->hi << 8)));
+	size_t step = (region->size / BLACK_PROBES) & ~(size_t) 1;
+	for (int i = 0; i < BLACK_PROBES; i++) {
+		__m128i v = _mm_loadu_si128((const __m128i*) (region->p + i * step));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern)) != 0xFFFF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool IsPattern(const BlackRegion* region) {
+	const uint8_t* p = region->p;
+	const __m128i pattern = _mm_set1_epi16((short) (region->lo | (region->hi << 8)));
+	size_t i = 0;
+
+	for (; i + 64 <= region->size; i += 64) {
+		__m128i eq = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i)), pattern),
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i + 16)), pattern)),
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i + 32)), pattern),
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i + 48)), pattern)));
+		if (_mm_movemask_epi8(eq) != 0xFFFF) {
+			return false;
+		}
+	}
+
+	for (; i < region->size; i++) {
+		if (p[i] != ((i & 1) ? region->hi : region->lo)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The stretches of a black sample and what each repeats: Y 0x10 limited
+// range, 0x00 full range, U and V 0x80; P010 has them in the high byte.
+static int GetBlackRegions(const OutputLayout* layout, const uint8_t* sample, int size, BlackRegion regions[2]) {
+	uint8_t black = IsFullRange(layout->color_space) ? 0x00 : 0x10;
+	int frame_size = GetOutputFrameSize(layout->format, layout->width, layout->height);
+	if (size > frame_size) {
+		size = frame_size;
+	}
+	if (size < 0) {
+		size = 0;
+	}
+
+	switch (layout->format) {
+	case OUTPUT_YUY2:
+		regions[0] = { sample, (size_t) size, black, 0x80 };
+		return 1;
+	case OUTPUT_UYVY:
+		regions[0] = { sample, (size_t) size, 0x80, black };
+		return 1;
+	default: {
+		bool p010 = layout->format == OUTPUT_P010;
+		int y_size = layout->offset_u < size ? layout->offset_u : size;
+		regions[0] = { sample, (size_t) y_size, p010 ? (uint8_t) 0x00 : black, black };
+		regions[1] = { sample + y_size, (size_t) (size - y_size), p010 ? (uint8_t) 0x00 : (uint8_t) 0x80, 0x80 };
+		return 2;
+	}
+	}
+}
+
+bool IsBlackFrame(const OutputLayout* layout, const uint8_t* sample, int size) {
+	BlackRegion regions[2];
+	int count = GetBlackRegions(layout, sample, size, regions);
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!IsPatternProbed(&regions[i])) {
+			return false;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		if (!IsPattern(&regions[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void FillPattern(const BlackRegion* region) {
+	uint8_t* p = (uint8_t*) region->p;
+	if (region->lo == region->hi) {
+		memset(p, region->lo, region->size);
+		return;
+	}
+
+	const __m128i pattern = _mm_set1_epi16((short) (region->lo | (region->hi << 8)));
+	size_t i = 0;
+	for (; i + 16 <= region->size; i += 16) {
+		_mm_storeu_si128((__m128i*) (p + i), pattern);
+	}
+	for (; i < region->size; i++) {
+		p[i] = (i & 1) ? region->hi : region->lo;
+	}
+}
+
+void FillBlackFrame(const OutputLayout* layout, uint8_t* sample) {
+	BlackRegion regions[2];
+	int size = GetOutputFrameSize(layout->format, layout->width, layout->height);
+	int count = GetBlackRegions(layout, sample, size, regions);
+
+	for (int i = 0; i < count; i++) {
+		FillPattern(&regions[i]);
+	}
+}
+
+// 16 pixels a step; the color bits of all of them ORed together are zero
+static bool IsBlackRow32(const uint8_t* row, int width, uint32_t color_mask) {
+	const __m128i mask = _mm_set1_epi32((int) color_mask);
+	const __m128i zero = _mm_setzero_si128();
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m128i* p = (const __m128i*) (row + x * 4);
+		__m128i any = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+			_mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(any, mask), zero)) != 0xFFFF) {
+			return false;
+		}
+	}
+
+	for (; x < width; x++) {
+		uint32_t pixel;
+		memcpy(&pixel, row + x * 4, 4);
+		if (pixel & color_mask) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool IsBlackPixels32(const uint8_t* src, int src_stride, int width, int height, uint32_t color_mask) {
+	const __m128i mask = _mm_set1_epi32((int) color_mask);
+	const __m128i zero = _mm_setzero_si128();
+	int y;
+
+	if (!src || width <= 0 || height <= 0) {
+		return false;
+	}
+
+	// probe 4 pixels at 8 places on 8 rows, first and last included
+	if (width >= 64 && height >= 8) {
+		for (int i = 0; i < BLACK_PROBES; i++) {
+			int probe_y = (i / 8) * (height - 1) / 7;
+			int probe_x = (i % 8) * (width - 4) / 7;
+			__m128i v = _mm_loadu_si128((const __m128i*) (src + (intptr_t) probe_y * src_stride + probe_x * 4));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, mask), zero)) != 0xFFFF) {
+				return false;
+			}
+		}
+	}
+
+	for (y = 0; y < height; y++) {
+		if (!IsBlackRow32(src + (intptr_t) y * src_stride, width, color_mask)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// libyuv only writes NV12, YUY2 and UYVY in BT.601 limited range. Other
+// color spaces convert SCALE_BAND_ROWS rows at a time into a per thread
+// planar scratch band that stays in cache, then interleave it: NV12 gets
+// its Y plane written directly and only U / V staged, the packed 4:2:2
+// layouts go through I422 so every row keeps its own chroma. The band goes
+// with its thread.
+template <ColorSpace CS>
+static int ARGBToInterleavedRows(const OutputLayout* layout,
+	const uint8_t* src_argb,
+	int src_stride_argb,
+	uint8_t* dst_y,
+	uint8_t* dst_uv,
+	int rows) {
+	static thread_local std::vector<uint8_t> band_yuv;
+
+	int width = layout->width;
+	int half_width = (width + 1) / 2;
+	size_t size = (size_t)(width + half_width * 2) * SCALE_BAND_ROWS;
+	int y;
+
+	if (band_yuv.size() < size) {
+		band_yuv.resize(size);
+	}
+
+	uint8_t* band_y = band_yuv.data();
+	uint8_t* band_u = band_y + width * SCALE_BAND_ROWS;
+	uint8_t* band_v = band_u + half_width * SCALE_BAND_ROWS;
+
+	for (y = 0; y < rows; y += SCALE_BAND_ROWS) {
+		int band_rows = rows - y < SCALE_BAND_ROWS ? rows - y : SCALE_BAND_ROWS;
+		const uint8_t* band_src = src_argb + y * src_stride_argb;
+		int err;
+
+		switch (layout->format) {
+		case OUTPUT_NV12:
+			err = ARGBToI420Matrix<CS>(band_src, src_stride_argb,
+				dst_y + y * layout->stride_y, layout->stride_y,
+				band_u, half_width,
+				band_v, half_width,
+				width, band_rows);
+			if (!err) {
+				libyuv::MergeUVPlane(band_u, half_width, band_v, half_width,
+					dst_uv + (y / 2) * layout->stride_uv, layout->stride_uv,
+					half_width, (band_rows + 1) / 2);
+			}
+			break;
+		case OUTPUT_YUY2:
+		case OUTPUT_UYVY:
+			err = ARGBToI422Matrix<CS>(band_src, src_stride_argb,
+				band_y, width,
+				band_u, half_width,
+				band_v, half_width,
+				width, band_rows);
+			if (err) {
+				break;
+			}
+			err = layout->format == OUTPUT_YUY2 ?
+				libyuv::I422ToYUY2(band_y, width, band_u, half_width, band_v, half_width,
+					dst_y + y * layout->stride_y, layout->stride_y, width, band_rows) :
+				libyuv::I422ToUYVY(band_y, width, band_u, half_width, band_v, half_width,
+					dst_y + y * layout->stride_y, layout->stride_y, width, band_rows);
+			break;
+		default:
+			err = -1;
+			break;
+		}
+		if (err) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+template <ColorSpace CS>
+static int ARGBToOutputRowsMatrix(const OutputLayout* layout,
+	const uint8_t* src_argb,
+	int src_stride_argb,
+	uint8_t* dst,
+	int first_row,
+	int rows) {
+	uint8_t* dst_y = dst + first_row * layout->stride_y;
+	uint8_t* dst_u = dst + layout->offset_u + (first_row / 2) * layout->stride_uv;
+	uint8_t* dst_v = dst + layout->offset_v + (first_row / 2) * layout->stride_uv;
+
+	switch (layout->format) {
+	case OUTPUT_I420:
+		return ARGBToI420Matrix<CS>(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			dst_u, layout->stride_uv,
+			dst_v, layout->stride_uv,
+			layout->width, rows);
+	case OUTPUT_NV12:
+	case OUTPUT_YUY2:
+	case OUTPUT_UYVY:
+		return ARGBToInterleavedRows<CS>(layout, src_argb, src_stride_argb, dst_y, dst_u, rows);
+	case OUTPUT_P010:
+		return ARGBToP010<CS>(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			dst_u, layout->stride_uv,
+			layout->width, rows);
+	default:
+		return -1;
+	}
+}
+
+// the default color space has libyuv writers for every 8 bit layout
+template <>
+int ARGBToOutputRowsMatrix<COLOR_BT601_LIMITED>(const OutputLayout* layout,
+	const uint8_t* src_argb,
+	int src_stride_argb,
+	uint8_t* dst,
+	int first_row,
+	int rows) {
+	uint8_t* dst_y = dst + first_row * layout->stride_y;
+	uint8_t* dst_u = dst + layout->offset_u + (first_row / 2) * layout->stride_uv;
+	uint8_t* dst_v = dst + layout->offset_v + (first_row / 2) * layout->stride_uv;
+
+	switch (layout->format) {
+	case OUTPUT_I420:
+		return libyuv::ARGBToI420(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			dst_u, layout->stride_uv,
+			dst_v, layout->stride_uv,
+			layout->width, rows);
+	case OUTPUT_NV12:
+		return libyuv::ARGBToNV12(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			dst_u, layout->stride_uv,
+			layout->width, rows);
+	case OUTPUT_YUY2:
+		return libyuv::ARGBToYUY2(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			layout->width, rows);
+	case OUTPUT_UYVY:
+		return libyuv::ARGBToUYVY(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			layout->width, rows);
+	case OUTPUT_P010:
+		return ARGBToP010<COLOR_BT601_LIMITED>(src_argb, src_stride_argb,
+			dst_y, layout->stride_y,
+			dst_u, layout->stride_uv,
+			layout->width, rows);
+	default:
+		return -1;
+	}
+}
+
+int ARGBToOutputRows(const OutputLayout* layout,
+	const uint8_t* src_argb,
+	int src_stride_argb,
+	uint8_t* dst,
+	int first_row,
+	int rows) {
+	switch (layout->color_space) {
+	case COLOR_BT709_LIMITED:
+		return ARGBToOutputRowsMatrix<COLOR_BT709_LIMITED>(layout, src_argb, src_stride_argb, dst, first_row, rows);
+	case COLOR_BT601_FULL:
+		return ARGBToOutputRowsMatrix<COLOR_BT601_FULL>(layout, src_argb, src_stride_argb, dst, first_row, rows);
+	case COLOR_BT709_FULL:
+		return ARGBToOutputRowsMatrix<COLOR_BT709_FULL>(layout, src_argb, src_stride_argb, dst, first_row, rows);
+	case COLOR_BT601_LIMITED:
+	default:
+		return ARGBToOutputRowsMatrix<COLOR_BT601_LIMITED>(layout, src_argb, src_stride_argb, dst, first_row, rows);
+	}
+}
+
+int ARGBScaleToOutputRows(const uint8_t* src_argb,
+	int src_stride_argb,
+	int src_width,
+	int src_height,
+	const OutputLayout* layout,
+	uint8_t* dst,
+	int first_row,
+	int rows,
+	uint8_t* band_argb) {
+	int y;
+	int end_row = first_row + rows;
+	int dst_width = layout->width;
+	int dst_height = layout->height;
+	int band_stride = 4 * dst_width;
+
+	if (!src_argb || !dst || !band_argb || src_width <= 0 || src_height <= 0 ||
+		first_row < 0 || (first_row & 1) || rows <= 0 || end_row > dst_height) {
+		return -1;
+	}
+
+	if (src_width == dst_width && src_height == dst_height) {
+		return ARGBToOutputRows(layout, src_argb + first_row * src_stride_argb, src_stride_argb,
+			dst, first_row, rows);
+	}
+
+	// bands start on even rows so every band but the last one covers whole
+	// chroma rows
+	for (y = first_row; y < end_row; y += SCALE_BAND_ROWS) {
+		int band_rows = end_row - y < SCALE_BAND_ROWS ? end_row - y : SCALE_BAND_ROWS;
+
+		// ARGBScaleClip writes the clip rect at its position inside dst,
+		// point dst back by y rows so the band lands at the top of band_argb.
+		int err = libyuv::ARGBScaleClip(src_argb, src_stride_argb,
+			src_width, src_height,
+			band_argb - y * band_stride, band_stride,
+			dst_width, dst_height,
+			0, y, dst_width, band_rows,
+			libyuv::FilterMode(libyuv::kFilterBox));
+		if (err) {
+			return err;
+		}
+
+		err = ARGBToOutputRows(layout, band_argb, band_stride, dst, y, band_rows);
+		if (err) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+// Layout and base pointer that make columns [x, x + width) of layout look
+// like a frame of their own, so the row writers can fill a rect. x is even,
+// so the window starts on a whole chroma sample in every format.
+static uint8_t* GetOutputWindow(const OutputLayout* layout, uint8_t* dst, int x, int width, OutputLayout* window) {
+	*window = *layout;
+	window->width = width;
+
+	switch (layout->format) {
+	case OUTPUT_I420:
+		// Y moves x bytes, U and V only x / 2
+		window->offset_u += x / 2 - x;
+		window->offset_v += x / 2 - x;
+		return dst + x;
+	case OUTPUT_NV12:
+		// a UV pair per two pixels, same byte offset as Y
+		return dst + x;
+	case OUTPUT_YUY2:
+	case OUTPUT_UYVY:
+	case OUTPUT_P010:
+		// two bytes per pixel, P010 UV is 4 bytes per two pixels
+		return dst + x * 2;
+	default:
+		return dst;
+	}
+}
+
+int ARGBScaleRectToOutput(const uint8_t* src_argb,
+	int src_stride_argb,
+	int src_width,
+	int src_height,
+	const OutputLayout* layout,
+	uint8_t* dst,
+	int x,
+	int y,
+	int width,
+	int height,
+	uint8_t* band_argb) {
+	OutputLayout window;
+	uint8_t* dst_window;
+	int band_stride = 4 * width;
+	int end_row = y + height;
+	int row;
+
+	if (!src_argb || !dst || !band_argb || src_width <= 0 || src_height <= 0 ||
+		x < 0 || y < 0 || (x & 1) || (y & 1) || width <= 0 || height <= 0 ||
+		x + width > layout->width || end_row > layout->height) {
+		return -1;
+	}
+
+	dst_window = GetOutputWindow(layout, dst, x, width, &window);
+
+	if (src_width == layout->width && src_height == layout->height) {
+		return ARGBToOutputRows(&window, src_argb + y * src_stride_argb + x * 4, src_stride_argb,
+			dst_window, y, height);
+	}
+
+	for (row = y; row < end_row; row += SCALE_BAND_ROWS) {
+		int band_rows = end_row - row < SCALE_BAND_ROWS ? end_row - row : SCALE_BAND_ROWS;
+
+		// same trick as ARGBScaleToOutputRows, in both directions: the clip
+		// rect lands at the top left of band_argb
+		int err = libyuv::ARGBScaleClip(src_argb, src_stride_argb,
+			src_width, src_height,
+			band_argb - row * band_stride - x * 4, band_stride,
+			layout->width, layout->height,
+			x, row, width, band_rows,
+			libyuv::FilterMode(libyuv::kFilterBox));
+		if (err) {
+			return err;
+		}
+
+		err = ARGBToOutputRows(&window, band_argb, band_stride, dst_window, row, band_rows);
+		if (err) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+void GetLetterboxRect(int src_width, int src_height, int dst_width, int dst_height,
+	int* x, int* y, int* width, int* height) {
+	int w = dst_width;
+	int h = dst_height;
+
+	// compare aspect ratios in 64 bit, 4K * 4K overflows int
+	if ((int64_t) src_width * dst_height > (int64_t) dst_width * src_height) {
+		// wider than the sample, bars top and bottom
+		h = (int) ((int64_t) dst_width * src_height / src_width);
+	} else {
+		// taller, bars left and right
+		w = (int) ((int64_t) dst_height * src_width / src_height);
+	}
+
+	w &= ~1;
+	h &= ~1;
+	if (w < 2) {
+		w = dst_width < 2 ? dst_width : 2;
+	}
+	if (h < 2) {
+		h = dst_height < 2 ? dst_height : 2;
+	}
+
+	*x = ((dst_width - w) / 2) & ~1;
+	*y = ((dst_height - h) / 2) & ~1;
+	*width = w;
+	*height = h;
+}
+
+// Paints the part of a plane outside the rect [x, x + w) x [y, y + h).
+static void SetBorders(uint8_t* plane, int stride, int width, int height,
+	int x, int y, int w, int h, uint8_t value) {
+	if (y > 0) {
+		libyuv::SetPlane(plane, stride, width, y, value);
+	}
+	if (y + h < height) {
+		libyuv::SetPlane(plane + (y + h) * stride, stride, width, height - y - h, value);
+	}
+	if (x > 0) {
+		libyuv::SetPlane(plane + y * stride, stride, x, h, value);
+	}
+	if (x + w < width) {
+		libyuv::SetPlane(plane + y * stride + x + w, stride, width - x - w, h, value);
+	}
+}
+
+// 8 bit planar to P010: the samples move up to the top byte, 16 -> 64 << 6
+// and 128 -> 512 << 6 like the 10 bit converters' offsets. 16 pixels a
+// step, unpacking against zero puts each byte on top of its 16 bit sample.
+static void I420ToP010(const uint8_t* src_y, int src_stride_y,
+	const uint8_t* src_u, int src_stride_u,
+	const uint8_t* src_v, int src_stride_v,
+	uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_uv, int dst_stride_uv,
+	int width, int height) {
+	const __m128i zero = _mm_setzero_si128();
+	int half_width = (width + 1) / 2;
+	int half_height = (height + 1) / 2;
+	int x, y;
+
+	for (y = 0; y < height; ++y) {
+		uint8_t* row = dst_y + y * dst_stride_y;
+		for (x = 0; x + 16 <= width; x += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (src_y + x));
+			_mm_storeu_si128((__m128i*) (row + 2 * x), _mm_unpacklo_epi8(zero, v));
+			_mm_storeu_si128((__m128i*) (row + 2 * x + 16), _mm_unpackhi_epi8(zero, v));
+		}
+		for (; x < width; ++x) {
+			row[2 * x] = 0;
+			row[2 * x + 1] = src_y[x];
+		}
+		src_y += src_stride_y;
+	}
+
+	for (y = 0; y < half_height; ++y) {
+		uint8_t* row = dst_uv + y * dst_stride_uv;
+		for (x = 0; x + 16 <= half_width; x += 16) {
+			__m128i u = _mm_loadu_si128((const __m128i*) (src_u + x));
+			__m128i v = _mm_loadu_si128((const __m128i*) (src_v + x));
+			__m128i uv_lo = _mm_unpacklo_epi8(u, v);
+			__m128i uv_hi = _mm_unpackhi_epi8(u, v);
+			_mm_storeu_si128((__m128i*) (row + 4 * x), _mm_unpacklo_epi8(zero, uv_lo));
+			_mm_storeu_si128((__m128i*) (row + 4 * x + 16), _mm_unpackhi_epi8(zero, uv_lo));
+			_mm_storeu_si128((__m128i*) (row + 4 * x + 32), _mm_unpacklo_epi8(zero, uv_hi));
+			_mm_storeu_si128((__m128i*) (row + 4 * x + 48), _mm_unpackhi_epi8(zero, uv_hi));
+		}
+		for (; x < half_width; ++x) {
+			row[4 * x] = 0;
+			row[4 * x + 1] = src_u[x];
+			row[4 * x + 2] = 0;
+			row[4 * x + 3] = src_v[x];
+		}
+		src_u += src_stride_u;
+		src_v += src_stride_v;
+	}
+}
+
+int I420ScaleToOutput(const uint8_t* src_y, int src_stride_y,
+	const uint8_t* src_u, int src_stride_u,
+	const uint8_t* src_v, int src_stride_v,
+	int src_width, int src_height,
+	const OutputLayout* layout,
+	uint8_t* dst,
+	uint8_t* staging) {
+	OutputLayout i420;
+	uint8_t* frame = dst;
+	int x, y, w, h;
+	int err;
+
+	if (!src_y || !src_u || !src_v || !dst || src_width <= 0 || src_height <= 0) {
+		return -1;
+	}
+
+	GetOutputLayout(&i420, OUTPUT_I420, layout->color_space, layout->width, layout->height);
+	if (layout->format != OUTPUT_I420) {
+		if (!staging) {
+			return -1;
+		}
+		frame = staging;
+	}
+
+	GetLetterboxRect(src_width, src_height, layout->width, layout->height, &x, &y, &w, &h);
+
+	uint8_t* frame_y = frame;
+	uint8_t* frame_u = frame + i420.offset_u;
+	uint8_t* frame_v = frame + i420.offset_v;
+	int half_width = (layout->width + 1) / 2;
+	int half_height = (layout->height + 1) / 2;
+	uint8_t black = IsFullRange(layout->color_space) ? 0x00 : 0x10;
+
+	SetBorders(frame_y, i420.stride_y, layout->width, layout->height, x, y, w, h, black);
+	SetBorders(frame_u, i420.stride_uv, half_width, half_height, x / 2, y / 2, w / 2, h / 2, 0x80);
+	SetBorders(frame_v, i420.stride_uv, half_width, half_height, x / 2, y / 2, w / 2, h / 2, 0x80);
+
+	err = libyuv::I420Scale(src_y, src_stride_y,
+		src_u, src_stride_u,
+		src_v, src_stride_v,
+		src_width, src_height,
+		frame_y + y * i420.stride_y + x, i420.stride_y,
+		frame_u + (y / 2) * i420.stride_uv + x / 2, i420.stride_uv,
+		frame_v + (y / 2) * i420.stride_uv + x / 2, i420.stride_uv,
+		w, h,
+		libyuv::FilterMode(libyuv::kFilterBox));
+	if (err) {
+		return err;
+	}
+
+	uint8_t* dst_y = dst;
+	uint8_t* dst_uv = dst + layout->offset_u;
+
+	switch (layout->format) {
+	case OUTPUT_I420:
+		return 0;
+	case OUTPUT_NV12:
+		return libyuv::I420ToNV12(frame_y, i420.stride_y, frame_u, i420.stride_uv, frame_v, i420.stride_uv,
+			dst_y, layout->stride_y, dst_uv, layout->stride_uv,
+			layout->width, layout->height);
+	case OUTPUT_YUY2:
+		return libyuv::I420ToYUY2(frame_y, i420.stride_y, frame_u, i420.stride_uv, frame_v, i420.stride_uv,
+			dst_y, layout->stride_y,
+			layout->width, layout->height);
+	case OUTPUT_UYVY:
+		return libyuv::I420ToUYVY(frame_y, i420.stride_y, frame_u, i420.stride_uv, frame_v, i420.stride_uv,
+			dst_y, layout->stride_y,
+			layout->width, layout->height);
+	case OUTPUT_P010:
+		I420ToP010(frame_y, i420.stride_y, frame_u, i420.stride_uv, frame_v, i420.stride_uv,
+			dst_y, layout->stride_y, dst_uv, layout->stride_uv,
+			layout->width, layout->height);
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+// 16 bit planes, stride in samples
+static void SetPlane16(uint16_t* plane, int stride, int width, int height, uint16_t value) {
+	for (int y = 0; y < height; y++) {
+		std::fill(plane + y * stride, plane + y * stride + width, value);
+	}
+}
+
+// SetBorders for 16 bit planes.
+static void SetBorders16(uint16_t* plane, int stride, int width, int height,
+	int x, int y, int w, int h, uint16_t value) {
+	if (y > 0) {
+		SetPlane16(plane, stride, width, y, value);
+	}
+	if (y + h < height) {
+		SetPlane16(plane + (y + h) * stride, stride, width, height - y - h, value);
+	}
+	if (x > 0) {
+		SetPlane16(plane + y * stride, stride, x, h, value);
+	}
+	if (x + w < width) {
+		SetPlane16(plane + y * stride + x + w, stride, width - x - w, h, value);
+	}
+}
+
+// P010 chroma split into U and V planes, 8 pairs a step: each half of a
+// pair sign extended to 32 bits packs back to the same 16 bits.
+static void SplitUVPlane16(const uint16_t* src_uv, int src_stride_uv,
+	uint16_t* dst_u, uint16_t* dst_v, int dst_stride,
+	int width, int height) {
+	for (int y = 0; y < height; y++) {
+		const uint16_t* uv = src_uv + y * src_stride_uv;
+		uint16_t* u = dst_u + y * dst_stride;
+		uint16_t* v = dst_v + y * dst_stride;
+		int x = 0;
+
+		for (; x + 8 <= width; x += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i*) (uv + 2 * x));
+			__m128i b = _mm_loadu_si128((const __m128i*) (uv + 2 * x + 8));
+			__m128i u32a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+			__m128i u32b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+			_mm_storeu_si128((__m128i*) (u + x), _mm_packs_epi32(u32a, u32b));
+			_mm_storeu_si128((__m128i*) (v + x), _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+		}
+		for (; x < width; x++) {
+			u[x] = uv[2 * x];
+			v[x] = uv[2 * x + 1];
+		}
+	}
+}
+
+// The box filter averages P010 samples to 16 bits; rounded back to 10 bits
+// in the top of each sample. The largest P010 sample is 0xFFC0, so adding
+// half a step does not carry out.
+static inline __m128i RoundToP010(__m128i v) {
+	return _mm_and_si128(_mm_adds_epu16(v, _mm_set1_epi16(0x20)), _mm_set1_epi16((short) 0xFFC0));
+}
+
+static inline uint16_t RoundToP010(uint16_t v) {
+	return (uint16_t) ((v + 0x20) & 0xFFC0);
+}
+
+static void RoundPlaneToP010(uint16_t* plane, int stride, int width, int height) {
+	for (int y = 0; y < height; y++) {
+		uint16_t* row = plane + y * stride;
+		int x = 0;
+
+		for (; x + 8 <= width; x += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (row + x));
+			_mm_storeu_si128((__m128i*) (row + x), RoundToP010(v));
+		}
+		for (; x < width; x++) {
+			row[x] = RoundToP010(row[x]);
+		}
+	}
+}
+
+// Scaled U and V planes interleaved back into P010 chroma, rounded.
+static void MergeUVPlaneToP010(const uint16_t* src_u, const uint16_t* src_v, int src_stride,
+	uint16_t* dst_uv, int dst_stride_uv, int width, int height) {
+	for (int y = 0; y < height; y++) {
+		const uint16_t* u = src_u + y * src_stride;
+		const uint16_t* v = src_v + y * src_stride;
+		uint16_t* uv = dst_uv + y * dst_stride_uv;
+		int x = 0;
+
+		for (; x + 8 <= width; x += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i*) (u + x));
+			__m128i b = _mm_loadu_si128((const __m128i*) (v + x));
+			_mm_storeu_si128((__m128i*) (uv + 2 * x), RoundToP010(_mm_unpacklo_epi16(a, b)));
+			_mm_storeu_si128((__m128i*) (uv + 2 * x + 8), RoundToP010(_mm_unpackhi_epi16(a, b)));
+		}
+		for (; x < width; x++) {
+			uv[2 * x] = RoundToP010(u[x]);
+			uv[2 * x + 1] = RoundToP010(v[x]);
+		}
+	}
+}
+
+int GetP010ScaleStagingSize(int src_width, int src_height, int dst_width, int dst_height) {
+	int src_chroma = ((src_width + 1) / 2) * ((src_height + 1) / 2);
+	int dst_chroma = ((dst_width + 1) / 2) * ((dst_height + 1) / 2);
+	return (src_chroma + dst_chroma) * 2 * (int) sizeof(uint16_t);
+}
+
+int P010ScaleToOutput(const uint8_t* src_y, int src_stride_y,
+	const uint8_t* src_uv, int src_stride_uv,
+	int src_width, int src_height,
+	const OutputLayout* layout,
+	uint8_t* dst,
+	uint8_t* staging) {
+	int x, y, w, h;
+	int err;
+
+	if (!src_y || !src_uv || !dst || !staging || src_width <= 0 || src_height <= 0 ||
+		layout->format != OUTPUT_P010) {
+		return -1;
+	}
+
+	GetLetterboxRect(src_width, src_height, layout->width, layout->height, &x, &y, &w, &h);
+
+	// strides of the 16 bit planes are in samples
+	uint16_t* dst_y = (uint16_t*) dst;
+	uint16_t* dst_uv = (uint16_t*) (dst + layout->offset_u);
+	int stride_y = layout->stride_y / 2;
+	int stride_uv = layout->stride_uv / 2;
+	int half_width = (layout->width + 1) / 2;
+	int half_height = (layout->height + 1) / 2;
+	uint16_t black = IsFullRange(layout->color_space) ? 0x0000 : 64 << 6;
+
+	SetBorders16(dst_y, stride_y, layout->width, layout->height, x, y, w, h, black);
+	SetBorders16(dst_uv, stride_uv, half_width * 2, half_height, x, y / 2, w, h / 2, 512 << 6);
+
+	int src_half_width = (src_width + 1) / 2;
+	int src_half_height = (src_height + 1) / 2;
+	int rect_half_width = (w + 1) / 2;
+	int rect_half_height = (h + 1) / 2;
+	uint16_t* src_u = (uint16_t*) staging;
+	uint16_t* src_v = src_u + src_half_width * src_half_height;
+	uint16_t* rect_u = src_v + src_half_width * src_half_height;
+	uint16_t* rect_v = rect_u + rect_half_width * rect_half_height;
+
+	SplitUVPlane16((const uint16_t*) src_uv, src_stride_uv / 2, src_u, src_v, src_half_width,
+		src_half_width, src_half_height);
+
+	err = libyuv::I420Scale_16((const uint16_t*) src_y, src_stride_y / 2,
+		src_u, src_half_width,
+		src_v, src_half_width,
+		src_width, src_height,
+		dst_y + y * stride_y + x, stride_y,
+		rect_u, rect_half_width,
+		rect_v, rect_half_width,
+		w, h,
+		libyuv::FilterMode(libyuv::kFilterBox));
+	if (err) {
+		return err;
+	}
+
+	RoundPlaneToP010(dst_y + y * stride_y + x, stride_y, w, h);
+	MergeUVPlaneToP010(rect_u, rect_v, rect_half_width,
+		dst_uv + (y / 2) * stride_uv + x, stride_uv, rect_half_width, rect_half_height);
+	return 0;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+
+// YUV matrix and range of the output. Every converter below is a template on
+// it, so each combination is its own kernel with the coefficients folded in;
+// the choice is made once per capture session, not per pixel.
+enum ColorSpace {
+	COLOR_BT601_LIMITED,    // what libyuv produces, the default
+	COLOR_BT709_LIMITED,
+	COLOR_BT601_FULL,
+	COLOR_BT709_FULL,
+};
+
+// matrix is 601 or 709, anything else is taken as 601.
+ColorSpace GetColorSpace(int matrix, bool full_range);
+
+inline bool IsFullRange(ColorSpace color_space) {
+	return color_space == COLOR_BT601_FULL || color_space == COLOR_BT709_FULL;
+}
+
+// 32 bit ARGB (B, G, R, A in memory), ABGR (R, G, B, A, DXGI R8G8B8A8) and
+// R10G10B10A2 (DXGI_FORMAT_R10G10B10A2_UNORM) to I420. BT.601 limited range
+// ARGB / ABGR go to libyuv, everything else runs our own kernels. The row
+// functions are picked once at load time from the best instruction set the
+// CPU has; the C rows in ColorConvert.cpp are the reference every SIMD row
+// must match bit for bit.
+template <ColorSpace CS>
+int ARGBToI420Matrix(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+template <ColorSpace CS>
+int ABGRToI420Matrix(const uint8_t* src_abgr, int src_stride_abgr, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+template <>
+int ARGBToI420Matrix<COLOR_BT601_LIMITED>(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+template <>
+int ABGRToI420Matrix<COLOR_BT601_LIMITED>(const uint8_t* src_abgr, int src_stride_abgr, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+template <ColorSpace CS>
+int ABGR10ToI420(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u,int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+
+// DXGI_FORMAT_B5G6R5_UNORM and DXGI_FORMAT_B5G5R5A1_UNORM to I420 in one
+// pass: the SSE2 / AVX2 rows widen the 5/6 bit channels in registers and
+// produce Y and UV directly. Alpha is ignored.
+template <ColorSpace CS>
+int B5G6R5ToI420(const uint8_t* src_rgb, int src_stride_rgb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+template <ColorSpace CS>
+int B5G5R5A1ToI420(const uint8_t* src_rgb, int src_stride_rgb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+
+// R10G10B10A2 and 8 bit ARGB to P010 (10 bit 4:2:0, Y plane then
+// interleaved UV, 16 bit little endian samples MSB aligned), same
+// coefficients as the 8 bit converters with 10 bit offsets. R10G10B10A2
+// keeps all 10 bits. Strides are in bytes.
+template <ColorSpace CS>
+int ABGR10ToP010(const uint8_t* src_abgr10, int src_stride_abgr10, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_uv, int dst_stride_uv, int width, int height);
+template <ColorSpace CS>
+int ARGBToP010(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_uv, int dst_stride_uv, int width, int height);
+
+void ABGR10ToARGBRow_C(const uint8_t* src_abgr10, uint8_t* dst_argb, int width);
+void ABGR10ToARGBRow_SSE2(const uint8_t* src_abgr10, uint8_t* dst_argb, int width);
+void ABGR10ToARGBRow_AVX2(const uint8_t* src_abgr10, uint8_t* dst_argb, int width);
+
+// R10G10B10A2 to opaque 8 bit ARGB, keeping the top 8 bits of each channel
+// like ABGR10ToI420 does.
+int ABGR10ToARGB(const uint8_t* src_abgr10, int src_stride_abgr10, uint8_t* dst_argb, int dst_stride_argb, int width, int height);
+
+// Signature shared by libyuv::ARGBToI420, libyuv::ABGRToI420 and the I420
+// converters above.
+typedef int(*ARGBToI420Fn)(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_u, int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
+
+// Signature shared by ABGR10ToP010 and ARGBToP010.
+typedef int(*ToP010Fn)(const uint8_t* src, int src_stride, uint8_t* dst_y, int dst_stride_y,
+	uint8_t* dst_uv, int dst_stride_uv, int width, int height);
+
+// Signature shared by libyuv::ABGRToARGB, RGB565ToARGB, ARGB1555ToARGB and
+// ABGR10ToARGB.
+typedef int(*ToARGBFn)(const uint8_t* src, int src_stride, uint8_t* dst_argb, int dst_stride_argb, int width, int height);
+
+// Sample layouts the pin can negotiate.
+enum OutputFormat {
+	OUTPUT_I420,
+	OUTPUT_NV12,
+	OUTPUT_YUY2,
+	OUTPUT_UYVY,
+	OUTPUT_P010,
+};
+
+// Where the planes of a width x height frame sit in the sample, and the
+// color space they are written in. The packed 4:2:2 formats (YUY2, UYVY)
+// only use stride_y.
+struct OutputLayout {
+	OutputFormat format;
+	ColorSpace   color_space;
+	int          width;
+	int          height;
+	int          stride_y;
+	int          stride_uv;
+	int          offset_u;   // NV12, P010: the interleaved UV plane
+	int          offset_v;
+};
+
+void GetOutputLayout(OutputLayout* layout, OutputFormat format, ColorSpace color_space, int width, int height);
+int GetOutputFrameSize(OutputFormat format, int width, int height);
+
+// True when the first size bytes of the sample are all video black in
+// layout (Y 0x10 limited range, 0x00 full range, U and V 0x80). Probes the
+// frame sparsely before scanning all of it, and stops at the first bytes
+// that are not black.
+bool IsBlackFrame(const OutputLayout* layout, const uint8_t* sample, int size);
+
+// Writes a black frame of layout.
+void FillBlackFrame(const OutputLayout* layout, uint8_t* sample);
+
+// Color bits of 32 bit source pixels: B8G8R8A8 / R8G8B8A8 / X8 and
+// R10G10B10A2, alpha left out.
+const uint32_t ARGB_COLOR_MASK = 0x00FFFFFF;
+const uint32_t ABGR10_COLOR_MASK = 0x3FFFFFFF;
+
+// True when none of the width x height 32 bit pixels has a color bit of
+// color_mask set: a source frame that converts to a black sample, checked
+// before converting it. Same probe first, then scan as IsBlackFrame.
+bool IsBlackPixels32(const uint8_t* src, int src_stride, int width, int height, uint32_t color_mask);
+
+// What a capture found out about a frame's content before converting it,
+// for the pin's black frame detection.
+enum FrameContent {
+	CONTENT_UNKNOWN,   // not checked, the pin looks at the sample
+	CONTENT_BLACK,     // all black, the sample was not written
+	CONTENT_PICTURE,   // not black, converted into the sample as usual
+};
+
+// What the pin asks a capture to look for before converting a frame, and
+// what it found.
+struct FrameCheck {
+	bool         black;     // look for all black frames, and do not convert them
+	bool         repeat;    // look for repeats, and hand out the last output again
+	FrameContent content;   // CONTENT_UNKNOWN unless black was looked for
+	bool         repeated;  // the sample holds the last frame's output again
+};
+
+// Writes rows of ARGB pixels, src_argb pointing at the first of them, as
+// rows [first_row, first_row + rows) of the sample. first_row must be even;
+// a negative src_stride_argb walks the source bottom up.
+int ARGBToOutputRows(const OutputLayout* layout, const uint8_t* src_argb, int src_stride_argb,
+	uint8_t* dst, int first_row, int rows);
+
+// Rows of ARGB staged per pass when scaling or swizzling; 16 rows of a 1080p
+// frame are 120 KB, small enough to stay in L2.
+const int SCALE_BAND_ROWS = 16;
+
+inline int ScaleBandSize(int dst_width) {
+	return 4 * dst_width * SCALE_BAND_ROWS;
+}
+
+// ARGBScale (box filter) + conversion to the sample layout in a single pass
+// over destination rows [first_row, first_row + rows), first_row even: the
+// scaled rows are produced SCALE_BAND_ROWS at a time into band_argb and
+// written out straight away, so no full size ARGB intermediate is written
+// and read back. band_argb must hold ScaleBandSize(layout->width) bytes.
+// When no scaling is needed the source is converted directly.
+int ARGBScaleToOutputRows(const uint8_t* src_argb, int src_stride_argb, int src_width, int src_height,
+	const OutputLayout* layout, uint8_t* dst, int first_row, int rows, uint8_t* band_argb);
+
+// Same as ARGBScaleToOutputRows, restricted to the x, y, width x height rect
+// of the sample; the rest of dst is left alone. x and y must be even, and so
+// must width and height unless the rect reaches the right / bottom edge, or
+// the chroma of the pixels next to the rect is overwritten. band_argb must
+// hold ScaleBandSize(width) bytes.
+int ARGBScaleRectToOutput(const uint8_t* src_argb, int src_stride_argb, int src_width, int src_height,
+	const OutputLayout* layout, uint8_t* dst, int x, int y, int width, int height, uint8_t* band_argb);
+
+// Largest rect with the aspect ratio of the source that fits a dst_width x
+// dst_height frame, centered. Position and size are even so the chroma
+// planes line up.
+void GetLetterboxRect(int src_width, int src_height, int dst_width, int dst_height,
+	int* x, int* y, int* width, int* height);
+
+// I420Scale (box filter) of an I420 frame into the letterbox rect of the
+// sample, borders painted video black. Scaling in I420 moves 1.5 bytes per
+// pixel instead of ARGB's 4. Layouts other than I420 are scaled into
+// staging, which then must hold GetOutputFrameSize(OUTPUT_I420,
+// layout->width, layout->height) bytes, and converted from there; P010 gets
+// the 8 bit samples shifted up, so 10 bit sources go through
+// P010ScaleToOutput instead.
+int I420ScaleToOutput(const uint8_t* src_y, int src_stride_y,
+	const uint8_t* src_u, int src_stride_u,
+	const uint8_t* src_v, int src_stride_v,
+	int src_width, int src_height,
+	const OutputLayout* layout, uint8_t* dst, uint8_t* staging);
+
+// I420ScaleToOutput for a P010 frame into the letterbox rect of a P010
+// sample, all 16 bits a sample through the box filter and rounded to 10
+// bits once at the end. The chroma is split into U and V planes in
+// staging, which must hold GetP010ScaleStagingSize bytes, and scaled
+// there.
+int P010ScaleToOutput(const uint8_t* src_y, int src_stride_y,
+	const uint8_t* src_uv, int src_stride_uv,
+	int src_width, int src_height,
+	const OutputLayout* layout, uint8_t* dst, uint8_t* staging);
+int GetP010ScaleStagingSize(int src_width, int src_height, int dst_width, int dst_height);
@@ -0,0 +1,370 @@
+#include "ConversionPlan.h"
+#include "dxgi-format.h"
+#include <vector>
+#include "libyuv/convert.h"
+#include "libyuv/convert_argb.h"
+#include "libyuv/planar_functions.h"
+#include "platform.h"
+
+// One instantiation per converter / flip / packed combination, so the hot
+// path has no format or flip branches and packed frames use a stride the
+// compiler derives from the width. Bpp is bytes per source pixel.
+template <ARGBToI420Fn Convert, int Bpp, bool Flip, bool Packed>
+static int ConvertRowsToI420(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	const int src_stride = Packed ? plan->width * Bpp : plan->src_stride;
+	const OutputLayout* out = &plan->out;
+
+	// flipped, destination row first_row comes from source row
+	// height - 1 - first_row, so the band is the mirrored source range
+	if (Flip) {
+		src += (plan->height - first_row - rows) * src_stride;
+	} else {
+		src += first_row * src_stride;
+	}
+
+	return Convert(src, src_stride,
+		dst + first_row * out->stride_y, out->stride_y,
+		dst + out->offset_u + (first_row / 2) * out->stride_uv, out->stride_uv,
+		dst + out->offset_v + (first_row / 2) * out->stride_uv, out->stride_uv,
+		plan->width, Flip ? -rows : rows);
+}
+
+template <ARGBToI420Fn Convert, int Bpp>
+static ConversionPlan::RowsFn SelectRowsToI420(bool flip, int width, int pitch) {
+	bool packed = pitch == width * Bpp;
+	if (flip) {
+		return packed ? ConvertRowsToI420<Convert, Bpp, true, true> : ConvertRowsToI420<Convert, Bpp, true, false>;
+	}
+	return packed ? ConvertRowsToI420<Convert, Bpp, false, true> : ConvertRowsToI420<Convert, Bpp, false, false>;
+}
+
+template <ToP010Fn Convert, bool Flip, bool Packed>
+static int ConvertRowsToP010(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	const int src_stride = Packed ? plan->width * 4 : plan->src_stride;
+	const OutputLayout* out = &plan->out;
+
+	if (Flip) {
+		src += (plan->height - first_row - rows) * src_stride;
+	} else {
+		src += first_row * src_stride;
+	}
+
+	return Convert(src, src_stride,
+		dst + first_row * out->stride_y, out->stride_y,
+		dst + out->offset_u + (first_row / 2) * out->stride_uv, out->stride_uv,
+		plan->width, Flip ? -rows : rows);
+}
+
+template <ToP010Fn Convert>
+static ConversionPlan::RowsFn SelectRowsToP010(bool flip, int width, int pitch) {
+	bool packed = pitch == width * 4;
+	if (flip) {
+		return packed ? ConvertRowsToP010<Convert, true, true> : ConvertRowsToP010<Convert, true, false>;
+	}
+	return packed ? ConvertRowsToP010<Convert, false, true> : ConvertRowsToP010<Convert, false, false>;
+}
+
+// ARGB sources go straight into the NV12 / YUY2 / UYVY / P010 writers; flipping is
+// a negative stride from the last source row of the band.
+template <bool Flip>
+static int ConvertARGBRows(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	if (Flip) {
+		src += (plan->height - 1 - first_row) * plan->src_stride;
+		return ARGBToOutputRows(&plan->out, src, -plan->src_stride, dst, first_row, rows);
+	}
+	return ARGBToOutputRows(&plan->out, src + first_row * plan->src_stride, plan->src_stride, dst, first_row, rows);
+}
+
+// Other sources have no direct writer for the non I420 layouts. They are
+// swizzled to ARGB SCALE_BAND_ROWS at a time into a per thread scratch band
+// that stays in cache, then written out like an ARGB source. The band
+// goes with its thread.
+template <ToARGBFn ToARGB, bool Flip>
+static int ConvertStagedRows(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	static thread_local std::vector<uint8_t> band;
+
+	size_t size = ScaleBandSize(plan->width);
+	int band_stride = 4 * plan->width;
+	int end_row = first_row + rows;
+	int y;
+
+	if (band.size() < size) {
+		band.resize(size);
+	}
+	uint8_t* band_argb = band.data();
+
+	for (y = first_row; y < end_row; y += SCALE_BAND_ROWS) {
+		int band_rows = end_row - y < SCALE_BAND_ROWS ? end_row - y : SCALE_BAND_ROWS;
+		const uint8_t* band_src = Flip ?
+			src + (plan->height - y - band_rows) * plan->src_stride :
+			src + y * plan->src_stride;
+
+		int err = ToARGB(band_src, plan->src_stride, band_argb, band_stride, plan->width, Flip ? -band_rows : band_rows);
+		if (err) {
+			return err;
+		}
+
+		err = ARGBToOutputRows(&plan->out, band_argb, band_stride, dst, y, band_rows);
+		if (err) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+template <ToARGBFn ToARGB>
+static ConversionPlan::RowsFn SelectStagedRows(bool flip) {
+	return flip ? ConvertStagedRows<ToARGB, true> : ConvertStagedRows<ToARGB, false>;
+}
+
+// Row converter for a source format in color space CS, NULL when there is
+// none.
+template <ColorSpace CS>
+static ConversionPlan::RowsFn SelectRowsFn(uint32_t format, OutputFormat output_format, bool flip, int width, int pitch) {
+	bool i420 = output_format == OUTPUT_I420;
+
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+		// Overwatch
+		return i420 ?
+			SelectRowsToI420<ABGRToI420Matrix<CS>, 4>(flip, width, pitch) :
+			SelectStagedRows<libyuv::ABGRToARGB>(flip);
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+		// Hearthstone
+		// opengl / minecraft (javaw.exe)
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+		// League Of Legends 7.2.17
+		if (i420) {
+			return SelectRowsToI420<ARGBToI420Matrix<CS>, 4>(flip, width, pitch);
+		}
+		return flip ? ConvertARGBRows<true> : ConvertARGBRows<false>;
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+		// unreal engine, pubg
+		if (i420) {
+			return SelectRowsToI420<ABGR10ToI420<CS>, 4>(flip, width, pitch);
+		} else if (output_format == OUTPUT_P010) {
+			// all 10 bits make it into the sample
+			return SelectRowsToP010<ABGR10ToP010<CS> >(flip, width, pitch);
+		}
+		return SelectStagedRows<ABGR10ToARGB>(flip);
+	case DXGI_FORMAT_B5G6R5_UNORM:
+		return i420 ?
+			SelectRowsToI420<B5G6R5ToI420<CS>, 2>(flip, width, pitch) :
+			SelectStagedRows<libyuv::RGB565ToARGB>(flip);
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		return i420 ?
+			SelectRowsToI420<B5G5R5A1ToI420<CS>, 2>(flip, width, pitch) :
+			SelectStagedRows<libyuv::ARGB1555ToARGB>(flip);
+	default:
+		return NULL;
+	}
+}
+
+// Frames the hook converted itself are copied plane by plane: rows
+// [first_row, first_row + rows) and the chroma rows under them.
+static int CopyI420Rows(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	const OutputLayout* in = &plan->in;
+	const OutputLayout* out = &plan->out;
+	int uv_row = first_row / 2;
+
+	return libyuv::I420Copy(src + first_row * in->stride_y, in->stride_y,
+		src + in->offset_u + uv_row * in->stride_uv, in->stride_uv,
+		src + in->offset_v + uv_row * in->stride_uv, in->stride_uv,
+		dst + first_row * out->stride_y, out->stride_y,
+		dst + out->offset_u + uv_row * out->stride_uv, out->stride_uv,
+		dst + out->offset_v + uv_row * out->stride_uv, out->stride_uv,
+		plan->width, rows);
+}
+
+static int CopyNV12Rows(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	const OutputLayout* in = &plan->in;
+	const OutputLayout* out = &plan->out;
+	int uv_row = first_row / 2;
+
+	libyuv::CopyPlane(src + first_row * in->stride_y, in->stride_y,
+		dst + first_row * out->stride_y, out->stride_y,
+		plan->width, rows);
+	libyuv::CopyPlane(src + in->offset_u + uv_row * in->stride_uv, in->stride_uv,
+		dst + out->offset_u + uv_row * out->stride_uv, out->stride_uv,
+		in->stride_uv, (rows + 1) / 2);
+	return 0;
+}
+
+// NV12 frames that get scaled are split into I420 first.
+static int SplitNV12Rows(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows) {
+	const OutputLayout* in = &plan->in;
+	const OutputLayout* out = &plan->out;
+	int uv_row = first_row / 2;
+
+	return libyuv::NV12ToI420(src + first_row * in->stride_y, in->stride_y,
+		src + in->offset_u + uv_row * in->stride_uv, in->stride_uv,
+		dst + first_row * out->stride_y, out->stride_y,
+		dst + out->offset_u + uv_row * out->stride_uv, out->stride_uv,
+		dst + out->offset_v + uv_row * out->stride_uv, out->stride_uv,
+		plan->width, rows);
+}
+
+// The scale buffers are touched in full every frame, at 1440p and up that
+// is thousands of 4 KB pages each.
+static uint8_t* AllocScaleBuffer(ConversionPlan* plan, size_t size) {
+	if (!plan->large_pages) {
+		return new uint8_t[size];
+	}
+
+	bool large = false;
+	uint8_t* buffer = (uint8_t*)os_large_page_alloc(size, &large);
+	plan->os_buffers = true;
+	plan->large_buffers = plan->large_buffers && large;
+	return buffer;
+}
+
+static void FreeScaleBuffer(const ConversionPlan* plan, uint8_t* buffer) {
+	if (plan->os_buffers) {
+		os_large_page_free(buffer);
+	} else {
+		delete[] buffer;
+	}
+}
+
+// Sizes and layouts shared by both kinds of plan; returns the format
+// rows_fn has to write.
+static OutputFormat InitPlanLayouts(ConversionPlan* plan, int width, int height,
+	OutputFormat output_format, ColorSpace color_space, int sample_width, int sample_height) {
+	plan->width = width;
+	plan->height = height;
+	plan->scaled = sample_width != width || sample_height != height;
+
+	GetOutputLayout(&plan->sample, output_format, color_space, sample_width, sample_height);
+	if (plan->scaled && output_format == OUTPUT_P010 && plan->format != 0) {
+		// convert at source size into P010 and scale that, 16 bits a
+		// sample, so 10 bit sources keep their precision
+		plan->large_buffers = plan->large_pages;
+		plan->scale_frame = AllocScaleBuffer(plan, GetOutputFrameSize(OUTPUT_P010, width, height));
+		plan->scale_staging = AllocScaleBuffer(plan, GetP010ScaleStagingSize(width, height, sample_width, sample_height));
+	} else if (plan->scaled) {
+		// convert at source size, I420 is what gets scaled; the hook's
+		// planar frames have 8 bits to begin with
+		output_format = OUTPUT_I420;
+		plan->large_buffers = plan->large_pages;
+		plan->scale_frame = AllocScaleBuffer(plan, GetOutputFrameSize(OUTPUT_I420, width, height));
+		if (plan->sample.format != OUTPUT_I420) {
+			plan->scale_staging = AllocScaleBuffer(plan, GetOutputFrameSize(OUTPUT_I420, sample_width, sample_height));
+		}
+	}
+	GetOutputLayout(&plan->out, output_format, color_space, width, height);
+	return output_format;
+}
+
+bool BuildConversionPlan(ConversionPlan* plan, uint32_t format, bool flip, int width, int height, int pitch,
+	OutputFormat output_format, ColorSpace color_space, int sample_width, int sample_height) {
+	FreeConversionPlan(plan);
+
+	plan->format = format;
+	plan->flip = flip;
+	plan->src_stride = pitch;
+	output_format = InitPlanLayouts(plan, width, height, output_format, color_space, sample_width, sample_height);
+
+	switch (color_space) {
+	case COLOR_BT709_LIMITED:
+		plan->rows_fn = SelectRowsFn<COLOR_BT709_LIMITED>(format, output_format, flip, width, pitch);
+		break;
+	case COLOR_BT601_FULL:
+		plan->rows_fn = SelectRowsFn<COLOR_BT601_FULL>(format, output_format, flip, width, pitch);
+		break;
+	case COLOR_BT709_FULL:
+		plan->rows_fn = SelectRowsFn<COLOR_BT709_FULL>(format, output_format, flip, width, pitch);
+		break;
+	case COLOR_BT601_LIMITED:
+	default:
+		plan->rows_fn = SelectRowsFn<COLOR_BT601_LIMITED>(format, output_format, flip, width, pitch);
+		break;
+	}
+
+	return plan->rows_fn != NULL;
+}
+
+bool BuildPlanarPlan(ConversionPlan* plan, OutputFormat in_format, int width, int height,
+	OutputFormat output_format, ColorSpace color_space, int sample_width, int sample_height) {
+	FreeConversionPlan(plan);
+
+	plan->format = 0;
+	plan->flip = false;
+	GetOutputLayout(&plan->in, in_format, color_space, width, height);
+	plan->src_stride = plan->in.stride_y;
+	output_format = InitPlanLayouts(plan, width, height, output_format, color_space, sample_width, sample_height);
+
+	if (in_format == OUTPUT_I420 && output_format == OUTPUT_I420) {
+		plan->rows_fn = CopyI420Rows;
+	} else if (in_format == OUTPUT_NV12 && output_format == OUTPUT_NV12) {
+		plan->rows_fn = CopyNV12Rows;
+	} else if (in_format == OUTPUT_NV12 && output_format == OUTPUT_I420) {
+		plan->rows_fn = SplitNV12Rows;
+	}
+
+	return plan->rows_fn != NULL;
+}
+
+void FreeConversionPlan(ConversionPlan* plan) {
+	FreeScaleBuffer(plan, plan->scale_frame);
+	FreeScaleBuffer(plan, plan->scale_staging);
+	plan->scale_frame = NULL;
+	plan->scale_staging = NULL;
+	plan->large_buffers = false;
+	plan->os_buffers = false;
+	plan->scaled = false;
+	plan->rows_fn = NULL;
+}
+
+FrameContent ConversionPlan::SourceContent(const uint8_t* src) const {
+	uint32_t color_mask;
+
+	if (!IsValid()) {
+		return CONTENT_UNKNOWN;
+	}
+
+	if (format == 0) {
+		int size = GetOutputFrameSize(in.format, in.width, in.height);
+		return IsBlackFrame(&in, src, size) ? CONTENT_BLACK : CONTENT_PICTURE;
+	}
+
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+		color_mask = ARGB_COLOR_MASK;
+		break;
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+		color_mask = ABGR10_COLOR_MASK;
+		break;
+	default:
+		return CONTENT_UNKNOWN;
+	}
+
+	return IsBlackPixels32(src, src_stride, width, height, color_mask) ? CONTENT_BLACK : CONTENT_PICTURE;
+}
+
+size_t ConversionPlan::SourceSize() const {
+	if (format == 0) {
+		return (size_t)GetOutputFrameSize(in.format, in.width, in.height);
+	}
+	return (size_t)src_stride * height;
+}
+
+int ConversionPlan::ScaleToSample(uint8_t* dst) const {
+	if (!scaled) {
+		return 0;
+	}
+
+	if (out.format == OUTPUT_P010) {
+		return P010ScaleToOutput(scale_frame, out.stride_y,
+			scale_frame + out.offset_u, out.stride_uv,
+			width, height,
+			&sample, dst, scale_staging);
+	}
+
+	return I420ScaleToOutput(scale_frame, out.stride_y,
+		scale_frame + out.offset_u, out.stride_uv,
+		scale_frame + out.offset_v, out.stride_uv,
+		width, height,
+		&sample, dst, scale_staging);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ColorConvert.h"
+
+// How a shared memory game frame turns into the output sample, resolved once
+// per capture session in init_shmem_capture: the row converter is picked by
+// template on source format, color space, flip and whether rows are tightly
+// packed, and the sample plane offsets and strides are precomputed. Per
+// frame (or per ConvertPool band) this is a single indirect call.
+//
+// New source formats go into BuildConversionPlan, not the per frame path.
+struct ConversionPlan {
+	typedef int(*RowsFn)(const ConversionPlan* plan, const uint8_t* src, uint8_t* dst, int first_row, int rows);
+
+	RowsFn   rows_fn;   // NULL when the source format is not supported
+	uint32_t format;    // DXGI_FORMAT of the source, 0 for planar sources
+	bool     flip;
+
+	int      width;
+	int      height;
+	int      src_stride;
+
+	OutputLayout in;    // planar sources: where the planes sit in the slot
+	OutputLayout out;   // what rows_fn writes
+
+	// Set when the hook delivers a different size than the sample: rows_fn
+	// writes I420 (P010 for P010 samples) at source size into scale_frame
+	// and ScaleToSample letterboxes that into the sample.
+	bool         scaled;
+	OutputLayout sample;
+	uint8_t*     scale_frame;
+	uint8_t*     scale_staging;   // non I420 samples, see I420ScaleToOutput and P010ScaleToOutput
+
+	// Set before building to put the scale buffers on large pages, see
+	// os_large_page_alloc; large_buffers tells whether they got them.
+	bool         large_pages;
+	bool         large_buffers;
+	bool         os_buffers;      // allocated with os_large_page_alloc
+
+	bool IsValid() const { return rows_fn != NULL; }
+
+	// Converts destination rows [first_row, first_row + rows), first_row even,
+	// into dst, or into scale_frame when scaled.
+	int ConvertRows(const uint8_t* src, uint8_t* dst, int first_row, int rows) const {
+		return rows_fn(this, src, scaled ? scale_frame : dst, first_row, rows);
+	}
+
+	// Once all rows are converted, scales scale_frame into the sample.
+	int ScaleToSample(uint8_t* dst) const;
+
+	// Whether the source frame is all black, before converting it; unknown
+	// for the 16 bit formats.
+	FrameContent SourceContent(const uint8_t* src) const;
+
+	// Bytes of the source frame in the slot, what repeats are hashed over.
+	size_t SourceSize() const;
+};
+
+// Fills plan for a width x height source of DXGI format with rows pitch bytes
+// apart, converted into a sample_width x sample_height output sample in
+// color_space. When the sizes differ the plan converts at source size and
+// scales in I420, or in P010 for P010 samples. Returns false, with plan->rows_fn left NULL, for formats
+// there is no converter for.
+//
+// plan must be zeroed or built before; buffers of a previous build are
+// freed, and the scale buffers allocated anew.
+bool BuildConversionPlan(ConversionPlan* plan, uint32_t format, bool flip, int width, int height, int pitch,
+	OutputFormat output_format, ColorSpace color_space, int sample_width, int sample_height);
+
+// Fills plan for a width x height frame the hook already converted to
+// in_format (I420 or NV12, see SHMEM_TRANSPORT_*): planes are copied into
+// the sample when it has the same layout and size, and scaled in I420
+// otherwise. Returns false for any other pairing.
+bool BuildPlanarPlan(ConversionPlan* plan, OutputFormat in_format, int width, int height,
+	OutputFormat output_format, ColorSpace color_space, int sample_width, int sample_height);
+
+void FreeConversionPlan(ConversionPlan* plan);
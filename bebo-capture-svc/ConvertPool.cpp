@@ -0,0 +1,150 @@
+#include "ConvertPool.h"
+
+ConvertPool::ConvertPool(int threads) :
+	threads_(1),
+	job_(nullptr),
+	job_height_(0),
+	job_bands_(0),
+	pending_(0),
+	generation_(0),
+	quit_(false)
+{
+	Start(threads);
+}
+
+ConvertPool::~ConvertPool() {
+	Stop();
+}
+
+int ConvertPool::DefaultThreads() {
+	int threads = (int) std::thread::hardware_concurrency() / 2;
+	if (threads < 1) {
+		return 1;
+	}
+	return threads > 4 ? 4 : threads;
+}
+
+void ConvertPool::SetThreads(int threads) {
+	if (threads < 1) {
+		threads = 1;
+	} else if (threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+
+	if (threads == threads_) {
+		return;
+	}
+
+	Stop();
+	Start(threads);
+}
+
+void ConvertPool::Start(int threads) {
+	if (threads < 1) {
+		threads = 1;
+	} else if (threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+
+	quit_ = false;
+	threads_ = threads;
+	// workers of an earlier Start() ran the frames up to generation_, the
+	// new ones wait for the next
+	for (int band = 1; band < threads_; band++) {
+		workers_.push_back(std::thread(&ConvertPool::WorkerLoop, this, band, generation_));
+	}
+}
+
+void ConvertPool::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	work_cv_.notify_all();
+
+	for (size_t i = 0; i < workers_.size(); i++) {
+		workers_[i].join();
+	}
+	workers_.clear();
+	threads_ = 1;
+}
+
+int ConvertPool::BandCount(int height, int threads) {
+	int bands = height / MIN_BAND_ROWS;
+	if (bands > threads) {
+		bands = threads;
+	}
+	return bands < 1 ? 1 : bands;
+}
+
+void ConvertPool::BandRange(int height, int bands, int band, int* first_row, int* rows) {
+	// round up to even rows, the last band takes what is left
+	int band_rows = ((height + bands - 1) / bands + 1) & ~1;
+	int first = band * band_rows;
+	int count = height - first < band_rows ? height - first : band_rows;
+
+	*first_row = first;
+	*rows = count > 0 ? count : 0;
+}
+
+void ConvertPool::Run(int height, const BandFn& fn) {
+	int bands = BandCount(height, threads_);
+
+	if (bands == 1) {
+		fn(0, 0, height);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job_ = &fn;
+		job_height_ = height;
+		job_bands_ = bands;
+		pending_ = bands - 1;
+		generation_++;
+	}
+	work_cv_.notify_all();
+
+	int first_row, rows;
+	BandRange(height, bands, 0, &first_row, &rows);
+	fn(0, first_row, rows);
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_cv_.wait(lock, [this] { return pending_ == 0; });
+	job_ = nullptr;
+}
+
+void ConvertPool::WorkerLoop(int band, uint64_t seen) {
+	for (;;) {
+		const BandFn* job;
+		int first_row, rows;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			work_cv_.wait(lock, [this, seen] { return quit_ || generation_ != seen; });
+			if (quit_) {
+				return;
+			}
+
+			seen = generation_;
+			if (band >= job_bands_) {
+				// frame too small to need this thread
+				continue;
+			}
+
+			job = job_;
+			BandRange(job_height_, job_bands_, band, &first_row, &rows);
+		}
+
+		if (rows > 0) {
+			(*job)(band, first_row, rows);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (--pending_ == 0) {
+				done_cv_.notify_one();
+			}
+		}
+	}
+}
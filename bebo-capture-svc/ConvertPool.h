@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for colour conversion. A frame is cut into one
+// horizontal band per thread; every band but the last starts on an even row
+// and has an even row count, so 4:2:0 chroma rows never straddle two bands
+// and the bands can be converted straight into the output sample in parallel.
+class ConvertPool {
+public:
+	static const int MAX_THREADS = 8;
+	// below this a band costs more in wake up than it saves
+	static const int MIN_BAND_ROWS = 64;
+
+	typedef std::function<void(int band, int first_row, int rows)> BandFn;
+
+	explicit ConvertPool(int threads);
+	~ConvertPool();
+
+	// half the hardware threads, capped at 4 - the game and the encoder
+	// need the rest
+	static int DefaultThreads();
+
+	// 1 runs everything on the calling thread.
+	void SetThreads(int threads);
+	int GetThreads() const { return threads_; }
+
+	// Runs fn once per band of a frame of height rows and returns when all
+	// bands are done. The calling thread converts band 0 itself. band is
+	// below GetThreads(), so callers can use it to pick per band scratch.
+	void Run(int height, const BandFn& fn);
+
+private:
+	ConvertPool(const ConvertPool&) = delete;
+	ConvertPool& operator=(const ConvertPool&) = delete;
+
+	static int BandCount(int height, int threads);
+	static void BandRange(int height, int bands, int band, int* first_row, int* rows);
+
+	void Start(int threads);
+	void Stop();
+	void WorkerLoop(int band, uint64_t seen);
+
+	int threads_;
+	std::vector<std::thread> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable work_cv_;
+	std::condition_variable done_cv_;
+	const BandFn* job_;
+	int job_height_;
+	int job_bands_;
+	int pending_;
+	uint64_t generation_;
+	bool quit_;
+};
+
+// Runs fn over a frame of height rows on pool, or as a single band on the
+// calling thread when there is no pool.
+inline void RunBands(ConvertPool* pool, int height, const ConvertPool::BandFn& fn) {
+	if (pool) {
+		pool->Run(height, fn);
+	} else {
+		fn(0, 0, height);
+	}
+}
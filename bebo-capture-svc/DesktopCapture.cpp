@@ -8,8 +8,7 @@ using namespace DirectX;
 #include <tchar.h>
 #include <windows.h>
 #include <dxgi.h>
-#include "libyuv/convert.h"
-#include "libyuv/scale_argb.h"
+#include "ColorConvert.h"
 #include "CommonTypes.h"
 
 
@@ -46,7 +45,13 @@ DesktopCapture::DesktopCapture() : m_Device(nullptr),
 	m_Initialized(false),
 	m_LastFrameData(new FrameData),
 	m_LastDesktopFrame(new DesktopFrame),
-	m_negotiatedArgbBuffer(nullptr)
+	m_scaleBandBuffer(nullptr),
+	m_convertPool(nullptr),
+	m_outputFrame(nullptr),
+	m_outputFrameSize(0),
+	m_outputSourceWidth(0),
+	m_outputSourceHeight(0),
+	m_fullConvert(true)
 {
 	m_retryTimeout = 0;
 	RtlZeroMemory(&m_OutputDesc, sizeof(DXGI_OUTPUT_DESC));
@@ -84,9 +89,14 @@ DesktopCapture::~DesktopCapture()
 		m_MouseInfo = nullptr;
 	}
 
-	if (m_negotiatedArgbBuffer) {
-		delete[] m_negotiatedArgbBuffer;
-		m_negotiatedArgbBuffer = nullptr;
+	if (m_scaleBandBuffer) {
+		delete[] m_scaleBandBuffer;
+		m_scaleBandBuffer = nullptr;
+	}
+
+	if (m_outputFrame) {
+		delete[] m_outputFrame;
+		m_outputFrame = nullptr;
 	}
 }
 
@@ -128,17 +138,26 @@ void DesktopCapture::CleanRefs()
 //
 // Initialize
 //
-void DesktopCapture::Init(int adapterId, int desktopId, int width, int height)
+void DesktopCapture::Init(int adapterId, int desktopId, int width, int height, OutputFormat format, ColorSpace color_space)
 {
     m_iAdapterNumber = adapterId;
     m_iDesktopNumber = desktopId;
     m_negotiatedWidth = width;
     m_negotiatedHeight = height;
+    GetOutputLayout(&m_outputLayout, format, color_space, width, height);
 
-    if (m_negotiatedArgbBuffer) {
-        delete[] m_negotiatedArgbBuffer;
+    if (m_scaleBandBuffer) {
+        delete[] m_scaleBandBuffer;
     }
-    m_negotiatedArgbBuffer = new BYTE[4 * m_negotiatedWidth * m_negotiatedHeight];
+    // one band per convert thread
+    m_scaleBandBuffer = new BYTE[ScaleBandSize(m_negotiatedWidth) * ConvertPool::MAX_THREADS];
+
+    if (m_outputFrame) {
+        delete[] m_outputFrame;
+    }
+    m_outputFrameSize = GetOutputFrameSize(format, width, height);
+    m_outputFrame = new BYTE[m_outputFrameSize];
+    m_fullConvert = true;
 
     HRESULT hr = InitializeDXResources();
 
@@ -315,6 +334,8 @@ HRESULT DesktopCapture::InitDuplication() {
 		error_hr("Failed to create staging texture", hr);
 		return hr;
 	}
+	// new texture, the output frame has to be converted from scratch
+	m_fullConvert = true;
 
 	if (m_Surface) {
 		m_Surface->Release();
@@ -468,6 +489,9 @@ void DesktopCapture::CopyMove(FrameData* data, INT offsetX, INT offsetY)
 		m_DeviceContext->CopySubresourceRegion(m_StagingTexture, 0, dest_rect.left + m_OutputDesc.DesktopCoordinates.left - offsetX, 
 			dest_rect.top + m_OutputDesc.DesktopCoordinates.top - offsetY, 0, m_MoveSurf, 0, &box);
 
+		OffsetRect(&dest_rect, m_OutputDesc.DesktopCoordinates.left - offsetX, m_OutputDesc.DesktopCoordinates.top - offsetY);
+		AddDirtyRect(&dest_rect);
+
 		move_buffer++;
 		move_count--;
 	}
@@ -491,6 +515,7 @@ void DesktopCapture::CopyDirty(FrameData* data, INT offsetX, INT offsetY)
 		Box.back = 1;
 
 		m_DeviceContext->CopySubresourceRegion(m_StagingTexture, 0, dirty_buffer->left, dirty_buffer->top, 0, data->Frame, 0, &Box);
+		AddDirtyRect(dirty_buffer);
 
 		dirty_buffer++;
 		dirty_count--;
@@ -503,45 +528,110 @@ static inline int getI420BufferSize(int width, int height) {
 	return width * height + half_width * half_height * 2;
 }
 
-static uint8_t* copy_frame = new uint8_t[4 * 1920 * 1080];
-
-bool DesktopCapture::PushFrame(IMediaSample* pSample, DesktopFrame* frame) {
-	if (!frame->data() || frame->stride() == 0) {
-		warn("push frame - no data");
-		return false;
-	}
-
-	BYTE *pData;
-	pSample->GetPointer(&pData);
+void DesktopCapture::AddDirtyRect(const RECT* rect) {
+	DirtyRect dirty = { rect->left, rect->top, rect->right, rect->bottom };
+	m_dirtyRects.push_back(dirty);
+}
 
+//
+// Brings m_outputFrame up to date with the staging texture: converted from
+// scratch after (re)initialization, otherwise only where this frame's move
+// and dirty rects touched it.
+//
+void DesktopCapture::UpdateOutputFrame(DesktopFrame* frame) {
 	const uint8_t* src_frame = frame->data();
 	int src_stride_frame = frame->stride();
 	int src_width = frame->width();
 	int src_height = frame->height();
+	int band_size = ScaleBandSize(m_negotiatedWidth);
+	int count = 0;
 
-	int scaled_argb_stride = 4 * m_negotiatedWidth;
+	if (src_width != m_outputSourceWidth || src_height != m_outputSourceHeight) {
+		m_fullConvert = true;
+	}
 
-	libyuv::ARGBScale(
-		src_frame, src_stride_frame,
-		src_width, src_height,
-		m_negotiatedArgbBuffer, scaled_argb_stride,
-		m_negotiatedWidth, m_negotiatedHeight,
-		libyuv::FilterMode(libyuv::kFilterBox)
-	);
+	if (!m_fullConvert) {
+		// to output rects, in place
+		for (size_t i = 0; i < m_dirtyRects.size(); i++) {
+			if (ScaleDirtyRect(&m_dirtyRects[i], src_width, src_height,
+				m_negotiatedWidth, m_negotiatedHeight, &m_dirtyRects[count])) {
+				count++;
+			}
+		}
+		count = MergeDirtyRects(m_dirtyRects.data(), count);
 
+		// past half the frame a full convert costs about the same and
+		// splits evenly across the pool
+		if (DirtyRectsArea(m_dirtyRects.data(), count) * 2 > (int64_t) m_negotiatedWidth * m_negotiatedHeight) {
+			m_fullConvert = true;
+		}
+	}
+
+	if (m_fullConvert) {
+		RunBands(m_convertPool, m_negotiatedHeight, [&](int band, int first_row, int rows) {
+			ARGBScaleToOutputRows(src_frame, src_stride_frame,
+				src_width, src_height,
+				&m_outputLayout, m_outputFrame,
+				first_row, rows,
+				m_scaleBandBuffer + band * band_size);
+		});
+		m_outputSourceWidth = src_width;
+		m_outputSourceHeight = src_height;
+		m_fullConvert = false;
+	} else if (count) {
+		const DirtyRect* rects = m_dirtyRects.data();
+
+		RunBands(m_convertPool, m_negotiatedHeight, [&](int band, int first_row, int rows) {
+			ARGBScaleDirtyRectsToOutput(src_frame, src_stride_frame,
+				src_width, src_height,
+				&m_outputLayout, m_outputFrame,
+				rects, count,
+				first_row, rows,
+				m_scaleBandBuffer + band * band_size);
+		});
+	}
+
+	m_dirtyRects.clear();
+}
+
+bool DesktopCapture::PushFrame(IMediaSample* pSample, DesktopFrame* frame, FrameCheck* check) {
+	if (!frame->data() || frame->stride() == 0) {
+		warn("push frame - no data");
+		return false;
+	}
 
-	uint8* y = pData;
-	int stride_y = m_negotiatedWidth;
-	uint8* u = pData + (m_negotiatedWidth * m_negotiatedHeight);
-	int stride_u = (m_negotiatedWidth + 1) / 2;
-	uint8* v = u + ((m_negotiatedWidth * m_negotiatedHeight) >> 2);
-	int stride_v = stride_u;
+	if (check && check->black) {
+		if (IsBlackPixels32(frame->data(), frame->stride(), frame->width(), frame->height(), ARGB_COLOR_MASK)) {
+			// the output frame is what converting the whole staging texture
+			// would give, so later dirty rects still apply on top of it
+			FillBlackFrame(&m_outputLayout, m_outputFrame);
+			m_outputSourceWidth = frame->width();
+			m_outputSourceHeight = frame->height();
+			m_dirtyRects.clear();
+			check->content = CONTENT_BLACK;
+			return true;
+		}
+		check->content = CONTENT_PICTURE;
+	}
 
-	libyuv::ARGBToI420(m_negotiatedArgbBuffer, scaled_argb_stride,
-		y, stride_y,
-		u, stride_u,
-		v, stride_v,
-		m_negotiatedWidth, m_negotiatedHeight);
+	// duplication already tells what changed: without move or dirty rects
+	// the output frame is handed out again as it is, no hash needed
+	if (check && check->repeat) {
+		check->repeated = !m_fullConvert && m_dirtyRects.empty() &&
+			frame->width() == m_outputSourceWidth && frame->height() == m_outputSourceHeight;
+	}
+
+	BYTE *pData;
+	pSample->GetPointer(&pData);
+
+	// the output frame follows the desktop either way, dirty rects only
+	// apply on top of the last one
+	UpdateOutputFrame(frame);
+	if (pSample->GetSize() < (long)m_outputFrameSize) {
+		warn("sample of %ld bytes too small for a %d byte frame", pSample->GetSize(), m_outputFrameSize);
+		return false;
+	}
+	memcpy(pData, m_outputFrame, m_outputFrameSize);
 
 	return true;
 }
@@ -741,7 +831,7 @@ void DesktopCapture::Cleanup()
 //
 // Get next frame and write it into Data
 //
-bool DesktopCapture::GetFrame(IMediaSample *pSample, bool captureMouse, REFERENCE_TIME now)
+bool DesktopCapture::GetFrame(IMediaSample *pSample, bool captureMouse, REFERENCE_TIME now, FrameCheck* check)
 {
 	if (!m_Initialized) {
 		error("DesktopCapture.Init() required.");
@@ -771,7 +861,7 @@ bool DesktopCapture::GetFrame(IMediaSample *pSample, bool captureMouse, REFERENC
 
 	m_Surface->Map(&map, D3D11_MAP_READ);
     m_LastDesktopFrame->updateFrame(frame_desc.Width, frame_desc.Height, map.Pitch, map.pBits);
-    got_frame = PushFrame(pSample, m_LastDesktopFrame);
+    got_frame = PushFrame(pSample, m_LastDesktopFrame, check);
 	m_Surface->Unmap();
 
 	DoneWithFrame();
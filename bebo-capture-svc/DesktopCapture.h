@@ -5,7 +5,11 @@
 #include <dshow.h>
 #include <windows.h>
 #include <stdint.h>
+#include <vector>
 #include "CommonTypes.h"
+#include "ColorConvert.h"
+#include "ConvertPool.h"
+#include "DirtyRects.h"
 
 class DesktopFrame {
 public:
@@ -37,13 +41,16 @@ class DesktopCapture {
 public:
 	DesktopCapture();
 	~DesktopCapture();
-	void Init(int adapterId, int desktopId, int width, int height);
+	void Init(int adapterId, int desktopId, int width, int height, OutputFormat format, ColorSpace color_space);
 	
 	void Cleanup();
-	bool GetFrame(IMediaSample *pSimple, bool captureMouse, REFERENCE_TIME now);
+	// With check, a black desktop is not converted, and frames without move
+	// or dirty rects are told apart as repeats, see FrameCheck.
+	bool GetFrame(IMediaSample *pSimple, bool captureMouse, REFERENCE_TIME now, FrameCheck* check = NULL);
 	bool GetOldFrame(IMediaSample *pSimple, bool captureMouse);
 	bool DoneWithFrame();
 	bool IsReady() { return m_Initialized;  };
+	void SetConvertPool(ConvertPool* pool) { m_convertPool = pool; };
 
 private:
 	// methods
@@ -62,7 +69,9 @@ private:
 	HRESULT ReinitializeDuplication();
 
 	bool AcquireNextFrame(DXGI_OUTDUPL_FRAME_INFO * frame, REFERENCE_TIME now);
-	bool PushFrame(IMediaSample *pSample, DesktopFrame* frame);
+	bool PushFrame(IMediaSample *pSample, DesktopFrame* frame, FrameCheck* check = NULL);
+	void AddDirtyRect(const RECT* rect);
+	void UpdateOutputFrame(DesktopFrame* frame);
 
 	void CleanRefs();
 
@@ -90,6 +99,17 @@ private:
 	REFERENCE_TIME m_retryTimeout;
 	int m_negotiatedWidth;
 	int m_negotiatedHeight;
-	BYTE* m_negotiatedArgbBuffer;
+	OutputLayout m_outputLayout;
+	BYTE* m_scaleBandBuffer;
+	ConvertPool* m_convertPool;
+
+	// The converted desktop is kept between frames and only the output rects
+	// the move and dirty rects map to are re-converted, see DirtyRects.h.
+	BYTE* m_outputFrame;
+	int m_outputFrameSize;
+	int m_outputSourceWidth;
+	int m_outputSourceHeight;
+	bool m_fullConvert;	// m_outputFrame does not match the staging texture
+	std::vector<DirtyRect> m_dirtyRects;	// staging texture coordinates
 };
 #endif
\ No newline at end of file
@@ -47,6 +47,16 @@ long double GetCounterSinceStartMillis(__int64 sinceThisTime) // see above for s
 	return long double(li.QuadPart - sinceThisTime) / PCFreqMillis; //division kind of forces us to return a double of some sort...
 } // LODO do I really need long double here? no really.
 
+// same clock and units as os_gettime_ns() in the graphics hook, which stamps
+// captured frames with it
+QWORD GetCounterNanos()
+{
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	ASSERT_RAISE(PCFreqMillis != 0.0);
+	return QWORD(long double(li.QuadPart) * 1000000.0 / PCFreqMillis);
+}
+
 void AddMouse(HDC hMemDC, LPRECT lpRect, HDC hScrDC, HWND hwnd) {
 	__int64 start = StartCounter();
 	POINT p;
@@ -18,6 +18,7 @@ typedef unsigned __int64 QWORD;
 void WarmupCounter();
 __int64 StartCounter();
 long double GetCounterSinceStartMillis(__int64 start);
+QWORD GetCounterNanos();
 void AddMouse(HDC hMemDC, LPRECT lpRect, HDC hScrDC, HWND hwnd);
 
 #define ASSERT_RAISE(cond) \
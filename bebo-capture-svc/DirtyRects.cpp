@@ -0,0 +1,116 @@
+#include "DirtyRects.h"
+
+static inline int Clamp(int v, int lo, int hi) {
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+bool ScaleDirtyRect(const DirtyRect* src, int src_width, int src_height,
+	int dst_width, int dst_height, DirtyRect* dst) {
+	if (src_width <= 0 || src_height <= 0 || src->right <= src->left || src->bottom <= src->top) {
+		return false;
+	}
+
+	int left = src->left;
+	int top = src->top;
+	int right = src->right;
+	int bottom = src->bottom;
+
+	if (src_width != dst_width || src_height != dst_height) {
+		// round outwards, 64 bit as 4K * 4K overflows int
+		left = (int) ((int64_t) left * dst_width / src_width) - 1;
+		top = (int) ((int64_t) top * dst_height / src_height) - 1;
+		right = (int) (((int64_t) right * dst_width + src_width - 1) / src_width) + 1;
+		bottom = (int) (((int64_t) bottom * dst_height + src_height - 1) / src_height) + 1;
+	}
+
+	left = Clamp(left, 0, dst_width) & ~1;
+	top = Clamp(top, 0, dst_height) & ~1;
+	right = Clamp((right + 1) & ~1, 0, dst_width);
+	bottom = Clamp((bottom + 1) & ~1, 0, dst_height);
+
+	if (right <= left || bottom <= top) {
+		return false;
+	}
+
+	dst->left = left;
+	dst->top = top;
+	dst->right = right;
+	dst->bottom = bottom;
+	return true;
+}
+
+static inline bool Overlaps(const DirtyRect* a, const DirtyRect* b) {
+	return a->left < b->right && b->left < a->right &&
+		a->top < b->bottom && b->top < a->bottom;
+}
+
+int MergeDirtyRects(DirtyRect* rects, int count) {
+	bool merged = true;
+	int i;
+	int j;
+
+	// a merged box can overlap rects that were already checked, so go
+	// again until a pass merges nothing
+	while (merged) {
+		merged = false;
+		for (i = 0; i < count; i++) {
+			DirtyRect* a = &rects[i];
+
+			for (j = i + 1; j < count; j++) {
+				const DirtyRect* b = &rects[j];
+				if (!Overlaps(a, b)) {
+					continue;
+				}
+
+				if (b->left < a->left) a->left = b->left;
+				if (b->top < a->top) a->top = b->top;
+				if (b->right > a->right) a->right = b->right;
+				if (b->bottom > a->bottom) a->bottom = b->bottom;
+
+				// b is replaced by the last rect, check slot j again
+				rects[j] = rects[--count];
+				j--;
+				merged = true;
+			}
+		}
+	}
+	return count;
+}
+
+int64_t DirtyRectsArea(const DirtyRect* rects, int count) {
+	int64_t area = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		area += (int64_t) (rects[i].right - rects[i].left) * (rects[i].bottom - rects[i].top);
+	}
+	return area;
+}
+
+int ARGBScaleDirtyRectsToOutput(const uint8_t* src_argb, int src_stride_argb, int src_width, int src_height,
+	const OutputLayout* layout, uint8_t* dst, const DirtyRect* rects, int count,
+	int first_row, int rows, uint8_t* band_argb) {
+	int end_row = first_row + rows;
+	int i;
+
+	if ((first_row & 1) || rows <= 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		int top = rects[i].top > first_row ? rects[i].top : first_row;
+		int bottom = rects[i].bottom < end_row ? rects[i].bottom : end_row;
+
+		if (bottom <= top) {
+			continue;
+		}
+
+		int err = ARGBScaleRectToOutput(src_argb, src_stride_argb, src_width, src_height,
+			layout, dst, rects[i].left, top, rects[i].right - rects[i].left, bottom - top,
+			band_argb);
+		if (err) {
+			return err;
+		}
+	}
+	return 0;
+}
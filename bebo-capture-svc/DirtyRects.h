@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include "ColorConvert.h"
+
+// Incremental desktop conversion: DXGI duplication reports which parts of the
+// desktop changed (move and dirty rects), DesktopCapture keeps the converted
+// output frame between frames and only re-converts the output rects those
+// map to. Nothing here depends on windows.h, so it can be exercised off
+// Windows with made up rect lists.
+
+// Right and bottom are exclusive, like a Win32 RECT.
+struct DirtyRect {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+// Maps src, a rect of a src_width x src_height frame, to the rect of the
+// dst_width x dst_height output whose pixels it can change: one pixel of
+// margin for the scaler's filter taps when the sizes differ, edges rounded
+// out to even so whole chroma samples are rewritten, clipped to the frame.
+// Returns false when nothing is left.
+bool ScaleDirtyRect(const DirtyRect* src, int src_width, int src_height,
+	int dst_width, int dst_height, DirtyRect* dst);
+
+// Replaces overlapping rects by their bounding box until no two overlap, so
+// no output pixel is converted twice. Returns the new count.
+int MergeDirtyRects(DirtyRect* rects, int count);
+
+// Pixels covered by rects, which must not overlap.
+int64_t DirtyRectsArea(const DirtyRect* rects, int count);
+
+// Re-converts the parts of rects (output coordinates, as returned by
+// ScaleDirtyRect) that fall in rows [first_row, first_row + rows) of the
+// sample, first_row even, so a frame can be updated one ConvertPool band at a
+// time. The rest of dst keeps what an earlier conversion wrote. band_argb
+// must hold ScaleBandSize(layout->width) bytes.
+int ARGBScaleDirtyRectsToOutput(const uint8_t* src_argb, int src_stride_argb, int src_width, int src_height,
+	const OutputLayout* layout, uint8_t* dst, const DirtyRect* rects, int count,
+	int first_row, int rows, uint8_t* band_argb);
@@ -0,0 +1,174 @@
+#include "FrameHash.h"
+#include <emmintrin.h>
+#include <string.h>
+
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+
+// stripes of 64 bytes between scrambles, see Scramble
+static const int HASH_STRIPES = 16;
+
+static inline uint64_t Mix64(uint64_t h) {
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return h;
+}
+
+// 16 bytes into a pair of 64 bit lanes: the two 32 bit halves of the data
+// keyed by its position multiplied together, plus the data itself, so a
+// lane of zeros after keying still counts
+static inline __m128i Accumulate(__m128i acc, __m128i data, __m128i key) {
+	__m128i keyed = _mm_xor_si128(data, key);
+	__m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+	acc = _mm_add_epi64(acc, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_add_epi64(acc, product);
+}
+
+// every HASH_STRIPES the lanes are mixed, so long runs of additions do not
+// cancel each other out
+static inline __m128i Scramble(__m128i acc, __m128i key) {
+	const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+	acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47));
+	acc = _mm_xor_si128(acc, key);
+	__m128i lo = _mm_mul_epu32(acc, prime);
+	__m128i hi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+	return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+}
+
+uint64_t HashFrameBlock(const uint8_t* data, size_t size, uint32_t index) {
+	// a key per lane, moving on by step every stripe
+	const __m128i step = _mm_set_epi32(0x27D4EB2F, 0x165667B1, 0x85EBCA77, (int)PRIME32_1);
+	const __m128i scramble_key = _mm_set_epi32(0x7F4A7C15, 0x3C6EF372, 0xBB67AE85, 0x6A09E667);
+	__m128i base = _mm_set1_epi32((int)(index * PRIME32_1));
+
+	__m128i acc0 = _mm_set_epi64x(PRIME64_1, PRIME64_2);
+	__m128i acc1 = _mm_set_epi64x(PRIME64_2, index);
+	__m128i acc2 = _mm_set_epi64x(PRIME64_1 ^ index, PRIME64_1);
+	__m128i acc3 = _mm_set_epi64x(index, PRIME64_2 ^ size);
+
+	size_t stripes = size / 64;
+	const uint8_t* p = data;
+
+	for (size_t done = 0; done < stripes; ) {
+		size_t run = stripes - done < HASH_STRIPES ? stripes - done : HASH_STRIPES;
+		__m128i key = base;
+
+		for (size_t i = 0; i < run; i++, p += 64) {
+			acc0 = Accumulate(acc0, _mm_loadu_si128((const __m128i*)p), key);
+			acc1 = Accumulate(acc1, _mm_loadu_si128((const __m128i*)(p + 16)), _mm_shuffle_epi32(key, _MM_SHUFFLE(2, 1, 0, 3)));
+			acc2 = Accumulate(acc2, _mm_loadu_si128((const __m128i*)(p + 32)), _mm_shuffle_epi32(key, _MM_SHUFFLE(1, 0, 3, 2)));
+			acc3 = Accumulate(acc3, _mm_loadu_si128((const __m128i*)(p + 48)), _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 2, 1)));
+			key = _mm_add_epi32(key, step);
+		}
+		done += run;
+
+		if (run == HASH_STRIPES) {
+			acc0 = Scramble(acc0, scramble_key);
+			acc1 = Scramble(acc1, scramble_key);
+			acc2 = Scramble(acc2, scramble_key);
+			acc3 = Scramble(acc3, scramble_key);
+		}
+		base = _mm_add_epi32(base, _mm_set1_epi32(HASH_STRIPES));
+	}
+
+	// the last bytes as a stripe padded with zeros, the size tells them
+	// apart from real zeros
+	size_t tail = size & 63;
+	if (tail) {
+		uint8_t last[64] = { 0 };
+		memcpy(last, p, tail);
+		acc0 = Accumulate(acc0, _mm_loadu_si128((const __m128i*)last), base);
+		acc1 = Accumulate(acc1, _mm_loadu_si128((const __m128i*)(last + 16)), base);
+		acc2 = Accumulate(acc2, _mm_loadu_si128((const __m128i*)(last + 32)), base);
+		acc3 = Accumulate(acc3, _mm_loadu_si128((const __m128i*)(last + 48)), base);
+	}
+
+	uint64_t lanes[8];
+	_mm_storeu_si128((__m128i*)lanes, acc0);
+	_mm_storeu_si128((__m128i*)(lanes + 2), acc1);
+	_mm_storeu_si128((__m128i*)(lanes + 4), acc2);
+	_mm_storeu_si128((__m128i*)(lanes + 6), acc3);
+
+	uint64_t h = (index + 1) * PRIME64_1 ^ size * PRIME64_2;
+	for (int i = 0; i < 8; i++) {
+		h = Mix64(h ^ lanes[i]);
+	}
+	return h;
+}
+
+uint64_t HashFrame(ConvertPool* pool, const uint8_t* data, size_t size) {
+	int blocks = (int)((size + HASH_BLOCK - 1) / HASH_BLOCK);
+	uint64_t sums[ConvertPool::MAX_THREADS] = { 0 };
+
+	// blocks for rows, the bands never share one
+	RunBands(pool, blocks, [&](int band, int first_block, int count) {
+		uint64_t sum = 0;
+		for (int i = first_block; i < first_block + count; i++) {
+			size_t offset = (size_t)i * HASH_BLOCK;
+			size_t block_size = size - offset < (size_t)HASH_BLOCK ? size - offset : HASH_BLOCK;
+			sum += HashFrameBlock(data + offset, block_size, (uint32_t)i);
+		}
+		sums[band] = sum;
+	});
+
+	uint64_t h = 0;
+	for (int i = 0; i < ConvertPool::MAX_THREADS; i++) {
+		h += sums[i];
+	}
+	return h;
+}
+
+RepeatDetector::RepeatDetector() {
+	Reset();
+}
+
+void RepeatDetector::Reset() {
+	size_ = 0;
+	probed_ = false;
+	hash_ = 0;
+	hashed_ = false;
+}
+
+bool RepeatDetector::Check(ConvertPool* pool, const uint8_t* data, size_t size, bool* keep) {
+	*keep = false;
+	if (size < 16) {
+		hashed_ = false;
+		probed_ = false;
+		return false;
+	}
+
+	// the probes of the last frame are only wanted once, so this one's
+	// are read straight over them
+	bool same = probed_ && size == size_;
+	size_t last = size - 16;
+	for (int i = 0; i < PROBES; i++) {
+		const uint8_t* src = data + last * i / (PROBES - 1);
+		__m128i probe = _mm_loadu_si128((const __m128i*)src);
+		__m128i* kept = (__m128i*)(probes_ + i * 16);
+		if (same && _mm_movemask_epi8(_mm_cmpeq_epi8(probe, _mm_loadu_si128(kept))) != 0xFFFF) {
+			same = false;
+		}
+		_mm_storeu_si128(kept, probe);
+	}
+	size_ = size;
+	probed_ = true;
+
+	if (!same) {
+		hashed_ = false;
+		return false;
+	}
+
+	uint64_t hash = HashFrame(pool, data, size);
+	if (hashed_ && hash == hash_) {
+		return true;
+	}
+
+	hash_ = hash;
+	hashed_ = true;
+	*keep = true;
+	return false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ConvertPool.h"
+
+// Content hashes of source frames, to tell a repeat of the last frame (menus,
+// loading screens, an idle window) from a new one before converting it.
+//
+// A frame is cut into HASH_BLOCK byte blocks, each hashed on its own with
+// SSE2 and seeded with its index, and the frame's hash is the sum of its
+// blocks'. The blocks spread over the convert pool like the conversion
+// itself, and the same bytes in another block hash differently, so content
+// moving around is a change. Not cryptographic: a change is missed with a
+// chance of about 2^-64.
+
+static const int HASH_BLOCK = 16 * 1024;
+
+// Hash of one block of size bytes, size at most HASH_BLOCK.
+uint64_t HashFrameBlock(const uint8_t* data, size_t size, uint32_t index);
+
+// Hash of the size bytes at data, run on pool (or the calling thread when
+// there is none).
+uint64_t HashFrame(ConvertPool* pool, const uint8_t* data, size_t size);
+
+// Tells repeats of the last frame apart from new ones, for a capture that
+// keeps its last converted output to hand out again.
+//
+// Hashing costs about half a conversion, too much to pay on every frame of
+// a game in motion, so PROBES spots of 16 bytes spread over the frame are
+// compared with the last frame's first; only when they all match is the
+// frame hashed. A frame is a repeat when its hash is the kept output's, so
+// the first repeat after a change is still converted, and kept.
+class RepeatDetector {
+public:
+	static const int PROBES = 256;
+
+	RepeatDetector();
+
+	// Looks at the size bytes of a new source frame. True when it repeats
+	// the kept output; otherwise *keep tells whether it was hashed and its
+	// output is to be kept for the next frame.
+	bool Check(ConvertPool* pool, const uint8_t* data, size_t size, bool* keep);
+
+	// The kept output is gone or was never written (a torn read, a black
+	// frame, a conversion nobody checked), the next frame starts over.
+	void Drop() { hashed_ = false; }
+	void Reset();
+
+private:
+	uint8_t probes_[PROBES * 16];
+	size_t size_;
+	bool probed_;
+	uint64_t hash_;
+	bool hashed_;
+};
@@ -0,0 +1,113 @@
+#include "FramePacer.h"
+
+FramePacer::FramePacer(PacerClock* clock) :
+	clock_(clock),
+	frame_length_(10000000 / 30),
+	deadline_(0),
+	last_frame_(0),
+	started_(false),
+	late_(true),
+	retry_(false)
+{
+}
+
+void FramePacer::SetFrameLength(int64_t frame_length) {
+	if (frame_length <= 0 || frame_length == frame_length_) {
+		return;
+	}
+
+	if (started_) {
+		deadline_ = last_frame_ + frame_length;
+	}
+	frame_length_ = frame_length;
+}
+
+FrameSlot FramePacer::Wait() {
+	FrameSlot slot = { 0, 0, false };
+	int64_t now = clock_->Now();
+
+	if (now <= 0) {
+		// graph clock not running yet
+		clock_->SleepFor(frame_length_ / 2);
+		slot.now = clock_->Now();
+		slot.late = true;
+		return slot;
+	}
+
+	if (!started_) {
+		// nothing to pace against until the first frame, poll for it
+		if (retry_) {
+			clock_->SleepFor(frame_length_ / 2);
+			now = clock_->Now();
+		}
+		retry_ = true;
+		slot.now = now;
+		slot.late = true;
+		return slot;
+	}
+
+	if (now < deadline_) {
+		// sleep to the deadline, again if the sleep came back early
+		while (now > 0 && now < deadline_) {
+			int64_t before = now;
+			clock_->SleepFor(deadline_ - now);
+			now = clock_->Now();
+			if (now == before) {
+				// graph paused, stream time stands still
+				break;
+			}
+		}
+		late_ = false;
+		retry_ = true;
+		slot.now = now;
+		return slot;
+	}
+
+	if (retry_ && late_) {
+		// already tried past the deadline and got nothing
+		clock_->SleepFor(frame_length_ / 2);
+		now = clock_->Now();
+	}
+	late_ = true;
+	retry_ = true;
+
+	if (now - deadline_ > frame_length_) {
+		slot.skipped = (int) ((now - deadline_) / frame_length_);
+		deadline_ += slot.skipped * frame_length_;
+	}
+
+	slot.now = now;
+	slot.late = true;
+	return slot;
+}
+
+void FramePacer::FrameDelivered() {
+	if (!started_) {
+		return;
+	}
+
+	last_frame_ = deadline_;
+	deadline_ += frame_length_;
+	late_ = false;
+	retry_ = false;
+}
+
+void FramePacer::Restart(int64_t now) {
+	if (now <= 0) {
+		return;
+	}
+
+	last_frame_ = now;
+	deadline_ = now + frame_length_;
+	started_ = true;
+	late_ = false;
+	retry_ = false;
+}
+
+void FramePacer::Reset() {
+	started_ = false;
+	late_ = true;
+	retry_ = false;
+	deadline_ = 0;
+	last_frame_ = 0;
+}
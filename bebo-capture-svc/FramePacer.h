@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time source for FramePacer, in 100 ns units like REFERENCE_TIME. The pin
+// uses the filter graph's stream time; anything else (a fake clock replaying
+// a trace) can be plugged in instead.
+class PacerClock {
+public:
+	virtual ~PacerClock() {}
+
+	// Current time, 0 or less while there is no running clock.
+	virtual int64_t Now() = 0;
+
+	// Blocks for about duration. It may wake early or late, the pacer only
+	// relies on Now().
+	virtual void SleepFor(int64_t duration) = 0;
+};
+
+// What the pacer decided for one capture attempt.
+struct FrameSlot {
+	int64_t now;      // clock time the attempt is made at
+	int     skipped;  // whole frame slots given up because capture fell behind
+	bool    late;     // past the deadline, repeating the previous frame is fine
+};
+
+// Paces the capture loop on absolute deadlines: the frame after a delivered
+// one is due exactly one frame length after the previous deadline, however
+// early or late the sleep woke up, so timer jitter never accumulates into
+// drift.
+//
+// Missed frame policy: up to one frame behind the pacer catches up, the
+// attempt is marked late and made straight away. Further behind, the whole
+// frames missed are skipped (FrameSlot::skipped) and the schedule moves on,
+// instead of bursting out frames to catch up. A late attempt that still came
+// up empty is retried every half frame.
+class FramePacer {
+public:
+	explicit FramePacer(PacerClock* clock);
+
+	// Keeps the current deadline's phase when the length changes.
+	void SetFrameLength(int64_t frame_length);
+	int64_t FrameLength() const { return frame_length_; }
+
+	// Waits until the next attempt is due.
+	FrameSlot Wait();
+
+	// The frame was delivered; the next one is due a frame length after
+	// this one's deadline.
+	void FrameDelivered();
+
+	// Starts the schedule over with the next frame due a frame length after
+	// now; used for the first frame and after frames that were dropped. Does
+	// nothing while the clock is not running.
+	void Restart(int64_t now);
+
+	// Forgets the schedule, the next Wait() returns straight away.
+	void Reset();
+
+	bool Started() const { return started_; }
+	int64_t Deadline() const { return deadline_; }
+
+	// Time since the last frame was delivered (or the schedule restarted).
+	int64_t SinceLastFrame(int64_t now) const { return now - last_frame_; }
+
+private:
+	PacerClock* clock_;
+	int64_t frame_length_;
+	int64_t deadline_;
+	int64_t last_frame_;
+	bool started_;
+	bool late_;     // the current deadline has passed
+	bool retry_;    // Wait() returned since the last delivery or restart
+};
@@ -0,0 +1,130 @@
+#include "FramePoolAllocator.h"
+#include "Logging.h"
+#include "platform.h"
+
+FramePoolAllocator::FramePoolAllocator(HRESULT* phr, bool large_pages) :
+	CBaseAllocator(NAME("Frame pool allocator"), NULL, phr),
+	large_pages_(large_pages),
+	large_(false),
+	buffer_(NULL)
+{
+}
+
+FramePoolAllocator::~FramePoolAllocator() {
+	Decommit();
+	ReallyFree();
+}
+
+STDMETHODIMP FramePoolAllocator::SetProperties(ALLOCATOR_PROPERTIES* pRequest, ALLOCATOR_PROPERTIES* pActual) {
+	CheckPointer(pRequest, E_POINTER);
+	CheckPointer(pActual, E_POINTER);
+	CAutoLock cObjectLock(this);
+
+	ZeroMemory(pActual, sizeof(ALLOCATOR_PROPERTIES));
+
+	LONG align = pRequest->cbAlign;
+	if (align < 1) {
+		align = 1;
+	}
+	if ((align & (align - 1)) != 0) {
+		return VFW_E_BADALIGN;
+	}
+	if (align < ALIGNMENT) {
+		align = ALIGNMENT;
+	}
+
+	if (pRequest->cbBuffer <= 0 || pRequest->cBuffers <= 0 || pRequest->cbPrefix < 0) {
+		return E_INVALIDARG;
+	}
+
+	if (m_bCommitted) {
+		return VFW_E_ALREADY_COMMITTED;
+	}
+
+	if (m_lFree.GetCount() < m_lAllocated) {
+		return VFW_E_BUFFERS_OUTSTANDING;
+	}
+
+	// the prefix sits in front of the aligned part, like CMemAllocator
+	LONG size = pRequest->cbBuffer + pRequest->cbPrefix;
+	size = (size + align - 1) & ~(align - 1);
+
+	pActual->cbBuffer = m_lSize = size - pRequest->cbPrefix;
+	pActual->cBuffers = m_lCount = pRequest->cBuffers;
+	pActual->cbAlign = m_lAlignment = align;
+	pActual->cbPrefix = m_lPrefix = pRequest->cbPrefix;
+
+	m_bChanged = TRUE;
+	return NOERROR;
+}
+
+// called with the allocator locked on Commit, with all samples free
+HRESULT FramePoolAllocator::Alloc(void) {
+	CAutoLock lck(this);
+
+	HRESULT hr = CBaseAllocator::Alloc();
+	if (FAILED(hr)) {
+		return hr;
+	}
+
+	// same properties as last time, keep the pool
+	if (hr == S_FALSE) {
+		return NOERROR;
+	}
+
+	ReallyFree();
+
+	LONGLONG stride = m_lSize + (LONGLONG)m_lPrefix;
+	LONGLONG total = stride * m_lCount;
+	if (total > MAXLONG) {
+		return E_OUTOFMEMORY;
+	}
+
+	// page aligned, and every stride is a multiple of the alignment
+	if (large_pages_) {
+		buffer_ = (LPBYTE)os_large_page_alloc((size_t)total, &large_);
+	} else {
+		buffer_ = (LPBYTE)VirtualAlloc(NULL, (SIZE_T)total, MEM_COMMIT, PAGE_READWRITE);
+	}
+	if (!buffer_) {
+		return E_OUTOFMEMORY;
+	}
+
+	LPBYTE next = buffer_;
+	for (; m_lAllocated < m_lCount; m_lAllocated++, next += stride) {
+		CMediaSample* pSample = new CMediaSample(NAME("Frame pool sample"), this, &hr, next + m_lPrefix, m_lSize);
+		if (pSample == NULL) {
+			return E_OUTOFMEMORY;
+		}
+		m_lFree.Add(pSample);
+	}
+
+	info("frame pool: %ld samples of %ld bytes%s", m_lCount, m_lSize, large_ ? ", large pages" : "");
+
+	m_bChanged = FALSE;
+	return NOERROR;
+}
+
+// keeps the pool for the next Commit, ReallyFree gives it back
+void FramePoolAllocator::Free(void) {
+}
+
+void FramePoolAllocator::ReallyFree(void) {
+	ASSERT(m_lAllocated == m_lFree.GetCount());
+
+	CMediaSample* pSample;
+	while ((pSample = m_lFree.RemoveHead()) != NULL) {
+		delete pSample;
+	}
+	m_lAllocated = 0;
+
+	if (buffer_) {
+		if (large_pages_) {
+			os_large_page_free(buffer_);
+		} else {
+			VirtualFree(buffer_, 0, MEM_RELEASE);
+		}
+		buffer_ = NULL;
+	}
+	large_ = false;
+}
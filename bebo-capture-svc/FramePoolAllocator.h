@@ -0,0 +1,35 @@
+#pragma once
+
+#include <streams.h>
+
+// The allocator the pin offers downstream before taking the input pin's:
+// a pool of samples of one output frame each, every one starting on a cache
+// line and padded to whole cache lines, so the converters writing straight
+// into a sample never share a line with the next one. With large pages the
+// pool lives on them like the scale buffers, when the account may lock
+// pages in memory.
+//
+// Memory is kept on Decommit, like CMemAllocator, and only given back when
+// the properties change or the allocator goes away.
+class FramePoolAllocator : public CBaseAllocator {
+public:
+	static const LONG ALIGNMENT = 64;
+
+	FramePoolAllocator(HRESULT* phr, bool large_pages);
+	~FramePoolAllocator();
+
+	// Rounds the alignment up to ALIGNMENT; the request's has to be a power
+	// of two.
+	STDMETHODIMP SetProperties(ALLOCATOR_PROPERTIES* pRequest, ALLOCATOR_PROPERTIES* pActual);
+
+protected:
+	HRESULT Alloc(void);
+	void Free(void);
+
+private:
+	void ReallyFree(void);
+
+	bool large_pages_;
+	bool large_;
+	LPBYTE buffer_;
+};
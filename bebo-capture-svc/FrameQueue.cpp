@@ -0,0 +1,122 @@
+#include "FrameQueue.h"
+
+#include <chrono>
+#include <string.h>
+
+FrameQueue::FrameQueue(int depth, size_t frame_size, FrameDropPolicy policy) :
+	depth_(depth),
+	frame_size_(frame_size),
+	policy_(policy),
+	closed_(false)
+{
+	if (depth_ < 1) {
+		depth_ = 1;
+	} else if (depth_ > MAX_DEPTH) {
+		depth_ = MAX_DEPTH;
+	}
+
+	memset(&stats_, 0, sizeof(stats_));
+
+	frames_.resize(depth_ + 2);
+	for (size_t i = 0; i < frames_.size(); i++) {
+		frames_[i].data = new uint8_t[frame_size_];
+		frames_[i].size = frame_size_;
+		memset(&frames_[i].info, 0, sizeof(frames_[i].info));
+		free_.push_back(&frames_[i]);
+	}
+}
+
+FrameQueue::~FrameQueue() {
+	for (size_t i = 0; i < frames_.size(); i++) {
+		delete[] frames_[i].data;
+	}
+}
+
+QueuedFrame* FrameQueue::Acquire() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (free_.empty()) {
+		// only when a side holds more than the one buffer it is owed
+		return nullptr;
+	}
+
+	QueuedFrame* frame = free_.back();
+	free_.pop_back();
+	memset(&frame->info, 0, sizeof(frame->info));
+	return frame;
+}
+
+void FrameQueue::Commit(QueuedFrame* frame) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stats_.queued++;
+
+		if ((int)queue_.size() >= depth_) {
+			stats_.dropped++;
+			if (policy_ == DROP_NEWEST) {
+				free_.push_back(frame);
+				return;
+			}
+			free_.push_back(queue_.front());
+			queue_.pop_front();
+		}
+
+		queue_.push_back(frame);
+	}
+	ready_cv_.notify_one();
+}
+
+void FrameQueue::Discard(QueuedFrame* frame) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	free_.push_back(frame);
+}
+
+QueuedFrame* FrameQueue::Pop(uint32_t timeout_ms) {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	if (queue_.empty() && !closed_) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		ready_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+			[this] { return !queue_.empty() || closed_; });
+		stats_.waits++;
+		stats_.wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	}
+
+	if (queue_.empty() || closed_) {
+		return nullptr;
+	}
+
+	int depth = (int)queue_.size();
+	stats_.depth_sum += depth;
+	if (depth > stats_.max_depth) {
+		stats_.max_depth = depth;
+	}
+	stats_.delivered++;
+
+	QueuedFrame* frame = queue_.front();
+	queue_.pop_front();
+	return frame;
+}
+
+void FrameQueue::Release(QueuedFrame* frame) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	free_.push_back(frame);
+}
+
+void FrameQueue::Close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+	}
+	ready_cv_.notify_all();
+}
+
+bool FrameQueue::Closed() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return closed_;
+}
+
+FrameQueue::Stats FrameQueue::GetStats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// What FrameQueue does with a new frame while it is full.
+enum FrameDropPolicy {
+	DROP_OLDEST = 0, // the oldest queued frame makes room, latency stays low
+	DROP_NEWEST = 1, // the new frame is thrown away, queued frames go out in order
+};
+
+// What the capture measured along with a frame. It travels with the frame
+// so numbering, time stamps and the stats logged with them are only kept
+// by FillBuffer's thread. Times are in 100 ns units like REFERENCE_TIME.
+struct FrameInfo {
+	uint64_t capture_time_ns; // QPC ns the frame was captured at
+	int64_t  frame_length;    // the capture rate's at the time
+	int64_t  deadline;        // the pacer's for the frame
+	long     skipped;         // frame slots the pacer gave up before it
+	long     missed;          // frames that did not come in time, besides those
+	double   millis_took;
+	uint64_t black_frames;    // looked for until the first picture
+	bool     restarted;       // the first since the capture was cleaned up
+};
+
+// One pooled output frame.
+struct QueuedFrame {
+	uint8_t*  data;
+	size_t    size;
+	FrameInfo info;
+};
+
+// Bounded queue between a pin's capture thread and FillBuffer. The frames
+// come out of a fixed pool of depth + 2 buffers, one for the producer to
+// write the next frame into and one for the consumer to copy out of, so
+// neither side ever allocates or waits for the other to hand a buffer back.
+// Only the consumer waits, for a frame to be queued.
+class FrameQueue {
+public:
+	static const int MAX_DEPTH = 8;
+
+	struct Stats {
+		uint64_t queued;      // frames committed by the producer
+		uint64_t delivered;   // frames popped by the consumer
+		uint64_t dropped;     // frames the drop policy threw away
+		uint64_t waits;       // pops that found the queue empty
+		uint64_t wait_ns;     // time spent in those
+		uint64_t depth_sum;   // queue depth seen by each pop, for the average
+		int      max_depth;
+	};
+
+	FrameQueue(int depth, size_t frame_size, FrameDropPolicy policy);
+	~FrameQueue();
+
+	int Depth() const { return depth_; }
+	size_t FrameSize() const { return frame_size_; }
+	FrameDropPolicy Policy() const { return policy_; }
+
+	// Producer: a free buffer to capture into, never blocks. Give it back
+	// with Commit() or Discard().
+	QueuedFrame* Acquire();
+	// Queues the frame, dropping one per the policy when the queue is full.
+	void Commit(QueuedFrame* frame);
+	// Returns a buffer that did not get a frame.
+	void Discard(QueuedFrame* frame);
+
+	// Consumer: the oldest queued frame, waiting up to timeout_ms for one;
+	// NULL on timeout or once the queue is closed. Hand it back with
+	// Release() before the next Pop().
+	QueuedFrame* Pop(uint32_t timeout_ms);
+	void Release(QueuedFrame* frame);
+
+	// Wakes a waiting Pop(), which returns NULL from then on. The producer
+	// closes the queue when it stops, so the consumer does not wait on it.
+	void Close();
+	bool Closed();
+
+	Stats GetStats();
+
+private:
+	FrameQueue(const FrameQueue&) = delete;
+	FrameQueue& operator=(const FrameQueue&) = delete;
+
+	int depth_;
+	size_t frame_size_;
+	FrameDropPolicy policy_;
+
+	std::vector<QueuedFrame> frames_;
+	std::vector<QueuedFrame*> free_;
+	std::deque<QueuedFrame*> queue_;
+
+	std::mutex mutex_;
+	std::condition_variable ready_cv_;
+	bool closed_;
+	Stats stats_;
+};
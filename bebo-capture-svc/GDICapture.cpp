@@ -11,8 +11,7 @@
 #include "DibHelper.h"
 #include "window-helpers.h"
 #include "Logging.h"
-#include "libyuv/convert.h"
-#include "libyuv/scale_argb.h"
+#include "ColorConvert.h"
 
 GDICapture::GDICapture():
 	negotiated_width(0),
@@ -23,7 +22,10 @@ GDICapture::GDICapture():
 	capture_mouse(false),
 	capture_hwnd(false),
 	last_frame(new GDIFrame),
-	negotiated_argb_buffer(nullptr)
+	scale_band_buffer(nullptr),
+	convert_pool(nullptr),
+	output_frame(nullptr),
+	output_frame_size(0)
 {
 }
 
@@ -32,20 +34,33 @@ GDICapture::~GDICapture() {
 		delete last_frame;
 	}
 
-	if (negotiated_argb_buffer) {
-		delete[] negotiated_argb_buffer;
+	if (scale_band_buffer) {
+		delete[] scale_band_buffer;
+	}
+
+	if (output_frame) {
+		delete[] output_frame;
 	}
 }
 
-void GDICapture::SetSize(int width, int height) {
+void GDICapture::SetSize(int width, int height, OutputFormat format, ColorSpace color_space) {
 	negotiated_width = width;
 	negotiated_height = height;
+	GetOutputLayout(&output_layout, format, color_space, width, height);
 
-	if (negotiated_argb_buffer) {
-		delete[] negotiated_argb_buffer;
+	if (scale_band_buffer) {
+		delete[] scale_band_buffer;
 	}
 
-	negotiated_argb_buffer = new BYTE[4 * negotiated_width * negotiated_height];
+	// one band per convert thread
+	scale_band_buffer = new BYTE[ScaleBandSize(negotiated_width) * ConvertPool::MAX_THREADS];
+
+	if (output_frame) {
+		delete[] output_frame;
+		output_frame = nullptr;
+	}
+	output_frame_size = GetOutputFrameSize(format, width, height);
+	repeats.Reset();
 }
 
 void GDICapture::SetCaptureHandle(HWND handle) {
@@ -55,6 +70,7 @@ void GDICapture::SetCaptureHandle(HWND handle) {
 		delete last_frame;
 		last_frame = new GDIFrame;
 	}
+	repeats.Reset();
 }
 
 GDIFrame* GDICapture::CaptureFrame()
@@ -103,7 +119,7 @@ GDIFrame* GDICapture::CaptureFrame()
 	return frame;
 }
 
-bool GDICapture::GetFrame(IMediaSample *pSample)
+bool GDICapture::GetFrame(IMediaSample *pSample, FrameCheck* check)
 {
 	GDIFrame* frame = CaptureFrame();
 	if (frame == NULL) {
@@ -113,33 +129,58 @@ bool GDICapture::GetFrame(IMediaSample *pSample)
 	BYTE *pdata;
 	pSample->GetPointer(&pdata);
 
+	// converted into it, or copied from the kept frame
+	if (pSample->GetSize() < (long)output_frame_size) {
+		warn("sample of %ld bytes too small for a %d byte frame", pSample->GetSize(), output_frame_size);
+		return false;
+	}
+
 	const uint8_t* src_frame = frame->data();
 	int src_stride_frame = frame->stride();
 	int src_width = frame->width();
 	int src_height = frame->height();
 
-	int scaled_argb_stride = 4 * negotiated_width;
-
-	libyuv::ARGBScale(
-		src_frame, src_stride_frame,
-		src_width, src_height,
-		negotiated_argb_buffer, scaled_argb_stride,
-		negotiated_width, negotiated_height,
-		libyuv::FilterMode(libyuv::kFilterBox)
-	);
-
-	uint8* y = pdata;
-	int stride_y = negotiated_width;
-	uint8* u = pdata + (negotiated_width * negotiated_height);
-	int stride_u = (negotiated_width + 1) / 2;
-	uint8* v = u + ((negotiated_width * negotiated_height) >> 2);
-	int stride_v = stride_u;
-
-	libyuv::ARGBToI420(negotiated_argb_buffer, scaled_argb_stride,
-		y, stride_y,
-		u, stride_u,
-		v, stride_v,
-		negotiated_width, negotiated_height);
+	if (check && check->black) {
+		if (IsBlackPixels32(src_frame, src_stride_frame, src_width, src_height, ARGB_COLOR_MASK)) {
+			check->content = CONTENT_BLACK;
+			return true;
+		}
+		check->content = CONTENT_PICTURE;
+	}
+
+	bool keep = false;
+	if (check && check->repeat) {
+		if (repeats.Check(convert_pool, src_frame, (size_t)src_stride_frame * src_height, &keep)) {
+			check->repeated = true;
+			memcpy(pdata, output_frame, output_frame_size);
+			return true;
+		}
+	} else {
+		repeats.Drop();
+	}
+
+	// a frame that may repeat is converted where it is kept
+	BYTE* dst = pdata;
+	if (keep) {
+		if (!output_frame) {
+			output_frame = new BYTE[output_frame_size];
+		}
+		dst = output_frame;
+	}
+
+	int band_size = ScaleBandSize(negotiated_width);
+
+	RunBands(convert_pool, negotiated_height, [&](int band, int first_row, int rows) {
+		ARGBScaleToOutputRows(src_frame, src_stride_frame,
+			src_width, src_height,
+			&output_layout, dst,
+			first_row, rows,
+			scale_band_buffer + band * band_size);
+	});
+
+	if (keep) {
+		memcpy(pdata, output_frame, output_frame_size);
+	}
 
 	return true;
 }
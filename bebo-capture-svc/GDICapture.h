@@ -4,6 +4,9 @@
 #include <dshow.h>
 #include <windows.h>
 #include <stdint.h>
+#include "ColorConvert.h"
+#include "ConvertPool.h"
+#include "FrameHash.h"
 class GDIFrame {
 public:
 	GDIFrame() : _bound(RECT()), _bitmap(), _data(nullptr) { }
@@ -53,10 +56,13 @@ public:
 	~GDICapture();
 
 	void Cleanup();
-	void SetSize(int width, int height);
+	void SetSize(int width, int height, OutputFormat format, ColorSpace color_space);
 	void SetCaptureHandle(HWND hwnd);
+	void SetConvertPool(ConvertPool* pool) { convert_pool = pool; }
 	bool IsReady() { return capture_hwnd != NULL; }
-	bool GetFrame(IMediaSample *pSample);
+	// With check, a black window is not converted and a repeat gets the
+	// last output again, see FrameCheck.
+	bool GetFrame(IMediaSample *pSample, FrameCheck* check = NULL);
 	HWND GetCaptureHandle() const { return capture_hwnd; }
 
 private:
@@ -69,9 +75,16 @@ private:
 	bool capture_mouse;
 	HWND capture_hwnd;
 
-	BYTE* negotiated_argb_buffer;
+	OutputLayout output_layout;
+	BYTE* scale_band_buffer;
+	ConvertPool* convert_pool;
 	GDIFrame* last_frame;
 
+	// the last output, kept while it may repeat
+	BYTE* output_frame;
+	int output_frame_size;
+	RepeatDetector repeats;
+
 	GDIFrame* CaptureFrame();
 };
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 ﻿#include "GameCapture.h"
 
 #include <chrono>
+#include <atomic>
+#include <mutex>
 #include "Logging.h"
 #include <dshow.h>
 #include <strsafe.h>
@@ -19,10 +21,15 @@
 #include "DibHelper.h"
 #include "window-helpers.h"
 #include "ipc-util/pipe.h"
+#include "ipc-util/shmem.h"
 #include "libyuv/convert.h"
 #include "libyuv/scale.h"
 #include "CommonTypes.h"
 #include "registry.h"
+#include "ColorConvert.h"
+#include "ConvertPool.h"
+#include "ConversionPlan.h"
+#include "FrameHash.h"
 
 #define STOP_BEING_BAD \
 	    "This is most likely due to security software" \
@@ -82,8 +89,82 @@ enum capture_mode {
 
 static uint32_t inject_failed_count = 0;
 
-struct game_capture {
+struct game_capture;
+
+// Pins that want the same sample format, color space and size share an
+// output: a frame is converted once for all of them, into frame when there
+// is more than one, and copied into their samples from there.
+struct capture_output {
+	struct capture_output         *next;
+	int                           clients;
+
+	enum OutputFormat             output_format;
+	enum ColorSpace               color_space;
+	uint32_t                      scale_cx;
+	uint32_t                      scale_cy;
+
+	ConversionPlan                plan;
+	uint8_t                       *frame;
+	uint32_t                      frame_size;
+	uint32_t                      frame_seq;
+	uint64_t                      frame_capture_time;
+	bool                          have_frame;
+
+	// set once a pin looks for repeats; knows whether frame is the
+	// converted output of the frame it last hashed
+	RepeatDetector                *repeats;
+
+	// a pin is converting into frame, the others of the output wait for it
+	bool                          converting;
+};
+
+// What hook() hands a pin: its subscription to the shared game_capture of
+// the window, with the pin's own frame bookkeeping.
+struct game_capture_client {
+	struct game_capture           *gc;
+	struct game_capture_client    *next;
+	struct capture_output         *output;
+	ConvertPool                   *convert_pool;
+	uint64_t                      frame_interval;
+
 	int                           last_tex;
+	uint32_t                      last_frame_seq;
+	uint64_t                      last_capture_time;
+};
+
+struct game_capture {
+	// one per hooked window, see find_session: keyed on the process and
+	// window the first pin asked for, which never change, unlike window
+	// (whatever get_selected_window picks). Everything below is only
+	// touched with mutex held, except for what pins read while they wait
+	// for or convert a frame, see use_ring
+	struct game_capture           *next_session;
+	DWORD                         session_process_id;
+	HWND                          session_window;
+	int                           clients;
+	CRITICAL_SECTION              mutex;
+	struct capture_output         *outputs;
+	struct game_capture_client    *pins;
+
+	// pins using the frame memory outside mutex, and those sharing the
+	// ring's read, see begin_ring_read
+	int                           ring_users;
+	CONDITION_VARIABLE            ring_released;
+	int                           ring_readers;
+	struct shmem_ring_read        ring_read;
+
+	// the pin waiting on the hook's frame event, which wakes one thread,
+	// and the other pins waiting on it, see wait_for_frame
+	bool                          frame_waiter;
+	CONDITION_VARIABLE            frame_ready;
+
+	// how long frame ring slots are held for, logged when the capture
+	// stops
+	uint32_t                      slot_reads;
+	uint32_t                      torn_reads;
+	uint32_t                      repeat_reads;
+	long double                   slot_hold_millis;
+	long double                   slot_hold_max_millis;
 
 //	struct cursor_data            cursor_data;
 	HANDLE                        injector_process;
@@ -114,7 +195,6 @@ struct game_capture {
 	bool                          error_acquiring;
 	bool                          dwm_capture;
 	bool                          initial_config;
-	bool                          convert_16bit;
 	bool                          is_app;
 
 	struct game_capture_config    config;
@@ -127,24 +207,24 @@ struct game_capture {
 	HANDLE                        hook_stop;
 	HANDLE                        hook_ready;
 	HANDLE                        hook_exit;
-	HANDLE                        hook_data_map;
+	ipc_shmem_t                   hook_data;
 	HANDLE                        global_hook_info_map;
 	HANDLE                        target_process;
-	HANDLE                        texture_mutexes[2];
 	wchar_t                       *app_sid;
 	int                           retrying;
 
 	union {
 		struct {
 			struct shmem_data *shmem_data;
-			uint8_t *texture_buffers[2];
+			struct shmem_ring *ring;
 		};
 
 		struct shtex_data *shtex_data;
 		void *data;
 	};
 
-	bool (*copy_texture)(struct game_capture*, IMediaSample *pSample);
+	bool (*copy_texture)(struct game_capture*, struct game_capture_client*,
+		IMediaSample *pSample, FrameCheck *check);
 };
 
 static inline int inject_library(HANDLE process, const wchar_t *dll)
@@ -205,6 +285,27 @@ static inline HANDLE open_map_plus_id(struct game_capture *gc,
 		: OpenFileMappingW(GC_MAPPING_FLAGS, false, new_name);
 }
 
+/* the hook's frame memory, apps see it under their own namespace */
+static inline bool open_hook_data(struct game_capture *gc, uint32_t id,
+	uint32_t size)
+{
+	char name[64];
+	sprintf(name, "%s%lu", SHMEM_TEXTURE, id);
+
+	if (!gc->is_app) {
+		return ipc_shmem_open(&gc->hook_data, name, size);
+	}
+
+	wchar_t map_name[64];
+	wchar_t frame_name[64];
+	_snwprintf(map_name, 64, L"%S", name);
+	_snwprintf(frame_name, 64, L"%S%S", name, IPC_SHMEM_FRAME_SUFFIX);
+
+	HANDLE map = open_app_map(gc->app_sid, map_name);
+	HANDLE frame = map ? open_app_event(gc->app_sid, frame_name) : NULL;
+	return ipc_shmem_open_handles(&gc->hook_data, map, frame, size);
+}
+
 static inline HANDLE open_hook_info(struct game_capture *gc)
 {
 	return open_map_plus_id(gc, SHMEM_HOOK_INFO, gc->process_id);
@@ -224,8 +325,16 @@ static struct game_capture *game_capture_create(game_capture_config *config, uin
 	gc->config.limit_framerate = config->limit_framerate;
 	gc->config.capture_overlays = config->capture_overlays;
 	gc->config.anticheat_hook = inject_failed_count > 10 ? true : config->anticheat_hook;
+	gc->config.output_format = config->output_format;
+	gc->config.color_space = config->color_space;
+	gc->config.shmem_slots = config->shmem_slots;
+	gc->config.copy_threads = config->copy_threads;
+	gc->config.hook_convert = config->hook_convert;
+	gc->config.large_pages = config->large_pages;
 	gc->frame_interval = frame_interval;
-	gc->last_tex = -1;
+	InitializeCriticalSection(&gc->mutex);
+	InitializeConditionVariable(&gc->ring_released);
+	InitializeConditionVariable(&gc->frame_ready);
 
 	gc->initial_config = true;
 	gc->priority = config->priority;
@@ -653,27 +762,6 @@ static inline bool init_keepalive(struct game_capture *gc)
 	return true;
 }
 
-static inline bool init_texture_mutexes(struct game_capture *gc)
-{
-	gc->texture_mutexes[0] = open_mutex_gc(gc, MUTEX_TEXTURE1);
-	gc->texture_mutexes[1] = open_mutex_gc(gc, MUTEX_TEXTURE2);
-
-	if (!gc->texture_mutexes[0] || !gc->texture_mutexes[1]) {
-		DWORD error = GetLastError();
-		if (error == 2) {
-			if (!gc->retrying) {
-				gc->retrying = 2;
-				info("hook not loaded yet, retrying..");
-			}
-		} else {
-			warn("failed to open texture mutexes: %lu",
-					GetLastError());
-		}
-		return false;
-	}
-
-	return true;
-}
 static void pipe_log(void *param, uint8_t *data, size_t size)
 {
 //	struct game_capture *gc = param;
@@ -700,30 +788,103 @@ static inline void reset_frame_interval(struct game_capture *gc)
 	gc->global_hook_info->frame_interval = gc->frame_interval;
 }
 
+// The hook captures as often as the fastest pin wants, the slower ones
+// skip frames. Called with gc->mutex held, whenever a pin comes, goes or
+// changes its rate.
+static void update_frame_interval(struct game_capture *gc)
+{
+	if (!gc->pins) {
+		return;
+	}
+
+	uint64_t frame_interval = gc->pins->frame_interval;
+	for (struct game_capture_client *client = gc->pins->next; client; client = client->next) {
+		if (client->frame_interval < frame_interval) {
+			frame_interval = client->frame_interval;
+		}
+	}
+
+	gc->frame_interval = frame_interval;
+	if (gc->global_hook_info) {
+		reset_frame_interval(gc);
+	}
+}
+
+// The hook writes I420 / NV12 into the frame ring itself when the sample
+// is in one of them, we then only copy planes.
+static inline uint32_t get_transport_request(struct game_capture *gc)
+{
+	if (!gc->config.hook_convert) {
+		return SHMEM_TRANSPORT_NATIVE;
+	}
+
+	switch (gc->config.output_format) {
+	case OUTPUT_I420:
+		return SHMEM_TRANSPORT_I420;
+	case OUTPUT_NV12:
+		return SHMEM_TRANSPORT_NV12;
+	default:
+		return SHMEM_TRANSPORT_NATIVE;
+	}
+}
+
+static inline bool is_planar_transport(uint32_t transport)
+{
+	return transport == SHMEM_TRANSPORT_I420 || transport == SHMEM_TRANSPORT_NV12;
+}
+
 static inline bool init_hook_info(struct game_capture *gc)
 {
 	gc->global_hook_info_map = open_hook_info(gc);
 	if (!gc->global_hook_info_map) {
-		warn("init_hook_info: get_hook_info failed: %lu",
-				GetLastError());
+		DWORD error = GetLastError();
+		if (error == 2) {
+			if (!gc->retrying) {
+				gc->retrying = 2;
+				info("hook not loaded yet, retrying..");
+			}
+		} else {
+			warn("init_hook_info: get_hook_info failed: %lu",
+					error);
+		}
 		return false;
 	}
 
+	// all of it: a hook of an older layout made it smaller than ours
 	gc->global_hook_info = (hook_info *) MapViewOfFile(gc->global_hook_info_map,
-			FILE_MAP_ALL_ACCESS, 0, 0,
-			sizeof(*gc->global_hook_info));
+			FILE_MAP_ALL_ACCESS, 0, 0, 0);
 	if (!gc->global_hook_info) {
 		warn("init_hook_info: failed to map data view: %lu",
 				GetLastError());
 		return false;
 	}
 
+	MEMORY_BASIC_INFORMATION view = { 0 };
+	VirtualQuery(gc->global_hook_info, &view, sizeof(view));
+	if (view.RegionSize < sizeof(*gc->global_hook_info) ||
+	    gc->global_hook_info->hook_version != HOOK_INFO_VERSION ||
+	    gc->global_hook_info->hook_info_size != sizeof(*gc->global_hook_info)) {
+		warn("init_hook_info: graphics hook of %S is from another build (hook info version %u), "
+			"not capturing", gc->config.executable,
+			view.RegionSize < sizeof(*gc->global_hook_info) ? 0 : gc->global_hook_info->hook_version);
+		return false;
+	}
+
 	gc->global_hook_info->offsets = gc->process_is_64bit ?  offsets64 : offsets32;
 	gc->global_hook_info->capture_overlay = gc->config.capture_overlays;
 	gc->global_hook_info->force_shmem = true;
+	gc->global_hook_info->shmem_slots = gc->config.shmem_slots;
+	gc->global_hook_info->copy_threads = gc->config.copy_threads;
+	gc->global_hook_info->large_pages = gc->config.large_pages;
+	gc->global_hook_info->transport_request = get_transport_request(gc);
+	gc->global_hook_info->yuv_matrix =
+		(gc->config.color_space == COLOR_BT709_LIMITED ||
+		 gc->config.color_space == COLOR_BT709_FULL) ? 709 : 601;
+	gc->global_hook_info->yuv_full_range = IsFullRange(gc->config.color_space);
 	gc->global_hook_info->use_scale = gc->config.force_scaling;
 	gc->global_hook_info->cx = gc->config.scale_cx;
 	gc->global_hook_info->cy = gc->config.scale_cy;
+	gc->global_hook_info->service_version = HOOK_INFO_VERSION;
 	reset_frame_interval(gc);
 
 	return true;
@@ -834,10 +995,6 @@ static bool init_hook(struct game_capture *gc)
 			return false;
 		}
 	}
-	if (!init_texture_mutexes(gc)) {
-		return false;
-	}
-
 	if (!init_hook_info(gc)) {
 		return false;
 	}
@@ -855,8 +1012,62 @@ static bool init_hook(struct game_capture *gc)
 	return true;
 }
 
+// Pins hold mutex only to look at the session, to claim the frame they read
+// and to publish what they converted; waiting for the hook and converting
+// happen outside of it, counted in ring_users. Until that is back to 0
+// the frame memory stays mapped and the plans stay as they are.
+
+// called with gc->mutex held
+static inline void use_ring(struct game_capture *gc)
+{
+	gc->ring_users++;
+}
+
+// called with gc->mutex held; also wakes pins waiting for another pin's
+// conversion of their output
+static inline void release_ring(struct game_capture *gc)
+{
+	gc->ring_users--;
+	WakeAllConditionVariable(&gc->ring_released);
+}
+
+// called with gc->mutex held, before unmapping the frame memory or
+// rebuilding plans, once copy_texture is NULL so no pin starts over
+static void wait_for_ring_users(struct game_capture *gc)
+{
+	while (gc->ring_users > 0) {
+		SleepConditionVariableCS(&gc->ring_released, &gc->mutex, INFINITE);
+	}
+}
+
+// The hook never waits for us: it writes around the slot we hold, which
+// the skipped / overwritten counts show, and we hold it only while
+// converting.
+static void log_ring_stats(struct game_capture *gc)
+{
+	if (!gc->ring || !gc->slot_reads) {
+		return;
+	}
+
+	info("frame ring: %u reads, slot held %.02Lf ms avg, %.02Lf ms max, %u torn, %u repeats, "
+		"hook wrote around the held slot %u times, over it %u times",
+		gc->slot_reads, gc->slot_hold_millis / gc->slot_reads, gc->slot_hold_max_millis,
+		gc->torn_reads, gc->repeat_reads, gc->ring->skipped, gc->ring->overwritten);
+
+	gc->slot_reads = 0;
+	gc->torn_reads = 0;
+	gc->repeat_reads = 0;
+	gc->slot_hold_millis = 0;
+	gc->slot_hold_max_millis = 0;
+}
+
 static void stop_capture(struct game_capture *gc)
 {
+	gc->copy_texture = NULL;
+	WakeAllConditionVariable(&gc->frame_ready);
+	wait_for_ring_users(gc);
+
+	log_ring_stats(gc);
 	ipc_pipe_server_free(&gc->pipe);
 
 	if (gc->hook_stop) {
@@ -868,10 +1079,9 @@ static void stop_capture(struct game_capture *gc)
 		gc->global_hook_info = NULL;
 	}
 
-	if (gc->data) {
-		UnmapViewOfFile(gc->data);
-		gc->data = NULL;
-	}
+	ipc_shmem_free(&gc->hook_data);
+	gc->data = NULL;
+	gc->ring = NULL;
 
 	if (gc->app_sid) {
 		LocalFree(gc->app_sid);
@@ -883,12 +1093,17 @@ static void stop_capture(struct game_capture *gc)
 	close_handle(&gc->hook_ready);
 	close_handle(&gc->hook_exit);
 	close_handle(&gc->hook_init);
-	close_handle(&gc->hook_data_map);
 	close_handle(&gc->keepalive_mutex);
 	close_handle(&gc->global_hook_info_map);
 	close_handle(&gc->target_process);
-	close_handle(&gc->texture_mutexes[0]);
-	close_handle(&gc->texture_mutexes[1]);
+
+	for (struct capture_output *output = gc->outputs; output; output = output->next) {
+		FreeConversionPlan(&output->plan);
+		output->have_frame = false;
+		if (output->repeats) {
+			output->repeats->Reset();
+		}
+	}
 
 	if (gc->active)
 		info("game capture stopped");
@@ -940,30 +1155,196 @@ static void try_hook(struct game_capture *gc)
 	}
 }
 
+// Every pin that targets the same window shares one game_capture: the game
+// is hooked once, and each frame converted once per distinct output.
+static std::mutex sessions_mutex;
+static struct game_capture *sessions = NULL;
+
+static struct game_capture *find_session(DWORD process_id, HWND window)
+{
+	for (struct game_capture *gc = sessions; gc; gc = gc->next_session) {
+		if (gc->session_process_id == process_id && gc->session_window == window) {
+			return gc;
+		}
+	}
+	return NULL;
+}
+
+static void game_capture_destroy(struct game_capture *gc)
+{
+	stop_capture(gc);
+
+	dstr_free(&gc->title);
+	dstr_free(&gc->klass);
+	dstr_free(&gc->executable);
+	free(gc->config.title);
+	free(gc->config.klass);
+	free(gc->config.executable);
+
+	DeleteCriticalSection(&gc->mutex);
+	bfree(gc);
+}
+
+static void init_output_plan(struct game_capture *gc, struct capture_output *output);
+static void request_native_transport(struct game_capture *gc);
+
+// called with gc->mutex held
+static struct capture_output *subscribe_output(struct game_capture *gc,
+	game_capture_config *config)
+{
+	struct capture_output *output;
+
+	for (output = gc->outputs; output; output = output->next) {
+		if (output->output_format == config->output_format &&
+		    output->color_space == config->color_space &&
+		    output->scale_cx == config->scale_cx &&
+		    output->scale_cy == config->scale_cy) {
+			output->clients++;
+			info("sharing converted frames with %d other pin(s)", output->clients - 1);
+			return output;
+		}
+	}
+
+	output = (struct capture_output*) bzalloc(sizeof(*output));
+	output->clients = 1;
+	output->output_format = config->output_format;
+	output->color_space = config->color_space;
+	output->scale_cx = config->scale_cx;
+	output->scale_cy = config->scale_cy;
+	output->next = gc->outputs;
+	gc->outputs = output;
+
+	// joined a capture that is already running; a capture that is yet
+	// to start checks all outputs in init_shmem_capture
+	if (gc->ring) {
+		init_output_plan(gc, output);
+		if (!output->plan.IsValid() && is_planar_transport(gc->global_hook_info->transport)) {
+			request_native_transport(gc);
+		}
+	}
+	return output;
+}
+
+// called with gc->mutex held
+static void unsubscribe_output(struct game_capture *gc, struct capture_output *output)
+{
+	if (--output->clients > 0) {
+		return;
+	}
+
+	struct capture_output **link = &gc->outputs;
+	while (*link != output) {
+		link = &(*link)->next;
+	}
+	*link = output->next;
+
+	FreeConversionPlan(&output->plan);
+	delete output->repeats;
+	bfree(output->frame);
+	bfree(output);
+}
+
+static struct game_capture_client *subscribe(HWND window, game_capture_config *config,
+	uint64_t frame_interval)
+{
+	DWORD process_id = 0;
+	GetWindowThreadProcessId(window, &process_id);
+
+	struct game_capture *gc;
+	{
+		std::lock_guard<std::mutex> lock(sessions_mutex);
+
+		gc = find_session(process_id, window);
+		if (gc) {
+			gc->clients++;
+			info("joining capture of %S, %d pins", gc->config.title, gc->clients);
+		} else {
+			gc = game_capture_create(config, frame_interval);
+			gc->session_process_id = process_id;
+			gc->session_window = window;
+			gc->clients = 1;
+			gc->next_session = sessions;
+			sessions = gc;
+		}
+	}
+
+	struct game_capture_client *client = (struct game_capture_client*) bzalloc(sizeof(*client));
+	client->gc = gc;
+	client->convert_pool = config->convert_pool;
+	client->frame_interval = frame_interval;
+	client->last_tex = -1;
+
+	EnterCriticalSection(&gc->mutex);
+	client->output = subscribe_output(gc, config);
+	client->next = gc->pins;
+	gc->pins = client;
+	update_frame_interval(gc);
+	LeaveCriticalSection(&gc->mutex);
+	return client;
+}
+
+// The last pin to leave stops the capture.
+static void unsubscribe(struct game_capture_client *client)
+{
+	struct game_capture *gc = client->gc;
+
+	EnterCriticalSection(&gc->mutex);
+	unsubscribe_output(gc, client->output);
+	struct game_capture_client **link = &gc->pins;
+	while (*link != client) {
+		link = &(*link)->next;
+	}
+	*link = client->next;
+	update_frame_interval(gc);
+	LeaveCriticalSection(&gc->mutex);
+	bfree(client);
+
+	{
+		std::lock_guard<std::mutex> lock(sessions_mutex);
+
+		if (--gc->clients > 0) {
+			return;
+		}
+
+		struct game_capture **link = &sessions;
+		while (*link != gc) {
+			link = &(*link)->next_session;
+		}
+		*link = gc->next_session;
+	}
+
+	game_capture_destroy(gc);
+}
+
 bool isReady(void ** data) {
 	if (*data == NULL) {
 		return false;
 	}
-	struct game_capture *gc = (game_capture *) *data;
+	struct game_capture *gc = ((game_capture_client *) *data)->gc;
 //	debug("isReady - data active: %d && retrying %d - %d", gc->active, gc->retrying, gc->active && gc->capturing);
 	return gc->active && ! gc->retrying;
 }
 
 void set_fps(void **data, uint64_t frame_interval) {
-	struct game_capture *gc = (game_capture *) *data;
+	struct game_capture_client *client = (game_capture_client *) *data;
 
-	if (gc == NULL) {
+	if (client == NULL) {
 		debug("set_fps: gc==NULL");
 		return;
 	}
 	debug("set_fps: %d", frame_interval);
-	gc->global_hook_info->frame_interval = frame_interval;
+
+	struct game_capture *gc = client->gc;
+	EnterCriticalSection(&gc->mutex);
+	client->frame_interval = frame_interval;
+	update_frame_interval(gc);
+	LeaveCriticalSection(&gc->mutex);
 }
 
 void * hook(void **data, LPCWSTR windowClassName, LPCWSTR windowName, game_capture_config *config, uint64_t frame_interval)
 {
-	struct game_capture *gc = (game_capture *) *data;
-	if (gc == NULL) {
+	struct game_capture_client *client = (game_capture_client *) *data;
+	if (client == NULL) {
 		HWND hwnd = NULL;
 		window_priority priority = WINDOW_PRIORITY_EXE;
 
@@ -990,27 +1371,41 @@ void * hook(void **data, LPCWSTR windowClassName, LPCWSTR windowName, game_captu
 
 		config->window = hwnd;
 
-		gc = game_capture_create(config, frame_interval);
+		client = subscribe(hwnd, config, frame_interval);
 
-		struct dstr *klass = &gc->klass;
-		struct dstr *title = &gc->title;
-		struct dstr *exe = &gc->executable;
-		get_window_class(klass, hwnd);
-		get_window_exe(exe, hwnd);
-		get_window_title(title, hwnd);
+		struct game_capture *gc = client->gc;
+		EnterCriticalSection(&gc->mutex);
+		if (!gc->config.executable) {
+			struct dstr *klass = &gc->klass;
+			struct dstr *title = &gc->title;
+			struct dstr *exe = &gc->executable;
+			get_window_class(klass, hwnd);
+			get_window_exe(exe, hwnd);
+			get_window_title(title, hwnd);
 
-		gc->config.executable = _strdup(exe->array);
-		gc->config.title = _strdup(title->array);
-		gc->config.klass = _strdup(klass->array);;
+			gc->config.executable = _strdup(exe->array);
+			gc->config.title = _strdup(title->array);
+			gc->config.klass = _strdup(klass->array);;
 
-		gc->priority = priority;
+			gc->priority = priority;
+		}
+		LeaveCriticalSection(&gc->mutex);
+	}
+
+	// a pin joining a running capture leaves the hook alone
+	struct game_capture *gc = client->gc;
+	EnterCriticalSection(&gc->mutex);
+	if (!gc->active || gc->retrying) {
+		try_hook(gc);
 	}
+	bool hooked = gc->active || gc->retrying;
+	LeaveCriticalSection(&gc->mutex);
 
-	try_hook(gc);
-	if (gc->active || gc->retrying) {
-		return gc;
+	if (hooked) {
+		return client;
 	}
 
+	unsubscribe(client);
 	return NULL;
 }
 
@@ -1022,20 +1417,23 @@ enum capture_result {
 
 static inline enum capture_result init_capture_data(struct game_capture *gc)
 {
+	// pins still on the old frame memory finish first; the capture may
+	// have stopped meanwhile
+	wait_for_ring_users(gc);
+	if (!gc->global_hook_info) {
+		return CAPTURE_FAIL;
+	}
+
 	gc->cx = gc->global_hook_info->cx;
 	gc->cy = gc->global_hook_info->cy;
 	gc->pitch = gc->global_hook_info->pitch;
 
-	if (gc->data) {
-		UnmapViewOfFile(gc->data);
-		gc->data = NULL;
-	}
+	ipc_shmem_free(&gc->hook_data);
+	gc->data = NULL;
+	gc->ring = NULL;
 
-	CloseHandle(gc->hook_data_map);
-
-	gc->hook_data_map = open_map_plus_id(gc, SHMEM_TEXTURE,
-			gc->global_hook_info->map_id);
-	if (!gc->hook_data_map) {
+	if (!open_hook_data(gc, gc->global_hook_info->map_id,
+			gc->global_hook_info->map_size)) {
 		DWORD error = GetLastError();
 		if (error == 2) {
 			return CAPTURE_RETRY;
@@ -1045,241 +1443,204 @@ static inline enum capture_result init_capture_data(struct game_capture *gc)
 		}
 		return CAPTURE_FAIL;
 	}
-
-	gc->data = MapViewOfFile(gc->hook_data_map, FILE_MAP_ALL_ACCESS, 0, 0,
-			gc->global_hook_info->map_size);
-	if (!gc->data) {
-		warn("init_capture_data: failed to map data view: %lu",
-				GetLastError());
-		return CAPTURE_FAIL;
-	}
+	gc->data = ipc_shmem_data(&gc->hook_data);
 
 	info("init_capture_data successful for %S, %S, %S", gc->config.title, gc->config.klass, gc->config.executable);
 	return CAPTURE_SUCCESS;
 }
 
-static inline bool is_16bit_format(uint32_t format)
+/* the hook bumps the ring's frame_count after every copy */
+static inline bool new_frame_available(struct game_capture *gc,
+	struct game_capture_client *client)
 {
-	return format == DXGI_FORMAT_B5G5R5A1_UNORM ||
-	       format == DXGI_FORMAT_B5G6R5_UNORM;
+	if (client->last_tex == -1)
+		return true;
+	return gc->ring->frame_count != client->last_frame_seq;
 }
 
-static void copy_b5g6r5_tex(struct game_capture *gc, int cur_texture,
-		uint8_t *data, uint32_t pitch)
+/* blocks until the hook copies a new frame or timeout_ms is up, one
+ * wakeup per frame instead of polling; called with gc->mutex held, which
+ * other pins get while this one waits. The hook's frame event wakes a
+ * single thread, so one pin of the session waits on it and wakes the
+ * others through frame_ready; when it gives up first, another takes over. */
+static inline void wait_for_frame(struct game_capture *gc,
+	struct game_capture_client *client, DWORD timeout_ms)
 {
-	uint8_t *input = gc->texture_buffers[cur_texture];
-	uint32_t gc_cx = gc->cx;
-	uint32_t gc_cy = gc->cy;
-	uint32_t gc_pitch = gc->pitch;
-
-	for (uint32_t y = 0; y < gc_cy; y++) {
-		uint8_t *row = input + (gc_pitch * y);
-		uint8_t *out = data + (pitch * y);
-
-		for (uint32_t x = 0; x < gc_cx; x += 8) {
-			__m128i pixels_blue, pixels_green, pixels_red;
-			__m128i pixels_result;
-			__m128i *pixels_dest;
-
-			__m128i *pixels_src = (__m128i*)(row + x * sizeof(uint16_t));
-			__m128i pixels = _mm_load_si128(pixels_src);
-
-			__m128i zero = _mm_setzero_si128();
-			__m128i pixels_low = _mm_unpacklo_epi16(pixels, zero);
-			__m128i pixels_high = _mm_unpackhi_epi16(pixels, zero);
-
-			__m128i blue_channel_mask = _mm_set1_epi32(0x0000001F);
-			__m128i blue_offset = _mm_set1_epi32(0x00000003);
-			__m128i green_channel_mask = _mm_set1_epi32(0x000007E0);
-			__m128i green_offset = _mm_set1_epi32(0x00000008);
-			__m128i red_channel_mask = _mm_set1_epi32(0x0000F800);
-			__m128i red_offset = _mm_set1_epi32(0x00000300);
-
-			pixels_blue = _mm_and_si128(pixels_low, blue_channel_mask);
-			pixels_blue = _mm_slli_epi32(pixels_blue, 3);
-			pixels_blue = _mm_add_epi32(pixels_blue, blue_offset);
-
-			pixels_green = _mm_and_si128(pixels_low, green_channel_mask);
-			pixels_green = _mm_add_epi32(pixels_green, green_offset);
-			pixels_green = _mm_slli_epi32(pixels_green, 5);
-
-			pixels_red = _mm_and_si128(pixels_low, red_channel_mask);
-			pixels_red = _mm_add_epi32(pixels_red, red_offset);
-			pixels_red = _mm_slli_epi32(pixels_red, 8);
-
-			pixels_result = _mm_set1_epi32(0xFF000000);
-			pixels_result = _mm_or_si128(pixels_result, pixels_blue);
-			pixels_result = _mm_or_si128(pixels_result, pixels_green);
-			pixels_result = _mm_or_si128(pixels_result, pixels_red);
+	if (!gc->ring || !timeout_ms || new_frame_available(gc, client))
+		return;
 
-			pixels_dest = (__m128i*)(out + x * sizeof(uint32_t));
-			_mm_store_si128(pixels_dest, pixels_result);
+	struct shmem_ring *ring = gc->ring;
+	__int64 start = StartCounter();
+	use_ring(gc);
 
-			pixels_blue = _mm_and_si128(pixels_high, blue_channel_mask);
-			pixels_blue = _mm_slli_epi32(pixels_blue, 3);
-			pixels_blue = _mm_add_epi32(pixels_blue, blue_offset);
+	while (gc->copy_texture && !new_frame_available(gc, client)) {
+		long double waited = GetCounterSinceStartMillis(start);
+		if (waited >= timeout_ms)
+			break;
+		DWORD left = (DWORD)(timeout_ms - waited) + 1;
 
-			pixels_green = _mm_and_si128(pixels_high, green_channel_mask);
-			pixels_green = _mm_add_epi32(pixels_green, green_offset);
-			pixels_green = _mm_slli_epi32(pixels_green, 5);
+		if (gc->frame_waiter) {
+			SleepConditionVariableCS(&gc->frame_ready, &gc->mutex, left);
+			continue;
+		}
 
-			pixels_red = _mm_and_si128(pixels_high, red_channel_mask);
-			pixels_red = _mm_add_epi32(pixels_red, red_offset);
-			pixels_red = _mm_slli_epi32(pixels_red, 8);
+		uint32_t seen = client->last_frame_seq;
+		gc->frame_waiter = true;
+		LeaveCriticalSection(&gc->mutex);
+		ipc_shmem_wait(&gc->hook_data, &ring->frame_count, seen, left);
+		EnterCriticalSection(&gc->mutex);
+		gc->frame_waiter = false;
+		WakeAllConditionVariable(&gc->frame_ready);
+	}
+	debug("waited %.02f ms for frame", GetCounterSinceStartMillis(start));
 
-			pixels_result = _mm_set1_epi32(0xFF000000);
-			pixels_result = _mm_or_si128(pixels_result, pixels_blue);
-			pixels_result = _mm_or_si128(pixels_result, pixels_green);
-			pixels_result = _mm_or_si128(pixels_result, pixels_red);
+	release_ring(gc);
+}
 
-			pixels_dest = (__m128i*)(out + (x + 4) * sizeof(uint32_t));
-			_mm_store_si128(pixels_dest, pixels_result);
-		}
+// The ring has a single reader slot: pins converting at the same time
+// share the read of the first one, and the slot is only let go once the
+// last of them is done. Called with gc->mutex held.
+static bool begin_ring_read(struct game_capture *gc, struct shmem_ring_read *read)
+{
+	if (!gc->ring_readers && !shmem_ring_read_begin(gc->ring, &gc->ring_read)) {
+		return false;
 	}
+	gc->ring_readers++;
+	*read = gc->ring_read;
+	return true;
 }
 
-static void copy_b5g5r5a1_tex(struct game_capture *gc, int cur_texture,
-		uint8_t *data, uint32_t pitch)
+// called with gc->mutex held; true when what was read is a whole frame
+static bool end_ring_read(struct game_capture *gc, struct shmem_ring *ring,
+	const struct shmem_ring_read *read)
 {
-	uint8_t *input = gc->texture_buffers[cur_texture];
-	uint32_t gc_cx = gc->cx;
-	uint32_t gc_cy = gc->cy;
-	uint32_t gc_pitch = gc->pitch;
-
-	for (uint32_t y = 0; y < gc_cy; y++) {
-		uint8_t *row = input + (gc_pitch * y);
-		uint8_t *out = data + (pitch * y);
-
-		for (uint32_t x = 0; x < gc_cx; x += 8) {
-			__m128i pixels_blue, pixels_green, pixels_red, pixels_alpha;
-			__m128i pixels_result;
-			__m128i *pixels_dest;
-
-			__m128i *pixels_src = (__m128i*)(row + x * sizeof(uint16_t));
-			__m128i pixels = _mm_load_si128(pixels_src);
-
-			__m128i zero = _mm_setzero_si128();
-			__m128i pixels_low = _mm_unpacklo_epi16(pixels, zero);
-			__m128i pixels_high = _mm_unpackhi_epi16(pixels, zero);
-
-			__m128i blue_channel_mask = _mm_set1_epi32(0x0000001F);
-			__m128i blue_offset = _mm_set1_epi32(0x00000003);
-			__m128i green_channel_mask = _mm_set1_epi32(0x000003E0);
-			__m128i green_offset = _mm_set1_epi32(0x000000C);
-			__m128i red_channel_mask = _mm_set1_epi32(0x00007C00);
-			__m128i red_offset = _mm_set1_epi32(0x00000180);
-			__m128i alpha_channel_mask = _mm_set1_epi32(0x00008000);
-			__m128i alpha_offset = _mm_set1_epi32(0x00000001);
-			__m128i alpha_mask32 = _mm_set1_epi32(0xFF000000);
-
-			pixels_blue = _mm_and_si128(pixels_low, blue_channel_mask);
-			pixels_blue = _mm_slli_epi32(pixels_blue, 3);
-			pixels_blue = _mm_add_epi32(pixels_blue, blue_offset);
-
-			pixels_green = _mm_and_si128(pixels_low, green_channel_mask);
-			pixels_green = _mm_add_epi32(pixels_green, green_offset);
-			pixels_green = _mm_slli_epi32(pixels_green, 6);
-
-			pixels_red = _mm_and_si128(pixels_low, red_channel_mask);
-			pixels_red = _mm_add_epi32(pixels_red, red_offset);
-			pixels_red = _mm_slli_epi32(pixels_red, 9);
-
-			pixels_alpha = _mm_and_si128(pixels_low, alpha_channel_mask);
-			pixels_alpha = _mm_srli_epi32(pixels_alpha, 15);
-			pixels_alpha = _mm_sub_epi32(pixels_alpha, alpha_offset);
-			pixels_alpha = _mm_andnot_si128(pixels_alpha, alpha_mask32);
-
-			pixels_result = pixels_red;
-			pixels_result = _mm_or_si128(pixels_result, pixels_alpha);
-			pixels_result = _mm_or_si128(pixels_result, pixels_blue);
-			pixels_result = _mm_or_si128(pixels_result, pixels_green);
-
-			pixels_dest = (__m128i*)(out + x * sizeof(uint32_t));
-			_mm_store_si128(pixels_dest, pixels_result);
-
-			pixels_blue = _mm_and_si128(pixels_high, blue_channel_mask);
-			pixels_blue = _mm_slli_epi32(pixels_blue, 3);
-			pixels_blue = _mm_add_epi32(pixels_blue, blue_offset);
+	if (--gc->ring_readers > 0) {
+		return shmem_ring_read_intact(ring, read);
+	}
+	return shmem_ring_read_end(ring, read);
+}
 
-			pixels_green = _mm_and_si128(pixels_high, green_channel_mask);
-			pixels_green = _mm_add_epi32(pixels_green, green_offset);
-			pixels_green = _mm_slli_epi32(pixels_green, 6);
+static inline void deliver_frame(struct game_capture_client *client,
+	uint32_t frame_seq, uint64_t capture_time, int slot)
+{
+	client->last_tex = slot;
+	client->last_frame_seq = frame_seq;
+	client->last_capture_time = capture_time;
+}
 
-			pixels_red = _mm_and_si128(pixels_high, red_channel_mask);
-			pixels_red = _mm_add_epi32(pixels_red, red_offset);
-			pixels_red = _mm_slli_epi32(pixels_red, 9);
+// Another pin of the same output already converted the newest frame.
+static bool copy_output_frame(struct game_capture *gc,
+	struct game_capture_client *client, IMediaSample *pSample)
+{
+	struct capture_output *output = client->output;
 
-			pixels_alpha = _mm_and_si128(pixels_high, alpha_channel_mask);
-			pixels_alpha = _mm_srli_epi32(pixels_alpha, 15);
-			pixels_alpha = _mm_sub_epi32(pixels_alpha, alpha_offset);
-			pixels_alpha = _mm_andnot_si128(pixels_alpha, alpha_mask32);
+	if (!output->have_frame || output->frame_seq != gc->ring->frame_count) {
+		return false;
+	}
 
-			pixels_result = pixels_red;
-			pixels_result = _mm_or_si128(pixels_result, pixels_alpha);
-			pixels_result = _mm_or_si128(pixels_result, pixels_blue);
-			pixels_result = _mm_or_si128(pixels_result, pixels_green);
+	if (client->last_tex != -1 && client->last_frame_seq == output->frame_seq) {
+		return false;
+	}
 
-			pixels_dest = (__m128i*)(out + (x + 4) * sizeof(uint32_t));
-			_mm_store_si128(pixels_dest, pixels_result);
-		}
+	BYTE *pData;
+	pSample->GetPointer(&pData);
+	if (pSample->GetSize() < (long)output->frame_size) {
+		warn("sample of %ld bytes too small for a %u byte frame", pSample->GetSize(), output->frame_size);
+		return false;
 	}
+
+	memcpy(pData, output->frame, output->frame_size);
+	deliver_frame(client, output->frame_seq, output->frame_capture_time, 0);
+	debug("FRAME %u - shared", output->frame_seq);
+	return true;
 }
 
-static inline void copy_16bit_tex(struct game_capture *gc, int cur_texture,
-		uint8_t *data, uint32_t pitch)
+static inline uint8_t *kept_frame(struct capture_output *output)
 {
-	if (gc->global_hook_info->format == DXGI_FORMAT_B5G5R5A1_UNORM) {
-		copy_b5g5r5a1_tex(gc, cur_texture, data, pitch);
-
-	} else if (gc->global_hook_info->format == DXGI_FORMAT_B5G6R5_UNORM) {
-		copy_b5g6r5_tex(gc, cur_texture, data, pitch);
+	if (!output->frame) {
+		output->frame = (uint8_t*)bmalloc(output->frame_size);
 	}
+	return output->frame;
 }
 
-static bool copy_shmem_tex(struct game_capture *gc, IMediaSample *pSample)
+// Called with gc->mutex held, which other pins get while this one converts.
+static bool copy_shmem_tex(struct game_capture *gc,
+	struct game_capture_client *client, IMediaSample *pSample,
+	FrameCheck *check)
 {
-	int cur_texture = gc->shmem_data->last_tex;
+	struct capture_output *output = client->output;
+	struct shmem_ring_read read;
+	uint32_t pitch;
 
-	if (cur_texture == gc->last_tex) {
-		debug("last_tex didn't change - try again later");
-		return false;
+	// another pin converts for the same output, what it gets is as new
+	// as anything this one would; the capture may restart meanwhile
+	while (output->converting) {
+		SleepConditionVariableCS(&gc->ring_released, &gc->mutex, INFINITE);
+		if (!gc->copy_texture) {
+			return false;
+		}
 	}
 
-	HANDLE mutex = NULL;
-	uint32_t pitch;
-	int next_texture;
+	if (copy_output_frame(gc, client, pSample)) {
+		return true;
+	}
 
-	if (cur_texture < 0 || cur_texture > 1)
+	// no conversion from the hook's frames (yet), nothing to hand out
+	if (!output->plan.IsValid()) {
+		debug("no conversion for this output - try again later");
 		return false;
+	}
 
-	next_texture = cur_texture == 1 ? 0 : 1;
+	// converted into it, or copied from the kept frame
+	if (pSample->GetSize() < (long)output->frame_size) {
+		warn("sample of %ld bytes too small for a %u byte frame", pSample->GetSize(), output->frame_size);
+		return false;
+	}
 
-	debug("FRAME - %d", cur_texture);
-	if (object_signalled(gc->texture_mutexes[cur_texture])) {
-		mutex = gc->texture_mutexes[cur_texture];
-	} else if (object_signalled(gc->texture_mutexes[next_texture])) {
-		debug("FRAME B - %d", next_texture);
-		mutex = gc->texture_mutexes[next_texture];
-		cur_texture = next_texture;
-	} else {
-		warn("NO FRAME - try again");
+	if (!new_frame_available(gc, client)) {
+		debug("no new frame - try again later");
 		return false;
 	}
 
-	gc->last_tex = cur_texture;
+	// the newest slot is converted in place, the hook writes elsewhere
+	// meanwhile and never waits for us
+	struct shmem_ring *ring = gc->ring;
+	if (!begin_ring_read(gc, &read)) {
+		debug("NO FRAME - try again");
+		return false;
+	}
+	if (client->last_tex != -1 && read.frame == client->last_frame_seq) {
+		// joined another pin's read of the frame this one already has
+		end_ring_read(gc, ring, &read);
+		debug("no new frame - try again later");
+		return false;
+	}
+	__int64 hold_start = StartCounter();
+	debug("FRAME - %d", read.slot);
 
 	BYTE *pData;
     pSample->GetPointer(&pData);
 
-	pitch = gc->pitch;
+	// with other pins on the output the frame is kept for them, and
+	// frames that may repeat are kept to hand out again
+	BYTE *pSampleData = pData;
+	bool shared = output->clients > 1;
+	bool keep = shared;
+	if (keep) {
+		pData = kept_frame(output);
+	}
 
-	if (gc->convert_16bit) {
+	// frame is rewritten from here on
+	output->converting = true;
+	output->have_frame = false;
+	use_ring(gc);
+	LeaveCriticalSection(&gc->mutex);
 
-		/// FIXME LOG ERROR
-		warn("copy_shmem_text 16 bit - not handled");
-		copy_16bit_tex(gc, cur_texture, pData, pitch);
+	pitch = gc->pitch;
+	bool black = false;
+	bool repeat = false;
 
-	} else if (pitch == gc->pitch) {
+	if (pitch == gc->pitch) {
 
 		// Convert camera sample to I420 with cropping, rotation and vertical flip.
 		// "src_size" is needed to parse MJPG.
@@ -1306,86 +1667,59 @@ static bool copy_shmem_tex(struct game_capture *gc, IMediaSample *pSample)
 
 
 		// FIXME make sure 16 byte alignment!
-		const uint8* src_frame = gc->texture_buffers[cur_texture];
-		int src_stride_frame = pitch;
-
-		int width = gc->cx;
-		int height = gc->cy;
-		uint8* dst_y = pData;
-		int dst_stride_y = width;
-		uint8* dst_u = pData + (width * height);
-		int dst_stride_u = (width + 1) / 2;
-		//uint8* dst_v = pData + ((width * height) >> 2);
-		uint8* dst_v = dst_u + ((width * height) >> 2);
-		int dst_stride_v = dst_stride_u;
-
-		if (gc->global_hook_info->flip) {
-			height = -height;
+		const uint8_t* src_frame = shmem_ring_slot_data(ring, read.slot);
+		const ConversionPlan* plan = &output->plan;
+
+		// black frames are looked for in the slot, and not converted;
+		// a shared output is converted for the other pins anyway
+		if (check && check->black && !shared) {
+			check->content = plan->SourceContent(src_frame);
+			black = check->content == CONTENT_BLACK;
 		}
 
-		// TODO - better to initialize function pointer once ?
-		int err = NULL;
-		if (gc->global_hook_info->format == DXGI_FORMAT_R8G8B8A8_UNORM) {
-			// Overwatch
-			err = libyuv::ABGRToI420(src_frame,
-				src_stride_frame,
-				dst_y,
-				dst_stride_y,
-				dst_u,
-				dst_stride_u,
-				dst_v,
-				dst_stride_v,
-				width,
-				height);
-		} else if (gc->global_hook_info->format == DXGI_FORMAT_B8G8R8A8_UNORM) {
-			// Hearthstone
-			// opengl / minecraft (javaw.exe)
-			err = libyuv::ARGBToI420(src_frame,
-				src_stride_frame,
-				dst_y,
-				dst_stride_y,
-				dst_u,
-				dst_stride_u,
-				dst_v,
-				dst_stride_v,
-				width,
-				height);
-		} else if (gc->global_hook_info->format == DXGI_FORMAT_B8G8R8X8_UNORM) {
-			// League Of Legends 7.2.17
-			err = libyuv::ARGBToI420(src_frame,
-				src_stride_frame,
-				dst_y,
-				dst_stride_y,
-				dst_u,
-				dst_stride_u,
-				dst_v,
-				dst_stride_v,
-				width,
-				height);
-		} else if (gc->global_hook_info->format == DXGI_FORMAT_R10G10B10A2_UNORM) {
-			// unreal engine, pubg
-			err = ABGR10ToI420(src_frame,
-				src_stride_frame,
-				dst_y,
-				dst_stride_y,
-				dst_u,
-				dst_stride_u,
-				dst_v,
-				dst_stride_v,
-				width,
-				height);
-				
-		} else {
-			warn("Unknown DXGI FORMAT %d", gc->global_hook_info->format);
+		if (!black && check && check->repeat) {
+			if (!output->repeats) {
+				output->repeats = new RepeatDetector;
+			}
+			bool hashed;
+			repeat = output->repeats->Check(client->convert_pool, src_frame, plan->SourceSize(), &hashed);
+			keep = keep || hashed || repeat;
+			check->repeated = repeat;
+		} else if (output->repeats && !black) {
+			// converted without looking, the kept frame stops matching
+			output->repeats->Drop();
+		}
+
+		if (keep) {
+			pData = kept_frame(output);
 		}
 
-		if (err) {
-			warn("yuv conversion failed");
+		if (!black && !repeat) {
+			// bands go straight into the sample, the slot is checked
+			// once all of them are done; once the hook got to it the
+			// frame is lost anyway and the remaining bands are skipped
+			std::atomic<int> err(0);
+			RunBands(client->convert_pool, plan->height, [&](int /*band*/, int first_row, int rows) {
+				if (!shmem_ring_read_intact(ring, &read)) {
+					return;
+				}
+				int band_err = plan->ConvertRows(src_frame, pData, first_row, rows);
+				if (band_err) {
+					err = band_err;
+				}
+			});
+
+			if (err) {
+				warn("yuv conversion failed");
+				if (output->repeats) {
+					output->repeats->Drop();
+				}
+			}
 		}
 
 	} else {
 		error("Unexpected state - no pitch");
-		uint8_t *input = gc->texture_buffers[cur_texture];
+		uint8_t *input = shmem_ring_slot_data(ring, read.slot);
 		uint32_t best_pitch =
 			pitch < gc->pitch ? pitch : gc->pitch;
 
@@ -1397,17 +1731,174 @@ static bool copy_shmem_tex(struct game_capture *gc, IMediaSample *pSample)
 		}
 	}
 
-	ReleaseMutex(mutex);
+	EnterCriticalSection(&gc->mutex);
+	bool intact = end_ring_read(gc, ring, &read);
+	long double held = GetCounterSinceStartMillis(hold_start);
+
+	gc->slot_reads++;
+	gc->slot_hold_millis += held;
+	if (held > gc->slot_hold_max_millis) {
+		gc->slot_hold_max_millis = held;
+	}
+	debug("slot %u held %.02Lf ms", read.slot, held);
+
+	if (!intact) {
+		if (output->repeats) {
+			output->repeats->Drop();
+		}
+		gc->torn_reads++;
+		debug("frame %u overwritten while converting - try again", read.frame);
+		output->converting = false;
+		release_ring(gc);
+		return false;
+	}
+
+	deliver_frame(client, read.frame, read.capture_time, read.slot);
+
+	if (repeat) {
+		gc->repeat_reads++;
+		debug("frame %u repeats the last one", read.frame);
+	}
+
+	LeaveCriticalSection(&gc->mutex);
 
+	// the slot is released, scaling only reads the plan's own frame
+	if (output->plan.scaled && !black && !repeat) {
+		__int64 start = StartCounter();
+		if (output->plan.ScaleToSample(pData)) {
+			warn("yuv scale failed");
+		}
+		debug("yuv scale %dx%d -> %dx%d took %.02f ms", gc->cx, gc->cy,
+			output->plan.sample.width, output->plan.sample.height, GetCounterSinceStartMillis(start));
+	}
+
+	if (keep) {
+		memcpy(pSampleData, output->frame, output->frame_size);
+	}
+
+	EnterCriticalSection(&gc->mutex);
+	if (keep) {
+		output->frame_seq = read.frame;
+		output->frame_capture_time = read.capture_time;
+		output->have_frame = true;
+	}
+	output->converting = false;
+	release_ring(gc);
 	return true;
 }
 
+// large pages are opt-in and quietly fall back, say when they did
+static inline void log_plan_buffers(struct capture_output *output)
+{
+	if (output->plan.scaled && output->plan.large_pages) {
+		info("scale buffers on %s pages", output->plan.large_buffers ? "large" : "normal");
+	}
+}
+
+// What turns the hook's frames into this output's samples. The hook's
+// transport follows the pin that started the capture: planar frames come
+// converted in its color space and only copy into some formats, an output
+// they cannot serve is left without a plan, see request_native_transport.
+static void init_output_plan(struct game_capture *gc, struct capture_output *output)
+{
+	int sample_cx = output->scale_cx ? output->scale_cx : gc->cx;
+	int sample_cy = output->scale_cy ? output->scale_cy : gc->cy;
+	uint32_t transport = gc->global_hook_info->transport;
+
+	output->plan.large_pages = gc->config.large_pages;
+	output->frame_size = GetOutputFrameSize(output->output_format, sample_cx, sample_cy);
+	output->have_frame = false;
+	bfree(output->frame);
+	output->frame = NULL;
+	if (output->repeats) {
+		output->repeats->Reset();
+	}
+
+	if (is_planar_transport(transport)) {
+		OutputFormat in_format = transport == SHMEM_TRANSPORT_NV12 ? OUTPUT_NV12 : OUTPUT_I420;
+		if (output->color_space != gc->config.color_space) {
+			FreeConversionPlan(&output->plan);
+			warn("hook converts to %s in color space %d, not %d",
+				in_format == OUTPUT_NV12 ? "NV12" : "I420", gc->config.color_space, output->color_space);
+		} else if (!BuildPlanarPlan(&output->plan, in_format, gc->cx, gc->cy,
+				output->output_format, output->color_space,
+				sample_cx, sample_cy)) {
+			warn("hook converts to %s, sample format %d has no copy from it",
+				in_format == OUTPUT_NV12 ? "NV12" : "I420", output->output_format);
+		} else {
+			info("hook converts to %s, %s", in_format == OUTPUT_NV12 ? "NV12" : "I420",
+				output->plan.scaled ? "scaling" : "copying planes");
+			log_plan_buffers(output);
+		}
+		return;
+	}
+
+	if (!BuildConversionPlan(&output->plan, gc->global_hook_info->format,
+			gc->global_hook_info->flip, gc->cx, gc->cy, gc->pitch,
+			output->output_format, output->color_space,
+			sample_cx, sample_cy)) {
+		warn("Unknown DXGI FORMAT %d", gc->global_hook_info->format);
+	} else if (output->plan.scaled) {
+		info("hook delivers %dx%d, scaling to %dx%d", gc->cx, gc->cy,
+			output->plan.sample.width, output->plan.sample.height);
+		log_plan_buffers(output);
+	}
+}
+
+// An output the hook's planar frames cannot serve: the hook goes back to
+// native frames, which every output converts from, and starts over. The
+// capture resumes on hook_ready, with new plans for all outputs.
+static void request_native_transport(struct game_capture *gc)
+{
+	info("an output has no copy from the frames the hook converts, switching %S back to native frames",
+		gc->config.executable);
+
+	gc->config.hook_convert = false;
+	gc->global_hook_info->transport_request = SHMEM_TRANSPORT_NATIVE;
+	gc->copy_texture = NULL;
+	gc->capturing = false;
+	log_ring_stats(gc);
+	gc->ring = NULL;
+
+	if (gc->hook_stop) {
+		SetEvent(gc->hook_stop);
+	}
+}
+
 static inline bool init_shmem_capture(struct game_capture *gc)
 {
-	gc->texture_buffers[0] = (uint8_t*)gc->data + gc->shmem_data->tex1_offset;
-	gc->texture_buffers[1] = (uint8_t*)gc->data + gc->shmem_data->tex2_offset;
-	gc->convert_16bit = is_16bit_format(gc->global_hook_info->format);
+	if (!shmem_ring_valid(&gc->shmem_data->ring, gc->global_hook_info->map_size)) {
+		warn("init_shmem_capture: hook shared memory has no valid frame ring");
+		return false;
+	}
+	gc->ring = &gc->shmem_data->ring;
+	info("shmem frame ring with %u slots", gc->ring->slot_count);
 	gc->copy_texture = copy_shmem_tex;
+
+	uint32_t transport = gc->global_hook_info->transport;
+
+	if (is_planar_transport(transport)) {
+		if (gc->ring->slot_size < shmem_transport_size(transport, gc->cx, gc->cy, gc->pitch)) {
+			warn("init_shmem_capture: frame ring slots too small for %dx%d", gc->cx, gc->cy);
+			gc->ring = NULL;
+			return false;
+		}
+	} else if (transport != SHMEM_TRANSPORT_NATIVE) {
+		warn("init_shmem_capture: unknown hook transport %u", transport);
+		gc->ring = NULL;
+		return false;
+	}
+
+	bool served = true;
+	for (struct capture_output *output = gc->outputs; output; output = output->next) {
+		init_output_plan(gc, output);
+		served = served && output->plan.IsValid();
+	}
+
+	if (is_planar_transport(transport) && !served) {
+		request_native_transport(gc);
+		return false;
+	}
 	return true;
 }
 
@@ -1443,7 +1934,8 @@ static inline bool capture_valid(struct game_capture *gc)
 	return !object_signalled(gc->target_process);
 }
 
-bool get_game_frame(void **data, bool missed, IMediaSample *pSample) {
+static bool capture_frame(struct game_capture *gc, struct game_capture_client *client,
+	bool missed, IMediaSample *pSample, DWORD wait_ms, FrameCheck *check) {
 	/*
 	 * Direct Show and OBS have a different strategy on dealing with frames
 	 * 
@@ -1456,10 +1948,15 @@ bool get_game_frame(void **data, bool missed, IMediaSample *pSample) {
 	 * We don't want to capture higher than the target fps
 	 *  -> we set the target fps in the graphics hook to keep impact to the graphics pipeline low
 	 * OBS graphics-hook has no semaphore on "new texture" available,
-	 * the only thing we can trigger off is the last_tex id, which is 0 or 1
+	 * our hook bumps the ring's frame_count and wakes us after every
+	 * copy (ipc_shmem_signal), so we block on that for up to wait_ms.
+	 * We always take the newest slot of the ring, the hook writes around
+	 * it; if it got overwritten while we converted we try again
 	 *
-	 * So we sample at 2 times fps, if last_text_id changes -> we have a new sample
-	 * If the mutex is locked - we use the other sample
+	 * Pins sharing the capture only take turns to look at the session,
+	 * they wait and convert side by side; pins converting at the same
+	 * time share the ring's read (begin_ring_read), and a pin whose output
+	 * another one is converting waits for it and copies the result
 	 * 
 	 * If we are late we need to get both frames and check 
 	 * If we are late
@@ -1467,14 +1964,8 @@ bool get_game_frame(void **data, bool missed, IMediaSample *pSample) {
 	*/
 
 
-	struct game_capture *gc = (game_capture *) *data;
-	if (!gc->active) {
-		*data = NULL;
-		return false;
-	}
-
 	if (missed) {
-		gc->last_tex = -1;
+		client->last_tex = -1;
 	}
 
 	// TODO there are more interesting cases handled in the obs game_capture_tick - need to re-asses those
@@ -1513,8 +2004,12 @@ bool get_game_frame(void **data, bool missed, IMediaSample *pSample) {
 			if (gc->shmem_data == NULL) {
 				return false;
 			}
+			if (gc->copy_texture && !missed) {
+				wait_for_frame(gc, client, wait_ms);
+			}
+			// the capture may have restarted while waiting
 			if (gc->copy_texture) {
-				return gc->copy_texture(gc, pSample);
+				return gc->copy_texture(gc, client, pSample, check);
 			}
 		}
 //
@@ -1537,129 +2032,35 @@ bool get_game_frame(void **data, bool missed, IMediaSample *pSample) {
 	return false;
 }
 
-bool stop_game_capture(void **data) {
-	struct game_capture *gc = (game_capture *) *data;
-	stop_capture(gc);
-	return true;
-}
-
-
-// color conversion
-static __inline int RGBToY(uint8_t r, uint8_t g, uint8_t b) {
-	return (66 * r + 129 * g + 25 * b + 0x1080) >> 8;
-}
-
-static __inline int RGBToU(uint8_t r, uint8_t g, uint8_t b) {
-	return (112 * b - 74 * g - 38 * r + 0x8080) >> 8;
-}
-static __inline int RGBToV(uint8_t r, uint8_t g, uint8_t b) {
-	return (112 * r - 94 * g - 18 * b + 0x8080) >> 8;
-}
-
-void ABGR10ToYRow_C(const uint8_t* src_argb0, uint8_t* dst_y, int width) {
-	int x;
-	for (x = 0; x < width; ++x) {
-		uint8_t r = (src_argb0[0] & 0xFC) >> 2 | (src_argb0[1] & 0x3) << 6;
-		uint8_t g = (src_argb0[1] & 0xF0) >> 4 | (src_argb0[2] & 0xF) << 4;
-		uint8_t b = (src_argb0[2] & 0xC0) >> 6 | (src_argb0[3] & 0x3F) << 2;
-		dst_y[0] = RGBToY(r, g, b);
-		src_argb0 += 4;
-		dst_y += 1;
-	}
-}
-
-
-void ABGR10ToUVRow_C(const uint8_t* src_rgb0, int src_stride_rgb,
-	uint8_t* dst_u, uint8_t* dst_v, int width) {
-	const uint8_t* src_rgb1 = src_rgb0 + src_stride_rgb;
-	int x;
-	for (x = 0; x < width - 1; x += 2) {
-		uint8_t r0 = (src_rgb0[0] & 0xFC) >> 2 | (src_rgb0[1] & 0x3) << 6;
-		uint8_t g0 = (src_rgb0[1] & 0xF0) >> 4 | (src_rgb0[2] & 0xF) << 4;
-		uint8_t b0 = (src_rgb0[2] & 0xC0) >> 6 | (src_rgb0[3] & 0x3F) << 2;
-
-		uint8_t r1 = (src_rgb0[4] & 0xFC) >> 2 | (src_rgb0[5] & 0x3) << 6;
-		uint8_t g1 = (src_rgb0[5] & 0xF0) >> 4 | (src_rgb0[6] & 0xF) << 4;
-		uint8_t b1 = (src_rgb0[6] & 0xC0) >> 6 | (src_rgb0[7] & 0x3F) << 2;
+bool get_game_frame(void **data, bool missed, IMediaSample *pSample, DWORD wait_ms, FrameCheck *check) {
+	struct game_capture_client *client = (game_capture_client *) *data;
+	struct game_capture *gc = client->gc;
 
-		uint8_t r2 = (src_rgb1[0] & 0xFC) >> 2 | (src_rgb1[1] & 0x3) << 6;
-		uint8_t g2 = (src_rgb1[1] & 0xF0) >> 4 | (src_rgb1[2] & 0xF) << 4;
-		uint8_t b2 = (src_rgb1[2] & 0xC0) >> 6 | (src_rgb1[3] & 0x3F) << 2;
-
-		uint8_t r3 = (src_rgb1[4] & 0xFC) >> 2 | (src_rgb1[5] & 0x3) << 6;
-		uint8_t g3 = (src_rgb1[5] & 0xF0) >> 4 | (src_rgb1[6] & 0xF) << 4;
-		uint8_t b3 = (src_rgb1[6] & 0xC0) >> 6 | (src_rgb1[7] & 0x3F) << 2;
-
-		uint8_t ab = (b0 + b1 + b2 + b3) >> 2;
-		uint8_t ag = (g0 + g1 + g2 + g3) >> 2;
-		uint8_t ar = (r0 + r1 + r2 + r3) >> 2;
-
-		dst_u[0] = RGBToU(ar, ag, ab);
-		dst_v[0] = RGBToV(ar, ag, ab);
-		src_rgb0 += 4 * 2;
-		src_rgb1 += 4 * 2;
-		dst_u += 1;
-		dst_v += 1;
+	EnterCriticalSection(&gc->mutex);
+	if (!gc->active) {
+		LeaveCriticalSection(&gc->mutex);
+		unsubscribe(client);
+		*data = NULL;
+		return false;
 	}
-	if (width & 1) {
-		uint8_t r0 = (src_rgb0[0] & 0xFC) >> 2 | (src_rgb0[1] & 0x3) << 6;
-		uint8_t g0 = (src_rgb0[1] & 0xF0) >> 4 | (src_rgb0[2] & 0xF) << 4;
-		uint8_t b0 = (src_rgb0[2] & 0xC0) >> 6 | (src_rgb0[3] & 0x3F) << 2;
-
-		uint8_t r2 = (src_rgb1[0] & 0xFC) >> 2 | (src_rgb1[1] & 0x3) << 6;
-		uint8_t g2 = (src_rgb1[1] & 0xF0) >> 4 | (src_rgb1[2] & 0xF) << 4;
-		uint8_t b2 = (src_rgb1[2] & 0xC0) >> 6 | (src_rgb1[3] & 0x3F) << 2;
-
-		uint8_t ab = (b0 + b2) >> 1;
-		uint8_t ag = (g0 + g2) >> 1;
-		uint8_t ar = (r0 + r2) >> 1;
 
-		dst_u[0] = RGBToU(ar, ag, ab);
-		dst_v[0] = RGBToV(ar, ag, ab);
-	}
+	bool frame = capture_frame(gc, client, missed, pSample, wait_ms, check);
+	LeaveCriticalSection(&gc->mutex);
+	return frame;
 }
 
-int ABGR10ToI420(const uint8_t* src_argb,
-	int src_stride_argb,
-	uint8_t* dst_y,
-	int dst_stride_y,
-	uint8_t* dst_u,
-	int dst_stride_u,
-	uint8_t* dst_v,
-	int dst_stride_v,
-	int width,
-	int height) {
-	int y;
-	void(*ARGBToUVRow)(const uint8_t* src_argb0, int src_stride_argb, uint8_t* dst_u,
-		uint8_t* dst_v, int width) = ABGR10ToUVRow_C;
-	void(*ARGBToYRow)(const uint8_t* src_argb, uint8_t* dst_y, int width) = ABGR10ToYRow_C;
-
-	if (!src_argb || !dst_y || !dst_u || !dst_v || width <= 0 || height == 0) {
-		return -1;
-	}
-
-	// Negative height means invert the image.
-	if (height < 0) {
-		height = -height;
-		src_argb = src_argb + (height - 1) * src_stride_argb;
-		src_stride_argb = -src_stride_argb;
-	}
-
-	for (y = 0; y < height - 1; y += 2) {
-		ARGBToUVRow(src_argb, src_stride_argb, dst_u, dst_v, width);
-		ARGBToYRow(src_argb, dst_y, width);
-		ARGBToYRow(src_argb + src_stride_argb, dst_y + dst_stride_y, width);
-		src_argb += src_stride_argb * 2;
-		dst_y += dst_stride_y * 2;
-		dst_u += dst_stride_u;
-		dst_v += dst_stride_v;
+uint64_t get_game_frame_time(void **data) {
+	struct game_capture_client *client = (game_capture_client *) *data;
+	if (client == NULL) {
+		return 0;
 	}
+	return client->last_capture_time;
+}
 
-	if (height & 1) {
-		ARGBToUVRow(src_argb, 0, dst_u, dst_v, width);
-		ARGBToYRow(src_argb, dst_y, width);
+bool stop_game_capture(void **data) {
+	struct game_capture_client *client = (game_capture_client *) *data;
+	if (client) {
+		unsubscribe(client);
 	}
-	return 0;
+	return true;
 }
-
-
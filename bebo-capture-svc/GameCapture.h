@@ -5,6 +5,9 @@
 #include <windows.h>
 #include <stdint.h>
 #include "CommonTypes.h"
+#include "ColorConvert.h"
+
+class ConvertPool;
 
 struct game_capture_config {
 	char                          *title;
@@ -22,14 +25,35 @@ struct game_capture_config {
 	bool                          capture_overlays;
 	bool                          anticheat_hook;
 	HWND						  window;
+	ConvertPool                   *convert_pool;
+	enum OutputFormat             output_format;
+	enum ColorSpace               color_space;
+	uint32_t                      shmem_slots;
+	uint32_t                      copy_threads;
+	// let the hook convert to the sample format when it can
+	bool                          hook_convert;
+	// frame memory and scale buffers on large pages, when allowed
+	bool                          large_pages;
 };
 
 bool isReady(void ** data);
+// Subscribes the caller to the capture of the window, hooking the game
+// unless another pin already did; *data is what a previous call returned
+// and the result what to pass next time. Pins with the same output format,
+// color space and scale share each converted frame. The session's hook
+// settings (transport, slots, copy threads, large pages) are those of the
+// pin that started it; a pin the hook's converted frames cannot serve (another
+// format or color space) switches the hook back to native frames.
 void * hook(void **data, LPCWSTR windowClassName, LPCWSTR windowName, game_capture_config *config, uint64_t frame_interval);
-bool get_game_frame(void ** data, bool missed, IMediaSample *pSample);
+// wait_ms: how long to block for a new frame when the hook signals them,
+// 0 to only check. With check, black frames and repeats are looked for in
+// shared memory before converting, see FrameCheck.
+bool get_game_frame(void ** data, bool missed, IMediaSample *pSample, DWORD wait_ms, FrameCheck *check = NULL);
+// os_gettime_ns() (QueryPerformanceCounter) of the present the last frame
+// was captured at, 0 when the hook does not record it.
+uint64_t get_game_frame_time(void ** data);
+// Unsubscribes; the capture stops with the last pin.
 bool stop_game_capture(void ** data);
+// The pin's own frame interval; the hook captures at the shortest of its
+// pins' intervals.
 void set_fps(void **data, uint64_t frame_interval);
-
-int ABGR10ToI420(const uint8_t* src_argb, int src_stride_argb, uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u,int dst_stride_u, uint8_t* dst_v, int dst_stride_v, int width, int height);
-void ABGR10ToYRow_C(const uint8_t* src_argb0, uint8_t* dst_y, int width);
-void ABGR10ToUVRow_C(const uint8_t* src_rgb0, int src_stride_rgb, uint8_t* dst_u, uint8_t* dst_v, int width);
@@ -0,0 +1,102 @@
+#include "RateControl.h"
+
+#include <string.h>
+
+RateControl::RateControl() :
+	frame_length_(10000000 / 30)
+{
+	Reset();
+}
+
+void RateControl::SetFrameLength(int64_t frame_length) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (frame_length <= 0 || frame_length == frame_length_) {
+		return;
+	}
+
+	frame_length_ = frame_length;
+	rate_ = FULL_RATE;
+	pressure_ = false;
+}
+
+bool RateControl::Notify(int64_t now, long proportion, int64_t late) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	stats_.notices++;
+
+	bool flood = proportion < 1000 || late > FrameLengthLocked();
+	if (!flood) {
+		return false;
+	}
+
+	stats_.floods++;
+	last_pressure_ = now;
+
+	if (pressure_ && now - last_change_ < CUT_INTERVAL) {
+		// give the last cut time to show downstream
+		return false;
+	}
+
+	// late but not asking for less, take off a quarter
+	long keep = proportion < 1000 ? proportion : 750;
+	if (keep < 500) {
+		keep = 500;
+	}
+
+	int rate = (int)(rate_ * keep / 1000);
+	if (rate < MIN_RATE) {
+		rate = MIN_RATE;
+	}
+	last_change_ = now;
+	pressure_ = true;
+	if (rate >= rate_) {
+		return false;
+	}
+
+	rate_ = rate;
+	stats_.decreases++;
+	if (rate_ < stats_.min_rate) {
+		stats_.min_rate = rate_;
+	}
+	return true;
+}
+
+int64_t RateControl::Update(int64_t now) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (pressure_ && now - last_pressure_ >= HOLD && now - last_change_ >= HOLD) {
+		rate_ += STEP;
+		if (rate_ >= FULL_RATE) {
+			rate_ = FULL_RATE;
+			pressure_ = false;
+		}
+		last_change_ = now;
+		stats_.increases++;
+	}
+
+	return FrameLengthLocked();
+}
+
+int64_t RateControl::FrameLength() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return FrameLengthLocked();
+}
+
+int RateControl::Rate() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return rate_;
+}
+
+void RateControl::Reset() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	rate_ = FULL_RATE;
+	last_pressure_ = 0;
+	last_change_ = 0;
+	pressure_ = false;
+	memset(&stats_, 0, sizeof(stats_));
+	stats_.min_rate = FULL_RATE;
+}
+
+RateControl::Stats RateControl::GetStats() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+
+// Capture rate under downstream pressure, fed by IQualityControl::Notify.
+// Times are in 100 ns units like REFERENCE_TIME, on any clock that does not
+// stop or go back.
+//
+// A flood (Proportion below 1000, or a sample more than a frame late) cuts
+// the rate to the proportion downstream says it keeps up with, by at most
+// half per notice, at most once per CUT_INTERVAL and never below MIN_RATE of
+// the negotiated rate. Once downstream has gone HOLD without complaining,
+// the rate climbs back a STEP at a time, HOLD apart, so it does not flap
+// between the two on pressure that comes and goes.
+class RateControl {
+public:
+	// rates are per mille of the negotiated frame rate
+	static const int FULL_RATE = 1000;
+	static const int MIN_RATE = 250;
+	static const int STEP = 100;
+	static const int64_t HOLD = 10000000;           // 1 s
+	static const int64_t CUT_INTERVAL = 2500000;    // 250 ms
+
+	struct Stats {
+		uint64_t notices;     // Notify() calls
+		uint64_t floods;      // of those, ones reporting pressure
+		uint64_t decreases;   // rate cuts
+		uint64_t increases;   // steps back up
+		int      min_rate;    // lowest rate reached
+	};
+
+	RateControl();
+
+	// The negotiated frame length; a new one starts over at the full rate.
+	void SetFrameLength(int64_t frame_length);
+
+	// A quality notice from downstream at now. proportion is Quality's,
+	// 1000 when downstream keeps up; late how late the sample was. True
+	// when it cut the rate.
+	bool Notify(int64_t now, long proportion, int64_t late);
+
+	// Steps the rate back up when the pressure has cleared; returns the
+	// frame length to capture at.
+	int64_t Update(int64_t now);
+
+	int64_t FrameLength();
+	int Rate();
+
+	// Back to the full rate, counters cleared.
+	void Reset();
+	Stats GetStats();
+
+private:
+	int64_t FrameLengthLocked() const { return frame_length_ * FULL_RATE / rate_; }
+
+	std::mutex mutex_;
+	int64_t frame_length_;
+	int rate_;
+	int64_t last_pressure_;
+	int64_t last_change_;
+	bool pressure_;
+	Stats stats_;
+};
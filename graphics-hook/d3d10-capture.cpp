@@ -751,6 +751,7 @@ static inline void d3d10_shmem_capture(ID3D10Resource *backbuffer)
 	} else {
 		d3d10_copy_texture(data.textures[data.cur_tex], backbuffer);
 	}
+	shmem_texture_captured(data.cur_tex);
 
 	if (data.copy_wait < NUM_BUFFERS - 1) {
 		data.copy_wait++;
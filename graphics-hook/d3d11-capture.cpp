@@ -793,6 +793,7 @@ static inline void d3d11_shmem_capture(ID3D11Resource *backbuffer)
 	} else {
 		d3d11_copy_texture(data.textures[data.cur_tex], backbuffer);
 	}
+	shmem_texture_captured(data.cur_tex);
 
 	if (data.copy_wait < NUM_BUFFERS - 1) {
 		data.copy_wait++;
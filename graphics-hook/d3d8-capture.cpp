@@ -213,6 +213,7 @@ static void d3d8_shmem_capture(IDirect3DDevice8 *device,
 
 		hr = device->CopyRects(src, nullptr, 0, dst, nullptr);
 		if (SUCCEEDED(hr)) {
+			shmem_texture_captured(cur_surface);
 			d3d8_shmem_capture_copy(cur_surface);
 		}
 	}
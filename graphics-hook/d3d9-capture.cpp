@@ -585,6 +585,7 @@ static inline void d3d9_shmem_capture(IDirect3DSurface9 *backbuffer)
 		hlog_hr("d3d9_shmem_capture: StretchRect failed", hr);
 		return;
 	}
+	shmem_texture_captured(data.cur_tex);
 
 	if (data.copy_wait < NUM_BUFFERS - 1) {
 		data.copy_wait++;
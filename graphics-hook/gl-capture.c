@@ -702,6 +702,7 @@ static void gl_shmem_capture(void)
 	next_tex = (data.cur_tex == NUM_BUFFERS - 1) ? 0 : data.cur_tex + 1;
 
 	gl_copy_backbuffer(data.textures[next_tex]);
+	shmem_texture_captured(next_tex);
 
 	if (data.copy_wait < NUM_BUFFERS - 1) {
 		data.copy_wait++;
@@ -1,6 +1,8 @@
 #include <windows.h>
 #include <psapi.h>
 #include "graphics-hook.h"
+#include "shmem-convert.h"
+#include "shmem-copy.h"
 #include "../util/obfuscate.h"
 #include "./funchook.h"
 
@@ -12,18 +14,40 @@
 #define DbgOut(x)
 #endif
 
+#define MAX_COPY_HELPERS 3
+
+/* copies rows [first_row, first_row + rows) of every frame */
+struct copy_helper {
+	HANDLE                 thread;
+	HANDLE                 start_event;
+	HANDLE                 done_event;
+	uint32_t               first_row;
+	uint32_t               rows;
+};
+
 struct thread_data {
 	CRITICAL_SECTION       mutexes[NUM_BUFFERS];
 	CRITICAL_SECTION       data_mutex;
 	void *volatile         cur_data;
-	uint8_t                *shmem_textures[2];
 	HANDLE                 copy_thread;
 	HANDLE                 copy_event;
 	HANDLE                 stop_event;
 	volatile int           cur_tex;
+	uint64_t               cur_time;
+	uint64_t               capture_times[NUM_BUFFERS];
 	unsigned int           pitch;
+	unsigned int           row_bytes;
 	unsigned int           cy;
 	volatile bool          locked_textures[NUM_BUFFERS];
+	struct shmem_convert   convert;
+
+	/* frame being copied, the copy thread does the first own_rows rows
+	 * and the helpers the rest */
+	uint8_t *volatile      band_dst;
+	const uint8_t *volatile band_src;
+	uint32_t               own_rows;
+	int                    helper_count;
+	struct copy_helper     helpers[MAX_COPY_HELPERS];
 };
 
 ipc_pipe_client_t              pipe                            = {0};
@@ -32,7 +56,6 @@ HANDLE                         signal_stop                     = NULL;
 HANDLE                         signal_ready                    = NULL;
 HANDLE                         signal_exit                     = NULL;
 static HANDLE                  signal_init                     = NULL;
-HANDLE                         tex_mutexes[2]                  = {NULL, NULL};
 static HANDLE                  filemap_hook_info               = NULL;
 
 static HINSTANCE               dll_inst                        = NULL;
@@ -45,7 +68,7 @@ HWND                           dummy_window                    = NULL;
 
 static unsigned int            shmem_id_counter                = 0;
 static void                    *shmem_info                     = NULL;
-static HANDLE                  shmem_file_handle               = 0;
+static ipc_shmem_t             shmem_map                       = {0};
 
 static struct thread_data      thread_data                     = {0};
 
@@ -82,14 +105,6 @@ static HANDLE init_event(const wchar_t *name, DWORD pid)
 	return handle;
 }
 
-static HANDLE init_mutex(const wchar_t *name, DWORD pid)
-{
-	HANDLE handle = create_mutex_plus_id(name, pid);
-	if (!handle)
-		hlog("Failed to open mutex '%s': %lu", name, GetLastError());
-	return handle;
-}
-
 static inline bool init_signals(void)
 {
 	DWORD pid = GetCurrentProcessId();
@@ -122,23 +137,6 @@ static inline bool init_signals(void)
 	return true;
 }
 
-static inline bool init_mutexes(void)
-{
-	DWORD pid = GetCurrentProcessId();
-
-	tex_mutexes[0] = init_mutex(MUTEX_TEXTURE1, pid);
-	if (!tex_mutexes[0]) {
-		return false;
-	}
-
-	tex_mutexes[1] = init_mutex(MUTEX_TEXTURE2, pid);
-	if (!tex_mutexes[1]) {
-		return false;
-	}
-
-	return true;
-}
-
 static inline bool init_system_path(void)
 {
 	UINT ret = GetSystemDirectoryA(system_path, MAX_PATH);
@@ -179,6 +177,8 @@ static inline bool init_hook_info(void)
 		return false;
 	}
 
+	global_hook_info->hook_version = HOOK_INFO_VERSION;
+	global_hook_info->hook_info_size = sizeof(struct hook_info);
 	return true;
 }
 
@@ -266,8 +266,6 @@ static void free_hook(void)
 		global_hook_info = NULL;
 	}
 
-	close_handle(&tex_mutexes[1]);
-	close_handle(&tex_mutexes[0]);
 	close_handle(&signal_exit);
 	close_handle(&signal_ready);
 	close_handle(&signal_stop);
@@ -464,47 +462,27 @@ uint64_t os_gettime_ns(void)
 	return (uint64_t)time_val;
 }
 
-static inline int try_lock_shmem_tex(int id)
+static inline bool init_shared_info(size_t size, bool large)
 {
-	int next = id == 0 ? 1 : 0;
-
-	if (object_signalled_or_abandoned(tex_mutexes[id])) {
-		return id;
-	} else if (object_signalled_or_abandoned(tex_mutexes[next])) {
-		return next;
-	}
-
-	return -1;
-}
+	char name[64];
+	bool success;
+	sprintf(name, "%s%u", SHMEM_TEXTURE, ++shmem_id_counter);
 
-static inline void unlock_shmem_tex(int id)
-{
-	if (id != -1) {
-		ReleaseMutex(tex_mutexes[id]);
-	}
-}
-
-static inline bool init_shared_info(size_t size)
-{
-	wchar_t name[64];
-	_snwprintf(name, 64, L"%s%ld", SHMEM_TEXTURE, ++shmem_id_counter);
-
-	shmem_file_handle = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
-			PAGE_READWRITE, 0, (DWORD)size, name);
-	if (!shmem_file_handle) {
+	success = large
+		? ipc_shmem_create_large(&shmem_map, name, size)
+		: ipc_shmem_create(&shmem_map, name, size);
+	if (!success) {
 		hlog("init_shared_info: Failed to create shared memory: %d",
 				GetLastError());
 		return false;
 	}
 
-	shmem_info = MapViewOfFile(shmem_file_handle, FILE_MAP_ALL_ACCESS,
-			0, 0, size);
-	if (!shmem_info) {
-		hlog("init_shared_info: Failed to map shared memory: %d",
-				GetLastError());
-		return false;
+	if (large && !ipc_shmem_large(&shmem_map)) {
+		hlog("init_shared_info: No large pages (not allowed to lock "
+		     "memory, or none free), using normal pages");
 	}
 
+	shmem_info = ipc_shmem_data(&shmem_map);
 	return true;
 }
 
@@ -512,7 +490,7 @@ bool capture_init_shtex(struct shtex_data **data, HWND window,
 		uint32_t base_cx, uint32_t base_cy, uint32_t cx, uint32_t cy,
 		uint32_t format, bool flip, uintptr_t handle)
 {
-	if (!init_shared_info(sizeof(struct shtex_data))) {
+	if (!init_shared_info(sizeof(struct shtex_data), false)) {
 		hlog("capture_init_shtex: Failed to initialize memory");
 		return false;
 	}
@@ -524,6 +502,7 @@ bool capture_init_shtex(struct shtex_data **data, HWND window,
 	global_hook_info->type = CAPTURE_TYPE_TEXTURE;
 	global_hook_info->format = format;
 	global_hook_info->flip = flip;
+	global_hook_info->transport = SHMEM_TRANSPORT_NATIVE;
 	global_hook_info->map_id = shmem_id_counter;
 	global_hook_info->map_size = sizeof(struct shtex_data);
 	global_hook_info->cx = cx;
@@ -541,12 +520,63 @@ bool capture_init_shtex(struct shtex_data **data, HWND window,
 	return true;
 }
 
+static void copy_band(uint8_t *dst, const uint8_t *src, uint32_t first_row,
+		uint32_t rows)
+{
+	if (thread_data.convert.transport != SHMEM_TRANSPORT_NATIVE) {
+		shmem_convert_rows(&thread_data.convert, dst, src, first_row,
+				rows);
+	} else {
+		shmem_copy_rows(dst + first_row * thread_data.row_bytes,
+				thread_data.row_bytes,
+				src + first_row * thread_data.pitch,
+				thread_data.pitch, thread_data.row_bytes, rows);
+	}
+}
+
+static DWORD CALLBACK copy_helper_thread(LPVOID param)
+{
+	struct copy_helper *helper = param;
+	HANDLE events[2] = {helper->start_event, thread_data.stop_event};
+
+	for (;;) {
+		DWORD ret = WaitForMultipleObjects(2, events, false, INFINITE);
+		if (ret != WAIT_OBJECT_0) {
+			break;
+		}
+
+		copy_band(thread_data.band_dst, thread_data.band_src,
+				helper->first_row, helper->rows);
+		SetEvent(helper->done_event);
+	}
+
+	return 0;
+}
+
+static void copy_frame(uint8_t *dst, const uint8_t *src)
+{
+	HANDLE done[MAX_COPY_HELPERS];
+	int count = thread_data.helper_count;
+
+	thread_data.band_dst = dst;
+	thread_data.band_src = src;
+
+	for (int i = 0; i < count; i++) {
+		done[i] = thread_data.helpers[i].done_event;
+		SetEvent(thread_data.helpers[i].start_event);
+	}
+
+	copy_band(dst, src, 0, thread_data.own_rows);
+
+	if (count) {
+		WaitForMultipleObjects(count, done, true, INFINITE);
+	}
+}
+
 static DWORD CALLBACK copy_thread(LPVOID unused)
 {
-	uint32_t pitch = thread_data.pitch;
-	uint32_t cy = thread_data.cy;
 	HANDLE events[2] = {NULL, NULL};
-	int shmem_id = 0;
+	struct shmem_ring *ring = &((struct shmem_data*)shmem_info)->ring;
 
 	if (!duplicate_handle(&events[0], thread_data.copy_event)) {
 		hlog_hr("copy_thread: Failed to duplicate copy event: %d",
@@ -563,6 +593,7 @@ static DWORD CALLBACK copy_thread(LPVOID unused)
 	for (;;) {
 		int copy_tex;
 		void *cur_data;
+		uint64_t cur_time;
 
 		DWORD ret = WaitForMultipleObjects(2, events, false, INFINITE);
 		if (ret != WAIT_OBJECT_0) {
@@ -572,22 +603,18 @@ static DWORD CALLBACK copy_thread(LPVOID unused)
 		EnterCriticalSection(&thread_data.data_mutex);
 		copy_tex = thread_data.cur_tex;
 		cur_data = thread_data.cur_data;
+		cur_time = thread_data.cur_time;
 		LeaveCriticalSection(&thread_data.data_mutex);
 
 		if (copy_tex < NUM_BUFFERS && !!cur_data) {
 			EnterCriticalSection(&thread_data.mutexes[copy_tex]);
 
-			int lock_id = try_lock_shmem_tex(shmem_id);
-			if (lock_id != -1) {
-				memcpy(thread_data.shmem_textures[lock_id],
-						cur_data, pitch * cy);
-
-				unlock_shmem_tex(lock_id);
-				((struct shmem_data*)shmem_info)->last_tex =
-					lock_id;
-
-				shmem_id = lock_id == 0 ? 1 : 0;
-			}
+			/* never waits on the capture side: the slot written is
+			 * neither the newest one nor the one being read */
+			uint32_t slot = shmem_ring_write_begin(ring);
+			copy_frame(shmem_ring_slot_data(ring, slot), cur_data);
+			shmem_ring_write_end(ring, slot, cur_time);
+			ipc_shmem_signal(&shmem_map, &ring->frame_count);
 
 			LeaveCriticalSection(&thread_data.mutexes[copy_tex]);
 		}
@@ -604,11 +631,19 @@ finish:
 	return 0;
 }
 
+/* called from present when the backbuffer is copied into buffer idx, the
+ * time follows the buffer into shared memory */
+void shmem_texture_captured(size_t idx)
+{
+	thread_data.capture_times[idx] = os_gettime_ns();
+}
+
 void shmem_copy_data(size_t idx, void *volatile data)
 {
 	EnterCriticalSection(&thread_data.data_mutex);
 	thread_data.cur_tex = (int)idx;
 	thread_data.cur_data = data;
+	thread_data.cur_time = thread_data.capture_times[idx];
 	thread_data.locked_textures[idx] = true;
 	LeaveCriticalSection(&thread_data.data_mutex);
 
@@ -640,14 +675,78 @@ void shmem_texture_data_unlock(int idx)
 	LeaveCriticalSection(&thread_data.mutexes[idx]);
 }
 
-static inline bool init_shmem_thread(uint32_t pitch, uint32_t cy)
+/* the options after the graphics offsets are zero from a service built
+ * before them, and may be anything from one built for another layout */
+static inline bool service_options(void)
 {
-	struct shmem_data *data = shmem_info;
+	return global_hook_info->service_version == HOOK_INFO_VERSION;
+}
+
+/* global_hook_info->copy_threads splits every frame into that many bands
+ * of even rows, one for the copy thread and one per helper; a helper that
+ * fails to start leaves its rows to the others */
+static inline void init_copy_helpers(uint32_t cy)
+{
+	uint32_t threads = service_options() ?
+		global_hook_info->copy_threads : 1;
+	uint32_t count = threads > 1 ? threads - 1 : 0;
+	uint32_t band;
+	uint32_t row;
+
+	if (count > MAX_COPY_HELPERS)
+		count = MAX_COPY_HELPERS;
+
+	band = (cy + count) / (count + 1);
+	band = (band + 1) & ~1;
+	row = band < cy ? band : cy;
 
+	for (uint32_t i = 0; i < count && row < cy; i++) {
+		struct copy_helper *helper =
+			&thread_data.helpers[thread_data.helper_count];
+
+		helper->first_row = row;
+		helper->rows = cy - row < band ? cy - row : band;
+		helper->start_event = CreateEvent(NULL, false, false, NULL);
+		helper->done_event = CreateEvent(NULL, false, false, NULL);
+		if (helper->start_event && helper->done_event) {
+			helper->thread = CreateThread(NULL, 0,
+					copy_helper_thread, helper, 0, NULL);
+		}
+
+		if (!helper->thread) {
+			hlog("init_copy_helpers: Failed to start helper: %d",
+					GetLastError());
+			if (helper->start_event)
+				CloseHandle(helper->start_event);
+			if (helper->done_event)
+				CloseHandle(helper->done_event);
+			memset(helper, 0, sizeof(*helper));
+			break;
+		}
+
+		thread_data.helper_count++;
+		row += helper->rows;
+	}
+
+	/* whatever no helper took stays with the copy thread */
+	thread_data.own_rows = thread_data.helper_count ?
+		thread_data.helpers[0].first_row : cy;
+	if (thread_data.helper_count) {
+		struct copy_helper *last =
+			&thread_data.helpers[thread_data.helper_count - 1];
+		if (last->first_row + last->rows < cy)
+			last->rows = cy - last->first_row;
+		hlog("copying frames on %d threads",
+				thread_data.helper_count + 1);
+	}
+}
+
+static inline bool init_shmem_thread(uint32_t pitch, uint32_t row_bytes,
+		uint32_t cy)
+{
 	thread_data.pitch = pitch;
+	thread_data.row_bytes = row_bytes;
 	thread_data.cy = cy;
-	thread_data.shmem_textures[0] = (uint8_t*)data + data->tex1_offset;
-	thread_data.shmem_textures[1] = (uint8_t*)data + data->tex2_offset;
 
 	thread_data.copy_event = CreateEvent(NULL, false, false, NULL);
 	if (!thread_data.copy_event) {
@@ -669,6 +768,8 @@ static inline bool init_shmem_thread(uint32_t pitch, uint32_t cy)
 
 	InitializeCriticalSection(&thread_data.data_mutex);
 
+	init_copy_helpers(cy);
+
 	thread_data.copy_thread = CreateThread(NULL, 0, copy_thread, NULL, 0,
 			NULL);
 	if (!thread_data.copy_thread) {
@@ -687,13 +788,38 @@ bool capture_init_shmem(struct shmem_data **data, HWND window,
 		uint32_t base_cx, uint32_t base_cy, uint32_t cx, uint32_t cy,
 		uint32_t pitch, uint32_t format, bool flip)
 {
-	uint32_t  tex_size       = cy * pitch;
+	bool      options        = service_options();
+	uint32_t  slots          = shmem_ring_clamp_slots(options ?
+			global_hook_info->shmem_slots : 3);
+	uint32_t  transport      = SHMEM_TRANSPORT_NATIVE;
+	uint32_t  bpp            = shmem_format_bpp(format);
+	uint32_t  row_bytes;
+	uint32_t  tex_size;
 	uint32_t  aligned_header = ALIGN(sizeof(struct shmem_data), 32);
-	uint32_t  aligned_tex    = ALIGN(tex_size, 32);
-	uint32_t  total_size     = aligned_header + aligned_tex * 2;
+	uint32_t  aligned_tex;
+	uint32_t  total_size;
 	uintptr_t align_pos;
 
-	if (!init_shared_info(total_size)) {
+	/* converted on the copy thread when the service asked for it and
+	 * there is a converter for the format */
+	if (options && shmem_convert_init(&thread_data.convert,
+				global_hook_info->transport_request, format,
+				global_hook_info->yuv_matrix,
+				global_hook_info->yuv_full_range,
+				cx, cy, pitch, flip)) {
+		transport = thread_data.convert.transport;
+		hlog("capture_init_shmem: converting to %s on the copy thread",
+				transport == SHMEM_TRANSPORT_NV12 ? "NV12" : "I420");
+	}
+
+	/* native frames leave the row padding of the mapped surface behind */
+	row_bytes   = bpp && cx * bpp <= pitch ? cx * bpp : pitch;
+	tex_size    = shmem_transport_size(transport, cx, cy, row_bytes);
+	aligned_tex = ALIGN(tex_size, 32);
+	total_size  = aligned_header + aligned_tex * slots;
+
+	if (!init_shared_info(total_size,
+				options && global_hook_info->large_pages)) {
 		hlog("capture_init_shmem: Failed to initialize memory");
 		return false;
 	}
@@ -706,23 +832,25 @@ bool capture_init_shmem(struct shmem_data **data, HWND window,
 	align_pos &= ~(32 - 1);
 	align_pos -= (uintptr_t)shmem_info;
 
-	(*data)->last_tex = -1;
-	(*data)->tex1_offset = (uint32_t)align_pos;
-	(*data)->tex2_offset = (*data)->tex1_offset + aligned_tex;
+	shmem_ring_init(&(*data)->ring, slots, (uint32_t)align_pos,
+			aligned_tex);
 
 	global_hook_info->window = (uint32_t)(uintptr_t)window;
 	global_hook_info->type = CAPTURE_TYPE_MEMORY;
 	global_hook_info->format = format;
 	global_hook_info->flip = flip;
+	global_hook_info->transport = transport;
 	global_hook_info->map_id = shmem_id_counter;
-	global_hook_info->map_size = total_size;
-	global_hook_info->pitch = pitch;
+	/* large pages round it up, and a view of them may have to cover
+	 * all of it */
+	global_hook_info->map_size = (uint32_t)shmem_map.size;
+	global_hook_info->pitch = row_bytes;
 	global_hook_info->cx = cx;
 	global_hook_info->cy = cy;
 	global_hook_info->base_cx = base_cx;
 	global_hook_info->base_cy = base_cy;
 
-	if (!init_shmem_thread(pitch, cy)) {
+	if (!init_shmem_thread(pitch, row_bytes, cy)) {
 		return false;
 	}
 
@@ -748,6 +876,19 @@ static inline void thread_data_free(void)
 
 		CloseHandle(thread_data.copy_thread);
 	}
+	for (int i = 0; i < thread_data.helper_count; i++) {
+		struct copy_helper *helper = &thread_data.helpers[i];
+		DWORD ret;
+
+		SetEvent(thread_data.stop_event);
+		ret = WaitForSingleObject(helper->thread, 500);
+		if (ret != WAIT_OBJECT_0)
+			TerminateThread(helper->thread, (DWORD)-1);
+
+		CloseHandle(helper->thread);
+		CloseHandle(helper->start_event);
+		CloseHandle(helper->done_event);
+	}
 	if (thread_data.stop_event)
 		CloseHandle(thread_data.stop_event);
 	if (thread_data.copy_event)
@@ -764,12 +905,8 @@ void capture_free(void)
 {
 	thread_data_free();
 
-	if (shmem_info) {
-		UnmapViewOfFile(shmem_info);
-		shmem_info = NULL;
-	}
-
-	close_handle(&shmem_file_handle);
+	ipc_shmem_free(&shmem_map);
+	shmem_info = NULL;
 
 	SetEvent(signal_restart);
 	active = false;
@@ -800,9 +937,6 @@ BOOL WINAPI DllMain(HINSTANCE hinst, DWORD reason, LPVOID unused1)
 		if (!init_hook_info()) {
 			return false;
 		}
-		if (!init_mutexes()) {
-			return false;
-		}
 
 		/* this prevents the library from being automatically unloaded
 		 * by the next FreeLibrary call */
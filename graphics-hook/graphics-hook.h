@@ -9,6 +9,7 @@
 
 #include "../util/graphics-hook-info.h"
 #include <ipc-util/pipe.h>
+#include <ipc-util/shmem.h>
 #include <psapi.h>
 
 #ifdef __cplusplus
@@ -33,6 +34,7 @@ static inline bool capture_ready(void);
 static inline bool capture_should_stop(void);
 static inline bool capture_should_init(void);
 
+extern void shmem_texture_captured(size_t idx);
 extern void shmem_copy_data(size_t idx, void *volatile data);
 extern bool shmem_texture_data_lock(int idx);
 extern void shmem_texture_data_unlock(int idx);
@@ -95,7 +97,6 @@ extern HANDLE signal_restart;
 extern HANDLE signal_stop;
 extern HANDLE signal_ready;
 extern HANDLE signal_exit;
-extern HANDLE tex_mutexes[2];
 extern char system_path[MAX_PATH];
 extern char process_name[MAX_PATH];
 extern wchar_t keepalive_name[64];
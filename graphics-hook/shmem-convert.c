@@ -0,0 +1,419 @@
+#include <emmintrin.h>
+#include "../util/dxgi-format.h"
+#include "../util/graphics-hook-info.h"
+#include "shmem-convert.h"
+
+/* RGB -> YUV, 8 bit fixed point: [matrix is 709][full range] */
+static const int yuv_coefs[2][2][10] = {
+	{
+		/* BT.601 limited */
+		{66, 129, 25, 16, -38, -74, 112, 112, -94, -18},
+		/* BT.601 full */
+		{77, 150, 29, 0, -43, -84, 127, 127, -107, -20},
+	},
+	{
+		/* BT.709 limited */
+		{47, 157, 16, 16, -26, -86, 112, 112, -102, -10},
+		/* BT.709 full */
+		{54, 183, 19, 0, -29, -98, 127, 127, -115, -12},
+	},
+};
+
+/* ------------------------------------------------------------------------- */
+/* source pixels */
+
+static void unpack_packed32(const struct shmem_convert *conv,
+		const uint8_t *src, int *r, int *g, int *b)
+{
+	uint32_t p = src[0] | src[1] << 8 | src[2] << 16 |
+		(uint32_t)src[3] << 24;
+
+	*r = (p >> conv->r_shift) & 0xFF;
+	*g = (p >> conv->g_shift) & 0xFF;
+	*b = (p >> conv->b_shift) & 0xFF;
+}
+
+/* 5 and 6 bit channels are widened by repeating their top bits */
+static inline int expand5(int c)
+{
+	return (c << 3) | (c >> 2);
+}
+
+static inline int expand6(int c)
+{
+	return (c << 2) | (c >> 4);
+}
+
+static void unpack_b5g6r5(const struct shmem_convert *conv,
+		const uint8_t *src, int *r, int *g, int *b)
+{
+	int p = src[0] | src[1] << 8;
+
+	*b = expand5(p & 0x1F);
+	*g = expand6((p >> 5) & 0x3F);
+	*r = expand5(p >> 11);
+
+	(void)conv;
+}
+
+static void unpack_b5g5r5a1(const struct shmem_convert *conv,
+		const uint8_t *src, int *r, int *g, int *b)
+{
+	int p = src[0] | src[1] << 8;
+
+	*b = expand5(p & 0x1F);
+	*g = expand5((p >> 5) & 0x1F);
+	*r = expand5((p >> 10) & 0x1F);
+
+	(void)conv;
+}
+
+/* ------------------------------------------------------------------------- */
+/* C rows, also the tails of the SSE2 rows */
+
+static inline int rgb_to_y(const struct shmem_convert *conv,
+		int r, int g, int b)
+{
+	return (conv->yr * r + conv->yg * g + conv->yb * b +
+			(conv->y_offset << 8) + 0x80) >> 8;
+}
+
+static inline int rgb_to_u(const struct shmem_convert *conv,
+		int r, int g, int b)
+{
+	return (conv->ur * r + conv->ug * g + conv->ub * b + 0x8080) >> 8;
+}
+
+static inline int rgb_to_v(const struct shmem_convert *conv,
+		int r, int g, int b)
+{
+	return (conv->vr * r + conv->vg * g + conv->vb * b + 0x8080) >> 8;
+}
+
+static void y_row_c(const struct shmem_convert *conv, const uint8_t *src,
+		uint8_t *dst_y, uint32_t x, uint32_t width)
+{
+	int r, g, b;
+
+	for (src += x * conv->bpp; x < width; x++) {
+		conv->unpack(conv, src, &r, &g, &b);
+		dst_y[x] = (uint8_t)rgb_to_y(conv, r, g, b);
+		src += conv->bpp;
+	}
+}
+
+/* x is even; U and V samples are step bytes apart, 2 for NV12. An odd
+ * last column averages 2 pixels. */
+static void uv_row_c(const struct shmem_convert *conv, const uint8_t *src0,
+		const uint8_t *src1, uint8_t *dst_u, uint8_t *dst_v, int step,
+		uint32_t x, uint32_t width)
+{
+	int bpp = conv->bpp;
+	int r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+	int ar, ag, ab;
+
+	src0 += x * bpp;
+	src1 += x * bpp;
+	dst_u += x / 2 * step;
+	dst_v += x / 2 * step;
+
+	for (; x + 1 < width; x += 2) {
+		conv->unpack(conv, src0, &r0, &g0, &b0);
+		conv->unpack(conv, src0 + bpp, &r1, &g1, &b1);
+		conv->unpack(conv, src1, &r2, &g2, &b2);
+		conv->unpack(conv, src1 + bpp, &r3, &g3, &b3);
+		ar = (r0 + r1 + r2 + r3) >> 2;
+		ag = (g0 + g1 + g2 + g3) >> 2;
+		ab = (b0 + b1 + b2 + b3) >> 2;
+		*dst_u = (uint8_t)rgb_to_u(conv, ar, ag, ab);
+		*dst_v = (uint8_t)rgb_to_v(conv, ar, ag, ab);
+		src0 += 2 * bpp;
+		src1 += 2 * bpp;
+		dst_u += step;
+		dst_v += step;
+	}
+
+	if (x < width) {
+		conv->unpack(conv, src0, &r0, &g0, &b0);
+		conv->unpack(conv, src1, &r2, &g2, &b2);
+		ar = (r0 + r2) >> 1;
+		ag = (g0 + g2) >> 1;
+		ab = (b0 + b2) >> 1;
+		*dst_u = (uint8_t)rgb_to_u(conv, ar, ag, ab);
+		*dst_v = (uint8_t)rgb_to_v(conv, ar, ag, ab);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 rows for 4 byte pixels, 16 per iteration. The coefficients are only
+ * known at run time, the math is the C rows' in wrapping 16 bit lanes. */
+
+struct sse2_coefs {
+	__m128i r_shift, g_shift, b_shift;
+	__m128i yr, yg, yb, y_round;
+	__m128i ur, ug, ub;
+	__m128i vr, vg, vb;
+	__m128i uv_round;
+};
+
+static inline void sse2_coefs_init(struct sse2_coefs *c,
+		const struct shmem_convert *conv)
+{
+	c->r_shift = _mm_cvtsi32_si128(conv->r_shift);
+	c->g_shift = _mm_cvtsi32_si128(conv->g_shift);
+	c->b_shift = _mm_cvtsi32_si128(conv->b_shift);
+	c->yr = _mm_set1_epi16((short)conv->yr);
+	c->yg = _mm_set1_epi16((short)conv->yg);
+	c->yb = _mm_set1_epi16((short)conv->yb);
+	c->y_round = _mm_set1_epi16((short)((conv->y_offset << 8) + 0x80));
+	c->ur = _mm_set1_epi16((short)conv->ur);
+	c->ug = _mm_set1_epi16((short)conv->ug);
+	c->ub = _mm_set1_epi16((short)conv->ub);
+	c->vr = _mm_set1_epi16((short)conv->vr);
+	c->vg = _mm_set1_epi16((short)conv->vg);
+	c->vb = _mm_set1_epi16((short)conv->vb);
+	c->uv_round = _mm_set1_epi16((short)0x8080);
+}
+
+/* 8 pixels as 16 bit lanes */
+static inline void unpack8_sse2(const struct sse2_coefs *c,
+		const uint8_t *src, __m128i *r, __m128i *g, __m128i *b)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	__m128i p0 = _mm_loadu_si128((const __m128i*)src);
+	__m128i p1 = _mm_loadu_si128((const __m128i*)(src + 16));
+
+	*r = _mm_packs_epi32(
+			_mm_and_si128(_mm_srl_epi32(p0, c->r_shift), mask),
+			_mm_and_si128(_mm_srl_epi32(p1, c->r_shift), mask));
+	*g = _mm_packs_epi32(
+			_mm_and_si128(_mm_srl_epi32(p0, c->g_shift), mask),
+			_mm_and_si128(_mm_srl_epi32(p1, c->g_shift), mask));
+	*b = _mm_packs_epi32(
+			_mm_and_si128(_mm_srl_epi32(p0, c->b_shift), mask),
+			_mm_and_si128(_mm_srl_epi32(p1, c->b_shift), mask));
+}
+
+static inline __m128i matrix_sse2(__m128i r, __m128i g, __m128i b,
+		__m128i cr, __m128i cg, __m128i cb, __m128i round)
+{
+	__m128i v = _mm_add_epi16(_mm_mullo_epi16(r, cr),
+			_mm_mullo_epi16(g, cg));
+	v = _mm_add_epi16(v, _mm_mullo_epi16(b, cb));
+	v = _mm_add_epi16(v, round);
+	return _mm_srli_epi16(v, 8);
+}
+
+/* sum of each horizontal pair of two 8 lane column sums */
+static inline __m128i pair_sum_sse2(__m128i lo, __m128i hi)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	return _mm_packs_epi32(_mm_madd_epi16(lo, ones),
+			_mm_madd_epi16(hi, ones));
+}
+
+static uint32_t y_row_sse2(const struct sse2_coefs *c, const uint8_t *src,
+		uint8_t *dst_y, uint32_t width)
+{
+	__m128i r, g, b, y0, y1;
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		unpack8_sse2(c, src, &r, &g, &b);
+		y0 = matrix_sse2(r, g, b, c->yr, c->yg, c->yb, c->y_round);
+		unpack8_sse2(c, src + 32, &r, &g, &b);
+		y1 = matrix_sse2(r, g, b, c->yr, c->yg, c->yb, c->y_round);
+		_mm_storeu_si128((__m128i*)(dst_y + x),
+				_mm_packus_epi16(y0, y1));
+		src += 64;
+	}
+
+	return x;
+}
+
+static uint32_t uv_row_sse2(const struct sse2_coefs *c, const uint8_t *src0,
+		const uint8_t *src1, uint8_t *dst_u, uint8_t *dst_v, bool nv12,
+		uint32_t width)
+{
+	__m128i ra, ga, ba, rb, gb, bb, r0, g0, b0, r1, g1, b1;
+	__m128i ar, ag, ab, u, v;
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		/* column sums of 2 rows, 8 pixels at a time, then pairs */
+		unpack8_sse2(c, src0, &ra, &ga, &ba);
+		unpack8_sse2(c, src1, &rb, &gb, &bb);
+		r0 = _mm_add_epi16(ra, rb);
+		g0 = _mm_add_epi16(ga, gb);
+		b0 = _mm_add_epi16(ba, bb);
+
+		unpack8_sse2(c, src0 + 32, &ra, &ga, &ba);
+		unpack8_sse2(c, src1 + 32, &rb, &gb, &bb);
+		r1 = _mm_add_epi16(ra, rb);
+		g1 = _mm_add_epi16(ga, gb);
+		b1 = _mm_add_epi16(ba, bb);
+
+		ar = _mm_srli_epi16(pair_sum_sse2(r0, r1), 2);
+		ag = _mm_srli_epi16(pair_sum_sse2(g0, g1), 2);
+		ab = _mm_srli_epi16(pair_sum_sse2(b0, b1), 2);
+
+		u = matrix_sse2(ar, ag, ab, c->ur, c->ug, c->ub, c->uv_round);
+		v = matrix_sse2(ar, ag, ab, c->vr, c->vg, c->vb, c->uv_round);
+
+		if (nv12) {
+			_mm_storeu_si128((__m128i*)(dst_u + x),
+					_mm_or_si128(u, _mm_slli_epi16(v, 8)));
+		} else {
+			_mm_storel_epi64((__m128i*)(dst_u + x / 2),
+					_mm_packus_epi16(u, u));
+			_mm_storel_epi64((__m128i*)(dst_v + x / 2),
+					_mm_packus_epi16(v, v));
+		}
+
+		src0 += 64;
+		src1 += 64;
+	}
+
+	return x;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void set_packed32(struct shmem_convert *conv,
+		int r_shift, int g_shift, int b_shift)
+{
+	conv->bpp = 4;
+	conv->r_shift = r_shift;
+	conv->g_shift = g_shift;
+	conv->b_shift = b_shift;
+	conv->unpack = unpack_packed32;
+}
+
+bool shmem_convert_init(struct shmem_convert *conv, uint32_t transport,
+		uint32_t format, uint32_t matrix, bool full_range,
+		uint32_t cx, uint32_t cy, uint32_t pitch, bool flip)
+{
+	const int *coefs;
+
+	memset(conv, 0, sizeof(*conv));
+
+	if (transport != SHMEM_TRANSPORT_I420 &&
+	    transport != SHMEM_TRANSPORT_NV12)
+		return false;
+
+	switch (format) {
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+		set_packed32(conv, 16, 8, 0);
+		break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+		set_packed32(conv, 0, 8, 16);
+		break;
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+		/* top 8 bits of each channel */
+		set_packed32(conv, 2, 12, 22);
+		break;
+	case DXGI_FORMAT_B5G6R5_UNORM:
+		conv->bpp = 2;
+		conv->unpack = unpack_b5g6r5;
+		break;
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		conv->bpp = 2;
+		conv->unpack = unpack_b5g5r5a1;
+		break;
+	default:
+		return false;
+	}
+
+	coefs = yuv_coefs[matrix == 709][full_range];
+	conv->yr = coefs[0];
+	conv->yg = coefs[1];
+	conv->yb = coefs[2];
+	conv->y_offset = coefs[3];
+	conv->ur = coefs[4];
+	conv->ug = coefs[5];
+	conv->ub = coefs[6];
+	conv->vr = coefs[7];
+	conv->vg = coefs[8];
+	conv->vb = coefs[9];
+
+	conv->transport = transport;
+	conv->cx = cx;
+	conv->cy = cy;
+	conv->pitch = pitch;
+	conv->flip = flip;
+	return true;
+}
+
+static inline const uint8_t *source_row(const struct shmem_convert *conv,
+		const uint8_t *src, uint32_t y)
+{
+	if (conv->flip)
+		y = conv->cy - 1 - y;
+	return src + (size_t)y * conv->pitch;
+}
+
+void shmem_convert_rows(const struct shmem_convert *conv, uint8_t *dst,
+		const uint8_t *src, uint32_t first_row, uint32_t rows)
+{
+	uint32_t cx = conv->cx;
+	uint32_t cy = conv->cy;
+	uint32_t half_cx = (cx + 1) / 2;
+	uint32_t half_cy = (cy + 1) / 2;
+	bool nv12 = conv->transport == SHMEM_TRANSPORT_NV12;
+	bool simd = conv->bpp == 4;
+	uint8_t *dst_y = dst;
+	uint8_t *dst_u = dst + cx * cy;
+	uint8_t *dst_v = nv12 ? dst_u + 1 : dst_u + half_cx * half_cy;
+	uint32_t uv_stride = nv12 ? half_cx * 2 : half_cx;
+	uint32_t end_row = first_row + rows < cy ? first_row + rows : cy;
+	int step = nv12 ? 2 : 1;
+	struct sse2_coefs c;
+	uint32_t y;
+
+	if (simd)
+		sse2_coefs_init(&c, conv);
+
+	/* two Y rows and the chroma row under them; an odd last row is its
+	 * own pair */
+	for (y = first_row; y < end_row; y += 2) {
+		const uint8_t *src0 = source_row(conv, src, y);
+		const uint8_t *src1 = y + 1 < cy ?
+			source_row(conv, src, y + 1) : src0;
+		uint8_t *row_u = dst_u + y / 2 * uv_stride;
+		uint8_t *row_v = dst_v + y / 2 * uv_stride;
+		uint32_t x;
+
+		x = simd ? y_row_sse2(&c, src0, dst_y + y * cx, cx) : 0;
+		y_row_c(conv, src0, dst_y + y * cx, x, cx);
+
+		if (y + 1 < cy) {
+			x = simd ? y_row_sse2(&c, src1, dst_y + (y + 1) * cx,
+					cx) : 0;
+			y_row_c(conv, src1, dst_y + (y + 1) * cx, x, cx);
+		}
+
+		x = simd ? uv_row_sse2(&c, src0, src1, row_u, row_v, nv12,
+				cx) : 0;
+		uv_row_c(conv, src0, src1, row_u, row_v, step, x, cx);
+	}
+}
+
+uint32_t shmem_format_bpp(uint32_t format)
+{
+	switch (format) {
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+		return 4;
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		return 2;
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * What the copy thread does on the way from a mapped staging surface into
+ * a ring slot with the I420 / NV12 shmem transports, so the service only
+ * has to copy planes; native frames are copied with shmem-copy.h. Both
+ * work on row bands so the copy can be split across helper threads. The
+ * conversion uses the same fixed point math as the service's converters
+ * (YUVCoefs in ColorConvert.cpp), 2x2 box averaged chroma.
+ */
+struct shmem_convert {
+	uint32_t transport;
+	uint32_t cx;
+	uint32_t cy;
+	uint32_t pitch;
+	bool     flip;
+
+	/* bytes per source pixel; 4 byte pixels have 8 bits of each channel
+	 * at these shifts and get the SSE2 rows */
+	int      bpp;
+	int      r_shift;
+	int      g_shift;
+	int      b_shift;
+	void     (*unpack)(const struct shmem_convert *conv,
+			const uint8_t *src, int *r, int *g, int *b);
+
+	int      yr, yg, yb, y_offset;
+	int      ur, ug, ub;
+	int      vr, vg, vb;
+};
+
+/* false, with conv->transport left SHMEM_TRANSPORT_NATIVE, when transport
+ * is native or there is no converter for the DXGI format */
+extern bool shmem_convert_init(struct shmem_convert *conv,
+		uint32_t transport, uint32_t format, uint32_t matrix,
+		bool full_range, uint32_t cx, uint32_t cy, uint32_t pitch,
+		bool flip);
+
+/* rows [first_row, first_row + rows) of the frame, first_row even; dst
+ * holds shmem_transport_size() bytes, src is the mapped surface */
+extern void shmem_convert_rows(const struct shmem_convert *conv,
+		uint8_t *dst, const uint8_t *src, uint32_t first_row,
+		uint32_t rows);
+
+/* bytes per pixel of a DXGI format, 0 when not known */
+extern uint32_t shmem_format_bpp(uint32_t format);
+
+#ifdef __cplusplus
+}
+#endif
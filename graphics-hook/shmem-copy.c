@@ -0,0 +1,68 @@
+#include <string.h>
+#include <emmintrin.h>
+#include "shmem-copy.h"
+
+#if !defined(__cplusplus) && !defined(inline)
+#define inline __inline
+#endif
+
+/* how far ahead of the copy the source is prefetched */
+#define PREFETCH_DISTANCE 512
+
+static inline void copy_row_stream(uint8_t *dst, const uint8_t *src,
+		uint32_t size)
+{
+	uint32_t head = (uint32_t)(-(intptr_t)dst & 15);
+	uint32_t i;
+
+	/* streaming stores need an aligned destination */
+	if (head > size)
+		head = size;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	for (i = 0; i + 64 <= size; i += 64) {
+		__m128i a, b, c, d;
+
+		_mm_prefetch((const char*)src + i + PREFETCH_DISTANCE,
+				_MM_HINT_NTA);
+		a = _mm_loadu_si128((const __m128i*)(src + i));
+		b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+		c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+		d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+		_mm_stream_si128((__m128i*)(dst + i), a);
+		_mm_stream_si128((__m128i*)(dst + i + 16), b);
+		_mm_stream_si128((__m128i*)(dst + i + 32), c);
+		_mm_stream_si128((__m128i*)(dst + i + 48), d);
+	}
+
+	for (; i + 16 <= size; i += 16)
+		_mm_stream_si128((__m128i*)(dst + i),
+				_mm_loadu_si128((const __m128i*)(src + i)));
+
+	memcpy(dst + i, src + i, size - i);
+}
+
+void shmem_copy_rows(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+		uint32_t src_pitch, uint32_t row_bytes, uint32_t rows)
+{
+	uint32_t y;
+
+	/* one run when neither side has padding */
+	if (dst_pitch == row_bytes && src_pitch == row_bytes) {
+		row_bytes *= rows;
+		rows = 1;
+	}
+
+	for (y = 0; y < rows; y++) {
+		copy_row_stream(dst, src, row_bytes);
+		dst += dst_pitch;
+		src += src_pitch;
+	}
+
+	/* streaming stores are weakly ordered, publish them before the
+	 * slot is */
+	_mm_sfence();
+}
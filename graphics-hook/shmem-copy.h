@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Native frames: copies row_bytes of each row with streaming stores, so the
+ * frame on its way out does not evict the game's working set from the
+ * cache, and reads ahead with non-temporal prefetches. Ends with a store
+ * fence, the rows are visible to other threads once it returns. */
+extern void shmem_copy_rows(uint8_t *dst, uint32_t dst_pitch,
+		const uint8_t *src, uint32_t src_pitch, uint32_t row_bytes,
+		uint32_t rows);
+
+#ifdef __cplusplus
+}
+#endif
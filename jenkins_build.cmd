@@ -5,6 +5,7 @@ set LEGACY_FILENAME=%JOB_NAME%_%TAG%.zip
 
 rmdir /s /q dist
 rmdir /s /q x64
+rmdir /s /q Win32
 rmdir /s /q Release
 
 pushd .
@@ -17,6 +18,14 @@ if errorlevel 1 (
   exit /b %errorlevel%
 )
 
+REM 32 bit games get the 32 bit hook, it has to match the service's hook_info
+MSBuild.exe bebo-capture.sln /property:Configuration=Release /property:Platform=x86 /target:graphics-hook:Rebuild
+
+if errorlevel 1 (
+  echo "Build of the 32 bit graphics hook Failed with %errorlevel%"
+  exit /b %errorlevel%
+)
+
 mkdir dist
 if errorlevel 1 (
   echo "mkdir dist failed with %errorlevel%"
@@ -42,6 +51,12 @@ if errorlevel 1 (
     exit /b %errorlevel%
 )
 
+xcopy Win32\Release\graphics-hook32.dll dist\
+if errorlevel 1 (
+    echo "Failed xcopy Win32\Release\graphics-hook32.dll dist\ with %errorlevel%"
+    exit /b %errorlevel%
+)
+
 "C:\Program Files\7-Zip\7z.exe" a -r %FILENAME% -w .\dist\* -mem=AES256
 
 @if errorlevel 1 (
@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ColorConvert.h"
+#include "bench.h"
+
+// Black frame detection per frame size: IsBlackPixels32 on the 32 bit
+// source before converting it, against what the pin used to do (convert,
+// then look at the I420 sample a byte at a time); and IsBlackFrame on
+// I420 and NV12 samples against the same byte loop. Frames that are all
+// black are scanned in full, a picture is found by the sparse probe, and
+// one lit pixel away from the probes is found by the scan near its end.
+//
+//   bench-black-frame [runs]
+
+struct Size {
+	const char* name;
+	int width, height;
+};
+
+static const Size SIZES[] = {
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4K", 3840, 2160 },
+};
+
+// the pin's loop before IsBlackFrame
+static bool byte_loop_black(const uint8_t* sample, int size, int y_size) {
+	for (int i = 0; i < size; i++) {
+		if ((i < y_size && sample[i] != 0x10) || (i >= y_size && sample[i] != 0x80)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void fill_pixels(uint8_t* frame, size_t pixels, uint32_t pixel) {
+	for (size_t i = 0; i < pixels; i++) {
+		memcpy(frame + i * 4, &pixel, 4);
+	}
+}
+
+static void bench_source(const Size& size, int runs) {
+	int stride = size.width * 4;
+	size_t pixels = (size_t)size.width * size.height;
+	uint8_t* frame = bench_alloc(pixels * 4, 0);
+	OutputLayout layout;
+	GetOutputLayout(&layout, OUTPUT_I420, COLOR_BT601_LIMITED, size.width, size.height);
+	int sample_size = GetOutputFrameSize(OUTPUT_I420, size.width, size.height);
+	uint8_t* sample = bench_alloc(sample_size, 0);
+	volatile bool sink = false;
+
+	// opaque black, as games present it
+	fill_pixels(frame, pixels, 0xFF000000);
+	double before_ms = bench_best_ms(runs, 10, [&] {
+		ARGBToOutputRows(&layout, frame, stride, sample, 0, size.height);
+		sink = byte_loop_black(sample, sample_size, layout.offset_u);
+	});
+	double black_ms = bench_best_ms(runs, 10, [&] {
+		sink = IsBlackPixels32(frame, stride, size.width, size.height, ARGB_COLOR_MASK);
+	});
+
+	// one dark blue pixel between probes on the second to last row
+	int lit = (size.height - 2) * size.width + size.width / 16;
+	frame[lit * 4] = 1;
+	double late_ms = bench_best_ms(runs, 10, [&] {
+		sink = IsBlackPixels32(frame, stride, size.width, size.height, ARGB_COLOR_MASK);
+	});
+
+	fill_pixels(frame, pixels, 0xFF204060);
+	double picture_ms = bench_best_ms(runs, 1000, [&] {
+		sink = IsBlackPixels32(frame, stride, size.width, size.height, ARGB_COLOR_MASK);
+	});
+
+	printf("%-5s source: convert + byte loop %6.3f ms; IsBlackPixels32 black %6.3f ms (%.0fx), "
+		"late pixel %6.3f ms, picture %3.0f ns\n",
+		size.name, before_ms, black_ms, before_ms / black_ms, late_ms, picture_ms * 1e6);
+
+	free(sample);
+	free(frame);
+}
+
+static void bench_sample(const Size& size, OutputFormat format, const char* format_name, int runs) {
+	OutputLayout layout;
+	GetOutputLayout(&layout, format, COLOR_BT601_LIMITED, size.width, size.height);
+	int sample_size = GetOutputFrameSize(format, size.width, size.height);
+	uint8_t* sample = bench_alloc(sample_size, 0);
+	volatile bool sink = false;
+
+	FillBlackFrame(&layout, sample);
+	double loop_ms = bench_best_ms(runs, 10, [&] {
+		sink = byte_loop_black(sample, sample_size, layout.offset_u);
+	});
+	double black_ms = bench_best_ms(runs, 10, [&] {
+		sink = IsBlackFrame(&layout, sample, sample_size);
+	});
+
+	// a lit chroma byte near the end, off the probes
+	sample[sample_size - 3] = 0x81;
+	double late_ms = bench_best_ms(runs, 10, [&] {
+		sink = IsBlackFrame(&layout, sample, sample_size);
+	});
+
+	memset(sample, 0x60, sample_size);
+	double picture_ms = bench_best_ms(runs, 1000, [&] {
+		sink = IsBlackFrame(&layout, sample, sample_size);
+	});
+
+	printf("%-5s %s:   byte loop %6.3f ms; IsBlackFrame black %6.3f ms (%.0fx), "
+		"late byte %6.3f ms, picture %3.0f ns\n",
+		size.name, format_name, loop_ms, black_ms, loop_ms / black_ms, late_ms, picture_ms * 1e6);
+
+	free(sample);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	for (const Size& size : SIZES) {
+		bench_source(size, runs);
+		bench_sample(size, OUTPUT_I420, "I420", runs);
+		bench_sample(size, OUTPUT_NV12, "NV12", runs);
+	}
+	return 0;
+}
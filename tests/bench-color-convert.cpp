@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "ColorConvert.h"
+#include "convert-reference.h"
+#include "libyuv/convert_from_argb.h"
+#include "bench.h"
+
+// Converters: a frame per call at 1080p, 1440p and 4K with the rows the
+// cpu picks, against the per pixel reference of the tests. The reference
+// is slower than the C rows; BEBO_CPU=c or sse2 times those rows instead,
+// for the speedup of each row set.
+//
+//   bench-color-convert [runs]
+
+struct Size {
+	const char* name;
+	int width, height;
+};
+
+static const Size SIZES[] = {
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4K", 3840, 2160 },
+};
+
+static void print_case(const char* what, const Size& size, double ms, double ref_ms) {
+	printf("%-22s %-5s: %7.2f ms, %6.0f Mpixel/s", what, size.name, ms,
+		size.width * (double)size.height / ms / 1e3);
+	if (ref_ms > 0) {
+		printf(", %.1fx the reference", ref_ms / ms);
+	}
+	printf("\n");
+}
+
+static void bench_i420(const char* what, ARGBToI420Fn convert, RefPixelFn pixel, const Size& size, int runs) {
+	int w = size.width, h = size.height;
+	uint8_t* src = bench_alloc((size_t)w * h * 4, 1);
+	uint8_t* y = bench_alloc((size_t)w * h, 0);
+	uint8_t* u = bench_alloc((size_t)w * h / 4, 0);
+	uint8_t* v = bench_alloc((size_t)w * h / 4, 0);
+
+	double ref_ms = pixel ? bench_best_ms(runs, 1, [&] {
+		ref_convert(pixel, 4, 8, COLOR_BT709_LIMITED, src, w * 4, y, w, u, v, w / 2, w, h);
+	}) : 0;
+	double ms = bench_best_ms(runs, 10, [&] {
+		convert(src, w * 4, y, w, u, w / 2, v, w / 2, w, h);
+	});
+	print_case(what, size, ms, ref_ms);
+
+	free(v);
+	free(u);
+	free(y);
+	free(src);
+}
+
+static void bench_p010(const char* what, ToP010Fn convert, RefPixelFn pixel, const Size& size, int runs) {
+	int w = size.width, h = size.height;
+	uint8_t* src = bench_alloc((size_t)w * h * 4, 1);
+	uint8_t* y = bench_alloc((size_t)w * h * 2, 0);
+	uint8_t* uv = bench_alloc((size_t)w * h, 0);
+
+	double ref_ms = bench_best_ms(runs, 1, [&] {
+		ref_convert(pixel, 4, 10, COLOR_BT709_LIMITED, src, w * 4, y, w * 2, uv, NULL, w * 2, w, h);
+	});
+	double ms = bench_best_ms(runs, 10, [&] {
+		convert(src, w * 4, y, w * 2, uv, w * 2, w, h);
+	});
+	print_case(what, size, ms, ref_ms);
+
+	free(uv);
+	free(y);
+	free(src);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	printf("rows: %s, BT.709 limited\n", cpu_rows_name());
+	for (const Size& size : SIZES) {
+		bench_i420("R10G10B10A2 to I420", ABGR10ToI420<COLOR_BT709_LIMITED>, ref_abgr10, size, runs);
+		bench_i420("ARGB to I420", ARGBToI420Matrix<COLOR_BT709_LIMITED>, ref_argb, size, runs);
+		bench_i420("ARGB to I420 (libyuv)", libyuv::ARGBToI420, NULL, size, runs);
+		bench_p010("R10G10B10A2 to P010", ABGR10ToP010<COLOR_BT709_LIMITED>, ref_abgr10_wide, size, runs);
+	}
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <thread>
+#include "ColorConvert.h"
+#include "ConvertPool.h"
+#include "bench.h"
+
+// Convert pool: ARGB to an I420 and an NV12 sample at 1080p, 1440p and 4K,
+// cut into bands over 1 to MAX_THREADS threads, and the speedup over one.
+// The pool cannot go faster than the cores the machine has, printed first.
+//
+//   bench-convert-pool [runs]
+
+struct Size {
+	const char* name;
+	int width, height;
+};
+
+static const Size SIZES[] = {
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4K", 3840, 2160 },
+};
+
+static void bench_size(const Size& size, OutputFormat format, const char* format_name, int runs) {
+	OutputLayout layout;
+	GetOutputLayout(&layout, format, COLOR_BT709_LIMITED, size.width, size.height);
+	int src_stride = size.width * 4;
+	uint8_t* src = bench_alloc((size_t)src_stride * size.height, 1);
+	uint8_t* dst = bench_alloc(GetOutputFrameSize(format, size.width, size.height), 0);
+
+	ConvertPool pool(1);
+	double one_ms = 0;
+	for (int threads = 1; threads <= ConvertPool::MAX_THREADS; threads *= 2) {
+		pool.SetThreads(threads);
+		double ms = bench_best_ms(runs, 10, [&] {
+			pool.Run(size.height, [&](int /*band*/, int first_row, int rows) {
+				ARGBToOutputRows(&layout, src + (size_t)first_row * src_stride, src_stride,
+					dst, first_row, rows);
+			});
+		});
+		if (threads == 1) {
+			one_ms = ms;
+		}
+		printf("%-5s %s, %d threads: %6.2f ms, %.2fx\n", size.name, format_name, threads, ms, one_ms / ms);
+	}
+
+	free(dst);
+	free(src);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	printf("%u hardware threads, default pool %d\n", std::thread::hardware_concurrency(),
+		ConvertPool::DefaultThreads());
+	for (const Size& size : SIZES) {
+		bench_size(size, OUTPUT_I420, "I420", runs);
+		bench_size(size, OUTPUT_NV12, "NV12", runs);
+	}
+	return 0;
+}
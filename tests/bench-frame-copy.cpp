@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ConvertPool.h"
+#include "shmem-copy.h"
+#include "bench.h"
+
+// The hook's frame copy into shared memory: shmem_copy_rows (streaming
+// stores, prefetch) against memcpy, per frame size, for a source without
+// padding and one with the row padding of a mapped surface (memcpy of the
+// whole pitch, as the hook used to, or row by row), and split over helper
+// threads. Last, what each copy leaves of a game's working set in cache:
+// the time to read 4 MB of it again after the copy.
+//
+//   bench-frame-copy [runs]
+
+struct Size {
+	const char* name;
+	int width, height;
+};
+
+static const Size SIZES[] = {
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4K", 3840, 2160 },
+};
+
+// D3D surfaces are mapped with their rows padded
+static const uint32_t PITCH_PADDING = 256;
+
+static const size_t WORKING_SET = 4 * 1024 * 1024;
+
+static uint64_t read_working_set(const uint8_t* data) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < WORKING_SET; i += 64) {
+		sum += data[i];
+	}
+	return sum;
+}
+
+static void bench_size(const Size& size, int runs) {
+	uint32_t row_bytes = (uint32_t)size.width * 4;
+	uint32_t pitch = row_bytes + PITCH_PADDING;
+	uint32_t rows = (uint32_t)size.height;
+	size_t frame = (size_t)row_bytes * rows;
+	uint8_t* src = bench_alloc((size_t)pitch * rows, 1);
+	uint8_t* dst = bench_alloc((size_t)pitch * rows, 0);
+
+	double memcpy_ms = bench_best_ms(runs, 10, [&] {
+		memcpy(dst, src, frame);
+	});
+	double stream_ms = bench_best_ms(runs, 10, [&] {
+		shmem_copy_rows(dst, row_bytes, src, row_bytes, row_bytes, rows);
+	});
+	printf("%-5s %5.1f MB: memcpy %5.2f ms, streaming %5.2f ms (%.2fx)\n", size.name, frame / 1e6,
+		memcpy_ms, stream_ms, memcpy_ms / stream_ms);
+
+	double pitch_ms = bench_best_ms(runs, 10, [&] {
+		memcpy(dst, src, (size_t)pitch * rows);
+	});
+	double rows_ms = bench_best_ms(runs, 10, [&] {
+		for (uint32_t y = 0; y < rows; y++) {
+			memcpy(dst + (size_t)y * row_bytes, src + (size_t)y * pitch, row_bytes);
+		}
+	});
+	double stream_rows_ms = bench_best_ms(runs, 10, [&] {
+		shmem_copy_rows(dst, row_bytes, src, pitch, row_bytes, rows);
+	});
+	printf("%-5s padded:   memcpy of the pitch %5.2f ms, memcpy per row %5.2f ms, streaming rows %5.2f ms\n",
+		size.name, pitch_ms, rows_ms, stream_rows_ms);
+
+	ConvertPool pool(1);
+	for (int threads = 2; threads <= 4; threads *= 2) {
+		pool.SetThreads(threads);
+		double ms = bench_best_ms(runs, 10, [&] {
+			pool.Run((int)rows, [&](int /*band*/, int first_row, int band_rows) {
+				shmem_copy_rows(dst + (size_t)first_row * row_bytes, row_bytes,
+					src + (size_t)first_row * pitch, pitch, row_bytes, (uint32_t)band_rows);
+			});
+		});
+		printf("%-5s padded:   streaming rows on %d threads %5.2f ms (%.2fx one)\n",
+			size.name, threads, ms, stream_rows_ms / ms);
+	}
+
+	free(dst);
+	free(src);
+}
+
+// the working set read right after each copy, against read on its own
+static void bench_cache(int runs) {
+	const Size& size = SIZES[1];
+	uint32_t row_bytes = (uint32_t)size.width * 4;
+	size_t frame = (size_t)row_bytes * size.height;
+	uint8_t* src = bench_alloc(frame, 1);
+	uint8_t* dst = bench_alloc(frame, 0);
+	uint8_t* game = bench_alloc(WORKING_SET, 3);
+	volatile uint64_t sink = 0;
+
+	double alone_ms = bench_best_ms(runs, 20, [&] {
+		sink += read_working_set(game);
+	});
+	double after_memcpy_ms = bench_best_ms(runs, 20, [&] {
+		sink += read_working_set(game);
+		memcpy(dst, src, frame);
+	});
+	double memcpy_ms = bench_best_ms(runs, 20, [&] {
+		memcpy(dst, src, frame);
+	});
+	double after_stream_ms = bench_best_ms(runs, 20, [&] {
+		sink += read_working_set(game);
+		shmem_copy_rows(dst, row_bytes, src, row_bytes, row_bytes, (uint32_t)size.height);
+	});
+	double stream_ms = bench_best_ms(runs, 20, [&] {
+		shmem_copy_rows(dst, row_bytes, src, row_bytes, row_bytes, (uint32_t)size.height);
+	});
+	printf("4 MB working set read: alone %.3f ms, after a %s memcpy %.3f ms, after a streaming copy %.3f ms\n",
+		alone_ms, size.name, after_memcpy_ms - memcpy_ms, after_stream_ms - stream_ms);
+
+	free(game);
+	free(dst);
+	free(src);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	for (const Size& size : SIZES) {
+		bench_size(size, runs);
+	}
+	bench_cache(runs);
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "ColorConvert.h"
+#include "ConversionPlan.h"
+#include "dxgi-format.h"
+#include "libyuv/convert_from_argb.h"
+#include "bench.h"
+
+// Service side scaling of game frames delivered at another size than the
+// pin's: I420ScaleToOutput on its own, the whole path (ARGB converted at
+// source size, then scaled in I420), and scaling the ARGB into the
+// letterbox rect instead, per frame. I420 and NV12 samples, one thread.
+// Last, R10G10B10A2 frames into P010 samples: the plan's scale in P010
+// against converting to 8 bit I420, scaling and shifting up.
+//
+//   bench-i420-scale [runs]
+
+struct Case {
+	const char* name;
+	int src_width, src_height;
+	int dst_width, dst_height;
+};
+
+static const Case CASES[] = {
+	{ "1440p to 1080p", 2560, 1440, 1920, 1080 },
+	{ "4K to 1080p", 3840, 2160, 1920, 1080 },
+	{ "1920x1200 to 1080p", 1920, 1200, 1920, 1080 },
+	{ "720p to 1080p", 1280, 720, 1920, 1080 },
+};
+
+static void bench_case(const Case& c, OutputFormat format, const char* format_name, int runs) {
+	OutputLayout layout;
+	GetOutputLayout(&layout, format, COLOR_BT601_LIMITED, c.dst_width, c.dst_height);
+	int sw = c.src_width, sh = c.src_height;
+	int half_w = (sw + 1) / 2, half_h = (sh + 1) / 2;
+
+	uint8_t* argb = bench_alloc((size_t)sw * 4 * sh, 1);
+	uint8_t* src_y = bench_alloc((size_t)sw * sh, 2);
+	uint8_t* src_u = bench_alloc((size_t)half_w * half_h, 3);
+	uint8_t* src_v = bench_alloc((size_t)half_w * half_h, 4);
+	uint8_t* dst = bench_alloc(GetOutputFrameSize(format, c.dst_width, c.dst_height), 0);
+	uint8_t* staging = bench_alloc(GetOutputFrameSize(OUTPUT_I420, c.dst_width, c.dst_height), 0);
+
+	int x, y, width, height;
+	GetLetterboxRect(sw, sh, c.dst_width, c.dst_height, &x, &y, &width, &height);
+	uint8_t* band = bench_alloc(ScaleBandSize(width), 0);
+
+	double scale_ms = bench_best_ms(runs, 10, [&] {
+		I420ScaleToOutput(src_y, sw, src_u, half_w, src_v, half_w, sw, sh, &layout, dst, staging);
+	});
+	double yuv_ms = bench_best_ms(runs, 10, [&] {
+		libyuv::ARGBToI420(argb, sw * 4, src_y, sw, src_u, half_w, src_v, half_w, sw, sh);
+		I420ScaleToOutput(src_y, sw, src_u, half_w, src_v, half_w, sw, sh, &layout, dst, staging);
+	});
+	double argb_ms = bench_best_ms(runs, 10, [&] {
+		FillBlackFrame(&layout, dst);
+		ARGBScaleRectToOutput(argb, sw * 4, sw, sh, &layout, dst, x, y, width, height, band);
+	});
+	printf("%-18s %s: I420 scale %5.2f ms, convert + I420 scale %5.2f ms, ARGB scale + convert %5.2f ms\n",
+		c.name, format_name, scale_ms, yuv_ms, argb_ms);
+
+	free(band);
+	free(staging);
+	free(dst);
+	free(src_v);
+	free(src_u);
+	free(src_y);
+	free(argb);
+}
+
+static void bench_p010(const Case& c, int runs) {
+	OutputLayout layout;
+	GetOutputLayout(&layout, OUTPUT_P010, COLOR_BT709_LIMITED, c.dst_width, c.dst_height);
+	int sw = c.src_width, sh = c.src_height;
+	int half_w = (sw + 1) / 2, half_h = (sh + 1) / 2;
+
+	uint8_t* abgr10 = bench_alloc((size_t)sw * 4 * sh, 1);
+	uint8_t* i420 = bench_alloc(GetOutputFrameSize(OUTPUT_I420, sw, sh), 2);
+	uint8_t* dst = bench_alloc(GetOutputFrameSize(OUTPUT_P010, c.dst_width, c.dst_height), 0);
+	uint8_t* staging = bench_alloc(GetOutputFrameSize(OUTPUT_I420, c.dst_width, c.dst_height), 0);
+	uint8_t* src_u = i420 + (size_t)sw * sh;
+	uint8_t* src_v = src_u + (size_t)half_w * half_h;
+
+	ConversionPlan plan = {};
+	BuildConversionPlan(&plan, DXGI_FORMAT_R10G10B10A2_UNORM, false, sw, sh, sw * 4,
+		OUTPUT_P010, COLOR_BT709_LIMITED, c.dst_width, c.dst_height);
+	double p010_ms = bench_best_ms(runs, 10, [&] {
+		plan.ConvertRows(abgr10, dst, 0, sh);
+		plan.ScaleToSample(dst);
+	});
+	double i420_ms = bench_best_ms(runs, 10, [&] {
+		ABGR10ToI420<COLOR_BT709_LIMITED>(abgr10, sw * 4, i420, sw, src_u, half_w, src_v, half_w, sw, sh);
+		I420ScaleToOutput(i420, sw, src_u, half_w, src_v, half_w, sw, sh, &layout, dst, staging);
+	});
+	printf("%-18s P010: convert + P010 scale %5.2f ms, 8 bit convert + I420 scale %5.2f ms\n",
+		c.name, p010_ms, i420_ms);
+
+	FreeConversionPlan(&plan);
+	free(staging);
+	free(dst);
+	free(i420);
+	free(abgr10);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	for (const Case& c : CASES) {
+		bench_case(c, OUTPUT_I420, "I420", runs);
+		bench_case(c, OUTPUT_NV12, "NV12", runs);
+	}
+	for (const Case& c : CASES) {
+		bench_p010(c, runs);
+	}
+	return 0;
+}
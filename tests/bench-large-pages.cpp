@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "ipc-util/shmem.h"
+#include "ColorConvert.h"
+#include "ConversionPlan.h"
+#include "dxgi-format.h"
+#include "platform.h"
+#include "shmem-copy.h"
+#include "bench.h"
+
+// Large pages under the frame path at 1440p and 4K, each step timed on
+// normal and on large pages: the hook's copy into the shared memory, the
+// service converting to I420 straight out of it, and a scaled conversion
+// through the plan's scale buffers. Large pages come from the hugetlb pool
+// (vm.nr_hugepages, hugetlbfs on /dev/hugepages for the shared memory);
+// without them both columns are normal pages, as each line says.
+//
+//   bench-large-pages [runs]
+
+struct Size {
+	const char* name;
+	int width, height;
+};
+
+static const Size SIZES[] = {
+	{ "1440p", 2560, 1440 },
+	{ "4K", 3840, 2160 },
+};
+
+struct Frame {
+	ipc_shmem_t shmem;
+	uint8_t*    data;
+	bool        large;
+};
+
+static bool create_frame(Frame* frame, const Size& size, bool large) {
+	std::string name = "bebo-bench-large-" + std::to_string(getpid()) + (large ? "-large" : "");
+	size_t bytes = (size_t)size.width * 4 * size.height;
+
+	memset(frame, 0, sizeof(*frame));
+	if (!(large ? ipc_shmem_create_large(&frame->shmem, name.c_str(), bytes) :
+			ipc_shmem_create(&frame->shmem, name.c_str(), bytes))) {
+		return false;
+	}
+	frame->data = (uint8_t*)ipc_shmem_data(&frame->shmem);
+	frame->large = ipc_shmem_large(&frame->shmem);
+	memset(frame->data, 0, bytes);
+	return true;
+}
+
+static const char* pages(bool large) {
+	return large ? "large" : "normal";
+}
+
+static void bench_size(const Size& size, int runs) {
+	uint32_t row_bytes = (uint32_t)size.width * 4;
+	uint32_t rows = (uint32_t)size.height;
+	uint8_t* game = bench_alloc((size_t)row_bytes * rows, 1);
+
+	Frame frames[2];
+	if (!create_frame(&frames[0], size, false) || !create_frame(&frames[1], size, true)) {
+		perror("ipc_shmem_create");
+		exit(1);
+	}
+
+	double copy_ms[2], convert_ms[2], scale_ms[2];
+	bool scale_large[2];
+	OutputLayout layout;
+	GetOutputLayout(&layout, OUTPUT_I420, COLOR_BT709_LIMITED, size.width, size.height);
+	uint8_t* sample = bench_alloc(GetOutputFrameSize(OUTPUT_I420, size.width, size.height), 0);
+	uint8_t* scaled = bench_alloc(GetOutputFrameSize(OUTPUT_I420, 1920, 1080), 0);
+
+	for (int i = 0; i < 2; i++) {
+		uint8_t* data = frames[i].data;
+
+		copy_ms[i] = bench_best_ms(runs, 10, [&] {
+			shmem_copy_rows(data, row_bytes, game, row_bytes, row_bytes, rows);
+		});
+		convert_ms[i] = bench_best_ms(runs, 10, [&] {
+			ARGBToOutputRows(&layout, data, (int)row_bytes, sample, 0, size.height);
+		});
+
+		ConversionPlan plan = {};
+		plan.large_pages = i == 1;
+		BuildConversionPlan(&plan, DXGI_FORMAT_B8G8R8A8_UNORM, false, size.width, size.height,
+			(int)row_bytes, OUTPUT_I420, COLOR_BT709_LIMITED, 1920, 1080);
+		scale_large[i] = plan.large_buffers;
+		scale_ms[i] = bench_best_ms(runs, 10, [&] {
+			plan.ConvertRows(data, scaled, 0, size.height);
+			plan.ScaleToSample(scaled);
+		});
+		FreeConversionPlan(&plan);
+	}
+
+	printf("%-5s copy into shmem:     %5.2f ms on %s pages, %5.2f ms on %s pages (%.2fx)\n", size.name,
+		copy_ms[0], pages(frames[0].large), copy_ms[1], pages(frames[1].large), copy_ms[0] / copy_ms[1]);
+	printf("%-5s I420 out of shmem:   %5.2f ms on %s pages, %5.2f ms on %s pages (%.2fx)\n", size.name,
+		convert_ms[0], pages(frames[0].large), convert_ms[1], pages(frames[1].large),
+		convert_ms[0] / convert_ms[1]);
+	printf("%-5s I420 scaled to 1080p: %5.2f ms, scale buffers on %s pages, %5.2f ms on %s pages (%.2fx)\n",
+		size.name, scale_ms[0], pages(scale_large[0]), scale_ms[1], pages(scale_large[1]),
+		scale_ms[0] / scale_ms[1]);
+
+	free(scaled);
+	free(sample);
+	ipc_shmem_free(&frames[1].shmem);
+	ipc_shmem_free(&frames[0].shmem);
+	free(game);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	for (const Size& size : SIZES) {
+		bench_size(size, runs);
+	}
+	return 0;
+}
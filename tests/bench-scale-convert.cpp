@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ColorConvert.h"
+#include "libyuv/convert_from_argb.h"
+#include "libyuv/scale_argb.h"
+#include "bench.h"
+
+// Desktop and GDI scaling: the two pass path the captures used to take
+// (ARGBScale into a full size ARGB frame, ARGBToI420 reading it back)
+// against ARGBScaleToOutputRows, which scales SCALE_BAND_ROWS rows at a
+// time and converts them while they are still in cache. One thread, I420
+// out; the largest difference between the two outputs is printed along,
+// the bands are scaled by the same box filter so it should be 0.
+//
+//   bench-scale-convert [runs]
+
+struct Case {
+	const char* name;
+	int src_width, src_height;
+	int dst_width, dst_height;
+};
+
+static const Case CASES[] = {
+	{ "1440p to 1080p", 2560, 1440, 1920, 1080 },
+	{ "4K to 1080p", 3840, 2160, 1920, 1080 },
+	{ "4K to 1440p", 3840, 2160, 2560, 1440 },
+	{ "1080p to 720p", 1920, 1080, 1280, 720 },
+};
+
+static void bench_case(const Case& c, int runs) {
+	OutputLayout layout;
+	GetOutputLayout(&layout, OUTPUT_I420, COLOR_BT601_LIMITED, c.dst_width, c.dst_height);
+	int frame_size = GetOutputFrameSize(OUTPUT_I420, c.dst_width, c.dst_height);
+	int src_stride = c.src_width * 4;
+
+	uint8_t* src = bench_alloc((size_t)src_stride * c.src_height, 1);
+	uint8_t* argb = bench_alloc((size_t)c.dst_width * 4 * c.dst_height, 0);
+	uint8_t* two_pass = bench_alloc(frame_size, 0);
+	uint8_t* one_pass = bench_alloc(frame_size, 0);
+	uint8_t* band = bench_alloc(ScaleBandSize(c.dst_width), 0);
+
+	double two_pass_ms = bench_best_ms(runs, 5, [&] {
+		libyuv::ARGBScale(src, src_stride, c.src_width, c.src_height,
+			argb, c.dst_width * 4, c.dst_width, c.dst_height, libyuv::kFilterBox);
+		libyuv::ARGBToI420(argb, c.dst_width * 4,
+			two_pass, layout.stride_y,
+			two_pass + layout.offset_u, layout.stride_uv,
+			two_pass + layout.offset_v, layout.stride_uv,
+			c.dst_width, c.dst_height);
+	});
+	double one_pass_ms = bench_best_ms(runs, 5, [&] {
+		ARGBScaleToOutputRows(src, src_stride, c.src_width, c.src_height,
+			&layout, one_pass, 0, c.dst_height, band);
+	});
+
+	int max_diff = 0;
+	for (int i = 0; i < frame_size; i++) {
+		int diff = abs(two_pass[i] - one_pass[i]);
+		if (diff > max_diff) {
+			max_diff = diff;
+		}
+	}
+	printf("%-15s: two pass %6.2f ms, single pass %6.2f ms, %.2fx, max difference %d\n",
+		c.name, two_pass_ms, one_pass_ms, two_pass_ms / one_pass_ms, max_diff);
+
+	free(band);
+	free(one_pass);
+	free(two_pass);
+	free(argb);
+	free(src);
+}
+
+int main(int argc, char** argv) {
+	int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+	for (const Case& c : CASES) {
+		bench_case(c, runs);
+	}
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "shmem-ring.h"
+#include "bench.h"
+
+// Frame ring: what the ring's bookkeeping costs per frame, and how a
+// consumer copying 1080p / 4K frames out of it fares against a producer
+// writing as fast as it can, per slot count.
+//
+//   bench-shmem-ring [seconds per case]
+
+static const uint32_t FIRST_OFFSET = (sizeof(struct shmem_ring) + 63) & ~63u;
+
+static void bench_ops() {
+	std::vector<uint64_t> memory((FIRST_OFFSET + 3 * 64) / 8 + 1);
+	struct shmem_ring* ring = (struct shmem_ring*)memory.data();
+	shmem_ring_init(ring, 3, FIRST_OFFSET, 64);
+
+	const int n = 1000000;
+	double write_ms = bench_best_ms(5, n, [&] {
+		uint32_t slot = shmem_ring_write_begin(ring);
+		shmem_ring_write_end(ring, slot, 0);
+	});
+	uint32_t failed = 0;
+	double read_ms = bench_best_ms(5, n, [&] {
+		struct shmem_ring_read read;
+		if (shmem_ring_read_begin(ring, &read)) {
+			shmem_ring_read_end(ring, &read);
+		} else {
+			failed++;
+		}
+	});
+	printf("ring ops: write %.1f ns, read %.1f ns, %u reads found no frame\n", write_ms * 1e6, read_ms * 1e6,
+		failed);
+}
+
+static void bench_frames(const char* name, uint32_t frame_size, uint32_t slots, double seconds) {
+	uint32_t slot_size = (frame_size + 4095) & ~4095u;
+	uint8_t* memory = bench_alloc(FIRST_OFFSET + (size_t)slots * slot_size, 0);
+	struct shmem_ring* ring = (struct shmem_ring*)memory;
+	shmem_ring_init(ring, slots, FIRST_OFFSET, slot_size);
+
+	uint8_t* source = bench_alloc(frame_size, 1);
+	uint8_t* sample = bench_alloc(frame_size, 2);
+	std::atomic<bool> stop(false);
+
+	std::thread producer([&] {
+		while (!stop) {
+			uint32_t slot = shmem_ring_write_begin(ring);
+			memcpy(shmem_ring_slot_data(ring, slot), source, frame_size);
+			shmem_ring_write_end(ring, slot, bench_now_ns());
+		}
+	});
+
+	uint64_t start = bench_now_ns();
+	uint64_t end = start + (uint64_t)(seconds * 1e9);
+	uint32_t reads = 0, torn = 0, seen = 0;
+	uint64_t age_ns = 0;
+	while (bench_now_ns() < end) {
+		struct shmem_ring_read read;
+		if (ring->frame_count == seen || !shmem_ring_read_begin(ring, &read)) {
+			std::this_thread::yield();
+			continue;
+		}
+		memcpy(sample, shmem_ring_slot_data(ring, read.slot), frame_size);
+		if (!shmem_ring_read_end(ring, &read)) {
+			torn++;
+			continue;
+		}
+		reads++;
+		seen = read.frame;
+		age_ns += bench_now_ns() - read.capture_time;
+	}
+	stop = true;
+	producer.join();
+
+	double elapsed = (bench_now_ns() - start) / 1e9;
+	printf("%s, %u slots: produced %.0f fps, read %.0f fps, %.1f%% torn, frame age %.2f ms, skipped %u, overwritten %u\n",
+		name, slots, ring->frame_count / elapsed, reads / elapsed,
+		reads + torn ? 100.0 * torn / (reads + torn) : 0.0,
+		reads ? age_ns / 1e6 / reads : 0.0, ring->skipped, ring->overwritten);
+
+	free(sample);
+	free(source);
+	free(memory);
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+	bench_ops();
+	for (uint32_t slots = 2; slots <= 4; slots++) {
+		bench_frames("1080p", 1920 * 1080 * 4, slots, seconds);
+	}
+	for (uint32_t slots = 2; slots <= 4; slots++) {
+		bench_frames("4K", 3840 * 2160 * 4, slots, seconds);
+	}
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ipc-util/shmem.h"
+#include "ColorConvert.h"
+#include "shmem-transport.h"
+#include "bench.h"
+
+// The shared memory transport across two processes: shmem-producer plays
+// the game and the hook's copy thread, this plays the capture service,
+// waking on the ring's counter and taking the newest frame, either copied
+// out whole or converted to an I420 sample straight from the slot like
+// copy_shmem_tex. Frames a second on both sides, torn reads, and the
+// latency from a frame's publication to the consumer being done with it.
+//
+//   bench-shmem-transport [seconds per case]
+
+extern char** environ;
+
+struct Case {
+	const char* name;
+	int width, height;
+	uint32_t slots;
+	int fps;            // 0: the producer goes as fast as it can
+	bool convert;
+};
+
+static const Case CASES[] = {
+	{ "1080p", 1920, 1080, 3, 60, false },
+	{ "1080p", 1920, 1080, 3, 60, true },
+	{ "1080p", 1920, 1080, 3, 0, false },
+	{ "1080p", 1920, 1080, 2, 0, true },
+	{ "1080p", 1920, 1080, 3, 0, true },
+	{ "4K", 3840, 2160, 3, 60, false },
+	{ "4K", 3840, 2160, 3, 60, true },
+	{ "4K", 3840, 2160, 3, 0, false },
+	{ "4K", 3840, 2160, 2, 0, true },
+	{ "4K", 3840, 2160, 3, 0, true },
+};
+
+static pid_t spawn_producer(const std::string& name, const Case& c) {
+	std::string width = std::to_string(c.width), height = std::to_string(c.height);
+	std::string slots = std::to_string(c.slots), fps = std::to_string(c.fps);
+	char* args[] = { (char*)SHMEM_PRODUCER, (char*)name.c_str(), (char*)width.c_str(), (char*)height.c_str(),
+		(char*)slots.c_str(), (char*)fps.c_str(), NULL };
+	pid_t pid;
+
+	if (posix_spawn(&pid, SHMEM_PRODUCER, NULL, NULL, args, environ) != 0) {
+		return -1;
+	}
+	return pid;
+}
+
+// the producer creates and sizes the memory, then publishes its first frame
+static bool open_transport(ipc_shmem_t* shmem, const std::string& name, size_t size) {
+	uint64_t give_up = bench_now_ns() + 5000000000ull;
+	while (!ipc_shmem_open(shmem, name.c_str(), size)) {
+		if (bench_now_ns() > give_up) {
+			return false;
+		}
+		usleep(1000);
+	}
+
+	struct shmem_ring* ring = &((struct transport_header*)ipc_shmem_data(shmem))->ring;
+	return ipc_shmem_wait(shmem, &ring->frame_count, 0, 5000) && shmem_ring_valid(ring, (uint32_t)size);
+}
+
+static void bench_case(const Case& c, double seconds) {
+	std::string name = "bebo-bench-transport-" + std::to_string(getpid());
+	size_t size = transport_size(c.width, c.height, c.slots);
+	pid_t producer = spawn_producer(name, c);
+	if (producer < 0) {
+		perror("posix_spawn " SHMEM_PRODUCER);
+		exit(1);
+	}
+
+	ipc_shmem_t shmem = {};
+	if (!open_transport(&shmem, name, size)) {
+		fprintf(stderr, "%s: the producer did not come up\n", c.name);
+		kill(producer, SIGKILL);
+		waitpid(producer, NULL, 0);
+		exit(1);
+	}
+	struct transport_header* header = (struct transport_header*)ipc_shmem_data(&shmem);
+	struct shmem_ring* ring = &header->ring;
+
+	OutputLayout layout;
+	GetOutputLayout(&layout, OUTPUT_I420, COLOR_BT601_LIMITED, c.width, c.height);
+	size_t frame_bytes = (size_t)c.width * 4 * c.height;
+	uint8_t* sample = bench_alloc(frame_bytes, 0);
+
+	std::vector<double> latency_ms;
+	uint32_t reads = 0, torn = 0, seen = 0;
+	uint32_t first_frame = ring->frame_count;
+	uint64_t start = bench_now_ns();
+	uint64_t end = start + (uint64_t)(seconds * 1e9);
+
+	while (bench_now_ns() < end) {
+		struct shmem_ring_read read;
+		ipc_shmem_wait(&shmem, &ring->frame_count, seen, 100);
+		if (!shmem_ring_read_begin(ring, &read)) {
+			continue;
+		}
+		if (read.frame == seen) {
+			// woken by the timeout, nothing new
+			shmem_ring_read_end(ring, &read);
+			continue;
+		}
+
+		const uint8_t* data = shmem_ring_slot_data(ring, read.slot);
+		if (c.convert) {
+			ARGBToOutputRows(&layout, data, c.width * 4, sample, 0, c.height);
+		} else {
+			memcpy(sample, data, frame_bytes);
+		}
+		if (!shmem_ring_read_end(ring, &read)) {
+			torn++;
+			continue;
+		}
+
+		reads++;
+		seen = read.frame;
+		latency_ms.push_back((bench_now_ns() - read.capture_time) / 1e6);
+	}
+
+	double elapsed = (bench_now_ns() - start) / 1e9;
+	uint32_t produced = ring->frame_count - first_frame;
+	header->stop = 1;
+	waitpid(producer, NULL, 0);
+
+	std::sort(latency_ms.begin(), latency_ms.end());
+	double mean = 0;
+	for (double ms : latency_ms) {
+		mean += ms;
+	}
+	mean = latency_ms.empty() ? 0 : mean / latency_ms.size();
+	double p99 = latency_ms.empty() ? 0 : latency_ms[latency_ms.size() * 99 / 100];
+
+	char producer_rate[16];
+	snprintf(producer_rate, sizeof(producer_rate), c.fps ? "%d fps" : "unpaced", c.fps);
+	printf("%-5s %-7s %u slots, %-4s: produced %5.0f fps, consumed %5.0f fps, %4.1f%% torn, "
+		"latency %5.2f ms (p99 %5.2f), skipped %u, overwritten %u\n",
+		c.name, producer_rate, c.slots, c.convert ? "I420" : "copy",
+		produced / elapsed, reads / elapsed, reads + torn ? 100.0 * torn / (reads + torn) : 0.0,
+		mean, p99, ring->skipped, ring->overwritten);
+
+	free(sample);
+	ipc_shmem_free(&shmem);
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+
+	for (const Case& c : CASES) {
+		bench_case(c, seconds);
+	}
+	return 0;
+}
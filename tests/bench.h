@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Benchmarks print one line per case: the best time of a few runs, which
+// is the least disturbed by the rest of the machine.
+static inline uint64_t bench_now_ns() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best milliseconds per call of fn over runs runs of iterations calls.
+template <typename Fn>
+static double bench_best_ms(int runs, int iterations, Fn fn) {
+	double best = 0;
+	for (int run = 0; run < runs; run++) {
+		uint64_t start = bench_now_ns();
+		for (int i = 0; i < iterations; i++) {
+			fn();
+		}
+		double ms = (bench_now_ns() - start) / 1e6 / iterations;
+		if (run == 0 || ms < best) {
+			best = ms;
+		}
+	}
+	return best;
+}
+
+// Pages of a buffer are touched once up front, so the first run does not
+// pay for faulting them in.
+static inline uint8_t* bench_alloc(size_t size, uint8_t seed) {
+	uint8_t* p = (uint8_t*)aligned_alloc(64, (size + 63) & ~(size_t)63);
+	for (size_t i = 0; i < size; i++) {
+		p[i] = (uint8_t)(i * 131 + seed);
+	}
+	return p;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ColorConvert.h"
+#include "libyuv/cpu_id.h"
+
+// Scalar reference of the converters in ColorConvert.cpp, written out per
+// pixel from the BT.601 / BT.709 fixed point formulas, for the tests to
+// hold the SIMD rows to and the benchmarks to time them against.
+//
+// The rows are picked once when the program loads, so which ones run is
+// chosen before that through the environment:
+//
+//   BEBO_CPU=c      the C rows
+//   BEBO_CPU=sse2   the SSE2 rows
+//   (unset)         the best the cpu has
+
+struct CpuSelect {
+	CpuSelect() {
+		const char* cpu = getenv("BEBO_CPU");
+		if (cpu && !strcmp(cpu, "c")) {
+			libyuv::MaskCpuFlags(libyuv::kCpuInitialized);
+		} else if (cpu && !strcmp(cpu, "sse2")) {
+			libyuv::MaskCpuFlags(~(libyuv::kCpuHasAVX2 | libyuv::kCpuHasAVX3));
+		}
+	}
+};
+
+// ahead of the converters' own static initialization
+static CpuSelect cpu_select __attribute__((init_priority(101)));
+
+static inline const char* cpu_rows_name() {
+	if (libyuv::TestCpuFlag(libyuv::kCpuHasAVX2)) {
+		return "avx2";
+	}
+	return libyuv::TestCpuFlag(libyuv::kCpuHasSSE2) ? "sse2" : "c";
+}
+
+struct RefCoefs {
+	int yr, yg, yb, y_offset;
+	int ur, ug, ub;
+	int vr, vg, vb;
+};
+
+static inline const RefCoefs& ref_coefs(ColorSpace cs) {
+	static const RefCoefs coefs[] = {
+		{ 66, 129, 25, 16, -38, -74, 112, 112, -94, -18 },    // BT.601 limited
+		{ 47, 157, 16, 16, -26, -86, 112, 112, -102, -10 },   // BT.709 limited
+		{ 77, 150, 29, 0, -43, -84, 127, 127, -107, -20 },    // BT.601 full
+		{ 54, 183, 19, 0, -29, -98, 127, 127, -115, -12 },    // BT.709 full
+	};
+	return coefs[cs];
+}
+
+// One source pixel as r, g, b at the converter's precision: 8 bits for
+// I420, 10 for P010.
+typedef void(*RefPixelFn)(const uint8_t* src, int* r, int* g, int* b);
+
+static inline uint32_t ref_load32(const uint8_t* src) {
+	return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+static inline void ref_argb(const uint8_t* src, int* r, int* g, int* b) {
+	*b = src[0];
+	*g = src[1];
+	*r = src[2];
+}
+
+static inline void ref_abgr(const uint8_t* src, int* r, int* g, int* b) {
+	*r = src[0];
+	*g = src[1];
+	*b = src[2];
+}
+
+// R10G10B10A2, the top 8 bits of each channel
+static inline void ref_abgr10(const uint8_t* src, int* r, int* g, int* b) {
+	uint32_t p = ref_load32(src);
+	*r = (p >> 2) & 0xFF;
+	*g = (p >> 12) & 0xFF;
+	*b = (p >> 22) & 0xFF;
+}
+
+// R10G10B10A2, all 10 bits
+static inline void ref_abgr10_wide(const uint8_t* src, int* r, int* g, int* b) {
+	uint32_t p = ref_load32(src);
+	*r = p & 0x3FF;
+	*g = (p >> 10) & 0x3FF;
+	*b = (p >> 20) & 0x3FF;
+}
+
+// 5 and 6 bit channels widened to 8 bits by repeating the top bits, as
+// libyuv's RGB565ToARGB and ARGB1555ToARGB do; alpha ignored
+static inline void ref_b5g6r5(const uint8_t* src, int* r, int* g, int* b) {
+	int p = src[0] | src[1] << 8;
+	*b = (p & 0x1F) << 3 | (p & 0x1F) >> 2;
+	*g = (p >> 5 & 0x3F) << 2 | (p >> 5 & 0x3F) >> 4;
+	*r = (p >> 11) << 3 | (p >> 11) >> 2;
+}
+
+static inline void ref_b5g5r5a1(const uint8_t* src, int* r, int* g, int* b) {
+	int p = src[0] | src[1] << 8;
+	*b = (p & 0x1F) << 3 | (p & 0x1F) >> 2;
+	*g = (p >> 5 & 0x1F) << 3 | (p >> 5 & 0x1F) >> 2;
+	*r = (p >> 10 & 0x1F) << 3 | (p >> 10 & 0x1F) >> 2;
+}
+
+// 8 bit ARGB widened to 10 bits by repeating the top bits
+static inline void ref_argb_wide(const uint8_t* src, int* r, int* g, int* b) {
+	ref_argb(src, r, g, b);
+	*r = *r << 2 | *r >> 6;
+	*g = *g << 2 | *g >> 6;
+	*b = *b << 2 | *b >> 6;
+}
+
+// I420 or P010 (bits 8 or 10) of a width x height source. A chroma sample
+// averages its 2x2 block, the last row or column of an odd size standing in
+// for its missing neighbour. P010 samples are MSB aligned little endian 16
+// bit, U and V interleaved in the dst_u plane.
+static inline void ref_convert(RefPixelFn pixel, int bpp, int bits, ColorSpace cs,
+	const uint8_t* src, int src_stride, uint8_t* dst_y, int stride_y,
+	uint8_t* dst_u, uint8_t* dst_v, int stride_uv, int width, int height) {
+	const RefCoefs& c = ref_coefs(cs);
+	int y_add = (c.y_offset << bits) + 0x80;
+	int uv_add = (0x80 << bits) + 0x80;
+	int r, g, b;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			pixel(src + y * src_stride + x * bpp, &r, &g, &b);
+			int value = (c.yr * r + c.yg * g + c.yb * b + y_add) >> 8;
+			if (bits == 8) {
+				dst_y[y * stride_y + x] = (uint8_t)value;
+			} else {
+				uint8_t* out = dst_y + y * stride_y + 2 * x;
+				out[0] = (uint8_t)(value << 6);
+				out[1] = (uint8_t)(value << 6 >> 8);
+			}
+		}
+	}
+
+	for (int y = 0; y < height; y += 2) {
+		for (int x = 0; x < width; x += 2) {
+			int sr = 0, sg = 0, sb = 0;
+			for (int i = 0; i < 4; i++) {
+				int px = x + (i & 1) < width ? x + (i & 1) : x;
+				int py = y + (i >> 1) < height ? y + (i >> 1) : y;
+				pixel(src + py * src_stride + px * bpp, &r, &g, &b);
+				sr += r;
+				sg += g;
+				sb += b;
+			}
+			sr >>= 2;
+			sg >>= 2;
+			sb >>= 2;
+			int u = (c.ur * sr + c.ug * sg + c.ub * sb + uv_add) >> 8;
+			int v = (c.vr * sr + c.vg * sg + c.vb * sb + uv_add) >> 8;
+			if (bits == 8) {
+				dst_u[y / 2 * stride_uv + x / 2] = (uint8_t)u;
+				dst_v[y / 2 * stride_uv + x / 2] = (uint8_t)v;
+			} else {
+				uint8_t* out = dst_u + y / 2 * stride_uv + 2 * x;
+				out[0] = (uint8_t)(u << 6);
+				out[1] = (uint8_t)(u << 6 >> 8);
+				out[2] = (uint8_t)(v << 6);
+				out[3] = (uint8_t)(v << 6 >> 8);
+			}
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ipc-util/shmem.h"
+#include "shmem-copy.h"
+#include "shmem-transport.h"
+#include "bench.h"
+
+// Synthetic game for bench-shmem-transport: does what the hook's copy
+// thread does with each frame the game presents (copy it into a free slot
+// of the ring, publish it, wake the consumer), at fps frames a second or
+// as fast as it can when fps is 0, until the consumer says stop.
+//
+//   shmem-producer <name> <width> <height> <slots> <fps> [large]
+
+static void sleep_until(uint64_t ns) {
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ns / 1000000000);
+	ts.tv_nsec = (long)(ns % 1000000000);
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 6) {
+		fprintf(stderr, "usage: %s <name> <width> <height> <slots> <fps> [large]\n", argv[0]);
+		return 2;
+	}
+
+	const char* name = argv[1];
+	int width = atoi(argv[2]);
+	int height = atoi(argv[3]);
+	uint32_t slots = shmem_ring_clamp_slots((uint32_t)atoi(argv[4]));
+	int fps = atoi(argv[5]);
+	bool large = argc > 6 && !strcmp(argv[6], "large");
+	size_t size = transport_size(width, height, slots);
+	uint32_t row_bytes = (uint32_t)width * 4;
+
+	ipc_shmem_t shmem = {};
+	if (!(large ? ipc_shmem_create_large(&shmem, name, size) : ipc_shmem_create(&shmem, name, size))) {
+		perror("shmem-producer: ipc_shmem_create");
+		return 1;
+	}
+
+	struct transport_header* header = (struct transport_header*)ipc_shmem_data(&shmem);
+	struct shmem_ring* ring = &header->ring;
+	shmem_ring_init(ring, slots, TRANSPORT_FIRST_OFFSET, transport_slot_size(width, height));
+
+	// two frames in turn, as a game in motion
+	uint8_t* frames[2] = {
+		bench_alloc((size_t)row_bytes * height, 1),
+		bench_alloc((size_t)row_bytes * height, 2),
+	};
+	uint64_t frame_ns = fps > 0 ? 1000000000ull / fps : 0;
+	uint64_t deadline = bench_now_ns();
+
+	for (uint32_t i = 0; !header->stop; i++) {
+		if (frame_ns) {
+			deadline += frame_ns;
+			sleep_until(deadline);
+		}
+
+		uint32_t slot = shmem_ring_write_begin(ring);
+		shmem_copy_rows(shmem_ring_slot_data(ring, slot), row_bytes, frames[i & 1], row_bytes,
+			row_bytes, (uint32_t)height);
+		shmem_ring_write_end(ring, slot, bench_now_ns());
+		ipc_shmem_signal(&shmem, &ring->frame_count);
+	}
+
+	free(frames[1]);
+	free(frames[0]);
+	ipc_shmem_free(&shmem);
+	return 0;
+}
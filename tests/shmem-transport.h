@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "shmem-ring.h"
+
+// Shared memory between shmem-producer and bench-shmem-transport, laid out
+// like the hook's: the frame ring first, the slots after it, each a whole
+// frame of 32 bit pixels rounded up to pages. stop is the consumer telling
+// the producer to finish.
+struct transport_header {
+	struct shmem_ring ring;
+	volatile uint32_t stop;
+};
+
+static const uint32_t TRANSPORT_FIRST_OFFSET = (sizeof(struct transport_header) + 63) & ~63u;
+
+static inline uint32_t transport_slot_size(int width, int height) {
+	return ((uint32_t)width * 4 * height + 4095) & ~4095u;
+}
+
+static inline size_t transport_size(int width, int height, uint32_t slots) {
+	return TRANSPORT_FIRST_OFFSET + (size_t)slots * transport_slot_size(width, height);
+}
@@ -0,0 +1,228 @@
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "ColorConvert.h"
+#include "convert-reference.h"
+#include "libyuv/convert_argb.h"
+#include "test.h"
+
+// Converters: every row the cpu picks, 32 and 16 bit sources, must match
+// the per pixel reference bit for bit, for every width around the SIMD
+// steps (so each tail length is hit), odd heights, bottom up sources, and
+// without writing past the width of a row. ctest runs this once per row set, see BEBO_CPU.
+
+static const uint8_t CANARY = 0xA5;
+
+struct Frame {
+	std::vector<uint8_t> data;
+	int stride;
+
+	Frame(int bytes_per_row, int rows, uint32_t seed) : stride(bytes_per_row + 16) {
+		data.resize((size_t)stride * (rows > 0 ? rows : 1));
+		for (size_t i = 0; i < data.size(); i++) {
+			seed = seed * 1664525u + 1013904223u;
+			data[i] = (uint8_t)(seed >> 24);
+		}
+	}
+};
+
+// Output planes with a canary around each row, laid out like the sample.
+struct Planes {
+	int stride_y, stride_uv;
+	std::vector<uint8_t> y, u, v;
+
+	Planes(int y_row_bytes, int uv_row_bytes, int height) :
+		stride_y(y_row_bytes + 32), stride_uv(uv_row_bytes + 32),
+		y((size_t)stride_y * height, CANARY),
+		u((size_t)stride_uv * ((height + 1) / 2), CANARY),
+		v((size_t)stride_uv * ((height + 1) / 2), CANARY) {
+	}
+};
+
+static const char* color_space_name(ColorSpace cs) {
+	static const char* names[] = { "601 limited", "709 limited", "601 full", "709 full" };
+	return names[cs];
+}
+
+static void check_planes(const char* what, ColorSpace cs, int width, int height,
+	const Planes& got, const Planes& want) {
+	if (got.y != want.y || got.u != want.u || got.v != want.v) {
+		fprintf(stderr, "%s (%s) %dx%d: differs from the reference\n", what, color_space_name(cs), width, height);
+		test_failures++;
+	}
+}
+
+// A source upside down in memory, for the negative heights.
+static std::vector<uint8_t> flip(const Frame& frame, int height) {
+	std::vector<uint8_t> flipped(frame.data.size());
+	for (int y = 0; y < height; y++) {
+		memcpy(&flipped[(size_t)y * frame.stride], &frame.data[(size_t)(height - 1 - y) * frame.stride], frame.stride);
+	}
+	return flipped;
+}
+
+static void check_i420(const char* what, ARGBToI420Fn convert, RefPixelFn pixel, int bpp, ColorSpace cs,
+	int width, int height) {
+	Frame src(width * bpp, height, width * 131 + height);
+	int uv_width = (width + 1) / 2;
+
+	Planes want(width, uv_width, height);
+	ref_convert(pixel, bpp, 8, cs, src.data.data(), src.stride, want.y.data(), want.stride_y,
+		want.u.data(), want.v.data(), want.stride_uv, width, height);
+
+	Planes got(width, uv_width, height);
+	CHECK_EQ(convert(src.data.data(), src.stride, got.y.data(), got.stride_y, got.u.data(), got.stride_uv,
+		got.v.data(), got.stride_uv, width, height), 0);
+	check_planes(what, cs, width, height, got, want);
+
+	std::vector<uint8_t> flipped = flip(src, height);
+	Planes bottom_up(width, uv_width, height);
+	CHECK_EQ(convert(flipped.data(), src.stride, bottom_up.y.data(), bottom_up.stride_y, bottom_up.u.data(),
+		bottom_up.stride_uv, bottom_up.v.data(), bottom_up.stride_uv, width, -height), 0);
+	check_planes(what, cs, width, -height, bottom_up, want);
+}
+
+static void check_p010(const char* what, ToP010Fn convert, RefPixelFn pixel, ColorSpace cs,
+	int width, int height) {
+	Frame src(width * 4, height, width * 7 + height * 13);
+	int uv_bytes = (width + 1) / 2 * 4;
+
+	Planes want(width * 2, uv_bytes, height);
+	ref_convert(pixel, 4, 10, cs, src.data.data(), src.stride, want.y.data(), want.stride_y,
+		want.u.data(), NULL, want.stride_uv, width, height);
+
+	Planes got(width * 2, uv_bytes, height);
+	CHECK_EQ(convert(src.data.data(), src.stride, got.y.data(), got.stride_y, got.u.data(), got.stride_uv,
+		width, height), 0);
+	check_planes(what, cs, width, height, got, want);
+}
+
+// widths around every SIMD step and its tail, heights even and odd
+static const int MAX_WIDTH = 70;
+static const int HEIGHTS[] = { 1, 2, 3, 6, 7 };
+
+template <ColorSpace CS>
+static void test_color_space() {
+	for (int height : HEIGHTS) {
+		for (int width = 1; width <= MAX_WIDTH; width++) {
+			check_i420("R10G10B10A2 to I420", ABGR10ToI420<CS>, ref_abgr10, 4, CS, width, height);
+			check_p010("R10G10B10A2 to P010", ABGR10ToP010<CS>, ref_abgr10_wide, CS, width, height);
+			check_p010("ARGB to P010", ARGBToP010<CS>, ref_argb_wide, CS, width, height);
+			check_i420("B5G6R5 to I420", B5G6R5ToI420<CS>, ref_b5g6r5, 2, CS, width, height);
+			check_i420("B5G5R5A1 to I420", B5G5R5A1ToI420<CS>, ref_b5g5r5a1, 2, CS, width, height);
+			// BT.601 limited ARGB / ABGR are libyuv's own rows, which
+			// round their averages differently
+			if (CS != COLOR_BT601_LIMITED) {
+				check_i420("ARGB to I420", ARGBToI420Matrix<CS>, ref_argb, 4, CS, width, height);
+				check_i420("ABGR to I420", ABGRToI420Matrix<CS>, ref_abgr, 4, CS, width, height);
+			}
+		}
+	}
+}
+
+// the extremes of every channel, where wrapping 16 bit math would show
+template <ColorSpace CS>
+static void test_extremes() {
+	static const uint32_t pixels[] = { 0x00000000, 0xFFFFFFFF, 0x3FFFFFFF, 0x000003FF, 0x000FFC00, 0x3FF00000,
+		0x00FF0000, 0x0000FF00, 0x000000FF, 0x00FFFFFF };
+	const int width = 32, height = 2;
+
+	for (uint32_t pixel : pixels) {
+		std::vector<uint32_t> src(width * height, pixel);
+		Planes want(width, width / 2, height), got(width, width / 2, height);
+		ref_convert(ref_abgr10, 4, 8, CS, (const uint8_t*)src.data(), width * 4, want.y.data(), want.stride_y,
+			want.u.data(), want.v.data(), want.stride_uv, width, height);
+		ABGR10ToI420<CS>((const uint8_t*)src.data(), width * 4, got.y.data(), got.stride_y, got.u.data(),
+			got.stride_uv, got.v.data(), got.stride_uv, width, height);
+		check_planes("R10G10B10A2 extremes", CS, width, height, got, want);
+
+		if (CS != COLOR_BT601_LIMITED) {
+			ref_convert(ref_argb, 4, 8, CS, (const uint8_t*)src.data(), width * 4, want.y.data(), want.stride_y,
+				want.u.data(), want.v.data(), want.stride_uv, width, height);
+			ARGBToI420Matrix<CS>((const uint8_t*)src.data(), width * 4, got.y.data(), got.stride_y, got.u.data(),
+				got.stride_uv, got.v.data(), got.stride_uv, width, height);
+			check_planes("ARGB extremes", CS, width, height, got, want);
+		}
+	}
+}
+
+// Every 16 bit pixel value once, in a 256 x 256 frame, against the
+// reference and against the two passes the one pass 16 bit converters
+// replace: libyuv's widening to ARGB, then our ARGB rows.
+template <ColorSpace CS>
+static void test_16bit_all_values(const char* what, ARGBToI420Fn convert, RefPixelFn pixel, ToARGBFn to_argb) {
+	const int width = 256, height = 256;
+	std::vector<uint16_t> src(width * height);
+	for (int i = 0; i < width * height; i++) {
+		src[i] = (uint16_t)i;
+	}
+
+	Planes want(width, width / 2, height), got(width, width / 2, height);
+	ref_convert(pixel, 2, 8, CS, (const uint8_t*)src.data(), width * 2, want.y.data(), want.stride_y,
+		want.u.data(), want.v.data(), want.stride_uv, width, height);
+	convert((const uint8_t*)src.data(), width * 2, got.y.data(), got.stride_y, got.u.data(), got.stride_uv,
+		got.v.data(), got.stride_uv, width, height);
+	check_planes(what, CS, width, height, got, want);
+
+	if (CS != COLOR_BT601_LIMITED) {
+		std::vector<uint8_t> argb(width * height * 4);
+		Planes two_pass(width, width / 2, height);
+		to_argb((const uint8_t*)src.data(), width * 2, argb.data(), width * 4, width, height);
+		ARGBToI420Matrix<CS>(argb.data(), width * 4, two_pass.y.data(), two_pass.stride_y, two_pass.u.data(),
+			two_pass.stride_uv, two_pass.v.data(), two_pass.stride_uv, width, height);
+		check_planes(what, CS, width, height, got, two_pass);
+	}
+}
+
+template <ColorSpace CS>
+static void test_16bit() {
+	test_16bit_all_values<CS>("B5G6R5 all values", B5G6R5ToI420<CS>, ref_b5g6r5, libyuv::RGB565ToARGB);
+	test_16bit_all_values<CS>("B5G5R5A1 all values", B5G5R5A1ToI420<CS>, ref_b5g5r5a1, libyuv::ARGB1555ToARGB);
+}
+
+static void test_abgr10_to_argb() {
+	for (int width = 1; width <= MAX_WIDTH; width++) {
+		Frame src(width * 4, 1, width);
+		std::vector<uint8_t> want(width * 4 + 16, CANARY), c(want), sse2(want), avx2(want), frame(want);
+
+		for (int x = 0; x < width; x++) {
+			int r, g, b;
+			ref_abgr10(&src.data[x * 4], &r, &g, &b);
+			want[x * 4] = (uint8_t)b;
+			want[x * 4 + 1] = (uint8_t)g;
+			want[x * 4 + 2] = (uint8_t)r;
+			want[x * 4 + 3] = 0xFF;
+		}
+		ABGR10ToARGBRow_C(src.data.data(), c.data(), width);
+		ABGR10ToARGBRow_SSE2(src.data.data(), sse2.data(), width);
+		CHECK(c == want);
+		CHECK(sse2 == want);
+		if (libyuv::TestCpuFlag(libyuv::kCpuHasAVX2)) {
+			ABGR10ToARGBRow_AVX2(src.data.data(), avx2.data(), width);
+			CHECK(avx2 == want);
+		}
+
+		// the row picked for the cpu, or BEBO_CPU
+		ABGR10ToARGB(src.data.data(), src.stride, frame.data(), width * 4, width, 1);
+		CHECK(frame == want);
+	}
+}
+
+int main() {
+	printf("rows: %s\n", cpu_rows_name());
+
+	test_color_space<COLOR_BT601_LIMITED>();
+	test_color_space<COLOR_BT709_LIMITED>();
+	test_color_space<COLOR_BT601_FULL>();
+	test_color_space<COLOR_BT709_FULL>();
+	test_extremes<COLOR_BT601_LIMITED>();
+	test_extremes<COLOR_BT709_LIMITED>();
+	test_extremes<COLOR_BT601_FULL>();
+	test_extremes<COLOR_BT709_FULL>();
+	test_16bit<COLOR_BT601_LIMITED>();
+	test_16bit<COLOR_BT709_LIMITED>();
+	test_16bit<COLOR_BT601_FULL>();
+	test_16bit<COLOR_BT709_FULL>();
+	test_abgr10_to_argb();
+	return TEST_RESULT();
+}
@@ -0,0 +1,227 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <vector>
+#include "ConversionPlan.h"
+#include "dxgi-format.h"
+#include "test.h"
+
+// Conversion plans that scale into P010 samples: 10 bit sources keep all
+// 10 bits through the scaler (a scaled frame matches the frame converted
+// at source size and averaged, to a step), samples stay P010 with the low
+// 6 bits clear, and the letterbox borders are video black. The hook's 8
+// bit planar frames still scale in I420 and come out shifted up.
+
+static uint32_t pack_abgr10(int r, int g, int b) {
+	return (uint32_t)r | (uint32_t)g << 10 | (uint32_t)b << 20 | 3u << 30;
+}
+
+static uint16_t sample16(const std::vector<uint8_t>& sample, size_t offset) {
+	uint16_t v;
+	memcpy(&v, &sample[offset], 2);
+	return v;
+}
+
+struct Source {
+	int width, height;
+	std::vector<uint32_t> pixels;
+
+	Source(int w, int h) : width(w), height(h), pixels((size_t)w * h) {}
+	const uint8_t* data() const { return (const uint8_t*)pixels.data(); }
+};
+
+// smooth 10 bit ramps, different per channel, so every level shows up
+static Source ramp_source(int width, int height) {
+	Source src(width, height);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int r = x * 1023 / (width - 1);
+			int g = (x + y * 3) * 1023 / (width + height * 3 - 4);
+			int b = 1023 - r;
+			src.pixels[(size_t)y * width + x] = pack_abgr10(r, g, b);
+		}
+	}
+	return src;
+}
+
+static std::vector<uint8_t> convert(const Source& src, ColorSpace cs, int sample_width, int sample_height,
+	bool* scaled) {
+	ConversionPlan plan = {};
+	std::vector<uint8_t> sample(GetOutputFrameSize(OUTPUT_P010, sample_width, sample_height), 0xEE);
+
+	CHECK(BuildConversionPlan(&plan, DXGI_FORMAT_R10G10B10A2_UNORM, false, src.width, src.height, src.width * 4,
+		OUTPUT_P010, cs, sample_width, sample_height));
+	*scaled = plan.scaled;
+	CHECK_EQ(plan.ConvertRows(src.data(), sample.data(), 0, src.height), 0);
+	CHECK_EQ(plan.ScaleToSample(sample.data()), 0);
+	FreeConversionPlan(&plan);
+	return sample;
+}
+
+static int low_bits_set(const std::vector<uint8_t>& sample) {
+	int count = 0;
+	for (size_t i = 0; i < sample.size(); i += 2) {
+		count += (sample16(sample, i) & 0x3F) != 0;
+	}
+	return count;
+}
+
+// at exactly half size every sample is the box of 4 at source size
+static void test_half_size(ColorSpace cs) {
+	const int width = 640, height = 360;
+	Source src = ramp_source(width, height);
+	bool scaled;
+	std::vector<uint8_t> full = convert(src, cs, width, height, &scaled);
+	CHECK(!scaled);
+	std::vector<uint8_t> half = convert(src, cs, width / 2, height / 2, &scaled);
+	CHECK(scaled);
+	CHECK_EQ(low_bits_set(half), 0);
+
+	OutputLayout in, out;
+	GetOutputLayout(&in, OUTPUT_P010, cs, width, height);
+	GetOutputLayout(&out, OUTPUT_P010, cs, width / 2, height / 2);
+	int worst = 0;
+	long total = 0, count = 0;
+
+	for (int plane = 0; plane < 2; plane++) {
+		// Y, then U and V interleaved: samples of a pair are 2 apart
+		int rows = plane ? out.height / 2 : out.height;
+		int cols = out.width;   // half as many pairs, 2 samples each
+		int step = plane ? 2 : 1;
+		size_t in_base = plane ? in.offset_u : 0, out_base = plane ? out.offset_u : 0;
+		int in_stride = plane ? in.stride_uv : in.stride_y, out_stride = plane ? out.stride_uv : out.stride_y;
+
+		for (int y = 0; y < rows; y++) {
+			for (int x = 0; x < cols; x++) {
+				int sx = (x / step) * 2 * step + x % step;
+				size_t a = in_base + (size_t)(2 * y) * in_stride + sx * 2;
+				int sum = (sample16(full, a) >> 6) + (sample16(full, a + step * 2) >> 6) +
+					(sample16(full, a + in_stride) >> 6) + (sample16(full, a + in_stride + step * 2) >> 6);
+				int want = (sum + 2) / 4;
+				int got = sample16(half, out_base + (size_t)y * out_stride + x * 2) >> 6;
+				int diff = abs(got - want);
+				worst = diff > worst ? diff : worst;
+				total += diff;
+				count++;
+			}
+		}
+	}
+
+	// an 8 bit detour is off by up to 3 steps, and by 1.5 on average
+	CHECK(worst <= 1);
+	CHECK(total * 10 < count);
+}
+
+// a ramp over all 1024 levels keeps far more than 8 bits of them
+static void test_levels() {
+	Source src(2048, 16);
+	for (int y = 0; y < src.height; y++) {
+		for (int x = 0; x < src.width; x++) {
+			src.pixels[(size_t)y * src.width + x] = pack_abgr10(x / 2, x / 2, x / 2);
+		}
+	}
+
+	bool scaled;
+	std::vector<uint8_t> sample = convert(src, COLOR_BT709_FULL, 1024, 8, &scaled);
+	std::set<int> levels;
+	for (int x = 0; x < 1024; x++) {
+		levels.insert(sample16(sample, (size_t)x * 2) >> 6);
+	}
+	CHECK(levels.size() > 900);
+}
+
+// odd sizes, letterboxed, flat color: inside the rect the scaled sample is
+// the color's P010 value exactly, outside it video black
+static void test_letterbox(ColorSpace cs, int width, int height, int sample_width, int sample_height) {
+	Source src(width, height);
+	for (uint32_t& p : src.pixels) {
+		p = pack_abgr10(700, 300, 100);
+	}
+
+	bool scaled;
+	std::vector<uint8_t> flat = convert(src, cs, width, height, &scaled);
+	uint16_t flat_y = sample16(flat, 0);
+	OutputLayout flat_layout;
+	GetOutputLayout(&flat_layout, OUTPUT_P010, cs, width, height);
+	uint16_t flat_u = sample16(flat, flat_layout.offset_u), flat_v = sample16(flat, flat_layout.offset_u + 2);
+
+	std::vector<uint8_t> sample = convert(src, cs, sample_width, sample_height, &scaled);
+	CHECK(scaled);
+	CHECK_EQ(low_bits_set(sample), 0);
+
+	OutputLayout out;
+	GetOutputLayout(&out, OUTPUT_P010, cs, sample_width, sample_height);
+	int rx, ry, rw, rh;
+	GetLetterboxRect(width, height, sample_width, sample_height, &rx, &ry, &rw, &rh);
+	uint16_t black = IsFullRange(cs) ? 0 : 64 << 6;
+	int wrong_y = 0, wrong_uv = 0;
+
+	for (int y = 0; y < sample_height; y++) {
+		for (int x = 0; x < sample_width; x++) {
+			bool inside = x >= rx && x < rx + rw && y >= ry && y < ry + rh;
+			wrong_y += sample16(sample, (size_t)y * out.stride_y + x * 2) != (inside ? flat_y : black);
+		}
+	}
+	for (int y = 0; y < (sample_height + 1) / 2; y++) {
+		for (int x = 0; x < (sample_width + 1) / 2; x++) {
+			bool inside = x >= rx / 2 && x < (rx + rw) / 2 && y >= ry / 2 && y < (ry + rh) / 2;
+			size_t uv = out.offset_u + (size_t)y * out.stride_uv + x * 4;
+			wrong_uv += sample16(sample, uv) != (inside ? flat_u : 512 << 6);
+			wrong_uv += sample16(sample, uv + 2) != (inside ? flat_v : 512 << 6);
+		}
+	}
+	CHECK_EQ(wrong_y, 0);
+	CHECK_EQ(wrong_uv, 0);
+}
+
+// the hook's I420 frames scale in 8 bits and shift up
+static void test_planar_source() {
+	const int width = 333, height = 201, sample_width = 250, sample_height = 150;
+	OutputLayout in;
+	GetOutputLayout(&in, OUTPUT_I420, COLOR_BT601_LIMITED, width, height);
+	std::vector<uint8_t> frame(GetOutputFrameSize(OUTPUT_I420, width, height));
+	memset(frame.data(), 0x50, in.offset_u);
+	memset(frame.data() + in.offset_u, 0x70, in.offset_v - in.offset_u);
+	memset(frame.data() + in.offset_v, 0x90, frame.size() - in.offset_v);
+
+	ConversionPlan plan = {};
+	std::vector<uint8_t> sample(GetOutputFrameSize(OUTPUT_P010, sample_width, sample_height));
+	CHECK(BuildPlanarPlan(&plan, OUTPUT_I420, width, height, OUTPUT_P010, COLOR_BT601_LIMITED,
+		sample_width, sample_height));
+	CHECK(plan.scaled);
+	CHECK_EQ(plan.ConvertRows(frame.data(), sample.data(), 0, height), 0);
+	CHECK_EQ(plan.ScaleToSample(sample.data()), 0);
+	FreeConversionPlan(&plan);
+
+	OutputLayout out;
+	GetOutputLayout(&out, OUTPUT_P010, COLOR_BT601_LIMITED, sample_width, sample_height);
+	int rx, ry, rw, rh;
+	GetLetterboxRect(width, height, sample_width, sample_height, &rx, &ry, &rw, &rh);
+	int wrong = 0;
+	for (int y = ry; y < ry + rh; y++) {
+		for (int x = rx; x < rx + rw; x++) {
+			wrong += sample16(sample, (size_t)y * out.stride_y + x * 2) != 0x5000;
+		}
+	}
+	for (int y = ry / 2; y < (ry + rh) / 2; y++) {
+		for (int x = rx / 2; x < (rx + rw) / 2; x++) {
+			size_t uv = out.offset_u + (size_t)y * out.stride_uv + x * 4;
+			wrong += sample16(sample, uv) != 0x7000;
+			wrong += sample16(sample, uv + 2) != 0x9000;
+		}
+	}
+	CHECK_EQ(wrong, 0);
+}
+
+int main() {
+	test_half_size(COLOR_BT601_LIMITED);
+	test_half_size(COLOR_BT709_FULL);
+	test_levels();
+	test_letterbox(COLOR_BT709_LIMITED, 1440, 1080, 1280, 720);
+	test_letterbox(COLOR_BT601_FULL, 1366, 768, 1280, 720);
+	test_letterbox(COLOR_BT709_LIMITED, 1279, 721, 854, 481);
+	test_letterbox(COLOR_BT601_LIMITED, 640, 480, 1920, 1080);
+	test_planar_source();
+	return TEST_RESULT();
+}
@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "ConvertPool.h"
+#include "test.h"
+
+// Convert pool: every row of a frame goes to exactly one band, bands start
+// on even rows with even counts but for the last, band indexes stay below
+// the thread count, and all that holds across thread count changes
+// between frames.
+
+static void check_run(ConvertPool* pool, int height) {
+	std::vector<std::atomic<int> > hits(height);
+	std::atomic<int> bad_band(0), odd(0), calls(0);
+	int threads = pool->GetThreads();
+
+	for (int i = 0; i < height; i++) {
+		hits[i] = 0;
+	}
+	pool->Run(height, [&](int band, int first_row, int rows) {
+		calls++;
+		if (band < 0 || band >= threads) {
+			bad_band++;
+		}
+		if ((first_row & 1) || ((rows & 1) && first_row + rows != height)) {
+			odd++;
+		}
+		for (int y = first_row; y < first_row + rows; y++) {
+			hits[y]++;
+		}
+	});
+
+	int wrong = 0;
+	for (int i = 0; i < height; i++) {
+		wrong += hits[i] != 1;
+	}
+	CHECK_EQ(wrong, 0);
+	CHECK_EQ(bad_band, 0);
+	CHECK_EQ(odd, 0);
+	CHECK(calls >= 1 && calls <= threads);
+}
+
+static void test_bands() {
+	static const int heights[] = { 1, 2, 63, 64, 65, 127, 128, 129, 360, 719, 1080, 2160 };
+
+	for (int threads = 1; threads <= ConvertPool::MAX_THREADS; threads++) {
+		ConvertPool pool(threads);
+		CHECK_EQ(pool.GetThreads(), threads);
+		for (int height : heights) {
+			check_run(&pool, height);
+		}
+	}
+}
+
+// workers started by SetThreads must not take the last frame before the
+// change for a new one: give them the time to wake before the next frame
+static void test_set_threads() {
+	ConvertPool pool(1);
+	static const int counts[] = { 2, 4, 1, 8, 3, 2, 8, 1, 4 };
+
+	for (int round = 0; round < 20; round++) {
+		for (int threads : counts) {
+			pool.SetThreads(threads);
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			check_run(&pool, 1080);
+			check_run(&pool, 64);
+		}
+	}
+
+	pool.SetThreads(0);
+	CHECK_EQ(pool.GetThreads(), 1);
+	pool.SetThreads(100);
+	CHECK_EQ(pool.GetThreads(), ConvertPool::MAX_THREADS);
+}
+
+static void test_no_pool() {
+	int calls = 0;
+	RunBands(nullptr, 1080, [&](int band, int first_row, int rows) {
+		calls++;
+		CHECK_EQ(band, 0);
+		CHECK_EQ(first_row, 0);
+		CHECK_EQ(rows, 1080);
+	});
+	CHECK_EQ(calls, 1);
+}
+
+int main() {
+	test_bands();
+	test_set_threads();
+	test_no_pool();
+	return TEST_RESULT();
+}
@@ -0,0 +1,275 @@
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "ColorConvert.h"
+#include "DirtyRects.h"
+#include "test.h"
+
+// Dirty rects: the mapping of source rects to output rects, merging, and
+// the end to end property DesktopCapture relies on: converting only the
+// dirty rects of a new frame over the output of the last one gives the
+// same sample as converting the whole new frame.
+
+static bool rect_eq(const DirtyRect& a, int left, int top, int right, int bottom) {
+	return a.left == left && a.top == top && a.right == right && a.bottom == bottom;
+}
+
+static uint32_t next_random(uint32_t* seed) {
+	*seed = *seed * 1664525u + 1013904223u;
+	return *seed >> 8;
+}
+
+static void test_scale_same_size() {
+	DirtyRect src = { 10, 20, 30, 40 }, dst;
+
+	CHECK(ScaleDirtyRect(&src, 640, 360, 640, 360, &dst));
+	CHECK(rect_eq(dst, 10, 20, 30, 40));
+
+	// odd edges round out to whole chroma samples
+	src = { 11, 21, 31, 41 };
+	CHECK(ScaleDirtyRect(&src, 640, 360, 640, 360, &dst));
+	CHECK(rect_eq(dst, 10, 20, 32, 42));
+
+	// rounding out stops at an odd frame edge
+	src = { 99, 73, 101, 75 };
+	CHECK(ScaleDirtyRect(&src, 101, 75, 101, 75, &dst));
+	CHECK(rect_eq(dst, 98, 72, 101, 75));
+
+	// clipped to the frame, or gone when nothing is left
+	src = { -10, -10, 5, 5 };
+	CHECK(ScaleDirtyRect(&src, 640, 360, 640, 360, &dst));
+	CHECK(rect_eq(dst, 0, 0, 6, 6));
+	src = { 700, 10, 800, 20 };
+	CHECK(!ScaleDirtyRect(&src, 640, 360, 640, 360, &dst));
+	src = { 10, 10, 10, 20 };
+	CHECK(!ScaleDirtyRect(&src, 640, 360, 640, 360, &dst));
+	src = { 10, 20, 30, 10 };
+	CHECK(!ScaleDirtyRect(&src, 640, 360, 640, 360, &dst));
+}
+
+static void test_scale_margins() {
+	DirtyRect src = { 100, 100, 200, 200 }, dst;
+
+	// half size: 50..100, a pixel of margin each side, rounded out to even
+	CHECK(ScaleDirtyRect(&src, 3840, 2160, 1920, 1080, &dst));
+	CHECK(rect_eq(dst, 48, 48, 102, 102));
+
+	// upscaled: 11 source pixels to 16.5 output ones
+	src = { 10, 10, 11, 11 };
+	CHECK(ScaleDirtyRect(&src, 1280, 720, 1920, 1080, &dst));
+	CHECK(rect_eq(dst, 14, 14, 18, 18));
+
+	// the margin is clipped at the frame edges
+	src = { 0, 0, 3840, 2160 };
+	CHECK(ScaleDirtyRect(&src, 3840, 2160, 1920, 1080, &dst));
+	CHECK(rect_eq(dst, 0, 0, 1920, 1080));
+
+	// 4K * 4K coordinates do not overflow
+	src = { 16000, 16000, 16384, 16384 };
+	CHECK(ScaleDirtyRect(&src, 16384, 16384, 16384 / 3, 16384 / 3, &dst));
+	CHECK(dst.right == 16384 / 3 && dst.bottom == 16384 / 3);
+}
+
+// Every output pixel a source pixel of the rect lands on, or takes as
+// filter tap, is inside the output rect.
+static void test_scale_covers() {
+	static const int sizes[][4] = {
+		{ 1366, 768, 640, 360 }, { 1920, 1080, 1280, 720 }, { 1280, 720, 1920, 1080 },
+		{ 1000, 1000, 999, 333 }, { 101, 75, 640, 360 },
+	};
+	uint32_t seed = 1;
+
+	for (const int* s : sizes) {
+		for (int i = 0; i < 200; i++) {
+			DirtyRect src, dst;
+			src.left = next_random(&seed) % s[0];
+			src.top = next_random(&seed) % s[1];
+			src.right = src.left + 1 + next_random(&seed) % (s[0] - src.left);
+			src.bottom = src.top + 1 + next_random(&seed) % (s[1] - src.top);
+			if (!ScaleDirtyRect(&src, s[0], s[1], s[2], s[3], &dst)) {
+				CHECK(false);
+				continue;
+			}
+
+			int first_x = (int)((int64_t)src.left * s[2] / s[0]);
+			int first_y = (int)((int64_t)src.top * s[3] / s[1]);
+			int end_x = (int)(((int64_t)src.right * s[2] + s[0] - 1) / s[0]);
+			int end_y = (int)(((int64_t)src.bottom * s[3] + s[1] - 1) / s[1]);
+			CHECK(dst.left <= (first_x > 0 ? first_x - 1 : 0));
+			CHECK(dst.top <= (first_y > 0 ? first_y - 1 : 0));
+			CHECK(dst.right >= (end_x < s[2] ? end_x + 1 : s[2]));
+			CHECK(dst.bottom >= (end_y < s[3] ? end_y + 1 : s[3]));
+			CHECK(!(dst.left & 1) && !(dst.top & 1));
+			CHECK(!(dst.right & 1) || dst.right == s[2]);
+			CHECK(!(dst.bottom & 1) || dst.bottom == s[3]);
+		}
+	}
+}
+
+static bool overlap(const DirtyRect& a, const DirtyRect& b) {
+	return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+static bool contains(const DirtyRect& a, const DirtyRect& b) {
+	return a.left <= b.left && a.top <= b.top && a.right >= b.right && a.bottom >= b.bottom;
+}
+
+static void test_merge() {
+	// a chain: the box of the first two reaches the third
+	DirtyRect rects[] = { { 0, 0, 10, 10 }, { 40, 0, 50, 10 }, { 5, 5, 45, 8 }, { 100, 100, 110, 110 } };
+	int count = MergeDirtyRects(rects, 4);
+	CHECK_EQ(count, 2);
+	CHECK(rect_eq(rects[0], 0, 0, 50, 10));
+	CHECK(rect_eq(rects[1], 100, 100, 110, 110));
+	CHECK_EQ(DirtyRectsArea(rects, count), 50 * 10 + 10 * 10);
+
+	// rects that only touch stay apart
+	DirtyRect touching[] = { { 0, 0, 10, 10 }, { 10, 0, 20, 10 }, { 0, 10, 10, 20 } };
+	CHECK_EQ(MergeDirtyRects(touching, 3), 3);
+
+	CHECK_EQ(MergeDirtyRects(touching, 0), 0);
+	CHECK_EQ(DirtyRectsArea(touching, 0), 0);
+
+	uint32_t seed = 7;
+	for (int round = 0; round < 200; round++) {
+		DirtyRect original[16], merged[16];
+		int n = 1 + next_random(&seed) % 16;
+		for (int i = 0; i < n; i++) {
+			original[i].left = next_random(&seed) % 600;
+			original[i].top = next_random(&seed) % 300;
+			original[i].right = original[i].left + 1 + next_random(&seed) % 80;
+			original[i].bottom = original[i].top + 1 + next_random(&seed) % 80;
+			merged[i] = original[i];
+		}
+		int m = MergeDirtyRects(merged, n);
+		CHECK(m >= 1 && m <= n);
+		for (int i = 0; i < m; i++) {
+			for (int j = i + 1; j < m; j++) {
+				CHECK(!overlap(merged[i], merged[j]));
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			bool covered = false;
+			for (int j = 0; j < m; j++) {
+				covered = covered || contains(merged[j], original[i]);
+			}
+			CHECK(covered);
+		}
+	}
+}
+
+struct Frame {
+	int width, height, stride;
+	std::vector<uint8_t> argb;
+
+	Frame(int w, int h, uint32_t seed) : width(w), height(h), stride(w * 4), argb((size_t)w * 4 * h) {
+		for (size_t i = 0; i < argb.size(); i++) {
+			argb[i] = (uint8_t)next_random(&seed);
+		}
+	}
+
+	// new content in r, as a game or a window redrawing part of the screen
+	void Paint(const DirtyRect& r, uint32_t seed) {
+		for (int y = r.top; y < r.bottom; y++) {
+			for (int x = r.left * 4; x < r.right * 4; x++) {
+				argb[(size_t)y * stride + x] = (uint8_t)next_random(&seed);
+			}
+		}
+	}
+};
+
+static const int BAND_ROWS = 64;
+
+static int max_difference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+	int max = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		int diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+		max = diff > max ? diff : max;
+	}
+	return max;
+}
+
+// The new frame's dirty rects over the last frame's output, one band at a
+// time like the pool does, against the whole new frame converted. Same
+// size the two match exactly. Scaled, libyuv can round the last pixels of
+// a row differently from the rest (SIMD rows, C tail), and where a row
+// ends depends on the rect, so a pixel may be 1 off.
+static void check_update(const char* what, OutputFormat format, int src_width, int src_height,
+	int dst_width, int dst_height, uint32_t seed) {
+	OutputLayout layout;
+	GetOutputLayout(&layout, format, COLOR_BT709_LIMITED, dst_width, dst_height);
+	int size = GetOutputFrameSize(format, dst_width, dst_height);
+	std::vector<uint8_t> band(ScaleBandSize(dst_width));
+	std::vector<uint8_t> updated(size), full(size);
+	int tolerance = src_width == dst_width && src_height == dst_height ? 0 : 1;
+
+	Frame frame(src_width, src_height, seed);
+	ARGBScaleToOutputRows(frame.argb.data(), frame.stride, src_width, src_height, &layout,
+		updated.data(), 0, dst_height, band.data());
+
+	for (int step = 0; step < 10; step++) {
+		DirtyRect src_rects[8], rects[8];
+		int n = 1 + next_random(&seed) % 8, count = 0;
+		for (int i = 0; i < n; i++) {
+			DirtyRect& r = src_rects[i];
+			r.left = next_random(&seed) % src_width;
+			r.top = next_random(&seed) % src_height;
+			r.right = r.left + 1 + next_random(&seed) % (src_width - r.left < 90 ? src_width - r.left : 90);
+			r.bottom = r.top + 1 + next_random(&seed) % (src_height - r.top < 90 ? src_height - r.top : 90);
+			frame.Paint(r, next_random(&seed));
+			if (ScaleDirtyRect(&r, src_width, src_height, dst_width, dst_height, &rects[count])) {
+				count++;
+			}
+		}
+		count = MergeDirtyRects(rects, count);
+
+		for (int row = 0; row < dst_height; row += BAND_ROWS) {
+			int rows = dst_height - row < BAND_ROWS ? dst_height - row : BAND_ROWS;
+			CHECK_EQ(ARGBScaleDirtyRectsToOutput(frame.argb.data(), frame.stride, src_width, src_height,
+				&layout, updated.data(), rects, count, row, rows, band.data()), 0);
+		}
+		ARGBScaleToOutputRows(frame.argb.data(), frame.stride, src_width, src_height, &layout,
+			full.data(), 0, dst_height, band.data());
+
+		if (max_difference(updated, full) > tolerance) {
+			fprintf(stderr, "%s %dx%d to %dx%d, update %d: differs from the whole frame converted\n",
+				what, src_width, src_height, dst_width, dst_height, step);
+			test_failures++;
+			return;
+		}
+	}
+}
+
+static void test_update() {
+	static const struct { OutputFormat format; const char* name; } formats[] = {
+		{ OUTPUT_I420, "I420" }, { OUTPUT_NV12, "NV12" }, { OUTPUT_YUY2, "YUY2" },
+	};
+	for (auto f : formats) {
+		check_update(f.name, f.format, 640, 360, 640, 360, 1);
+		check_update(f.name, f.format, 1280, 720, 640, 360, 2);
+		check_update(f.name, f.format, 1366, 768, 640, 360, 3);
+		check_update(f.name, f.format, 320, 180, 640, 360, 4);
+		check_update(f.name, f.format, 641, 361, 640, 360, 5);
+	}
+}
+
+static void test_bad_band() {
+	OutputLayout layout;
+	GetOutputLayout(&layout, OUTPUT_I420, COLOR_BT601_LIMITED, 64, 64);
+	std::vector<uint8_t> src(64 * 64 * 4), dst(GetOutputFrameSize(OUTPUT_I420, 64, 64));
+	std::vector<uint8_t> band(ScaleBandSize(64));
+	DirtyRect rect = { 0, 0, 64, 64 };
+
+	CHECK(ARGBScaleDirtyRectsToOutput(src.data(), 256, 64, 64, &layout, dst.data(), &rect, 1, 1, 10, band.data()) != 0);
+	CHECK(ARGBScaleDirtyRectsToOutput(src.data(), 256, 64, 64, &layout, dst.data(), &rect, 1, 0, 0, band.data()) != 0);
+}
+
+int main() {
+	test_scale_same_size();
+	test_scale_margins();
+	test_scale_covers();
+	test_merge();
+	test_update();
+	test_bad_band();
+	return TEST_RESULT();
+}
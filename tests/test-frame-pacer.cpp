@@ -0,0 +1,264 @@
+#include <stdint.h>
+#include <vector>
+#include "FramePacer.h"
+#include "test.h"
+
+// Frame pacer: a fake clock replays how the capture thread's sleeps wake
+// up (early, late, not at all while the graph is paused), and the tests
+// check the schedule the pacer keeps against it: no drift however the
+// sleeps jitter, whole missed frames skipped instead of burst out, and the
+// retries of a late attempt.
+
+static const int64_t FPS60 = 10000000 / 60;
+static const int64_t MS = 10000;
+
+class FakeClock : public PacerClock {
+public:
+	int64_t now;
+	// added to every sleep in turn, negative wakes early
+	std::vector<int64_t> jitter;
+	bool paused;
+	int sleeps;
+	int64_t slept;
+
+	explicit FakeClock(int64_t start) : now(start), paused(false), sleeps(0), slept(0), next_(0) {}
+
+	int64_t Now() override { return now; }
+
+	void SleepFor(int64_t duration) override {
+		sleeps++;
+		slept += duration;
+		if (paused) {
+			return;
+		}
+		int64_t d = duration;
+		if (!jitter.empty()) {
+			d += jitter[next_++ % jitter.size()];
+		}
+		now += d > 0 ? d : 0;
+	}
+
+private:
+	size_t next_;
+};
+
+static void test_clock_not_running() {
+	FakeClock clock(0);
+	FramePacer pacer(&clock);
+
+	FrameSlot slot = pacer.Wait();
+	CHECK(slot.late);
+	CHECK_EQ(clock.sleeps, 1);
+	CHECK_EQ(clock.slept, pacer.FrameLength() / 2);
+
+	// nor does a restart start the schedule
+	pacer.Restart(0);
+	CHECK(!pacer.Started());
+}
+
+// before the first frame the pacer polls every half frame
+static void test_first_frame() {
+	FakeClock clock(1000 * MS);
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+
+	FrameSlot slot = pacer.Wait();
+	CHECK(slot.late);
+	CHECK_EQ(slot.now, 1000 * MS);
+	CHECK_EQ(clock.sleeps, 0);
+
+	slot = pacer.Wait();
+	CHECK_EQ(clock.sleeps, 1);
+	CHECK_EQ(slot.now, 1000 * MS + FPS60 / 2);
+
+	pacer.Restart(slot.now);
+	CHECK(pacer.Started());
+	CHECK_EQ(pacer.Deadline(), slot.now + FPS60);
+	CHECK_EQ(pacer.SinceLastFrame(slot.now), 0);
+}
+
+// sleeps that wake up to 3 ms late or 2 ms early, and a capture that takes
+// 2 ms: every attempt is at or after its deadline, never a whole frame
+// behind, and after 10000 frames the schedule is exactly where it started
+// plus 10000 frame lengths
+static void test_no_drift() {
+	FakeClock clock(1000 * MS);
+	clock.jitter = { 3 * MS, -2 * MS, 0, 1 * MS, -1 * MS, 2 * MS, 0, 5000 };
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+	int64_t start = clock.Now();
+	int skipped = 0, late = 0;
+
+	for (int frame = 1; frame <= 10000; frame++) {
+		int64_t deadline = pacer.Deadline();
+		FrameSlot slot = pacer.Wait();
+		CHECK(slot.now >= deadline);
+		CHECK(slot.now - deadline < FPS60);
+		skipped += slot.skipped;
+		late += slot.late;
+		clock.now += 2 * MS;
+		pacer.FrameDelivered();
+	}
+
+	CHECK_EQ(skipped, 0);
+	CHECK_EQ(late, 0);
+	CHECK_EQ(pacer.Deadline(), start + 10001 * FPS60);
+	// a naive sleep of a frame length after each capture would have
+	// drifted by the 2 ms of capture plus the jitter every frame
+	CHECK(clock.now - start < 10000 * FPS60 + FPS60);
+}
+
+// a sleep that wakes early is slept again, up to the deadline
+static void test_early_wake() {
+	FakeClock clock(1000 * MS);
+	clock.jitter = { -FPS60 / 2, -FPS60 / 4, 0 };
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+
+	FrameSlot slot = pacer.Wait();
+	CHECK(!slot.late);
+	CHECK(slot.now >= pacer.Deadline());
+	CHECK(clock.sleeps > 1);
+}
+
+// less than a frame behind: the attempt is made at once and marked late
+static void test_late_within_frame() {
+	FakeClock clock(1000 * MS);
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+	int64_t deadline = pacer.Deadline();
+
+	clock.now = deadline + FPS60 / 2;
+	FrameSlot slot = pacer.Wait();
+	CHECK(slot.late);
+	CHECK_EQ(slot.skipped, 0);
+	CHECK_EQ(clock.sleeps, 0);
+	CHECK_EQ(pacer.Deadline(), deadline);
+
+	// delivered: the next frame keeps the original phase
+	pacer.FrameDelivered();
+	CHECK_EQ(pacer.Deadline(), deadline + FPS60);
+}
+
+// further behind: the whole frames missed are skipped in one go, the
+// phase is kept, and the next deadline is in the future again
+static void test_skip_missed_frames() {
+	FakeClock clock(1000 * MS);
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+	int64_t deadline = pacer.Deadline();
+
+	clock.now = deadline + 3 * FPS60 + FPS60 / 2;
+	FrameSlot slot = pacer.Wait();
+	CHECK(slot.late);
+	CHECK_EQ(slot.skipped, 3);
+	CHECK_EQ(pacer.Deadline(), deadline + 3 * FPS60);
+
+	pacer.FrameDelivered();
+	CHECK_EQ(pacer.Deadline(), deadline + 4 * FPS60);
+	CHECK(pacer.Deadline() > clock.Now());
+}
+
+// a late attempt that found nothing is retried every half frame, not in a
+// busy loop
+static void test_late_retry() {
+	FakeClock clock(1000 * MS);
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+
+	clock.now = pacer.Deadline() + MS;
+	pacer.Wait();
+	CHECK_EQ(clock.sleeps, 0);
+	pacer.Wait();
+	CHECK_EQ(clock.sleeps, 1);
+	CHECK_EQ(clock.slept, FPS60 / 2);
+	pacer.Wait();
+	CHECK_EQ(clock.sleeps, 2);
+}
+
+// stream time stands still while the graph is paused, the wait gives up
+// instead of spinning
+static void test_paused() {
+	FakeClock clock(1000 * MS);
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+
+	clock.paused = true;
+	FrameSlot slot = pacer.Wait();
+	CHECK_EQ(clock.sleeps, 1);
+	CHECK_EQ(slot.now, 1000 * MS);
+	CHECK(!slot.late);
+}
+
+static void test_frame_length_change() {
+	FakeClock clock(1000 * MS);
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+
+	pacer.SetFrameLength(10000000 / 30);
+	CHECK_EQ(pacer.Deadline(), 1000 * MS + 10000000 / 30);
+	pacer.SetFrameLength(0);
+	CHECK_EQ(pacer.FrameLength(), 10000000 / 30);
+
+	pacer.Reset();
+	CHECK(!pacer.Started());
+	CHECK_EQ(pacer.Deadline(), 0);
+}
+
+// A trace of capture times with hitches, as a game loading assets: every
+// frame is paced from the last deadline, skipped frames plus delivered
+// ones account for all the frame slots, and no two frames go out closer
+// than a frame length apart.
+static void test_trace() {
+	static const int64_t capture_ms[] = { 2, 2, 3, 40, 2, 2, 17, 2, 100, 1, 1, 1, 20, 2, 2, 2 };
+	const int n = sizeof(capture_ms) / sizeof(capture_ms[0]);
+	FakeClock clock(1000 * MS);
+	clock.jitter = { 1 * MS, 0, -1 * MS, 2 * MS };
+	FramePacer pacer(&clock);
+	pacer.SetFrameLength(FPS60);
+	pacer.Restart(clock.Now());
+	int64_t start = pacer.Deadline();
+
+	int delivered = 0, skipped = 0;
+	int64_t last_deadline = 0;
+	for (int round = 0; round < 100; round++) {
+		for (int i = 0; i < n; i++) {
+			FrameSlot slot = pacer.Wait();
+			skipped += slot.skipped;
+			int64_t deadline = pacer.Deadline();
+			CHECK(last_deadline == 0 || deadline - last_deadline >= FPS60);
+			CHECK(slot.now >= deadline);
+			CHECK(slot.now - deadline < 2 * FPS60);
+			last_deadline = deadline;
+
+			clock.now += capture_ms[i] * MS;
+			pacer.FrameDelivered();
+			delivered++;
+		}
+	}
+
+	CHECK(skipped > 0);
+	CHECK_EQ(pacer.Deadline(), start + (int64_t)(delivered + skipped) * FPS60);
+	printf("trace: %d frames delivered, %d skipped\n", delivered, skipped);
+}
+
+int main() {
+	test_clock_not_running();
+	test_first_frame();
+	test_no_drift();
+	test_early_wake();
+	test_late_within_frame();
+	test_skip_missed_frames();
+	test_late_retry();
+	test_paused();
+	test_frame_length_change();
+	test_trace();
+	return TEST_RESULT();
+}
@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ConversionPlan.h"
+#include "dxgi-format.h"
+#include "platform.h"
+#include "test.h"
+
+// os_large_page_alloc on Linux (MAP_HUGETLB, plain pages when the hugetlb
+// pool is short) and the conversion plan's scale buffers on top of it: the
+// memory is zeroed, aligned and usable whichever pages it got, and a plan
+// with large pages converts exactly like one without.
+
+static void check_alloc(size_t size) {
+	bool large = true;
+	uint8_t* p = (uint8_t*)os_large_page_alloc(size, &large);
+
+	CHECK(p != NULL);
+	if (!p) {
+		return;
+	}
+	CHECK_EQ((uintptr_t)p & 63, 0);
+
+	size_t nonzero = 0;
+	for (size_t i = 0; i < size; i += 4096) {
+		nonzero += p[i] != 0;
+	}
+	CHECK_EQ(nonzero, 0);
+	CHECK_EQ(p[size - 1], 0);
+
+	memset(p, 0xa5, size);
+	CHECK_EQ(p[0], 0xa5);
+	CHECK_EQ(p[size - 1], 0xa5);
+	printf("%zu bytes: %s pages\n", size, large ? "large" : "normal");
+	os_large_page_free(p);
+}
+
+// more than any hugetlb pool of a test machine, so the fallback; only the
+// ends are touched
+static void check_fallback() {
+	size_t size = (size_t)64 << 30;
+	bool large = true;
+	uint8_t* p = (uint8_t*)os_large_page_alloc(size, &large);
+
+	if (!p) {
+		// no overcommit for this much either
+		return;
+	}
+	CHECK(!large);
+	p[0] = 1;
+	p[size - 1] = 1;
+	os_large_page_free(p);
+}
+
+static void check_plan(int width, int height, int sample_width, int sample_height) {
+	int pitch = width * 4;
+	uint8_t* src = (uint8_t*)malloc((size_t)pitch * height);
+	for (size_t i = 0; i < (size_t)pitch * height; i++) {
+		src[i] = (uint8_t)(i * 131 + i / 4099);
+	}
+	size_t sample_size = GetOutputFrameSize(OUTPUT_NV12, sample_width, sample_height);
+	uint8_t* expected = (uint8_t*)calloc(sample_size, 1);
+	uint8_t* actual = (uint8_t*)calloc(sample_size, 1);
+
+	ConversionPlan normal = {}, large = {};
+	large.large_pages = true;
+	CHECK(BuildConversionPlan(&normal, DXGI_FORMAT_B8G8R8A8_UNORM, false, width, height, pitch,
+		OUTPUT_NV12, COLOR_BT709_LIMITED, sample_width, sample_height));
+	CHECK(BuildConversionPlan(&large, DXGI_FORMAT_B8G8R8A8_UNORM, false, width, height, pitch,
+		OUTPUT_NV12, COLOR_BT709_LIMITED, sample_width, sample_height));
+	CHECK(normal.scaled && large.scaled);
+	CHECK(!normal.large_buffers && !normal.os_buffers);
+	CHECK(large.os_buffers);
+
+	normal.ConvertRows(src, expected, 0, height);
+	normal.ScaleToSample(expected);
+	large.ConvertRows(src, actual, 0, height);
+	large.ScaleToSample(actual);
+	CHECK(memcmp(expected, actual, sample_size) == 0);
+	printf("%dx%d to %dx%d: scale buffers on %s pages\n", width, height, sample_width, sample_height,
+		large.large_buffers ? "large" : "normal");
+
+	// built again, the buffers of the first build go
+	CHECK(BuildConversionPlan(&large, DXGI_FORMAT_B8G8R8A8_UNORM, false, width, height, pitch,
+		OUTPUT_NV12, COLOR_BT709_LIMITED, sample_width, sample_height));
+	FreeConversionPlan(&large);
+	CHECK(!large.os_buffers && large.scale_frame == NULL && large.scale_staging == NULL);
+	FreeConversionPlan(&normal);
+
+	free(actual);
+	free(expected);
+	free(src);
+}
+
+int main() {
+	check_alloc(1);
+	check_alloc(4096);
+	check_alloc(2 * 1024 * 1024);
+	check_alloc(2560 * 1440 * 4);
+	check_alloc(3840 * 2160 * 4 + 12345);
+	check_fallback();
+	os_large_page_free(NULL);
+
+	check_plan(2560, 1440, 1920, 1080);
+	check_plan(3840, 2160, 1920, 1080);
+	check_plan(1366, 767, 1280, 720);
+	return TEST_RESULT();
+}
@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "shmem-ring.h"
+#include "test.h"
+
+// Frame ring: the single threaded cases pin down which slot the producer
+// picks around a read, the threaded one has a producer write as fast as it
+// can while the consumer reads, and checks that every read the ring calls
+// intact holds one whole frame.
+
+static const uint32_t SLOT_SIZE = 64 * 1024;
+static const uint32_t FIRST_OFFSET = (sizeof(struct shmem_ring) + 63) & ~63u;
+
+struct Ring {
+	std::vector<uint64_t> memory;
+	struct shmem_ring* ring;
+
+	explicit Ring(uint32_t slots) : memory((FIRST_OFFSET + SHMEM_RING_MAX_SLOTS * SLOT_SIZE) / 8) {
+		ring = (struct shmem_ring*)memory.data();
+		shmem_ring_init(ring, slots, FIRST_OFFSET, SLOT_SIZE);
+	}
+};
+
+// every word of a frame is derived from its number, a slot holding parts
+// of two frames does not check out
+static void fill_frame(uint8_t* data, uint32_t frame) {
+	uint32_t* words = (uint32_t*)data;
+	for (uint32_t i = 0; i < SLOT_SIZE / 4; i++) {
+		words[i] = frame * 2654435761u + i;
+	}
+}
+
+static bool check_frame(const uint8_t* data, uint32_t frame) {
+	const uint32_t* words = (const uint32_t*)data;
+	for (uint32_t i = 0; i < SLOT_SIZE / 4; i++) {
+		if (words[i] != frame * 2654435761u + i) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void write_frame(struct shmem_ring* ring) {
+	uint32_t slot = shmem_ring_write_begin(ring);
+	fill_frame(shmem_ring_slot_data(ring, slot), ring->frame_count + 1);
+	shmem_ring_write_end(ring, slot, ring->frame_count + 1);
+}
+
+static void test_empty() {
+	Ring r(3);
+	struct shmem_ring_read read;
+
+	CHECK(!shmem_ring_read_begin(r.ring, &read));
+	CHECK_EQ(r.ring->reading, SHMEM_RING_NONE);
+	CHECK(shmem_ring_valid(r.ring, FIRST_OFFSET + 3 * SLOT_SIZE));
+	CHECK(!shmem_ring_valid(r.ring, FIRST_OFFSET + 3 * SLOT_SIZE - 1));
+}
+
+static void test_clamp() {
+	CHECK_EQ(shmem_ring_clamp_slots(0), SHMEM_RING_MIN_SLOTS);
+	CHECK_EQ(shmem_ring_clamp_slots(3), 3);
+	CHECK_EQ(shmem_ring_clamp_slots(100), SHMEM_RING_MAX_SLOTS);
+}
+
+// the consumer always gets the newest frame
+static void test_newest() {
+	Ring r(3);
+	struct shmem_ring_read read;
+
+	for (int i = 0; i < 5; i++) {
+		write_frame(r.ring);
+	}
+	CHECK(shmem_ring_read_begin(r.ring, &read));
+	CHECK_EQ(read.frame, 5);
+	CHECK_EQ(read.capture_time, 5);
+	CHECK(check_frame(shmem_ring_slot_data(r.ring, read.slot), 5));
+	CHECK(shmem_ring_read_end(r.ring, &read));
+	CHECK_EQ(r.ring->reading, SHMEM_RING_NONE);
+}
+
+// with three slots and more the producer writes around the slot being read
+// for as long as the read takes
+static void test_write_around(uint32_t slots) {
+	Ring r(slots);
+	struct shmem_ring_read read;
+
+	write_frame(r.ring);
+	CHECK(shmem_ring_read_begin(r.ring, &read));
+	for (int i = 0; i < 20; i++) {
+		write_frame(r.ring);
+		CHECK(r.ring->latest != read.slot);
+		CHECK(shmem_ring_read_intact(r.ring, &read));
+	}
+	CHECK(check_frame(shmem_ring_slot_data(r.ring, read.slot), 1));
+	CHECK(shmem_ring_read_end(r.ring, &read));
+	CHECK(r.ring->skipped > 0);
+	CHECK_EQ(r.ring->overwritten, 0);
+	CHECK_EQ(r.ring->frame_count, 21);
+}
+
+// with two slots the producer does not wait either, the second frame
+// written during a read goes over it and the read is torn
+static void test_two_slots_overwrite() {
+	Ring r(2);
+	struct shmem_ring_read read;
+
+	write_frame(r.ring);
+	CHECK(shmem_ring_read_begin(r.ring, &read));
+	write_frame(r.ring);
+	CHECK(shmem_ring_read_intact(r.ring, &read));
+	write_frame(r.ring);
+	CHECK(!shmem_ring_read_intact(r.ring, &read));
+	CHECK(!shmem_ring_read_end(r.ring, &read));
+	CHECK_EQ(r.ring->overwritten, 1);
+
+	CHECK(shmem_ring_read_begin(r.ring, &read));
+	CHECK_EQ(read.frame, 3);
+	CHECK(shmem_ring_read_end(r.ring, &read));
+}
+
+// a slot the producer is still writing is not handed out
+static void test_read_while_written() {
+	Ring r(2);
+	struct shmem_ring_read read;
+
+	write_frame(r.ring);
+	write_frame(r.ring);
+	// the next write goes to the newest frame's slot only with two
+	// slots and the other one being read, so fake the newest
+	uint32_t slot = shmem_ring_write_begin(r.ring);
+	r.ring->latest = slot;
+	CHECK(!shmem_ring_read_begin(r.ring, &read));
+	CHECK_EQ(r.ring->reading, SHMEM_RING_NONE);
+	shmem_ring_write_end(r.ring, slot, 3);
+	CHECK(shmem_ring_read_begin(r.ring, &read));
+	CHECK(shmem_ring_read_end(r.ring, &read));
+}
+
+static void test_threads(uint32_t slots, uint32_t frames) {
+	Ring r(slots);
+	std::atomic<bool> done(false);
+	std::vector<uint8_t> copy(SLOT_SIZE);
+	uint32_t reads = 0, torn = 0, bad = 0, last = 0, backwards = 0;
+
+	std::thread producer([&] {
+		for (uint32_t i = 0; i < frames; i++) {
+			write_frame(r.ring);
+		}
+		done = true;
+	});
+
+	while (!done || last < frames) {
+		struct shmem_ring_read read;
+		if (!shmem_ring_read_begin(r.ring, &read)) {
+			continue;
+		}
+		memcpy(copy.data(), shmem_ring_slot_data(r.ring, read.slot), SLOT_SIZE);
+		if (!shmem_ring_read_end(r.ring, &read)) {
+			torn++;
+			continue;
+		}
+
+		reads++;
+		if (!check_frame(copy.data(), read.frame) || read.capture_time != read.frame) {
+			bad++;
+		}
+		if (read.frame < last) {
+			backwards++;
+		}
+		last = read.frame;
+	}
+	producer.join();
+
+	printf("%u slots: %u frames, %u intact reads, %u torn, skipped %u, overwritten %u\n",
+		slots, frames, reads, torn, r.ring->skipped, r.ring->overwritten);
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(backwards, 0);
+	CHECK(reads > 0);
+	CHECK_EQ(last, frames);
+	CHECK_EQ(r.ring->frame_count, frames);
+	CHECK_EQ(r.ring->reading, SHMEM_RING_NONE);
+}
+
+int main(int argc, char** argv) {
+	uint32_t frames = argc > 1 ? (uint32_t)atoi(argv[1]) : 20000;
+
+	test_empty();
+	test_clamp();
+	test_newest();
+	test_write_around(3);
+	test_write_around(SHMEM_RING_MAX_SLOTS);
+	test_two_slots_overwrite();
+	test_read_while_written();
+	for (uint32_t slots = SHMEM_RING_MIN_SLOTS; slots <= 4; slots++) {
+		test_threads(slots, frames);
+	}
+	return TEST_RESULT();
+}
@@ -0,0 +1,232 @@
+#include "shmem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/statfs.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/* the mapping outlives the descriptor, which is closed right away */
+static inline bool ipc_shmem_internal_map(ipc_shmem_t *shmem, int fd,
+		size_t size)
+{
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	int error = errno;
+
+	close(fd);
+	if (data == MAP_FAILED) {
+		errno = error;
+		return false;
+	}
+
+	shmem->data = data;
+	shmem->size = size;
+	return true;
+}
+
+static inline void ipc_shmem_internal_huge_path(const char *name,
+		char *path, size_t len)
+{
+	snprintf(path, len, "%s/%s", IPC_SHMEM_HUGETLBFS, name);
+}
+
+bool ipc_shmem_create(ipc_shmem_t *shmem, const char *name, size_t size)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	/* a producer that died leaves its object behind, maybe a large
+	 * page one that a consumer would look for first */
+	snprintf(shmem->name, sizeof(shmem->name), "/%s", name);
+	shm_unlink(shmem->name);
+	ipc_shmem_internal_huge_path(name, path, sizeof(path));
+	unlink(path);
+
+	fd = shm_open(shmem->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		return false;
+	}
+	shmem->owner = true;
+
+	/* a new object reads as zeros */
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return false;
+	}
+
+	return ipc_shmem_internal_map(shmem, fd, size);
+}
+
+bool ipc_shmem_create_large(ipc_shmem_t *shmem, const char *name,
+		size_t size)
+{
+#ifdef __linux__
+	char path[PATH_MAX];
+	struct statfs fs;
+	size_t page;
+	int fd;
+
+	ipc_shmem_internal_huge_path(name, path, sizeof(path));
+	unlink(path);
+
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		goto fallback;
+	}
+
+	/* hugetlbfs reports its page size as the block size */
+	if (fstatfs(fd, &fs) != 0 || fs.f_bsize <= 0) {
+		goto fail;
+	}
+	page = (size_t)fs.f_bsize;
+	size = (size + page - 1) & ~(page - 1);
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		goto fail;
+	}
+
+	/* pages are taken from the pool at mmap, which fails with ENOMEM
+	 * when it is short */
+	if (!ipc_shmem_internal_map(shmem, fd, size)) {
+		unlink(path);
+		goto fallback;
+	}
+
+	snprintf(shmem->name, sizeof(shmem->name), "%s", path);
+	shmem->owner = true;
+	shmem->large = true;
+	return true;
+
+fail:
+	close(fd);
+	unlink(path);
+fallback:
+#endif
+	if (!ipc_shmem_create(shmem, name, size)) {
+		return false;
+	}
+
+#ifdef MADV_HUGEPAGE
+	/* transparent huge pages, if shmem_enabled allows them */
+	madvise(shmem->data, shmem->size, MADV_HUGEPAGE);
+#endif
+	return true;
+}
+
+bool ipc_shmem_open(ipc_shmem_t *shmem, const char *name, size_t size)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	int fd;
+
+	snprintf(shmem->name, sizeof(shmem->name), "/%s", name);
+	shmem->owner = false;
+
+	/* a producer with large pages put it on the hugetlbfs mount */
+	ipc_shmem_internal_huge_path(name, path, sizeof(path));
+	fd = open(path, O_RDWR);
+	shmem->large = fd != -1;
+	if (fd == -1) {
+		fd = shm_open(shmem->name, O_RDWR, 0600);
+	}
+	if (fd == -1) {
+		return false;
+	}
+
+	/* the producer may not have sized it yet */
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < size) {
+		close(fd);
+		errno = ENOENT;
+		return false;
+	}
+
+	return ipc_shmem_internal_map(shmem, fd, size);
+}
+
+void ipc_shmem_free(ipc_shmem_t *shmem)
+{
+	if (!shmem) {
+		return;
+	}
+
+	if (shmem->data) {
+		munmap(shmem->data, shmem->size);
+		shmem->data = NULL;
+	}
+	if (shmem->owner && shmem->large) {
+		unlink(shmem->name);
+	} else if (shmem->owner) {
+		shm_unlink(shmem->name);
+	}
+	shmem->owner = false;
+	shmem->large = false;
+	shmem->size = 0;
+}
+
+#ifdef __linux__
+/* not FUTEX_PRIVATE_FLAG, the waiter is in another process */
+static inline long ipc_shmem_internal_futex(volatile uint32_t *addr, int op,
+		uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+#endif
+
+void ipc_shmem_signal(ipc_shmem_t *shmem, volatile uint32_t *counter)
+{
+	(void)shmem;
+#ifdef __linux__
+	ipc_shmem_internal_futex(counter, FUTEX_WAKE, INT_MAX, NULL);
+#else
+	(void)counter;
+#endif
+}
+
+static inline uint64_t ipc_shmem_internal_time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+bool ipc_shmem_wait(ipc_shmem_t *shmem, volatile uint32_t *counter,
+		uint32_t seen, uint32_t timeout_ms)
+{
+	uint64_t start = ipc_shmem_internal_time_ms();
+
+	(void)shmem;
+
+	/* the kernel compares *counter with seen before sleeping, a bump
+	 * in between is not lost */
+	while (*counter == seen) {
+		uint64_t waited = ipc_shmem_internal_time_ms() - start;
+		struct timespec ts;
+
+		if (waited >= timeout_ms) {
+			return false;
+		}
+
+#ifdef __linux__
+		waited = timeout_ms - waited;
+		ts.tv_sec = (time_t)(waited / 1000);
+		ts.tv_nsec = (long)(waited % 1000) * 1000000;
+		ipc_shmem_internal_futex(counter, FUTEX_WAIT, seen, &ts);
+#else
+		ts.tv_sec = 0;
+		ts.tv_nsec = 1000000;
+		nanosleep(&ts, NULL);
+#endif
+	}
+
+	return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <limits.h>
+
+/* shm_open object "/<name>", or a file of that name on the hugetlbfs
+ * mount for large pages, whose path is what name holds then; on Linux the
+ * wakeup is a futex on the counter, elsewhere the consumer polls it */
+#ifndef IPC_SHMEM_HUGETLBFS
+#define IPC_SHMEM_HUGETLBFS "/dev/hugepages"
+#endif
+
+struct ipc_shmem {
+	void                       *data;
+	size_t                     size;
+	bool                       owner;
+	bool                       large;
+	char                       name[PATH_MAX];
+};
+
+static inline bool ipc_shmem_valid(ipc_shmem_t *shmem)
+{
+	return shmem->data != NULL;
+}
+
+static inline void *ipc_shmem_data(ipc_shmem_t *shmem)
+{
+	return shmem->data;
+}
+
+static inline bool ipc_shmem_large(ipc_shmem_t *shmem)
+{
+	return shmem->large;
+}
@@ -0,0 +1,228 @@
+#include "shmem.h"
+
+#include <stdio.h>
+
+#define IPC_SHMEM_MAP_FLAGS   (FILE_MAP_READ | FILE_MAP_WRITE)
+#define IPC_SHMEM_EVENT_FLAGS (EVENT_MODIFY_STATE | SYNCHRONIZE)
+
+#ifndef FILE_MAP_LARGE_PAGES
+#define FILE_MAP_LARGE_PAGES  0x20000000
+#endif
+
+static inline void ipc_shmem_internal_names(const char *name,
+		wchar_t *map_name, wchar_t *event_name, size_t len)
+{
+	_snwprintf(map_name, len, L"%S", name);
+	_snwprintf(event_name, len, L"%S%S", name, IPC_SHMEM_FRAME_SUFFIX);
+	map_name[len - 1] = 0;
+	event_name[len - 1] = 0;
+}
+
+static inline bool ipc_shmem_internal_map(ipc_shmem_t *shmem, size_t size)
+{
+	MEMORY_BASIC_INFORMATION info;
+
+	shmem->data = MapViewOfFile(shmem->map, FILE_MAP_ALL_ACCESS, 0, 0,
+			size);
+	shmem->size = size;
+	if (shmem->data) {
+		return true;
+	}
+
+	/* a large page section may only be mapped in whole pages, the
+	 * consumer does not know it is one and takes all of it */
+	shmem->data = MapViewOfFile(shmem->map, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!shmem->data) {
+		return false;
+	}
+	if (VirtualQuery(shmem->data, &info, sizeof(info)) == sizeof(info) &&
+	    info.RegionSize >= size) {
+		shmem->size = info.RegionSize;
+	}
+	return true;
+}
+
+/* large page sections need SeLockMemoryPrivilege enabled in the token;
+ * it is only there to be enabled when the account was granted "Lock pages
+ * in memory" */
+static bool ipc_shmem_internal_lock_privilege(void)
+{
+	TOKEN_PRIVILEGES privileges = {0};
+	HANDLE token;
+	bool success;
+
+	if (!OpenProcessToken(GetCurrentProcess(),
+			TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		return false;
+	}
+
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	success = LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME,
+			&privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, false, &privileges, 0, NULL,
+			NULL) &&
+		/* ERROR_NOT_ALL_ASSIGNED when the account does not hold it */
+		GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(token);
+	return success;
+}
+
+bool ipc_shmem_create(ipc_shmem_t *shmem, const char *name, size_t size)
+{
+	wchar_t map_name[256];
+	wchar_t event_name[256];
+
+	ipc_shmem_internal_names(name, map_name, event_name, 256);
+
+	shmem->map = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, 0, (DWORD)size, map_name);
+	if (!shmem->map) {
+		return false;
+	}
+
+	shmem->frame_event = CreateEventW(NULL, false, false, event_name);
+	if (!shmem->frame_event) {
+		return false;
+	}
+
+	return ipc_shmem_internal_map(shmem, size);
+}
+
+bool ipc_shmem_create_large(ipc_shmem_t *shmem, const char *name,
+		size_t size)
+{
+	wchar_t map_name[256];
+	wchar_t event_name[256];
+	size_t page = GetLargePageMinimum();
+
+	if (!page || !ipc_shmem_internal_lock_privilege()) {
+		return ipc_shmem_create(shmem, name, size);
+	}
+
+	ipc_shmem_internal_names(name, map_name, event_name, 256);
+
+	/* committed and locked right here, fails with
+	 * ERROR_NO_SYSTEM_RESOURCES once physical memory is too fragmented
+	 * for contiguous pages */
+	size = (size + page - 1) & ~(page - 1);
+	shmem->map = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE | SEC_COMMIT | SEC_LARGE_PAGES, 0,
+			(DWORD)size, map_name);
+	if (!shmem->map) {
+		return ipc_shmem_create(shmem, name, size);
+	}
+
+	shmem->frame_event = CreateEventW(NULL, false, false, event_name);
+	if (!shmem->frame_event) {
+		return false;
+	}
+
+	/* before Windows 10 1703 views of the section get large pages
+	 * without asking and the flag is rejected */
+	shmem->data = MapViewOfFile(shmem->map,
+			FILE_MAP_ALL_ACCESS | FILE_MAP_LARGE_PAGES, 0, 0, size);
+	if (!shmem->data) {
+		shmem->data = MapViewOfFile(shmem->map, FILE_MAP_ALL_ACCESS,
+				0, 0, size);
+	}
+	shmem->size = size;
+	shmem->large = shmem->data != NULL;
+	return shmem->data != NULL;
+}
+
+bool ipc_shmem_open(ipc_shmem_t *shmem, const char *name, size_t size)
+{
+	wchar_t map_name[256];
+	wchar_t event_name[256];
+
+	ipc_shmem_internal_names(name, map_name, event_name, 256);
+
+	/* created in this order, so ERROR_FILE_NOT_FOUND from either means
+	 * the producer is not there (yet) */
+	shmem->map = OpenFileMappingW(IPC_SHMEM_MAP_FLAGS, false, map_name);
+	if (!shmem->map) {
+		return false;
+	}
+
+	shmem->frame_event = OpenEventW(IPC_SHMEM_EVENT_FLAGS, false,
+			event_name);
+	if (!shmem->frame_event) {
+		return false;
+	}
+
+	return ipc_shmem_internal_map(shmem, size);
+}
+
+bool ipc_shmem_open_handles(ipc_shmem_t *shmem, HANDLE map,
+		HANDLE frame_event, size_t size)
+{
+	shmem->map = map;
+	shmem->frame_event = frame_event;
+	if (!shmem->map || !shmem->frame_event) {
+		return false;
+	}
+
+	return ipc_shmem_internal_map(shmem, size);
+}
+
+void ipc_shmem_free(ipc_shmem_t *shmem)
+{
+	if (!shmem) {
+		return;
+	}
+
+	if (shmem->data) {
+		UnmapViewOfFile(shmem->data);
+		shmem->data = NULL;
+	}
+	if (shmem->frame_event) {
+		CloseHandle(shmem->frame_event);
+		shmem->frame_event = NULL;
+	}
+	if (shmem->map) {
+		CloseHandle(shmem->map);
+		shmem->map = NULL;
+	}
+	shmem->size = 0;
+	shmem->large = false;
+}
+
+static inline double ipc_shmem_internal_time_ms(void)
+{
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+}
+
+void ipc_shmem_signal(ipc_shmem_t *shmem, volatile uint32_t *counter)
+{
+	(void)counter;
+	SetEvent(shmem->frame_event);
+}
+
+bool ipc_shmem_wait(ipc_shmem_t *shmem, volatile uint32_t *counter,
+		uint32_t seen, uint32_t timeout_ms)
+{
+	double start = ipc_shmem_internal_time_ms();
+
+	/* the event can still be set for a frame already taken, go by the
+	 * counter and wait again for whatever time is left */
+	while (*counter == seen) {
+		double waited = ipc_shmem_internal_time_ms() - start;
+		if (waited >= timeout_ms) {
+			return false;
+		}
+
+		if (WaitForSingleObject(shmem->frame_event,
+				(DWORD)(timeout_ms - waited)) != WAIT_OBJECT_0) {
+			return *counter != seen;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <windows.h>
+
+/* the wakeup is an auto reset event named after the memory */
+#define IPC_SHMEM_FRAME_SUFFIX "_Frame"
+
+struct ipc_shmem {
+	HANDLE                     map;
+	HANDLE                     frame_event;
+	void                       *data;
+	size_t                     size;
+	bool                       large;
+};
+
+/* consumer: takes over a mapping and its frame event opened elsewhere,
+ * e.g. in an app container's namespace; both are closed by
+ * ipc_shmem_free, also when this fails */
+bool ipc_shmem_open_handles(ipc_shmem_t *shmem, HANDLE map,
+		HANDLE frame_event, size_t size);
+
+static inline bool ipc_shmem_valid(ipc_shmem_t *shmem)
+{
+	return shmem->data != NULL;
+}
+
+static inline void *ipc_shmem_data(ipc_shmem_t *shmem)
+{
+	return shmem->data;
+}
+
+static inline bool ipc_shmem_large(ipc_shmem_t *shmem)
+{
+	return shmem->large;
+}
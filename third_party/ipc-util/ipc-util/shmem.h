@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#elif _MSC_VER
+#ifndef inline
+#define inline __inline
+#endif
+#endif
+
+/*
+ * Named shared memory plus a "frame ready" wakeup, the transport between
+ * the graphics hook and the capture service. The wakeup is tied to a
+ * counter inside the memory that the producer bumps: waiting is "until
+ * the counter is no longer what I saw", so a wakeup is never lost and a
+ * stale one never counts.
+ */
+
+struct ipc_shmem;
+typedef struct ipc_shmem ipc_shmem_t;
+
+/* producer: creates name with size bytes, zeroed */
+bool ipc_shmem_create(ipc_shmem_t *shmem, const char *name, size_t size);
+/* producer: the same, backed by large pages (2 MB on x64) so a frame
+ * sized mapping needs a handful of TLB entries instead of thousands.
+ * Needs SeLockMemoryPrivilege on Windows, a hugetlbfs mount with free
+ * pages elsewhere; without them this is ipc_shmem_create, see
+ * ipc_shmem_large. The size is rounded up to whole large pages. */
+bool ipc_shmem_create_large(ipc_shmem_t *shmem, const char *name,
+		size_t size);
+/* consumer: maps the first size bytes of what the producer created */
+bool ipc_shmem_open(ipc_shmem_t *shmem, const char *name, size_t size);
+void ipc_shmem_free(ipc_shmem_t *shmem);
+
+/* producer, after bumping *counter */
+void ipc_shmem_signal(ipc_shmem_t *shmem, volatile uint32_t *counter);
+/* consumer, sleeps until *counter != seen or timeout_ms is up; true when
+ * the counter moved */
+bool ipc_shmem_wait(ipc_shmem_t *shmem, volatile uint32_t *counter,
+		uint32_t seen, uint32_t timeout_ms);
+
+static inline bool ipc_shmem_valid(ipc_shmem_t *shmem);
+static inline void *ipc_shmem_data(ipc_shmem_t *shmem);
+/* whether the mapping ended up on large pages */
+static inline bool ipc_shmem_large(ipc_shmem_t *shmem);
+
+#ifdef _WIN32
+#include "shmem-windows.h"
+#else /* assume posix */
+#include "shmem-posix.h"
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+ * The DXGI formats the frame converters know. dxgiformat.h on Windows;
+ * elsewhere, where the converters are only built to be tested, the same
+ * values are spelled out here.
+ */
+
+#ifdef _WIN32
+#include <dxgiformat.h>
+#else
+typedef enum DXGI_FORMAT {
+	DXGI_FORMAT_UNKNOWN            = 0,
+	DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+	DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+	DXGI_FORMAT_R10G10B10A2_UNORM  = 24,
+	DXGI_FORMAT_R8G8B8A8_UNORM     = 28,
+	DXGI_FORMAT_B5G6R5_UNORM       = 85,
+	DXGI_FORMAT_B5G5R5A1_UNORM     = 86,
+	DXGI_FORMAT_B8G8R8A8_UNORM     = 87,
+	DXGI_FORMAT_B8G8R8X8_UNORM     = 88,
+} DXGI_FORMAT;
+#endif
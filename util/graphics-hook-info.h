@@ -5,7 +5,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef _WIN32
 #include "hook-helpers.h"
+#endif
+#include "shmem-ring.h"
 
 #define EVENT_CAPTURE_RESTART L"CaptureHook_Restart"
 #define EVENT_CAPTURE_STOP    L"CaptureHook_Stop"
@@ -17,14 +20,14 @@
 
 #define WINDOW_HOOK_KEEPALIVE L"CaptureHook_KeepAlive"
 
-#define MUTEX_TEXTURE1        L"CaptureHook_TextureMutex1"
-#define MUTEX_TEXTURE2        L"CaptureHook_TextureMutex2"
-
 #define SHMEM_HOOK_INFO       L"CaptureHook_HookInfo"
-#define SHMEM_TEXTURE         L"CaptureHook_Texture"
+#define SHMEM_TEXTURE         "CaptureHook_Texture"
 
 #define PIPE_NAME             "CaptureHook_Pipe"
 
+/* bump on every change to struct hook_info */
+#define HOOK_INFO_VERSION     1
+
 #pragma pack(push, 8)
 
 struct d3d8_offsets {
@@ -58,9 +61,21 @@ struct ddraw_offsets {
 };
 
 struct shmem_data {
-	volatile int last_tex;
-	uint32_t tex1_offset;
-	uint32_t tex2_offset;
+	/* frames, see shmem-ring.h; frame_count is what the ipc_shmem wakeup
+	 * goes by and capture_time is os_gettime_ns()
+	 * (QueryPerformanceCounter) at the present the frame came from */
+	struct shmem_ring ring;
+};
+
+/* what the hook's copy thread puts in the ring slots */
+enum shmem_transport {
+	/* the game's pixels as captured, see format, pitch and flip */
+	SHMEM_TRANSPORT_NATIVE,
+	/* 8 bit 4:2:0 converted by the hook, already upright: a cx wide Y
+	 * plane, then (cx + 1) / 2 wide U and V planes, rows tightly packed */
+	SHMEM_TRANSPORT_I420,
+	/* the same with U and V interleaved in a single plane */
+	SHMEM_TRANSPORT_NV12,
 };
 
 struct shtex_data {
@@ -101,10 +116,50 @@ struct hook_info {
 
 	/* hook addresses */
 	struct graphics_offsets        offsets;
+
+	/* Everything below came after hooks and services of the old layout
+	 * shipped, and is only appended to. The hook sets hook_version and
+	 * hook_info_size when it creates the mapping, the service sets
+	 * service_version along with its options; the mapping starts out
+	 * zeroed, so a side built before reads 0. Neither side trusts the
+	 * fields below unless the other's version is HOOK_INFO_VERSION. */
+	uint32_t                       hook_version;
+	uint32_t                       hook_info_size;
+	uint32_t                       service_version;
+
+	uint32_t                       shmem_slots;
+	/* threads copying each frame into shared memory, 1 to 4 */
+	uint32_t                       copy_threads;
+	/* enum shmem_transport the service would like, the hook falls back
+	 * to native for formats it has no converter for. yuv_matrix is 601
+	 * or 709. */
+	uint32_t                       transport_request;
+	uint32_t                       yuv_matrix;
+	bool                           yuv_full_range;
+	/* frame memory on large pages when the game's account may lock
+	 * memory, see ipc_shmem_create_large */
+	bool                           large_pages;
+
+	/* enum shmem_transport of the frames in the ring, set by the hook
+	 * along with format */
+	uint32_t                       transport;
 };
 
 #pragma pack(pop)
 
+/* bytes of a frame in a ring slot */
+static inline uint32_t shmem_transport_size(uint32_t transport,
+		uint32_t cx, uint32_t cy, uint32_t pitch)
+{
+	uint32_t half_cx = (cx + 1) / 2;
+	uint32_t half_cy = (cy + 1) / 2;
+
+	if (transport == SHMEM_TRANSPORT_NATIVE)
+		return pitch * cy;
+	return cx * cy + half_cx * half_cy * 2;
+}
+
+#ifdef _WIN32
 #define GC_MAPPING_FLAGS (FILE_MAP_READ | FILE_MAP_WRITE)
 
 static inline HANDLE create_hook_info(DWORD id)
@@ -115,3 +170,4 @@ static inline HANDLE create_hook_info(DWORD id)
 	return CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
 			0, sizeof(struct hook_info), new_name);
 }
+#endif
@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "platform.h"
+
+/*
+ * The parts of platform.h that are built on Linux, where the converters
+ * and the capture buffers are tested and benchmarked.
+ */
+
+#define LARGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* the mapping's length sits in front of the memory handed out, munmap
+ * needs it; a cache line keeps what follows aligned */
+#define LARGE_PAGE_HEADER 64
+
+void *os_large_page_alloc(size_t size, bool *large)
+{
+	size_t length = (size + LARGE_PAGE_HEADER + LARGE_PAGE_SIZE - 1) &
+		~(size_t)(LARGE_PAGE_SIZE - 1);
+	void *map;
+
+	/* pages are taken from the hugetlb pool (vm.nr_hugepages) at mmap,
+	 * which fails with ENOMEM when it is short */
+	map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	if (large)
+		*large = map != MAP_FAILED;
+
+	if (map == MAP_FAILED) {
+		length = size + LARGE_PAGE_HEADER;
+		map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		/* transparent huge pages, if the system allows them */
+		madvise(map, length, MADV_HUGEPAGE);
+#endif
+	}
+
+	*(size_t *)map = length;
+	return (uint8_t *)map + LARGE_PAGE_HEADER;
+}
+
+void os_large_page_free(void *ptr)
+{
+	if (ptr) {
+		uint8_t *map = (uint8_t *)ptr - LARGE_PAGE_HEADER;
+		munmap(map, *(size_t *)map);
+	}
+}
@@ -606,6 +606,62 @@ void os_end_high_performance(os_performance_token_t *token)
 	UNUSED_PARAMETER(token);
 }
 
+/* "Lock pages in memory" only grants SeLockMemoryPrivilege, it still has to
+ * be enabled in the token before large pages can be allocated */
+static bool enable_lock_memory_privilege(void)
+{
+	TOKEN_PRIVILEGES privileges = {0};
+	HANDLE token;
+	bool success;
+
+	if (!OpenProcessToken(GetCurrentProcess(),
+				TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	success = LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME,
+			&privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, false, &privileges, 0, NULL,
+				NULL) &&
+		GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(token);
+	return success;
+}
+
+void *os_large_page_alloc(size_t size, bool *large)
+{
+	static volatile long privilege = -1;
+	size_t page = GetLargePageMinimum();
+	void *ptr = NULL;
+
+	if (privilege == -1)
+		InterlockedExchange(&privilege,
+				enable_lock_memory_privilege() ? 1 : 0);
+
+	if (page && privilege == 1) {
+		/* fails with ERROR_NO_SYSTEM_RESOURCES once physical memory
+		 * is too fragmented for contiguous pages */
+		ptr = VirtualAlloc(NULL, (size + page - 1) & ~(page - 1),
+				MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+				PAGE_READWRITE);
+	}
+
+	if (large)
+		*large = ptr != NULL;
+	if (!ptr)
+		ptr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT,
+				PAGE_READWRITE);
+	return ptr;
+}
+
+void os_large_page_free(void *ptr)
+{
+	if (ptr)
+		VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
 int os_copyfile(const char *file_in, const char *file_out)
 {
 	wchar_t *file_in_utf16 = NULL;
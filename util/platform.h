@@ -95,6 +95,15 @@ typedef const void os_performance_token_t;
 EXPORT os_performance_token_t *os_request_high_performance(const char *reason);
 EXPORT void                   os_end_high_performance(os_performance_token_t *);
 
+/**
+ * Allocates size bytes of zeroed memory on large pages (2 MB on x64) when
+ * the process is allowed to lock memory and there are contiguous pages
+ * left, on normal pages otherwise; large tells which.  The size is rounded
+ * up to whole pages.  Free with os_large_page_free.
+ */
+EXPORT void *os_large_page_alloc(size_t size, bool *large);
+EXPORT void os_large_page_free(void *ptr);
+
 /**
  * Sleeps to a specific time (in nanoseconds).  Doesn't have to be super
  * accurate in terms of actual slept time because the target time is ensured.
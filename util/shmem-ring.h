@@ -0,0 +1,251 @@
+#pragma once
+
+/*
+ * Frame ring for the shared memory capture path: one producer (the hook's
+ * copy thread) and one consumer (the capture service), neither of which
+ * ever waits on the other.
+ *
+ * Every slot has a sequence counter that is odd while the producer writes
+ * the slot (a seqlock). The consumer only ever takes the newest frame: it
+ * announces the slot in `reading`, reads it in place and checks the
+ * counter did not move. The producer skips the announced slot and the
+ * newest one when it picks where to write, so with three or more slots a
+ * read is only torn when the producer picked the slot just before it was
+ * announced, and the counter tells the consumer so. With two slots a slow
+ * consumer loses frames to the producer instead of holding it up.
+ *
+ * Only OS independent code in here, the data is wherever the caller puts
+ * it: slot offsets are relative to the ring.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if !defined(__cplusplus) && !defined(inline)
+#define inline __inline
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+/* x86 / x64 only reorder a store with a later load, volatile plus a
+ * compiler barrier covers the rest */
+#define shmem_ring_acquire() _ReadWriteBarrier()
+#define shmem_ring_release() _ReadWriteBarrier()
+#define shmem_ring_fence()   _mm_mfence()
+#else
+#define shmem_ring_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define shmem_ring_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define shmem_ring_fence()   __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define SHMEM_RING_MIN_SLOTS 2
+#define SHMEM_RING_MAX_SLOTS 8
+#define SHMEM_RING_NONE      0xFFFFFFFF
+
+#pragma pack(push, 8)
+
+struct shmem_ring_slot {
+	volatile uint32_t seq;
+	uint32_t          offset;
+	/* frame_count of the frame in the slot */
+	volatile uint32_t frame;
+	uint32_t          pad;
+	/* os_gettime_ns() of the present the frame was captured at, 0 when
+	 * not recorded */
+	volatile uint64_t capture_time;
+};
+
+struct shmem_ring {
+	uint32_t               slot_count;
+	uint32_t               slot_size;
+	/* slot of the newest frame, SHMEM_RING_NONE before the first */
+	volatile uint32_t      latest;
+	/* slot the consumer is reading, SHMEM_RING_NONE when idle */
+	volatile uint32_t      reading;
+	/* frames published so far */
+	volatile uint32_t      frame_count;
+	/* producer side: frames written elsewhere because the slot next in
+	 * line was being read, and frames written over a slot being read
+	 * (two slots only) */
+	volatile uint32_t      skipped;
+	volatile uint32_t      overwritten;
+	uint32_t               pad;
+	struct shmem_ring_slot slots[SHMEM_RING_MAX_SLOTS];
+};
+
+/* what shmem_ring_read_begin() saw, checked by shmem_ring_read_end() */
+struct shmem_ring_read {
+	uint32_t slot;
+	uint32_t seq;
+	uint32_t frame;
+	uint64_t capture_time;
+};
+
+#pragma pack(pop)
+
+static inline uint32_t shmem_ring_clamp_slots(uint32_t slot_count)
+{
+	if (slot_count < SHMEM_RING_MIN_SLOTS)
+		return SHMEM_RING_MIN_SLOTS;
+	if (slot_count > SHMEM_RING_MAX_SLOTS)
+		return SHMEM_RING_MAX_SLOTS;
+	return slot_count;
+}
+
+/* slots start at first_offset from the ring and are slot_size apart, both
+ * should keep the data aligned */
+static inline void shmem_ring_init(struct shmem_ring *ring,
+		uint32_t slot_count, uint32_t first_offset, uint32_t slot_size)
+{
+	uint32_t i;
+
+	ring->slot_count = shmem_ring_clamp_slots(slot_count);
+	ring->slot_size = slot_size;
+	ring->latest = SHMEM_RING_NONE;
+	ring->reading = SHMEM_RING_NONE;
+	ring->frame_count = 0;
+	ring->skipped = 0;
+	ring->overwritten = 0;
+	ring->pad = 0;
+
+	for (i = 0; i < SHMEM_RING_MAX_SLOTS; i++) {
+		struct shmem_ring_slot *slot = &ring->slots[i];
+
+		slot->seq = 0;
+		slot->offset = first_offset + i * slot_size;
+		slot->frame = 0;
+		slot->pad = 0;
+		slot->capture_time = 0;
+	}
+}
+
+/* what the consumer checks before trusting a mapping it did not set up */
+static inline bool shmem_ring_valid(const struct shmem_ring *ring,
+		uint32_t map_size)
+{
+	uint32_t count = ring->slot_count;
+
+	if (count < SHMEM_RING_MIN_SLOTS || count > SHMEM_RING_MAX_SLOTS)
+		return false;
+
+	return ring->slots[count - 1].offset <= map_size &&
+		ring->slot_size <= map_size - ring->slots[count - 1].offset;
+}
+
+static inline uint8_t *shmem_ring_slot_data(struct shmem_ring *ring,
+		uint32_t slot)
+{
+	return (uint8_t*)ring + ring->slots[slot].offset;
+}
+
+/* ---------------------------------------------------------------------- */
+/* producer */
+
+/* picks the slot after the newest one that the consumer is not reading and
+ * marks it as being written; always succeeds */
+static inline uint32_t shmem_ring_write_begin(struct shmem_ring *ring)
+{
+	uint32_t count = ring->slot_count;
+	uint32_t latest = ring->latest;
+	uint32_t reading = ring->reading;
+	uint32_t slot = latest == SHMEM_RING_NONE ? 0 : latest;
+	bool skipped = false;
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		slot = slot + 1 == count ? 0 : slot + 1;
+		if (slot != latest && slot != reading)
+			break;
+		skipped = skipped || slot == reading;
+	}
+
+	/* two slots and both taken: the older one is overwritten, the
+	 * consumer sees the sequence move */
+	if (slot == latest) {
+		slot = slot + 1 == count ? 0 : slot + 1;
+		if (slot == reading)
+			ring->overwritten++;
+	} else if (skipped) {
+		ring->skipped++;
+	}
+
+	ring->slots[slot].seq++;
+	shmem_ring_release();
+	return slot;
+}
+
+static inline void shmem_ring_write_end(struct shmem_ring *ring,
+		uint32_t slot, uint64_t capture_time)
+{
+	struct shmem_ring_slot *s = &ring->slots[slot];
+	uint32_t frame = ring->frame_count + 1;
+
+	s->frame = frame;
+	s->capture_time = capture_time;
+	shmem_ring_release();
+	s->seq++;
+	shmem_ring_release();
+	ring->latest = slot;
+	shmem_ring_release();
+	ring->frame_count = frame;
+}
+
+/* ---------------------------------------------------------------------- */
+/* consumer */
+
+/* claims the newest frame; false when there is none yet or the producer
+ * got to the slot first, try again later */
+static inline bool shmem_ring_read_begin(struct shmem_ring *ring,
+		struct shmem_ring_read *read)
+{
+	uint32_t slot = ring->latest;
+	struct shmem_ring_slot *s;
+
+	if (slot >= ring->slot_count)
+		return false;
+
+	/* announce first, then sample the sequence: a producer that picks
+	 * the slot after this sees the announcement, one that picked it
+	 * before makes the sequence odd, which either shows here or moves it
+	 * by the time shmem_ring_read_end() looks again */
+	ring->reading = slot;
+	shmem_ring_fence();
+
+	s = &ring->slots[slot];
+	read->slot = slot;
+	read->seq = s->seq;
+	shmem_ring_acquire();
+
+	if (read->seq & 1) {
+		ring->reading = SHMEM_RING_NONE;
+		return false;
+	}
+
+	read->frame = s->frame;
+	read->capture_time = s->capture_time;
+	return true;
+}
+
+/* while reading: false once the producer got to the slot, the rest of the
+ * read is wasted and can be skipped */
+static inline bool shmem_ring_read_intact(struct shmem_ring *ring,
+		const struct shmem_ring_read *read)
+{
+	shmem_ring_acquire();
+	return ring->slots[read->slot].seq == read->seq;
+}
+
+/* true when nothing was written to the slot since shmem_ring_read_begin(),
+ * so whatever was read from it is a whole frame */
+static inline bool shmem_ring_read_end(struct shmem_ring *ring,
+		const struct shmem_ring_read *read)
+{
+	uint32_t seq;
+
+	shmem_ring_acquire();
+	seq = ring->slots[read->slot].seq;
+	shmem_ring_release();
+	ring->reading = SHMEM_RING_NONE;
+
+	return seq == read->seq;
+}